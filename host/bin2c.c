@@ -0,0 +1,108 @@
+/*
+   ds81 - Nintendo DS ZX81 emulator.
+
+   Copyright (C) 2006  Ian Cowburn <ianc@noddybox.co.uk>
+   
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+  
+   $Id$
+
+   Host replacement for devkitARM's bin2o.  Converts a binary file into a
+   C file and header with the same symbol names bin2o produces, ie.
+   data/zx81.bin becomes zx81_bin, zx81_bin_end and zx81_bin_size.  The end
+   symbol is a macro so that it remains usable in static initialisers.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+int main(int argc, char *argv[])
+{
+    char sym[FILENAME_MAX];
+    char path[FILENAME_MAX];
+    const char *base;
+    FILE *in;
+    FILE *out;
+    long len;
+    int c;
+    int f;
+
+    if (argc != 3)
+    {
+	fprintf(stderr, "usage: %s file.bin output_dir\n", argv[0]);
+	return EXIT_FAILURE;
+    }
+
+    base = strrchr(argv[1], '/');
+    base = base ? base + 1 : argv[1];
+
+    for(f = 0; base[f] && f < FILENAME_MAX - 1; f++)
+    {
+    	sym[f] = isalnum((unsigned char)base[f]) ? base[f] : '_';
+    }
+
+    sym[f] = 0;
+
+    if (!(in = fopen(argv[1], "rb")))
+    {
+	perror(argv[1]);
+	return EXIT_FAILURE;
+    }
+
+    sprintf(path, "%s/%s.c", argv[2], sym);
+
+    if (!(out = fopen(path, "w")))
+    {
+	perror(path);
+	return EXIT_FAILURE;
+    }
+
+    fprintf(out, "/* Generated from %s -- do not edit */\n", base);
+    fprintf(out, "#include \"%s.h\"\n\n", sym);
+    fprintf(out, "const u8 %s[] __attribute__((aligned(4))) =\n{", sym);
+
+    len = 0;
+
+    while((c = getc(in)) != EOF)
+    {
+	fprintf(out, "%s0x%2.2x,", (len % 12) ? " " : "\n    ", c);
+	len++;
+    }
+
+    fprintf(out, "\n};\n\n");
+    fprintf(out, "const u32 %s_size = %ld;\n", sym, len);
+
+    fclose(out);
+    fclose(in);
+
+    sprintf(path, "%s/%s.h", argv[2], sym);
+
+    if (!(out = fopen(path, "w")))
+    {
+	perror(path);
+	return EXIT_FAILURE;
+    }
+
+    fprintf(out, "/* Generated from %s -- do not edit */\n", base);
+    fprintf(out, "#include <nds.h>\n\n");
+    fprintf(out, "extern const u8 %s[%ld];\n", sym, len);
+    fprintf(out, "#define %s_end (%s + %ld)\n", sym, sym, len);
+    fprintf(out, "extern const u32 %s_size;\n", sym);
+
+    fclose(out);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,71 @@
+/*
+   ds81 - Nintendo DS ZX81 emulator.
+
+   Copyright (C) 2006  Ian Cowburn <ianc@noddybox.co.uk>
+   
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+  
+   $Id$
+*/
+#ifndef DS81_HOST_NDS_H
+#define DS81_HOST_NDS_H
+
+/* The small subset of libnds that the emulation core uses, so that it can be
+   built and benchmarked on a host machine.  Nothing else should need this.
+*/
+#include <stdint.h>
+
+#ifndef TRUE
+#define TRUE	1
+#endif
+
+#ifndef FALSE
+#define FALSE	0
+#endif
+
+typedef uint8_t		u8;
+typedef uint16_t	u16;
+typedef uint32_t	u32;
+typedef uint8_t		uint8;
+typedef uint16_t	uint16;
+typedef uint32_t	uint32;
+
+#define RGB15(r,g,b)	((r)|((g)<<5)|((b)<<10))
+
+#define SCREEN_WIDTH	256
+#define SCREEN_HEIGHT	192
+
+typedef struct
+{
+    short	height;
+    short	width;
+    short	bpp;
+    unsigned short	*palette;
+    union
+    {
+	u8	*data8;
+	u16	*data16;
+	u32	*data32;
+    } image;
+} sImage;
+
+/* There's no VBlank to wait for on the host -- the emulation simply runs as
+   fast as it can.
+*/
+static inline void swiWaitForVBlank(void)
+{
+}
+
+#endif	/* DS81_HOST_NDS_H */
@@ -0,0 +1,56 @@
+/*
+   ds81 - Nintendo DS ZX81 emulator.
+
+   Copyright (C) 2006  Ian Cowburn <ianc@noddybox.co.uk>
+   
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+  
+   $Id$
+
+   Headless stand-ins for the GUI and soft keyboard routines the ZX81
+   emulation calls into.
+*/
+#include <stdio.h>
+
+#include <nds.h>
+
+#include "gui.h"
+#include "keyboard.h"
+
+/* ---------------------------------------- GUI
+*/
+void GUI_Alert(int fatal, const char *text)
+{
+    fprintf(stderr, "ALERT: %s\n", text);
+}
+
+
+int GUI_FileSelect(char pwd[], char selected_file[], const char *filter)
+{
+    return FALSE;
+}
+
+
+/* ---------------------------------------- SOFT KEYBOARD
+*/
+void SK_DisplayKeyboard(void)
+{
+}
+
+
+int SK_GetEvent(SoftKeyEvent *ev)
+{
+    return FALSE;
+}
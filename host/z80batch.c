@@ -0,0 +1,489 @@
+/*
+   ds81 - Nintendo DS ZX81 emulator.
+
+   Copyright (C) 2006  Ian Cowburn <ianc@noddybox.co.uk>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+   $Id$
+
+   Headless batch runner.  Loads each of a list of .P files into a freshly
+   booted ZX81, runs it for a number of frames and writes a line of JSON
+   with the final CPU state, CRCs of the screen and RAM and whether it
+   crashed.  The files are shared between a number of worker threads, each
+   of which runs one machine at a time.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <nds.h>
+
+#include "z80.h"
+#include "zx81.h"
+#include "config.h"
+#include "bootcache.h"
+
+/* ---------------------------------------- STATIC DATA
+*/
+#define KEY_FRAMES	5
+#define MAX_THREADS	256
+#define MAX_PATH	1024
+
+#define ERR_NR		0x4000
+
+typedef struct
+{
+    pthread_t	thread;
+    uint16	text_vram[32*32];
+    uint16	bitmap_vram[SCREEN_WIDTH*SCREEN_HEIGHT];
+} Worker;
+
+static char		**paths;
+static int		no_paths;
+static int		next_path;
+
+static int		frame_count = 500;
+
+static pthread_mutex_t	output_lock = PTHREAD_MUTEX_INITIALIZER;
+static int		no_crashed;
+
+
+/* ---------------------------------------- PRIVATE FUNCTIONS
+*/
+static double Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static unsigned long Crc(unsigned long crc, const void *data, long len)
+{
+    const unsigned char *p = data;
+    int f;
+
+    crc ^= 0xffffffff;
+
+    while(len-- > 0)
+    {
+	crc ^= *p++;
+
+	for(f = 0; f < 8; f++)
+	{
+	    crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+    }
+
+    return crc ^ 0xffffffff;
+}
+
+
+/* Runs up to count frames, stopping early if the machine crashes.  Returns
+   the number of frames run.
+*/
+static int RunFrames(ZX81Machine *zx, int count, double *tstates)
+{
+    Z80 *z80 = ZX81GetZ80(zx);
+    int f;
+
+    for(f = 0; f < count && !ZX81Crashed(zx); f++)
+    {
+	Z80Val length;
+	Z80Val before;
+
+	length = ZX81FrameTStates(zx);
+	before = Z80Cycles(z80);
+
+	ZX81RunFrame(zx);
+
+	*tstates += (double)length + Z80Cycles(z80) - before;
+    }
+
+    return f;
+}
+
+
+static void Type(ZX81Machine *zx, SoftKey key, int shifted)
+{
+    double tstates = 0;
+
+    if (shifted)
+    {
+	ZX81HandleKey(zx, SK_SHIFT, TRUE);
+    }
+
+    ZX81HandleKey(zx, key, TRUE);
+    RunFrames(zx, KEY_FRAMES, &tstates);
+
+    ZX81HandleKey(zx, key, FALSE);
+
+    if (shifted)
+    {
+	ZX81HandleKey(zx, SK_SHIFT, FALSE);
+    }
+
+    RunFrames(zx, KEY_FRAMES, &tstates);
+}
+
+
+/* Writes s as a JSON string
+*/
+static void PutString(FILE *fp, const char *s)
+{
+    putc('"', fp);
+
+    for(; *s; s++)
+    {
+	unsigned char c = *s;
+
+	if (c == '"' || c == '\\')
+	{
+	    fprintf(fp, "\\%c", c);
+	}
+	else if (c < 0x20)
+	{
+	    fprintf(fp, "\\u%4.4x", c);
+	}
+	else
+	{
+	    putc(c, fp);
+	}
+    }
+
+    putc('"', fp);
+}
+
+
+/* Writes a line for a file that couldn't be run
+*/
+static void Failed(const char *path, const char *error)
+{
+    pthread_mutex_lock(&output_lock);
+
+    fputs("{\"file\":", stdout);
+    PutString(stdout, path);
+    fputs(",\"status\":\"error\",\"error\":", stdout);
+    PutString(stdout, error);
+    fputs("}\n", stdout);
+
+    pthread_mutex_unlock(&output_lock);
+}
+
+
+/* Boots a new machine, loads the file and runs it, then writes its line
+*/
+static void RunFile(Worker *w, const char *path)
+{
+    ZX81Machine *zx;
+    Z80 *z80;
+    TapeSource tape;
+    FILE *fp;
+    Z80Byte *ram;
+    Z80Val ram_len;
+    Z80Byte err_nr;
+    double tstates = 0;
+    double start;
+    int run;
+    int crashed;
+
+    if (!(fp = fopen(path, "rb")))
+    {
+	Failed(path, "couldn't open file");
+	return;
+    }
+
+    if (!TAPE_FileSource(&tape, fp))
+    {
+	fclose(fp);
+	Failed(path, "couldn't read file");
+	return;
+    }
+
+    if (!(zx = ZX81Create(w->text_vram, w->bitmap_vram)))
+    {
+	TAPE_Close(&tape);
+	fclose(fp);
+	Failed(path, "couldn't create machine");
+	return;
+    }
+
+    z80 = ZX81GetZ80(zx);
+
+    start = Now();
+
+    ZX81Reconfigure(zx);
+    ZX81SetTape(zx, &tape);
+
+    BOOT_Reset(zx);
+
+    Type(zx, SK_J, FALSE);		/* LOAD */
+    Type(zx, SK_P, TRUE);		/* "	*/
+    Type(zx, SK_P, TRUE);		/* "	*/
+    Type(zx, SK_NEWLINE, FALSE);
+
+    /* The LOAD is trapped, so the program is in by the time the keys have
+       been let go.  Count from here.
+    */
+    tstates = 0;
+    run = RunFrames(zx, frame_count, &tstates);
+    crashed = ZX81Crashed(zx);
+
+    ram = ZX81GetRAM(zx, &ram_len);
+    err_nr = ZX81ReadMem(z80, ERR_NR);
+
+    pthread_mutex_lock(&output_lock);
+
+    fputs("{\"file\":", stdout);
+    PutString(stdout, path);
+
+    printf(",\"status\":\"%s\",\"frames\":%d,\"tstates\":%.0f,"
+	   "\"report\":%d,"
+	   "\"pc\":%u,\"sp\":%u,\"af\":%u,\"bc\":%u,\"de\":%u,\"hl\":%u,"
+	   "\"ix\":%u,\"iy\":%u,\"i\":%u,\"iff1\":%u,"
+	   "\"text\":\"%8.8lx\",\"bitmap\":\"%8.8lx\",\"ram\":\"%8.8lx\","
+	   "\"seconds\":%.3f}\n",
+	   crashed ? "crashed" : "ok", run, tstates,
+	   err_nr == 0xff ? 0 : err_nr + 1,
+	   z80->PC, z80->SP, z80->AF.w, z80->BC.w, z80->DE.w, z80->HL.w,
+	   z80->IX.w, z80->IY.w, z80->I, z80->IFF1,
+	   Crc(0, w->text_vram, sizeof w->text_vram),
+	   Crc(0, w->bitmap_vram, sizeof w->bitmap_vram),
+	   Crc(0, ram, ram_len),
+	   Now() - start);
+
+    no_crashed += crashed;
+
+    pthread_mutex_unlock(&output_lock);
+
+    ZX81Destroy(zx);
+    TAPE_Close(&tape);
+    fclose(fp);
+}
+
+
+/* Takes files off the shared list until it's empty.  Handing them out one
+   at a time keeps all the workers busy however long each file takes.
+*/
+static void *WorkerThread(void *arg)
+{
+    Worker *w = arg;
+    int f;
+
+    while((f = __sync_fetch_and_add(&next_path, 1)) < no_paths)
+    {
+	RunFile(w, paths[f]);
+    }
+
+    return NULL;
+}
+
+
+/* Reads the list of files from fp, one per line
+*/
+static void ReadPaths(FILE *fp)
+{
+    char line[MAX_PATH];
+    int size = 0;
+
+    while(fgets(line, sizeof line, fp))
+    {
+	line[strcspn(line, "\r\n")] = 0;
+
+	if (!line[0])
+	{
+	    continue;
+	}
+
+	if (no_paths == size)
+	{
+	    size = size ? size * 2 : 256;
+
+	    if (!(paths = realloc(paths, size * sizeof *paths)))
+	    {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	    }
+	}
+
+	paths[no_paths++] = strdup(line);
+    }
+}
+
+
+/* Sets the RAM pack from its size in K.  Returns FALSE if there isn't one
+   that size.
+*/
+static int SetRAMPack(int size)
+{
+    static const int sizes[DS81_NUM_RAM_PACKS] = {1, 2, 16, 32, 48, 56};
+    int f;
+
+    for(f = 0; f < DS81_NUM_RAM_PACKS; f++)
+    {
+	if (sizes[f] == size)
+	{
+	    DS81_Config[DS81_RAM_PACK] = f;
+	    return TRUE;
+	}
+    }
+
+    return FALSE;
+}
+
+
+static void Usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-f frames] [-j threads] [-m K] [-u] [-c] "
+		    "[-b dir/] [file.p ...]\n", prog);
+    fprintf(stderr, "files are read from stdin, one per line, if none "
+		    "are given\n");
+    fprintf(stderr, "-f runs each file for this many frames once loaded "
+		    "(default 500)\n");
+    fprintf(stderr, "-j runs this many machines at once (default one "
+		    "per CPU)\n");
+    fprintf(stderr, "-m fits 1, 2, 16, 32, 48 or 56K of RAM (default 16)\n");
+    fprintf(stderr, "-u runs the ULA display engine\n");
+    fprintf(stderr, "-c runs the fast calculator\n");
+    fprintf(stderr, "-b keeps the booted machine in this directory "
+		    "between runs\n");
+    exit(EXIT_FAILURE);
+}
+
+
+/* ---------------------------------------- MAIN
+*/
+int main(int argc, char *argv[])
+{
+    Worker *workers;
+    int no_threads;
+    double start;
+    double taken;
+    int f;
+
+    no_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for(f = 1; f < argc && argv[f][0] == '-' && argv[f][1]; f++)
+    {
+	if (strcmp(argv[f], "-f") == 0 && f + 1 < argc)
+	{
+	    frame_count = atoi(argv[++f]);
+	}
+	else if (strcmp(argv[f], "-j") == 0 && f + 1 < argc)
+	{
+	    no_threads = atoi(argv[++f]);
+	}
+	else if (strcmp(argv[f], "-m") == 0 && f + 1 < argc &&
+		 SetRAMPack(atoi(argv[f + 1])))
+	{
+	    f++;
+	}
+	else if (strcmp(argv[f], "-b") == 0 && f + 1 < argc)
+	{
+	    BOOT_SetDir(argv[++f]);
+	}
+	else if (strcmp(argv[f], "-c") == 0)
+	{
+	    DS81_Config[DS81_FAST_CALC] = TRUE;
+	}
+	else if (strcmp(argv[f], "-u") == 0)
+	{
+	    DS81_Config[DS81_ULA_DISPLAY] = TRUE;
+	}
+	else
+	{
+	    Usage(argv[0]);
+	}
+    }
+
+    if (f < argc)
+    {
+	paths = argv + f;
+	no_paths = argc - f;
+    }
+    else
+    {
+	ReadPaths(stdin);
+    }
+
+    if (no_threads < 1)
+    {
+	no_threads = 1;
+    }
+
+    if (no_threads > MAX_THREADS)
+    {
+	no_threads = MAX_THREADS;
+    }
+
+    if (no_threads > no_paths)
+    {
+	no_threads = no_paths ? no_paths : 1;
+    }
+
+    if (!(workers = calloc(no_threads, sizeof *workers)))
+    {
+	fprintf(stderr, "Out of memory\n");
+	return EXIT_FAILURE;
+    }
+
+    /* The first machine sets up tables shared by the rest, so is made
+       before any of the threads are started.
+    */
+    {
+	ZX81Machine *zx = ZX81Create(workers[0].text_vram,
+				     workers[0].bitmap_vram);
+
+	if (!zx)
+	{
+	    fprintf(stderr, "Failed to initialise the Z80 CPU emulation\n");
+	    return EXIT_FAILURE;
+	}
+
+	ZX81Destroy(zx);
+    }
+
+    start = Now();
+
+    for(f = 0; f < no_threads; f++)
+    {
+	if (pthread_create(&workers[f].thread, NULL, WorkerThread,
+			   workers + f) != 0)
+	{
+	    fprintf(stderr, "Couldn't start thread %d\n", f);
+	    return EXIT_FAILURE;
+	}
+    }
+
+    for(f = 0; f < no_threads; f++)
+    {
+	pthread_join(workers[f].thread, NULL);
+    }
+
+    taken = Now() - start;
+
+    fprintf(stderr, "%d files %d crashed %d threads %.3fs %.1f files/s\n",
+	    no_paths, no_crashed, no_threads, taken, no_paths / taken);
+
+    free(workers);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,1192 @@
+/*
+   ds81 - Nintendo DS ZX81 emulator.
+
+   Copyright (C) 2006  Ian Cowburn <ianc@noddybox.co.uk>
+   
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+  
+   $Id$
+
+   Headless throughput benchmark for the Z80/ZX81 emulation.  Boots the ROM,
+   types LOAD "" to pull in one of the built-in tapes, presses the key that
+   gets the game going and then runs it for a number of emulated frames
+   without waiting for any VBlank.  A .P file can be given instead of a
+   built-in tape, in which case it is loaded through a file tape source,
+   or idle to leave the machine waiting for a key at the K cursor.  Only
+   the frames run once the game has been started are counted and timed.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <nds.h>
+
+#include "z80.h"
+#include "zx81.h"
+#include "config.h"
+#include "rewind.h"
+
+#include "maze_bin.h"
+#include "mazogs_bin.h"
+
+/* ---------------------------------------- STATIC DATA
+*/
+#define BOOT_FRAMES	100
+#define ULA_BOOT_FRAMES	200
+#define KEY_FRAMES	5
+#define MAX_RUNS        8
+#define REWIND_STATES	50
+#define FORK_FRAMES	20
+
+#define CALC_CODE	0x7000
+#define CALC_STACK	0x6000
+#define CALC_SP		0x7e00
+#define CALC_STEPS	5000000
+#define CALC_MAX_OPS	12
+#define CALC_MAX_DEPTH	8
+#define CALC_ERROR	0x005f	/* ERROR-2, once SP is set from ERR_SP	*/
+
+#define PACE_FRAMES	3000
+#define PACE_PERIOD	16715
+
+typedef struct
+{
+    const char	*name;
+    const u8	*image;
+    const u8	*image_end;
+    SoftKey	start_key;
+    TapeSource  *source;
+} BenchTape;
+
+static const BenchTape	tapes[]=
+			{
+			    {"maze",	maze_bin,	maze_bin_end,	SK_C},
+			    {"mazogs",	mazogs_bin,	mazogs_bin_end,	NUM_SOFT_KEYS}
+			};
+
+#define NO_TAPES	(sizeof tapes / sizeof tapes[0])
+
+/* Not a tape, but leaves the machine waiting for a key at the K cursor
+*/
+static const BenchTape	idle = {"idle", NULL, NULL, NUM_SOFT_KEYS};
+
+static BenchTape        files[MAX_RUNS];
+static TapeSource       file_sources[MAX_RUNS];
+static int              no_files;
+
+static uint16		text_vram[32*32];
+static uint16		bitmap_vram[SCREEN_WIDTH*SCREEN_HEIGHT];
+
+static int		boot_frames = BOOT_FRAMES;
+static int		record_rewind;
+
+static unsigned long	frames;
+static double		tstates;
+
+/* The time in microseconds for the pacer check, which is only moved on by
+   hand or by waiting for a tick
+*/
+static unsigned long	fake_now;
+
+
+/* ---------------------------------------- PRIVATE FUNCTIONS
+*/
+static double Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void RunFrames(ZX81Machine *zx, int count)
+{
+    Z80 *z80 = ZX81GetZ80(zx);
+
+    while(count-- > 0)
+    {
+	Z80Val length;
+	Z80Val before;
+
+	length = ZX81FrameTStates(zx);
+	before = Z80Cycles(z80);
+
+	ZX81RunFrame(zx);
+
+	if (record_rewind)
+	{
+	    RWD_Frame(zx);
+	}
+
+	/* The frame length is taken off the cycle count as the frame ends,
+	   so add it back on to get what was actually run.
+	*/
+	tstates += (double)length + Z80Cycles(z80) - before;
+	frames++;
+    }
+}
+
+
+static void Type(ZX81Machine *zx, SoftKey key, int shifted)
+{
+    if (shifted)
+    {
+	ZX81HandleKey(zx, SK_SHIFT, TRUE);
+    }
+
+    ZX81HandleKey(zx, key, TRUE);
+    RunFrames(zx, KEY_FRAMES);
+
+    ZX81HandleKey(zx, key, FALSE);
+
+    if (shifted)
+    {
+	ZX81HandleKey(zx, SK_SHIFT, FALSE);
+    }
+
+    RunFrames(zx, KEY_FRAMES);
+}
+
+
+/* Simple CRC32 of the RAM and CPU state so that runs of differently
+   configured cores can be compared.
+*/
+static unsigned long Digest(Z80 *z80)
+{
+    unsigned long crc = 0xffffffff;
+    Z80Word regs[12];
+    Z80Val addr;
+    int f;
+
+    regs[0] = z80->PC;
+    regs[1] = z80->AF.w;
+    regs[2] = z80->BC.w;
+    regs[3] = z80->DE.w;
+    regs[4] = z80->HL.w;
+    regs[5] = z80->AF_;
+    regs[6] = z80->BC_;
+    regs[7] = z80->DE_;
+    regs[8] = z80->HL_;
+    regs[9] = z80->IX.w;
+    regs[10] = z80->IY.w;
+    regs[11] = z80->SP;
+
+    for(addr = 0; addr < 0x10000 + sizeof regs; addr++)
+    {
+	Z80Byte b;
+
+	if (addr < 0x10000)
+	{
+	    b = ZX81ReadMem(z80, addr);
+	}
+	else
+	{
+	    b = ((Z80Byte *)regs)[addr - 0x10000];
+	}
+
+	crc ^= b;
+
+	for(f = 0; f < 8; f++)
+	{
+	    crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+    }
+
+    return crc ^ 0xffffffff;
+}
+
+
+static void DumpScreen(void)
+{
+    static const char *charset =
+	" ??????????\"#$:?()><=+-*/;,.0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    int x,y;
+
+    for(y = 0; y < 24; y++)
+    {
+	for(x = 0; x < 32; x++)
+	{
+	    putchar(charset[text_vram[x + y * 32] & 0x3f]);
+	}
+
+	putchar('\n');
+    }
+}
+
+
+/* Shows the bitmap drawn by the ULA display engine, one character for each
+   4x8 block of pixels.
+*/
+static void DumpBitmap(void)
+{
+    int x,y;
+
+    for(y = 0; y < SCREEN_HEIGHT; y += 8)
+    {
+	for(x = 0; x < SCREEN_WIDTH; x += 4)
+	{
+	    int dark = 0;
+	    int dx,dy;
+
+	    for(dy = 0; dy < 8; dy++)
+	    {
+		for(dx = 0; dx < 4; dx++)
+		{
+		    if (bitmap_vram[x + dx + (y + dy) * SCREEN_WIDTH] != 0xffff)
+		    {
+			dark++;
+		    }
+		}
+	    }
+
+	    putchar(dark == 0 ? ' ' : dark < 12 ? '.' : dark < 24 ? '+' : '#');
+	}
+
+	putchar('\n');
+    }
+}
+
+
+/* Opens a .P file as a tape.  The file is left open for the life of the run.
+*/
+static const BenchTape *OpenFile(const char *path)
+{
+    BenchTape *tape;
+    FILE *fp;
+
+    if (no_files == MAX_RUNS || !(fp = fopen(path, "rb")))
+    {
+	return NULL;
+    }
+
+    tape = files + no_files;
+
+    if (!TAPE_FileSource(file_sources + no_files, fp))
+    {
+	fclose(fp);
+	return NULL;
+    }
+
+    tape->name = path;
+    tape->start_key = NUM_SOFT_KEYS;
+    tape->source = file_sources + no_files++;
+
+    return tape;
+}
+
+
+/* Winds back through the rewind buffer and runs forward to the same frame,
+   checking that the machine ends up in the same state.
+*/
+static void CheckRewind(ZX81Machine *zx)
+{
+    Z80 *z80 = ZX81GetZ80(zx);
+    unsigned long digest;
+    unsigned long back;
+    unsigned long run_frames;
+    double run_tstates;
+    long bytes;
+    int states;
+    int f;
+
+    run_frames = frames;
+    run_tstates = tstates;
+
+    states = RWD_Count(&bytes);
+    digest = Digest(z80);
+    back = frames % RWD_FRAMES;
+
+    for(f = 0; f < REWIND_STATES && RWD_Back(zx); f++)
+    {
+	if (f)
+	{
+	    back += RWD_FRAMES;
+	}
+    }
+
+    RunFrames(zx, back);
+
+    frames = run_frames;
+    tstates = run_tstates;
+
+    printf("rewind   %8d states %12ld bytes   back %lu frames %s\n",
+	   states, bytes, back, Digest(z80) == digest ? "ok" : "MISMATCH");
+}
+
+
+/* Forks the machine into a number of children, each run on from the
+   current state with a different key held down, then puts the machine
+   back to each of them in turn and checks it ends up in the same state.
+   Also shows how long a fork takes and how much memory each child uses.
+*/
+static void CheckFork(ZX81Machine *zx, int children)
+{
+    ZX81Checkpoint *root;
+    ZX81Checkpoint **child;
+    unsigned long *digest;
+    unsigned long root_digest;
+    unsigned long run_digest = 0;
+    unsigned long run_frames;
+    double run_tstates;
+    double fork_time = 0;
+    long bytes = 0;
+    int bad = 0;
+    int f;
+
+    child = calloc(children, sizeof *child);
+    digest = calloc(children, sizeof *digest);
+
+    if (!child || !digest)
+    {
+	free(child);
+	free(digest);
+	return;
+    }
+
+    run_frames = frames;
+    run_tstates = tstates;
+
+#ifdef __GLIBC__
+    bytes = -(long)mallinfo2().uordblks;
+#endif
+
+    root = ZX81Fork(zx);
+    root_digest = Digest(ZX81GetZ80(zx));
+
+    for(f = 0; f < children && root; f++)
+    {
+	SoftKey key = f % (SK_SPACE + 1);
+	double start;
+
+	ZX81Restore(zx, root);
+
+	ZX81HandleKey(zx, key, TRUE);
+	RunFrames(zx, FORK_FRAMES);
+	ZX81HandleKey(zx, key, FALSE);
+
+	start = Now();
+	child[f] = ZX81Fork(zx);
+	fork_time += Now() - start;
+
+	digest[f] = Digest(ZX81GetZ80(zx));
+    }
+
+#ifdef __GLIBC__
+    bytes += mallinfo2().uordblks;
+#endif
+
+    /* Each child is also run on, so that the run can be compared with a
+       build with a differently configured core
+    */
+    for(f = children - 1; f >= 0; f--)
+    {
+	if (!child[f] || !ZX81Restore(zx, child[f]) ||
+	    Digest(ZX81GetZ80(zx)) != digest[f])
+	{
+	    bad++;
+	}
+
+	RunFrames(zx, FORK_FRAMES);
+	run_digest = run_digest * 33 + Digest(ZX81GetZ80(zx));
+    }
+
+    if (!root || !ZX81Restore(zx, root) ||
+	Digest(ZX81GetZ80(zx)) != root_digest)
+    {
+	bad++;
+    }
+
+    for(f = 0; f < children; f++)
+    {
+	ZX81FreeCheckpoint(child[f]);
+    }
+
+    ZX81FreeCheckpoint(root);
+
+    frames = run_frames;
+    tstates = run_tstates;
+
+    printf("fork     %8d children %8.2f us/fork %8ld bytes/child %s "
+	   "digest %8.8lx\n", children, fork_time * 1e6 / children,
+	   bytes / (children + 1), bad ? "MISMATCH" : "ok",
+	   run_digest & 0xffffffff);
+
+    free(child);
+    free(digest);
+}
+
+
+/* Sets n to a random floating point number, mostly of a sensible size but
+   sometimes zero, a whole number or anything at all.
+*/
+static void RandomNumber(Z80Byte *n)
+{
+    int f;
+
+    switch(rand() % 10)
+    {
+	case 0:
+	    memset(n, 0, 5);
+	    break;
+
+	case 1:
+	case 2:
+	case 3:
+	{
+	    unsigned long v = rand() % 1000 + 1;
+
+	    n[0] = 0x80;
+
+	    while(!(v & 0x80000000))
+	    {
+		v <<= 1;
+	    }
+
+	    for(f = 0; f < 4; f++)
+	    {
+		n[f + 1] = v >> (24 - f * 8);
+	    }
+
+	    for(v = rand() % 1000 + 1; v; v >>= 1)
+	    {
+		n[0]++;
+	    }
+
+	    n[1] = (n[1] & 0x7f) | (rand() % 2 ? 0x80 : 0);
+	    break;
+	}
+
+	default:
+	    for(f = 1; f < 5; f++)
+	    {
+		n[f] = rand();
+	    }
+
+	    n[0] = rand() % 3 ? 0x60 + rand() % 0x40 : rand() % 0xff + 1;
+	    break;
+    }
+}
+
+
+/* Writes a random calculator program to addr, with depth numbers on the
+   stack to start with.  Returns the length written.
+*/
+static int RandomProgram(Z80 *z80, Z80Word addr, int depth)
+{
+    /* Literals by the numbers they take and leave
+    */
+    static const Z80Byte unary[] =
+    {
+	0x18, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25,
+	0x26, 0x27, 0x2c, 0x32, 0x33, 0x35, 0x36
+    };
+
+    static const Z80Byte binary[] =
+    {
+	0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d,
+	0x0e, 0x0f, 0x10
+    };
+
+    Z80Word start = addr;
+    Z80Byte n[5];
+    int ops;
+    int f;
+
+    ops = rand() % CALC_MAX_OPS + 1;
+
+    /* The first literal can use BREG as the ROM's comparisons do
+    */
+    if (depth >= 2 && rand() % 4 == 0)
+    {
+	Z80Poke(z80, addr++, 0x37);
+	depth--;
+    }
+
+    while(ops--)
+    {
+	int op = rand() % 12;
+
+	if (depth < 2 && op < 6)
+	{
+	    op = 6 + rand() % 6;
+	}
+
+	if (depth == 0 || depth >= CALC_MAX_DEPTH)
+	{
+	    op = depth ? 11 : 10;
+	}
+
+	switch(op)
+	{
+	    case 0:
+	    case 1:
+	    case 2:
+		Z80Poke(z80, addr++, binary[rand() % sizeof binary]);
+		depth--;
+		break;
+
+	    case 3:
+		Z80Poke(z80, addr++, rand() % 2 ? 0x01 : 0x2e);
+		break;
+
+	    case 4:
+		/* e-to-fp with an exponent of up to 16 either way
+		*/
+		Z80Poke(z80, addr++, 0x30);
+		Z80Poke(z80, addr++, 0x31 + rand() % 4);
+		Z80Poke(z80, addr++, rand());
+		Z80Poke(z80, addr++, 0x38);
+		break;
+
+	    case 5:
+		/* Skip over a literal if true
+		*/
+		Z80Poke(z80, addr++, 0x00);
+		Z80Poke(z80, addr++, 0x02);
+		Z80Poke(z80, addr++, unary[rand() % sizeof unary]);
+		depth--;
+		break;
+
+	    case 6:
+	    case 7:
+	    case 8:
+		Z80Poke(z80, addr++, unary[rand() % sizeof unary]);
+		break;
+
+	    case 9:
+		if (rand() % 4)
+		{
+		    Z80Poke(z80, addr++, 0xc0 + rand() % 6);
+		    break;
+		}
+
+		/* peek, which is handed to the ROM.  The address is kept
+		   below the stacks, as neither the patched ROM nor what the
+		   ROM leaves below SP reads back the same.
+		*/
+		f = 0x4000 + rand() % (CALC_STACK - 0x4000);
+		Z80Poke(z80, addr++, 0x30);
+		Z80Poke(z80, addr++, 0x7f);
+		Z80Poke(z80, addr++, f >> 7 & 0x7f);
+		Z80Poke(z80, addr++, f << 1 & 0xff);
+		Z80Poke(z80, addr++, 0x28);
+		break;
+
+	    case 10:
+		switch(rand() % 3)
+		{
+		    case 0:
+			Z80Poke(z80, addr++, 0xa0 + rand() % 5);
+			break;
+
+		    case 1:
+			Z80Poke(z80, addr++, 0xe0 + rand() % 6);
+			break;
+
+		    default:
+			RandomNumber(n);
+			Z80Poke(z80, addr++, 0x30);
+			Z80Poke(z80, addr++, 0xc0);
+			Z80Poke(z80, addr++, n[0] ? n[0] : 1);
+
+			for(f = 1; f < 5; f++)
+			{
+			    Z80Poke(z80, addr++, n[f]);
+			}
+			break;
+		}
+
+		depth++;
+		break;
+
+	    default:
+		Z80Poke(z80, addr++, rand() % 3 ? 0x2d : 0x02);
+		depth += Z80Peek(z80, addr - 1) == 0x2d ? 1 : -1;
+		break;
+	}
+    }
+
+    Z80Poke(z80, addr++, 0x34);
+
+    return addr - start;
+}
+
+
+/* Runs until the calculation at CALC_CODE returns or reports an error,
+   noting the lowest the stack pointer goes.  Returns FALSE if it doesn't.
+*/
+static int RunCalc(Z80 *z80, Z80Word stop, Z80Word *low)
+{
+    long f;
+
+    for(f = 0; f < CALC_STEPS; f++)
+    {
+	if (z80->PC == stop || z80->PC == CALC_ERROR)
+	{
+	    return TRUE;
+	}
+
+	if (z80->SP < *low)
+	{
+	    *low = z80->SP;
+	}
+
+	Z80SingleStep(z80);
+    }
+
+    return FALSE;
+}
+
+
+/* Runs random calculations through the ROM and the native calculator and
+   checks they leave the machine the same, other than BC' and the junk the
+   ROM leaves below the stack pointer.  Also shows how long each took.
+   The calculator is left set up as it was.
+*/
+static void CheckCalc(ZX81Machine *zx, int cases)
+{
+    Z80 *z80 = ZX81GetZ80(zx);
+    static Z80Byte before[0x10000];
+    static Z80Byte after[0x10000];
+    Z80 start;
+    Z80 rom;
+    Z80Val rom_tstates = 0;
+    Z80Val calc_tstates = 0;
+    int fast_calc = DS81_Config[DS81_FAST_CALC];
+    int errors = 0;
+    int bad = 0;
+    int c;
+
+    srand(1);
+
+    for(c = 0; c < cases; c++)
+    {
+	Z80Word stkend = CALC_STACK;
+	Z80Word sp = CALC_SP;
+	Z80Word low;
+	Z80Byte n[5];
+	Z80Val cycles;
+	Z80Val addr;
+	int depth;
+	int len;
+	int ok;
+	int f;
+
+	DS81_Config[DS81_FAST_CALC] = FALSE;
+	ZX81Reconfigure(zx);
+
+	depth = rand() % 4 + 1;
+
+	for(f = 0; f < depth; f++)
+	{
+	    int b;
+
+	    RandomNumber(n);
+
+	    for(b = 0; b < 5; b++)
+	    {
+		Z80Poke(z80, stkend++, n[b]);
+	    }
+	}
+
+	/* Sometimes leave little room so that the stack fills up
+	*/
+	if (rand() % 8 == 0)
+	{
+	    sp = stkend + 0x24 + rand() % 32;
+	}
+
+	len = RandomProgram(z80, CALC_CODE + 1, depth);
+	Z80Poke(z80, CALC_CODE, 0xef);
+
+	Z80Poke(z80, 0x4000, 0xff);			/* ERR_NR */
+	Z80Poke(z80, 0x4002, sp & 0xff);		/* ERR_SP */
+	Z80Poke(z80, 0x4003, sp >> 8);
+	Z80Poke(z80, 0x401a, CALC_STACK & 0xff);	/* STKBOT */
+	Z80Poke(z80, 0x401b, CALC_STACK >> 8);
+	Z80Poke(z80, 0x401c, stkend & 0xff);		/* STKEND */
+	Z80Poke(z80, 0x401d, stkend >> 8);
+	Z80Poke(z80, 0x401f, 0x5d);			/* MEM */
+	Z80Poke(z80, 0x4020, 0x40);
+
+	z80->PC = CALC_CODE;
+	z80->SP = sp;
+	z80->BC.w = (0x09 + rand() % 6) << 8 | rand() % 256;
+	z80->IY.w = 0x4000;
+
+	for(addr = 0; addr < 0x10000; addr++)
+	{
+	    before[addr] = ZX81ReadMem(z80, addr);
+	}
+
+	start = *z80;
+	low = sp;
+
+	/* Through the ROM
+	*/
+	cycles = Z80Cycles(z80);
+	ok = RunCalc(z80, CALC_CODE + 1 + len, &low);
+	rom_tstates += Z80Cycles(z80) - cycles;
+	rom = *z80;
+
+	for(addr = 0; addr < 0x10000; addr++)
+	{
+	    after[addr] = ZX81ReadMem(z80, addr);
+	}
+
+	/* And natively
+	*/
+	DS81_Config[DS81_FAST_CALC] = TRUE;
+	ZX81Reconfigure(zx);
+
+	for(addr = 0x4000; addr < 0x10000; addr++)
+	{
+	    Z80Poke(z80, addr, before[addr]);
+	}
+
+	*z80 = start;
+	cycles = Z80Cycles(z80);
+	ok = RunCalc(z80, CALC_CODE + 1 + len, &low) && ok;
+	calc_tstates += Z80Cycles(z80) - cycles;
+
+	if (rom.PC == CALC_ERROR)
+	{
+	    errors++;
+	}
+	else
+	{
+	    ok = ok && rom.AF.w == z80->AF.w && rom.BC.w == z80->BC.w &&
+		 rom.DE.w == z80->DE.w && rom.HL.w == z80->HL.w &&
+		 rom.AF_ == z80->AF_ && rom.DE_ == z80->DE_ &&
+		 rom.HL_ == z80->HL_ && rom.IX.w == z80->IX.w &&
+		 rom.IY.w == z80->IY.w;
+	}
+
+	ok = ok && rom.PC == z80->PC && rom.SP == z80->SP;
+
+	for(addr = 0x4000; ok && addr < 0x10000; addr++)
+	{
+	    if ((addr < low || addr >= sp - 2) &&
+		after[addr] != ZX81ReadMem(z80, addr))
+	    {
+		ok = FALSE;
+	    }
+	}
+
+	if (!ok && bad++ < 10)
+	{
+	    printf("calc     case %d differs at PC %4.4x/%4.4x "
+		   "address %4.4lx:", c, rom.PC, z80->PC, addr - 1);
+
+	    for(f = 0; f < len + 1; f++)
+	    {
+		printf(" %2.2x", before[CALC_CODE + f]);
+	    }
+
+	    printf("\n");
+	}
+    }
+
+    printf("calc     %8d cases %8d errors %8.0f/%.0f T-states %s\n",
+	   cases, errors, (double)rom_tstates / cases,
+	   (double)calc_tstates / cases, bad ? "MISMATCH" : "ok");
+
+    DS81_Config[DS81_FAST_CALC] = fast_calc;
+    ZX81Reconfigure(zx);
+}
+
+
+static unsigned long FakeTicks(void)
+{
+    return fake_now / PACE_PERIOD;
+}
+
+
+static unsigned long FakeMicros(void)
+{
+    return fake_now;
+}
+
+
+static void FakeWait(void)
+{
+    fake_now = (fake_now / PACE_PERIOD + 1) * PACE_PERIOD;
+}
+
+
+/* Runs the pacer against the fake clock with frames that take a set time
+   to run and draw.  Checks that no more than PACE_MAX_SKIP frames in a row
+   go undrawn, that every frame is drawn in real time when there's time to,
+   and that the frames are still run in real time when there's only time
+   to run them.
+*/
+static void CheckPace(void)
+{
+    static const PaceClock clock =
+    {
+	FakeTicks, FakeMicros, FakeWait, PACE_PERIOD, TRUE
+    };
+
+    static const struct
+    {
+	unsigned long	run;
+	unsigned long	draw;
+    } cases[] =
+    {
+	{8000,	4000},
+	{12000,	8000},
+	{16000,	4000},
+	{4000,	30000},
+	{20000,	4000}
+    };
+
+    int c;
+
+    for(c = 0; c < sizeof cases / sizeof cases[0]; c++)
+    {
+	unsigned long run = cases[c].run;
+	unsigned long draw = cases[c].draw;
+	unsigned long start;
+	unsigned long ticks;
+	int drawn = 0;
+	int skipped = 0;
+	int most_skipped = 0;
+	int ok;
+	int f;
+	Pacer p;
+
+	fake_now = 1000;
+
+	PACE_Init(&p);
+	PACE_SetClock(&p, &clock);
+
+	start = FakeTicks();
+
+	for(f = 0; f < PACE_FRAMES; f++)
+	{
+	    fake_now += run;
+
+	    if (PACE_Draw(&p))
+	    {
+		fake_now += draw;
+		drawn++;
+		skipped = 0;
+	    }
+	    else if (++skipped > most_skipped)
+	    {
+		most_skipped = skipped;
+	    }
+
+	    PACE_Wait(&p);
+	}
+
+	ticks = FakeTicks() - start;
+
+	ok = most_skipped <= PACE_MAX_SKIP;
+
+	if (run + draw < PACE_PERIOD)
+	{
+	    ok = ok && drawn == PACE_FRAMES && ticks == PACE_FRAMES;
+	}
+	else if (run < PACE_PERIOD)
+	{
+	    ok = ok && ticks <= PACE_FRAMES + PACE_FRAMES / 100;
+	}
+
+	printf("pace     %5lu+%5luus %6d frames %6lu ticks %6d drawn "
+	       "%6lu late %s\n", run, draw, PACE_FRAMES, ticks, drawn,
+	       p.no_late, ok ? "ok" : "MISMATCH");
+    }
+}
+
+
+static void Usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-f frames] [-s] [-u] [-r] [-c] [-k cases] "
+		    "[-x children] [-t speed] [-p] [-i] [tape ...]\n", prog);
+    fprintf(stderr, "tapes: maze mazogs or a .P file (default: all)\n");
+    fprintf(stderr, "idle leaves the machine at the K cursor instead\n");
+    fprintf(stderr, "-u runs the ULA display engine\n");
+    fprintf(stderr, "-r records and then checks the rewind buffer\n");
+    fprintf(stderr, "-c runs the fast calculator\n");
+    fprintf(stderr, "-k checks the fast calculator against the ROM after "
+		    "the run\n");
+    fprintf(stderr, "-x forks the machine into children after the run and "
+		    "checks them\n");
+    fprintf(stderr, "-t runs in turbo mode at 2, 4 or 8 times real time, "
+		    "or 0 for flat out\n");
+    fprintf(stderr, "-p checks the frame pacer against a made up clock "
+		    "and exits\n");
+    fprintf(stderr, "-i interprets all the code rather than translating "
+		    "it\n");
+    exit(EXIT_FAILURE);
+}
+
+
+/* ---------------------------------------- MAIN
+*/
+int main(int argc, char *argv[])
+{
+    const BenchTape *run[MAX_RUNS];
+    int no_run = 0;
+    int count = 5000;
+    int show = FALSE;
+    int check_calc = 0;
+    int check_fork = 0;
+    int interpret = FALSE;
+    double total_time = 0;
+    double total_tstates = 0;
+    unsigned long total_frames = 0;
+#ifdef ENABLE_DECODE_CACHE
+    Z80Val hits;
+    Z80Val misses;
+#endif
+    int f;
+
+    for(f = 1; f < argc; f++)
+    {
+	if (strcmp(argv[f], "-f") == 0 && f + 1 < argc)
+	{
+	    count = atoi(argv[++f]);
+	}
+	else if (strcmp(argv[f], "-s") == 0)
+	{
+	    show = TRUE;
+	}
+	else if (strcmp(argv[f], "-r") == 0)
+	{
+	    record_rewind = TRUE;
+	}
+	else if (strcmp(argv[f], "-c") == 0)
+	{
+	    DS81_Config[DS81_FAST_CALC] = TRUE;
+	}
+	else if (strcmp(argv[f], "-k") == 0 && f + 1 < argc)
+	{
+	    check_calc = atoi(argv[++f]);
+	}
+	else if (strcmp(argv[f], "-x") == 0 && f + 1 < argc)
+	{
+	    check_fork = atoi(argv[++f]);
+	}
+	else if (strcmp(argv[f], "-i") == 0)
+	{
+	    interpret = TRUE;
+	}
+	else if (strcmp(argv[f], "-p") == 0)
+	{
+	    CheckPace();
+	    return EXIT_SUCCESS;
+	}
+	else if (strcmp(argv[f], "-t") == 0 && f + 1 < argc)
+	{
+	    static const int speeds[DS81_NUM_TURBO_SPEEDS] = {2, 4, 8, 0};
+	    int speed = atoi(argv[++f]);
+	    int t = 0;
+
+	    while(t < DS81_NUM_TURBO_SPEEDS && speeds[t] != speed)
+	    {
+		t++;
+	    }
+
+	    if (t == DS81_NUM_TURBO_SPEEDS)
+	    {
+		Usage(argv[0]);
+	    }
+
+	    DS81_Config[DS81_TURBO] = TRUE;
+	    DS81_Config[DS81_TURBO_SPEED] = t;
+	}
+	else if (strcmp(argv[f], "-u") == 0)
+	{
+	    /* The ROM clears memory with the display running so takes longer
+	       to come up.
+	    */
+	    DS81_Config[DS81_ULA_DISPLAY] = TRUE;
+	    boot_frames = ULA_BOOT_FRAMES;
+	}
+	else
+	{
+	    const BenchTape *tape = NULL;
+	    int t;
+
+	    for(t = 0; t < NO_TAPES; t++)
+	    {
+		if (strcmp(argv[f], tapes[t].name) == 0)
+		{
+		    tape = tapes + t;
+		}
+	    }
+
+	    if (strcmp(argv[f], idle.name) == 0)
+	    {
+		tape = &idle;
+	    }
+
+	    if (!tape)
+	    {
+		tape = OpenFile(argv[f]);
+	    }
+
+	    if (!tape || no_run == MAX_RUNS)
+	    {
+		Usage(argv[0]);
+	    }
+
+	    run[no_run++] = tape;
+	}
+    }
+
+    if (!no_run)
+    {
+	for(f = 0; f < NO_TAPES; f++)
+	{
+	    run[no_run++] = tapes + f;
+	}
+    }
+
+    for(f = 0; f < no_run; f++)
+    {
+	ZX81Machine *zx;
+	TapeSource tape;
+	double start;
+	double taken;
+
+	zx = ZX81Create(text_vram, bitmap_vram);
+
+	if (!zx)
+	{
+	    fprintf(stderr, "Failed to initialise the Z80 CPU emulation\n");
+	    return EXIT_FAILURE;
+	}
+
+	Z80UseJit(ZX81GetZ80(zx), !interpret);
+	ZX81Reconfigure(zx);
+
+	if (run[f]->source)
+	{
+	    ZX81SetTape(zx, run[f]->source);
+	}
+	else if (run[f]->image)
+	{
+	    TAPE_MemorySource(&tape, run[f]->image,
+			      run[f]->image_end - run[f]->image);
+	    ZX81SetTape(zx, &tape);
+	}
+
+	RWD_Clear();
+
+	RunFrames(zx, boot_frames);
+
+	if (run[f] != &idle)
+	{
+	    Type(zx, SK_J, FALSE);		/* LOAD */
+	    Type(zx, SK_P, TRUE);		/* "	*/
+	    Type(zx, SK_P, TRUE);		/* "	*/
+	    Type(zx, SK_NEWLINE, FALSE);
+
+	    RunFrames(zx, boot_frames);
+	}
+
+	if (run[f]->start_key != NUM_SOFT_KEYS)
+	{
+	    Type(zx, run[f]->start_key, FALSE);
+	}
+
+	frames = 0;
+	tstates = 0;
+
+#ifdef ENABLE_DECODE_CACHE
+	Z80CacheStats(ZX81GetZ80(zx), &hits, &misses);
+#endif
+
+	start = Now();
+
+	RunFrames(zx, count);
+
+	taken = Now() - start;
+
+	printf("%-8s %8lu frames %12.0f T-states %8.3fs "
+	       "%8.0f fps %8.2f MT/s digest %8.8lx\n",
+	       run[f]->name, frames, tstates, taken,
+	       frames / taken, tstates / taken / 1e6, Digest(ZX81GetZ80(zx)));
+
+#ifdef ENABLE_DECODE_CACHE
+	{
+	    Z80Val run_hits;
+	    Z80Val run_misses;
+
+	    Z80CacheStats(ZX81GetZ80(zx), &run_hits, &run_misses);
+	    hits = run_hits - hits;
+	    misses = run_misses - misses;
+
+	    printf("cache    %8.2f%% hits %12lu misses\n",
+		   hits * 100.0 / (hits + misses), misses);
+	}
+#endif
+
+	if (record_rewind)
+	{
+	    CheckRewind(zx);
+	}
+
+	if (check_fork)
+	{
+	    CheckFork(zx, check_fork);
+	}
+
+	if (show)
+	{
+	    if (DS81_Config[DS81_ULA_DISPLAY])
+	    {
+		DumpBitmap();
+	    }
+	    else
+	    {
+		DumpScreen();
+	    }
+	}
+
+	/* This leaves the machine in a mess, so is done last
+	*/
+	if (check_calc)
+	{
+	    CheckCalc(zx, check_calc);
+	}
+
+	total_time += taken;
+	total_tstates += tstates;
+	total_frames += frames;
+
+	ZX81Destroy(zx);
+    }
+
+    if (no_run > 1)
+    {
+	printf("%-8s %8lu frames %12.0f T-states %8.3fs "
+	       "%8.0f fps %8.2f MT/s\n",
+	       "total", total_frames, total_tstates, total_time,
+	       total_frames / total_time, total_tstates / total_time / 1e6);
+    }
+
+    return EXIT_SUCCESS;
+}
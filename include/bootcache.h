@@ -0,0 +1,45 @@
+/*
+   ds81 - Nintendo DS ZX81 emulator.
+
+   Copyright (C) 2006  Ian Cowburn <ianc@noddybox.co.uk>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+   $Id$
+*/
+#ifndef DS81_BOOTCACHE_H
+#define DS81_BOOTCACHE_H
+
+#include "zx81.h"
+
+/* The number of frames after a reset by which the ROM is waiting for a
+   key, for each display engine.
+*/
+#define BOOT_FRAMES	100
+#define BOOT_ULA_FRAMES	200
+
+/* Sets the directory booted states are kept in between runs, which must
+   end with a '/'.  If NULL, the default, they are only kept in memory.
+*/
+void	BOOT_SetDir(const char *dir);
+
+/* Resets the machine and brings it to the point where the ROM is waiting
+   for a key.  The first time for each ROM and memory layout this is done
+   by running the boot, after which the state is kept and put straight
+   back.  Returns TRUE if a kept state was used.
+*/
+int	BOOT_Reset(ZX81Machine *zx);
+
+#endif	/* DS81_BOOTCACHE_H */
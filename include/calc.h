@@ -0,0 +1,40 @@
+/*
+   ds81 - Nintendo DS ZX81 emulator.
+
+   Copyright (C) 2006  Ian Cowburn <ianc@noddybox.co.uk>
+   
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+  
+   $Id$
+*/
+#ifndef DS81_CALC_H
+#define DS81_CALC_H
+
+#include "z80.h"
+
+/* The T-states charged for each literal the calculator runs.  This is the
+   time the ROM takes for the quicker literals, so that BASIC runs a lot
+   faster but loops timed by doing sums don't end at once.
+*/
+#define CALC_COST	250
+
+/* Does the calculation for a RST 28h that has just been made, as the ROM's
+   CALCULATE routine would.  On return the Z80 is either left as the ROM
+   would leave it, or set to carry on in the ROM where the ROM has to take
+   over, ie. to report an error or run a literal not done here.
+*/
+void	CALC_Run(Z80 *z80);
+
+#endif	/* DS81_CALC_H */
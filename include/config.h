@@ -33,9 +33,39 @@ typedef enum
     DS81_STATIC_RAM_AT_0x2000,
     DS81_ALLOW_TAPE_SAVE,
     DS81_LOAD_DEFAULT_SNAPSHOT,
+    DS81_ULA_DISPLAY,
+    DS81_REWIND,
+    DS81_FAST_CALC,
+    DS81_RAM_PACK,
+    DS81_TURBO,
+    DS81_TURBO_SPEED,
     DS81_NUM_CONFIG_ITEMS
 } DS81_ConfigItem;
 
+/* Values for DS81_RAM_PACK
+*/
+typedef enum
+{
+    DS81_RAM_1K,
+    DS81_RAM_2K,
+    DS81_RAM_16K,
+    DS81_RAM_32K,
+    DS81_RAM_48K,
+    DS81_RAM_56K,
+    DS81_NUM_RAM_PACKS
+} DS81_RamPack;
+
+/* Values for DS81_TURBO_SPEED
+*/
+typedef enum
+{
+    DS81_TURBO_2X,
+    DS81_TURBO_4X,
+    DS81_TURBO_8X,
+    DS81_TURBO_MAX,
+    DS81_NUM_TURBO_SPEEDS
+} DS81_TurboSpeed;
+
 /* Returns TRUE if config loaded from FAT device
 */
 int		LoadConfig(void);
@@ -48,6 +78,11 @@ int		SaveConfig(void);
 */
 const char	*ConfigDesc(DS81_ConfigItem item);
 
+/* Gets the number of values a config item can take.  Most are just TRUE or
+   FALSE.
+*/
+int		ConfigChoices(DS81_ConfigItem item);
+
 /* Table of configs.  Done like this for simple performance reasons.
 */
 extern int	DS81_Config[/*DS81_ConfigItem item*/];
@@ -22,11 +22,13 @@
 #ifndef DS81_GUI_H
 #define DS81_GUI_H
 
+#include "zx81.h"
+
 int	GUI_Menu(const char *opts[]);
 void	GUI_Alert(int fatal, const char *text);
 void	GUI_Config(void);
 int	GUI_FileSelect(char pwd[], char selected_file[], const char *filter);
-int	GUI_InputName(const char *prompt, const char *ext,
+int	GUI_InputName(ZX81Machine *zx, const char *prompt, const char *ext,
 		      char name[], int maxlen);
 
 #endif	/* DS81_GUI_H */
@@ -130,6 +130,10 @@ void	SK_SetSticky(SoftKey key, int is_sticky);
 */
 void	SK_DefinePad(SoftKey pad, SoftKey key);
 
+/* Returns the key a joypad button is mapped to, or NUM_SOFT_KEYS if none.
+*/
+SoftKey	SK_PadKey(SoftKey pad);
+
 /* Returns a name for key symbols.
 */
 const char *SK_KeyName(SoftKey pad);
@@ -22,8 +22,8 @@
 #ifndef DS81_MONITOR_H
 #define DS81_MONITOR_H
 
-#include "z80.h"
+#include "zx81.h"
 
-void MachineCodeMonitor(Z80 *cpu);
+void MachineCodeMonitor(ZX81Machine *zx);
 
 #endif	/* DS81_MONITOR_H */
@@ -0,0 +1,123 @@
+/*
+   ds81 - Nintendo DS ZX81 emulator.
+
+   Copyright (C) 2006  Ian Cowburn <ianc@noddybox.co.uk>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+   $Id$
+*/
+#ifndef DS81_PACE_H
+#define DS81_PACE_H
+
+/* Hosts have no VBlank, so ticks are made from a monotonic clock at this
+   rate instead.
+*/
+#define PACE_HOST_HZ	60
+
+/* The most frames in a row that are left undrawn when behind, so that the
+   display still moves when the emulation can't keep up at all.
+*/
+#define PACE_MAX_SKIP	4
+
+/* How far behind, in ticks, the emulation can fall before it gives up
+   catching up.
+*/
+#define PACE_MAX_DEBT	8
+
+/* Where a pacer gets the time from.  ticks() counts ticks, wait() returns
+   once the next tick has started and micros() is a clock in microseconds,
+   with period of them to a tick.  Both counts may wrap.  If realtime is
+   FALSE frames are only held back in turbo mode.
+*/
+typedef struct
+{
+    unsigned long	(*ticks)(void);
+    unsigned long	(*micros)(void);
+    void		(*wait)(void);
+    unsigned long	period;
+    int			realtime;
+} PaceClock;
+
+/* Decides which emulated frames are drawn and how long to wait after each.
+
+   Normally each frame is followed by a wait for the next tick, so that the
+   emulation runs in real time.  How long running and drawing frames takes
+   is measured, and a frame is left undrawn if drawing it would make the
+   next one late too.  Frames that finish late don't wait, so that the
+   emulation catches up rather than dropping to half speed.
+
+   In turbo mode frames are run without waiting, and only the first frame
+   to finish after each tick is drawn.  If cap is set no more than that
+   many frames are run for each tick.
+
+   The averages and counts can be read for display, and the counts cleared
+   with PACE_ClearStats().
+*/
+typedef struct
+{
+    const PaceClock	*clock;
+    int			turbo;
+    int			cap;
+    int			draw;
+    int			frames;
+    unsigned long	tick;
+
+    unsigned long	mark;
+    unsigned long	deadline;
+    int			skipped;
+
+    unsigned long	run_us;
+    unsigned long	draw_us;
+    unsigned long	no_frames;
+    unsigned long	no_drawn;
+    unsigned long	no_late;
+} Pacer;
+
+/* Counts a tick.  Called from the VBlank interrupt on the DS.
+*/
+void		PACE_VBlank(void);
+
+/* Returns the number of ticks so far from the system clock.
+*/
+unsigned long	PACE_Ticks(void);
+
+/* Sets up a pacer on the system clock, with turbo mode off.
+*/
+void		PACE_Init(Pacer *p);
+
+/* Changes the clock a pacer uses.
+*/
+void		PACE_SetClock(Pacer *p, const PaceClock *clock);
+
+/* Turns turbo mode on or off, and sets the most frames run per tick in it,
+   or 0 for no limit.
+*/
+void		PACE_SetTurbo(Pacer *p, int turbo, int cap);
+
+/* Called once for each frame before it is drawn.  Returns TRUE if it
+   should be.
+*/
+int		PACE_Draw(Pacer *p);
+
+/* Called once a frame has been finished to wait as needed.
+*/
+void		PACE_Wait(Pacer *p);
+
+/* Clears the counts of frames.
+*/
+void		PACE_ClearStats(Pacer *p);
+
+#endif	/* DS81_PACE_H */
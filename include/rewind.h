@@ -0,0 +1,50 @@
+/*
+   ds81 - Nintendo DS ZX81 emulator.
+
+   Copyright (C) 2006  Ian Cowburn <ianc@noddybox.co.uk>
+   
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+  
+   $Id$
+*/
+#ifndef DS81_REWIND_H
+#define DS81_REWIND_H
+
+#include "zx81.h"
+
+/* The number of frames between each state added to the buffer
+*/
+#define RWD_FRAMES	10
+
+/* Called after each frame.  Every few frames the state of the machine is
+   added to the rewind buffer, if enabled.
+*/
+void	RWD_Frame(ZX81Machine *zx);
+
+/* Winds the machine back to the last state added to the buffer, and
+   removes it so that the next call goes back further.  Returns FALSE if
+   the buffer is empty.
+*/
+int	RWD_Back(ZX81Machine *zx);
+
+/* Empties the buffer.
+*/
+void	RWD_Clear(void);
+
+/* Returns the number of states in the buffer and the bytes they use.
+*/
+int	RWD_Count(long *bytes);
+
+#endif	/* DS81_REWIND_H */
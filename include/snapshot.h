@@ -22,7 +22,7 @@
 #ifndef DS81_SNAPSHOT_H
 #define DS81_SNAPSHOT_H
 
-#include "z80.h"
+#include "zx81.h"
 
 typedef enum
 {
@@ -31,7 +31,8 @@ typedef enum
 } SnapshotType;
 
 void	SNAP_Enable(int enable);
-void	SNAP_Save(Z80 *cpu, SnapshotType type);
-void	SNAP_Load(Z80 *cpu, const char *optional_name, SnapshotType type);
+void	SNAP_Save(ZX81Machine *zx, SnapshotType type);
+void	SNAP_Load(ZX81Machine *zx, const char *optional_name,
+		  SnapshotType type);
 
 #endif	/* DS81_SNAPSHOT_H */
@@ -27,9 +27,26 @@
 void		PUT_Byte(FILE *fp, unsigned char c);
 void		PUT_Long(FILE *fp, long l);
 void		PUT_ULong(FILE *fp, unsigned long l);
+void		PUT_Block(FILE *fp, const void *p, long len);
 
 unsigned char	GET_Byte(FILE *fp);
 long		GET_Long(FILE *fp);
 unsigned long	GET_ULong(FILE *fp);
+int		GET_Block(FILE *fp, void *p, long len);
+
+/* Chunks are a four character ID and a length followed by the data.
+   PUT_Chunk() returns the position of the data, which is passed to
+   PUT_EndChunk() once it is written to fill in the length.  GET_Chunk()
+   reads the header into id, which must have room for 5 characters.
+*/
+long		PUT_Chunk(FILE *fp, const char *id);
+void		PUT_EndChunk(FILE *fp, long start);
+int		GET_Chunk(FILE *fp, char *id, long *len);
+
+/* Run-length encoded blocks.  GET_RLE() reads packed bytes and returns
+   FALSE unless they unpack to exactly len bytes.
+*/
+void		PUT_RLE(FILE *fp, const unsigned char *p, long len);
+int		GET_RLE(FILE *fp, unsigned char *p, long len, long packed);
 
 #endif	/* DS81_STREAM_H */
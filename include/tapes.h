@@ -22,6 +22,8 @@
 #ifndef DS81_TAPES_H
 #define DS81_TAPES_H
 
-void	SelectTape(void);
+#include "zx81.h"
+
+void	SelectTape(ZX81Machine *zx);
 
 #endif	/* DS81_TAPES_H */
@@ -0,0 +1,65 @@
+/*
+   ds81 - Nintendo DS ZX81 emulator.
+
+   Copyright (C) 2006  Ian Cowburn <ianc@noddybox.co.uk>
+   
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+  
+   $Id$
+*/
+#ifndef DS81_TAPESOURCE_H
+#define DS81_TAPESOURCE_H
+
+#include <stdio.h>
+
+/* A source of a .P tape image.  If the whole image is in memory (a built-in
+   tape or a file mapped on a host) data points at it and it is copied
+   straight into the ZX81.  Otherwise read is used to read it in one block.
+*/
+typedef struct TapeSource TapeSource;
+
+struct TapeSource
+{
+    const unsigned char	*data;
+    long		len;
+
+    long		(*read)(TapeSource *src, unsigned char *dest, long len);
+    void		(*close)(TapeSource *src);
+
+    void		*handle;
+};
+
+/* Sets up src for an image in memory, which must stay there while the
+   source is in use.
+*/
+void	TAPE_MemorySource(TapeSource *src, const unsigned char *image, long len);
+
+/* Sets up src to read the image in the file fp, which is left at an
+   undefined position.  Where possible the file is mapped into memory, in
+   which case fp can be closed straight away.  Returns FALSE if the length
+   of the file couldn't be found.
+*/
+int	TAPE_FileSource(TapeSource *src, FILE *fp);
+
+/* Copies the image into dest.  Returns the length copied, or -1 if it
+   couldn't be read or is longer than max, in which case dest is untouched.
+*/
+long	TAPE_Read(TapeSource *src, unsigned char *dest, long max);
+
+/* Releases anything held by src
+*/
+void	TAPE_Close(TapeSource *src);
+
+#endif	/* DS81_TAPESOURCE_H */
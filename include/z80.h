@@ -110,6 +110,15 @@ typedef	Z80Byte	(*Z80ReadMemory)(Z80 *cpu, Z80Word address);
 typedef	void	(*Z80WriteMemory)(Z80 *cpu, Z80Word address, Z80Byte value);
 
 
+/* Page sizes for the paged memory model
+*/
+#ifdef ENABLE_PAGED_MEMORY
+#define Z80_PAGE_SIZE	(1<<Z80_PAGE_SHIFT)
+#define Z80_PAGE_MASK	(Z80_PAGE_SIZE-1)
+#define Z80_NO_PAGES	(0x10000>>Z80_PAGE_SHIFT)
+#endif
+
+
 /* Interfaces needed to handle ports (IN/OUT commands)
 */
 typedef	Z80Byte	(*Z80ReadPort)(Z80 *cpu, Z80Word address);
@@ -121,6 +130,17 @@ typedef	void	(*Z80WritePort)(Z80 *cpu, Z80Word address, Z80Byte value);
 typedef int	(*Z80Callback)(Z80 *cpu, Z80Val data);
 
 
+/* Fetch hook.  Passed the address and opcode of an M1 cycle and returns the
+   opcode to actually execute.
+*/
+typedef Z80Byte	(*Z80FetchHook)(Z80 *cpu, Z80Word address, Z80Byte opcode);
+
+
+/* Timed event.  Passed the cycle count the event was due at.
+*/
+typedef void	(*Z80Event)(Z80 *cpu, Z80Val when);
+
+
 /* Callback reasons
 
    eZ80_Instruction	Called before the initial fetch for an instruction
@@ -178,6 +198,10 @@ typedef struct
 #ifdef ENABLE_ARRAY_MEMORY
 Z80	*Z80Init(Z80ReadPort read_port,
 		 Z80WritePort write_port);
+#elif defined(ENABLE_PAGED_MEMORY)
+Z80	*Z80Init(Z80WriteMemory write_memory,
+		 Z80ReadPort read_port,
+		 Z80WritePort write_port);
 #else
 Z80	*Z80Init(Z80ReadMemory read_memory,
 		 Z80WriteMemory write_memory,
@@ -187,6 +211,30 @@ Z80	*Z80Init(Z80ReadMemory read_memory,
 #endif
 
 
+#ifdef ENABLE_PAGED_MEMORY
+/* Maps len bytes of memory into the address space at addr.  Both must be
+   multiples of Z80_PAGE_SIZE.  Reads come from read and writes go to write,
+   or are thrown away if write is NULL (eg. for ROM).  Until mapped, pages
+   read as 0xff and ignore writes.
+*/
+void	Z80MapMemory(Z80 *cpu, Z80Word addr, Z80Val len,
+		     Z80Byte *read, Z80Byte *write);
+
+
+/* Sends writes to the pages covering len bytes from addr through the
+   write_memory function passed to Z80Init, eg. for pages that are only
+   partly writable.  Reads are unaffected.  Does nothing if no write_memory
+   function was given.  Z80MapMemory() undoes this.
+*/
+void	Z80TrapWrites(Z80 *cpu, Z80Word addr, Z80Val len);
+#endif
+
+
+/* Frees a processor created with Z80Init()
+*/
+void	Z80Free(Z80 *cpu);
+
+
 /* Resets the processor.
 */
 void	Z80Reset(Z80 *cpu);
@@ -221,7 +269,7 @@ void	Z80NMI(Z80 *cpu);
 
 
 /* Execute a single instruction.  Returns FALSE if any callback returned
-   FALSE.
+   FALSE.  Repeating block instructions such as LDIR only go round once.
 */
 int	Z80SingleStep(Z80 *cpu);
 
@@ -231,12 +279,90 @@ int	Z80SingleStep(Z80 *cpu);
 void	Z80Exec(Z80 *cpu);
 
 
+/* Executes until at least cycles T-states have passed or a callback returns
+   FALSE, in which case FALSE is returned.  No eZ80_Instruction callbacks are
+   made unless some have been lodged, in which case they are honoured as for
+   Z80SingleStep().  Otherwise repeating block instructions such as LDIR
+   go round as many times as fit in one go, rather than one instruction at
+   a time, with the same results.  Events that fall due are called as they
+   do, and before returning.
+*/
+int	Z80Run(Z80 *cpu, Z80Val cycles);
+
+
+/* Calls event before the first instruction run once the cycle count has
+   reached when, so that hardware timed in T-states doesn't have to be
+   checked for on every instruction.  An event is called once -- to repeat
+   it schedule it again from the event.  Scheduling an event that is
+   already waiting moves it.  Returns FALSE if the event couldn't be
+   scheduled (there is a max of 8 waiting).
+
+   Waiting events are moved along with the cycle count by Z80ResetCycles(),
+   but aren't part of the snapshot or state.
+*/
+int	Z80Schedule(Z80 *cpu, Z80Event event, Z80Val when);
+
+
+/* Removes an event.  Does nothing if it is not waiting.
+*/
+void	Z80Unschedule(Z80 *cpu, Z80Event event);
+
+
+/* Calls hook for the first opcode fetch of every instruction from addr
+   upwards, eg. to emulate hardware that watches the M1 cycle.  Pass a NULL
+   hook to remove it.
+*/
+void	Z80SetFetchHook(Z80 *cpu, Z80Word addr, Z80FetchHook hook);
+
+
+/* Set and get a pointer for the owner of the processor, eg. so that the
+   memory and port callbacks can find the machine the processor is part
+   of.  NULL until set.
+*/
+void	Z80SetUserData(Z80 *cpu, void *data);
+void	*Z80UserData(Z80 *cpu);
+
+
+/* Discards any decoded instructions or translated code.  Must be called if
+   memory the Z80 may have run code from is changed other than by the Z80
+   or Z80MapMemory().  Does nothing unless ENABLE_DECODE_CACHE or
+   ENABLE_JIT is defined.
+*/
+void	Z80FlushCache(Z80 *cpu);
+
+/* As Z80FlushCache(), but only for code in the len bytes from addr
+*/
+void	Z80FlushMemory(Z80 *cpu, Z80Word addr, Z80Val len);
+
+/* Turns translating code into native code on or off, eg. to check that
+   both give the same results.  On by default.  Nothing is allocated for
+   translation until there is code to translate.  Does nothing unless
+   ENABLE_JIT is defined.
+*/
+void	Z80UseJit(Z80 *cpu, int use);
+
+#ifdef ENABLE_DECODE_CACHE
+/* Gets the number of instructions that were and weren't found in the cache
+   of decoded instructions.
+*/
+void	Z80CacheStats(Z80 *cpu, Z80Val *hits, Z80Val *misses);
+#endif
+
+
 /* Manipulate the cylce count of the Z80
 */
 Z80Val	Z80Cycles(Z80 *cpu);
 void	Z80ResetCycles(Z80 *cpu, Z80Val cycles);
 
 
+/* Read and write memory as the processor does, eg. to emulate a routine
+   rather than run it.  Writes drop any decoded instructions or translated
+   code as the processor's own do.
+*/
+Z80Byte	Z80Peek(Z80 *cpu, Z80Word addr);
+void	Z80Poke(Z80 *cpu, Z80Word addr, Z80Byte val);
+
+
 /* Set address to label mappings for the disassembler
 */
 void	Z80SetLabels(Z80Label labels[]);
@@ -252,6 +378,24 @@ const char *Z80Disassemble(Z80 *cpu, Z80Word *addr);
 void	Z80SaveSnapshot(Z80 *cpu, FILE *fp);
 void	Z80LoadSnapshot(Z80 *cpu, FILE *fp);
 
+/* The CPU state less the memory map and callbacks, so that it can be
+   saved/loaded in memory.  The priv member of regs is not used.
+*/
+typedef struct
+{
+    Z80			regs;
+    Z80Val		cycle;
+    int			halt;
+    Z80Byte		shift;
+    int			raise;
+    Z80Byte		devbyte;
+    int			nmi;
+    int			last_cb;
+} Z80State;
+
+void	Z80GetState(Z80 *cpu, Z80State *state);
+void	Z80SetState(Z80 *cpu, const Z80State *state);
+
 #endif
 
 /* END OF FILE */
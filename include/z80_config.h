@@ -54,6 +54,98 @@
 #endif
 
 
+/* Define this to enable the paged memory model.  The 64K address space is
+   split into pages of 1<<Z80_PAGE_SHIFT bytes, each with a pointer to read
+   from and a pointer to write to which are set with Z80MapMemory().  Reads
+   and writes are then made directly without calling out of the emulation.
+
+   In this mode the signature of Z80Init changes so that only the
+   write_memory function is passed, which is just used for pages handed to
+   Z80TrapWrites().  Unlike the array model each processor instance has its
+   own memory map.  Must not be defined along with ENABLE_ARRAY_MEMORY.
+*/
+#define ENABLE_PAGED_MEMORY
+
+#ifdef ENABLE_PAGED_MEMORY
+#define Z80_PAGE_SHIFT 8
+#endif
+
+
+/* Define this to decode instructions through per-prefix tables of opcode
+   handlers rather than the nested switch statements.  When compiled with
+   GCC the handlers are dispatched with computed gotos; define
+   DISABLE_COMPUTED_GOTO as well to force plain function pointer tables.
+*/
+#define ENABLE_TABLE_DECODE
+
+
+/* Define this to work out the flags only when they are read.  The 8-bit
+   arithmetic and boolean instructions just note their operands and result,
+   and F is made from them when an instruction reads it, before a callback
+   or fetch hook is called and when Z80Run() or Z80SingleStep() return.
+   Left off as setting the flags straight away is quicker with the table
+   decoder.  'make -C host check' builds it with -DENABLE_LAZY_FLAGS and
+   compares the two.
+#define ENABLE_LAZY_FLAGS
+*/
+
+
+/* Define this to keep a cache of decoded instructions keyed by address.
+   Each entry holds the handler for the instruction, what its prefixes
+   added to the cycle count and R, and a copy of its bytes that the handler
+   reads its operands from.  Entries are dropped when a page they were
+   decoded from is written to, or with Z80FlushCache().  Pages read from the
+   same memory are treated as one, so that writing through a mirror drops
+   what was decoded through another.  Requires ENABLE_PAGED_MEMORY and
+   ENABLE_TABLE_DECODE.
+
+   Left off as on the host looking an instruction up costs more than
+   decoding it again, and the games write to the pages they run from often
+   enough to keep dropping entries.  Adds about 66K to each processor.
+#define ENABLE_DECODE_CACHE
+*/
+
+#if defined(ENABLE_DECODE_CACHE) && \
+	!(defined(ENABLE_PAGED_MEMORY) && defined(ENABLE_TABLE_DECODE))
+#error "ENABLE_DECODE_CACHE needs ENABLE_PAGED_MEMORY and ENABLE_TABLE_DECODE"
+#endif
+
+
+/* Define this to translate code that is run often into native x86-64 code.
+   Straight runs of code are translated into blocks once they have been run
+   a few times, with the less common instructions still handed to the
+   interpreter from inside the block.  A block is only run when it can't
+   overrun the cycles given to Z80Run() and no interrupt is waiting, so
+   timing is the same as the interpreter's.  Writing to translated code
+   drops it, as does Z80FlushCache().
+
+   Only takes effect when built with GCC for x86-64 on a system with mmap(),
+   otherwise it is quietly turned off.  Requires ENABLE_PAGED_MEMORY.  The
+   interpreter is used on the few early x86-64 processors without LAHF.
+*/
+#define ENABLE_JIT
+
+#if defined(ENABLE_JIT) && \
+	!(defined(__GNUC__) && defined(__x86_64__) && defined(__unix__))
+#undef ENABLE_JIT
+#endif
+
+#if defined(ENABLE_JIT) && !defined(ENABLE_PAGED_MEMORY)
+#error "ENABLE_JIT needs ENABLE_PAGED_MEMORY"
+#endif
+
+
+/* Define this to skip over loops that wait for something to change, such
+   as a keyboard or frame counter being polled.  When a short loop of
+   instructions that only read memory and registers is found to have gone
+   round without changing anything, the cycle count is moved on by as many
+   times round as fit before Z80Run() has to stop or an interrupt can be
+   taken.  The end result is the same as running the loop, as long as
+   reading memory has no side effects.
+*/
+#define ENABLE_IDLE_SKIP
+
+
 #endif
 
 /* END OF FILE */
@@ -41,13 +41,95 @@
 
 #define MAX_PER_CALLBACK	10
 
+#define MAX_EVENTS		8
+
+/* When there are no events waiting
+*/
+#define Z80_NEVER		((Z80Val)-1)
+
 
 /* ---------------------------------------- TYPES
 */
 
+typedef struct
+{
+    Z80Event		event;
+    Z80Val		when;
+} Z80TimedEvent;
+
+#ifdef ENABLE_DECODE_CACHE
+#define Z80_CACHE_SIZE		2048
+#define Z80_CACHE_MASK		(Z80_CACHE_SIZE-1)
+
+/* Room for the longest instruction, such as a DD or FD with no effect in
+   front of a four byte ED instruction, rounded up
+*/
+#define Z80_CACHE_BYTES		8
+
+/* A decoded instruction at pc.  handler is the label (or the entry in the
+   table of handlers) of its final opcode, which is reached after skip
+   bytes of prefixes and opcode that added r to R and tstates T-states.
+   bytes holds the instruction as it was read from memory, and the handler
+   takes its operands from there.  The entry is only valid while gen
+   matches the generation of its page.
+*/
+typedef struct
+{
+    const void		*handler;
+    unsigned		gen;
+    Z80Word		pc;
+    Z80Byte		skip;
+    Z80Byte		r;
+    Z80Byte		tstates;
+    Z80Byte		shift;
+    Z80Byte		opcode;
+    Z80Byte		bytes[Z80_CACHE_BYTES];
+} Z80CacheEntry;
+#endif
+
+#ifdef ENABLE_JIT
+typedef void	(*Z80JitCode)(Z80 *cpu);
+
+/* A block of translated code starting at pc, which sits in the buffer just
+   ahead of its code.  tstates is the most the block can take, so it is
+   only run if that fits before Z80Run() has to stop.  The block is only
+   valid while gen matches the generation of its page.  idle is the address
+   of the jump if the block is an idle loop.  Another block that ends by
+   going to pc carries on at entry, with the registers already loaded.
+*/
+typedef struct
+{
+    Z80JitCode		code;
+    void		*entry;
+    unsigned		gen;
+    Z80Word		pc;
+    Z80Word		tstates;
+#ifdef ENABLE_IDLE_SKIP
+    Z80Word		idle;
+#endif
+} Z80JitBlock;
+
+/* The blocks for each address and what has been translated, which are
+   only allocated once there is something to translate.  code has a bit
+   set for every byte translated.
+*/
+typedef struct
+{
+    Z80JitBlock		*block[0x10000];
+    unsigned		gen[Z80_NO_PAGES];
+    Z80Byte		code[0x10000/8];
+} Z80JitTables;
+
+/* Number of counts kept of how often code is entered, shared between
+   addresses that are a multiple of this apart
+*/
+#define Z80_JIT_COUNTS	0x1000
+#endif
+
 struct Z80Private
 {
     Z80Val		cycle;
+    Z80Val		end;
 
     int			halt;
 
@@ -57,7 +139,15 @@ struct Z80Private
     Z80Byte		devbyte;
     int			nmi;
 
-#ifndef ENABLE_ARRAY_MEMORY
+#if defined(ENABLE_PAGED_MEMORY)
+    Z80Byte		*rpage[Z80_NO_PAGES];
+    Z80Byte		*wpage[Z80_NO_PAGES];
+
+    Z80WriteMemory	mwrite;
+
+    Z80Byte		idle[Z80_PAGE_SIZE];
+    Z80Byte		discard[Z80_PAGE_SIZE];
+#elif !defined(ENABLE_ARRAY_MEMORY)
     Z80ReadMemory	disread;
 
     Z80ReadMemory	mread;
@@ -70,11 +160,76 @@ struct Z80Private
     Z80Callback		callback[eZ80_NO_CALLBACK][MAX_PER_CALLBACK];
 
     int			last_cb;
+
+    Z80FetchHook	fetch_hook;
+    Z80Val		fetch_from;
+
+    Z80TimedEvent	event[MAX_EVENTS];
+    Z80Val		due;
+
+    void		*user;
+
+#ifdef ENABLE_DECODE_CACHE
+    Z80CacheEntry	cache[Z80_CACHE_SIZE];
+    unsigned		gen[Z80_NO_PAGES];
+    unsigned		gen_next;
+    Z80Word		home[Z80_NO_PAGES];
+    Z80Byte		code[Z80_NO_PAGES];
+
+    const Z80Byte	*fetch;
+    Z80Byte		window[Z80_CACHE_BYTES];
+
+    Z80CacheEntry	*fill;
+    Z80Val		fill_cycle;
+    Z80Byte		fill_r;
+
+    Z80Val		hits;
+    Z80Val		misses;
+#endif
+
+#ifdef ENABLE_LAZY_FLAGS
+    Z80Byte		lazy;
+    Z80Byte		lazy_a;
+    Z80Byte		lazy_b;
+    unsigned		lazy_w;
+#endif
+
+#ifdef ENABLE_IDLE_SKIP
+    Z80Word		idle_from;
+    Z80Word		idle_reg[4];
+    Z80Val		idle_cycle;
+    Z80Byte		idle_r;
+#endif
+
+#ifdef ENABLE_JIT
+    Z80JitTables	*jit;
+    Z80Byte		jit_count[Z80_JIT_COUNTS];
+    Z80Word		jit_last;
+    Z80Byte		jit_page[Z80_NO_PAGES];
+    Z80Word		jit_mirror[Z80_NO_PAGES];
+
+    Z80Byte		*jit_buffer;
+    Z80Byte		*jit_write;
+    Z80Val		jit_used;
+    Z80Byte		jit_dirty;
+    Z80Byte		jit_use;
+#endif
 };
 
 #define PRIV		cpu->priv
 
 
+/* Working storage that can't be kept in the processor, eg. the buffers the
+   disassembler returns strings in, is private to each thread so that
+   processors can be run on different threads.
+*/
+#if defined(__GNUC__) && defined(__unix__)
+#define THREAD_LOCAL	__thread
+#else
+#define THREAD_LOCAL
+#endif
+
+
 /* ---------------------------------------- ARRAY MEMORY
 */
 
@@ -97,6 +252,7 @@ extern Z80Byte	Z80_MEMORY[];
 			{					\
 			int f;					\
 								\
+			FLUSH_FLAGS;				\
 			for(f=0;f<MAX_PER_CALLBACK;f++)		\
 			    if (PRIV->callback[r][f])		\
 				PRIV->last_cb &=		\
@@ -120,8 +276,76 @@ extern Z80Byte	Z80_MEMORY[];
 #define SET(v,b)		(v)|=b
 #define CLR(v,b)		(v)&=~(b)
 
-#define SETFLAG(f)		SET(cpu->AF.b[LO],f)
-#define CLRFLAG(f)		CLR(cpu->AF.b[LO],f)
+/* With lazy flags the operation that last set the flags is noted in place
+   of F, and F is only worked out when it is read.  C, Z and S can be read
+   straight from the result.  FLAGS is F made up to date.
+*/
+#ifdef ENABLE_LAZY_FLAGS
+
+enum
+{
+    Z80_LAZY_NONE,
+    Z80_LAZY_ADD,
+    Z80_LAZY_SUB,
+    Z80_LAZY_CMP,
+    Z80_LAZY_AND,
+    Z80_LAZY_LOGIC,
+    Z80_LAZY_INC,
+    Z80_LAZY_DEC
+};
+
+void Z80_FlushFlags(Z80 *cpu);
+
+#define FLUSH_FLAGS		(PRIV->lazy ? Z80_FlushFlags(cpu) : (void)0)
+
+static inline Z80Byte *Z80_Flags(Z80 *cpu)
+{
+    FLUSH_FLAGS;
+    return cpu->AF.b+Z80_LO_WORD;
+}
+
+static inline Z80Byte Z80_Carry(Z80 *cpu)
+{
+    switch(PRIV->lazy)
+    {
+	case Z80_LAZY_NONE:
+	    return cpu->AF.b[Z80_LO_WORD]&C_Z80;
+
+	case Z80_LAZY_INC:
+	case Z80_LAZY_DEC:
+	    return PRIV->lazy_b;
+
+	case Z80_LAZY_AND:
+	case Z80_LAZY_LOGIC:
+	    return 0;
+
+	default:
+	    return PRIV->lazy_w>>8;
+    }
+}
+
+#define FLAGS			(*Z80_Flags(cpu))
+
+#define IS_C			Z80_Carry(cpu)
+#define IS_Z			(PRIV->lazy ? !(PRIV->lazy_w&0xff) :	\
+					cpu->AF.b[LO]&Z_Z80)
+#define IS_S			(PRIV->lazy ? PRIV->lazy_w&0x80 :	\
+					cpu->AF.b[LO]&S_Z80)
+
+#else
+
+#define FLUSH_FLAGS		((void)0)
+
+#define FLAGS			cpu->AF.b[LO]
+
+#define IS_C			(FLAGS&C_Z80)
+#define IS_Z			(FLAGS&Z_Z80)
+#define IS_S			(FLAGS&S_Z80)
+
+#endif
+
+#define SETFLAG(f)		SET(FLAGS,f)
+#define CLRFLAG(f)		CLR(FLAGS,f)
 
 #ifdef ENABLE_ARRAY_MEMORY
 
@@ -153,6 +377,52 @@ static inline Z80Word PEEKW(Z80Word addr)
 				    Z80_MEMORY[cpu->PC-2]|		\
 					((Z80Word)Z80_MEMORY[cpu->PC-1]<<8))
 
+#elif defined(ENABLE_PAGED_MEMORY)
+
+/* Pages with a NULL write pointer are trapped by the write_memory callback
+*/
+static inline Z80Byte Z80_PagePeek(Z80 *cpu, Z80Word addr)
+{
+    return PRIV->rpage[addr>>Z80_PAGE_SHIFT][addr&Z80_PAGE_MASK];
+}
+
+#ifdef ENABLE_DECODE_CACHE
+void Z80_InvalidatePage(Z80 *cpu, int page);
+#endif
+
+#ifdef ENABLE_JIT
+void Z80_JitWrite(Z80 *cpu, Z80Word addr);
+#endif
+
+static inline void Z80_PagePoke(Z80 *cpu, Z80Word addr, Z80Byte val)
+{
+    Z80Byte *p=PRIV->wpage[addr>>Z80_PAGE_SHIFT];
+
+#ifdef ENABLE_DECODE_CACHE
+    if (PRIV->code[PRIV->home[addr>>Z80_PAGE_SHIFT]])
+	Z80_InvalidatePage(cpu,PRIV->home[addr>>Z80_PAGE_SHIFT]);
+#endif
+
+#ifdef ENABLE_JIT
+    if (PRIV->jit_page[addr>>Z80_PAGE_SHIFT])
+	Z80_JitWrite(cpu,addr);
+#endif
+
+    if (p)
+	p[addr&Z80_PAGE_MASK]=val;
+    else
+	PRIV->mwrite(cpu,addr,val);
+}
+
+#define PEEK(addr)		Z80_PagePeek(cpu,addr)
+#define PEEKW(addr)		FPEEKW(cpu,addr)
+
+#define POKE(addr,val)		Z80_PagePoke(cpu,addr,val)
+#define POKEW(addr,val)		FPOKEW(cpu,addr,val)
+
+#define FETCH_BYTE		Z80_PagePeek(cpu,cpu->PC++)
+#define FETCH_WORD		(cpu->PC+=2,FPEEKW(cpu,cpu->PC-2))
+
 #else
 
 #define PEEK(addr)		(PRIV->mread(cpu,addr))
@@ -167,12 +437,9 @@ static inline Z80Word PEEKW(Z80Word addr)
 #endif
 
 
-#define IS_C			(cpu->AF.b[LO]&C_Z80)
-#define IS_N			(cpu->AF.b[LO]&N_Z80)
-#define IS_P			(cpu->AF.b[LO]&P_Z80)
-#define IS_H			(cpu->AF.b[LO]&H_Z80)
-#define IS_Z			(cpu->AF.b[LO]&Z_Z80)
-#define IS_S			(cpu->AF.b[LO]&S_Z80)
+#define IS_N			(FLAGS&N_Z80)
+#define IS_P			(FLAGS&P_Z80)
+#define IS_H			(FLAGS&H_Z80)
 
 #define CARRY			IS_C
 
@@ -200,8 +467,8 @@ static inline Z80Word PEEKW(Z80Word addr)
 				{					\
 				    Z80Word pushv=REG;			\
 				    cpu->SP-=2;				\
-				    PRIV->mwrite(cpu,cpu->SP,pushv);	\
-				    PRIV->mwrite(cpu,cpu->SP+1,pushv>>8);\
+				    POKE(cpu->SP,pushv);		\
+				    POKE(cpu->SP+1,pushv>>8);		\
 				} while(0)
 #endif
 
@@ -212,13 +479,17 @@ static inline Z80Word PEEKW(Z80Word addr)
 				    cpu->SP+=2;				\
 				} while(0)
 
-#define SETHIDDEN(res)		cpu->AF.b[LO]=(cpu->AF.b[LO]&~(B3_Z80|B5_Z80))|\
+#define SETHIDDEN(res)		FLAGS=(FLAGS&~(B3_Z80|B5_Z80))|\
 					((res)&(B3_Z80|B5_Z80))
 
+/* The address is read before the return address is pushed, as on the
+   real thing, in case the push lands on it
+*/
 #define CALL			do				\
 				{				\
+				    Z80Word callto=PEEKW(cpu->PC);\
 				    PUSH(cpu->PC+2);		\
-				    cpu->PC=PEEKW(cpu->PC);	\
+				    cpu->PC=callto;		\
 				} while(0)
 
 #define NOCALL			cpu->PC+=2
@@ -247,6 +518,30 @@ extern Z80Label			*z80_labels;
 void Z80_Decode(Z80 *cpu, Z80Byte opcode);
 void Z80_InitialiseInternals(void);
 
+#ifdef ENABLE_DECODE_CACHE
+void Z80_DecodeCached(Z80 *cpu);
+#endif
+
+
+/* ---------------------------------------- IDLE LOOPS
+*/
+#ifdef ENABLE_IDLE_SKIP
+Z80Word		Z80_IdleLoop(Z80 *cpu, Z80Word head, int *r);
+void		Z80_IdleJump(Z80 *cpu, Z80Word from);
+#endif
+
+
+/* ---------------------------------------- TRANSLATION TO NATIVE CODE
+*/
+#ifdef ENABLE_JIT
+void		Z80_JitInit(Z80 *cpu);
+void		Z80_JitFree(Z80 *cpu);
+void		Z80_JitUse(Z80 *cpu, int use);
+int		Z80_JitRun(Z80 *cpu);
+void		Z80_JitMapPage(Z80 *cpu, int page);
+void		Z80_JitInvalidatePage(Z80 *cpu, int page);
+#endif
+
 
 /* ---------------------------------------- DISASSEMBLY
 */
@@ -31,31 +31,68 @@
 
 #include "z80.h"
 #include "keyboard.h"
+#include "tapesource.h"
+#include "pace.h"
 
 
-/* Initialise the ZX81
+/* A ZX81 and its Z80.  Machines share nothing that changes as they run, so
+   any number can be created and each run on its own thread.
 */
-void	ZX81Init(uint16 *text_vram, uint16 *bitmap_vram, Z80 *z80);
+typedef struct ZX81Machine ZX81Machine;
+
+/* Creates a ZX81 drawing into the passed text and bitmap displays.  Returns
+   NULL if there is not enough memory.  The first call sets up tables shared
+   by all machines, so must return before others are created on other
+   threads.
+*/
+ZX81Machine *ZX81Create(uint16 *text_vram, uint16 *bitmap_vram);
+
+/* Frees a ZX81 and its Z80
+*/
+void	ZX81Destroy(ZX81Machine *zx);
+
+/* Gets the Z80 of a ZX81
+*/
+Z80	*ZX81GetZ80(ZX81Machine *zx);
+
+/* Gets what paces the frames of a ZX81 and decides which are drawn
+*/
+Pacer	*ZX81GetPacer(ZX81Machine *zx);
 
 /* Handle keypresses
 */
-void	ZX81HandleKey(SoftKey k, int is_pressed);
+void	ZX81HandleKey(ZX81Machine *zx, SoftKey k, int is_pressed);
 
 /* Enable fopen() loading of tape files
 */
-void	ZX81EnableFileSystem(int enable);
+void	ZX81EnableFileSystem(ZX81Machine *zx, int enable);
 
-/* Set a file to load from tape
+/* Set a source to load from tape when no file name is given.  The source
+   must remain valid until another is set.
 */
-void	ZX81SetTape(const Z80Byte *image, int len);
+void	ZX81SetTape(ZX81Machine *zx, TapeSource *src);
 
 /* Reset the 81
 */
-void	ZX81Reset(Z80 *z80);
+void	ZX81Reset(ZX81Machine *zx);
+
+/* Returns the length in T-states of the frame currently being emulated
+*/
+Z80Val	ZX81FrameTStates(ZX81Machine *zx);
+
+/* Runs the 81 to the end of the current frame and then updates the display
+   and keyboard.
+*/
+void	ZX81RunFrame(ZX81Machine *zx);
+
+/* Executes a single instruction, completing the frame first if it is due.
+   Returns as Z80SingleStep().
+*/
+int	ZX81SingleStep(ZX81Machine *zx);
 
 /* Tell the 81 that config may have changed.
 */
-void	ZX81Reconfigure(void);
+void	ZX81Reconfigure(ZX81Machine *zx);
 
 /* Displays a string on the ZX81's dislpay.  The screen is cleared and the
    string displayed with \n characters breaking the line.
@@ -68,11 +105,11 @@ void	ZX81Reconfigure(void);
    ZX81SuspendDisplay() and ZX81ResumeDisplay() should be called so that the
    ZX81 can set up its internals.
 */
-void	ZX81DisplayString(const char *p);
-void	ZX81SuspendDisplay(void);
-void	ZX81ResumeDisplay(void);
+void	ZX81DisplayString(ZX81Machine *zx, const char *p);
+void	ZX81SuspendDisplay(ZX81Machine *zx);
+void	ZX81ResumeDisplay(ZX81Machine *zx);
 
-/* Interfaces for the Z80
+/* Interfaces for the Z80.  These find the ZX81 from the Z80's user data.
 */
 Z80Byte	ZX81ReadMem(Z80 *z80, Z80Word addr);
 void	ZX81WriteMem(Z80 *z80, Z80Word addr, Z80Byte val);
@@ -81,11 +118,88 @@ void	ZX81WritePort(Z80 *z80, Z80Word port, Z80Byte val);
 
 #define	ZX81ReadDisassem ZX81ReadMem
 
+/* How a machine's memory and display are set up, so that a state can be
+   checked as fitting it.  The RAM runs from ram_bot to ram_top, and is made
+   of the ram_len bytes returned by ZX81GetRAM() repeated as often as needed
+   from 0x4000.
+*/
+typedef struct
+{
+    Z80Word		ram_bot;
+    Z80Word		ram_top;
+    Z80Val		ram_len;
+    int			ula_display;
+} ZX81Layout;
+
+void	ZX81GetLayout(ZX81Machine *zx, ZX81Layout *layout);
+
 /* Interfaces to allows the ZX81 to save/load itself as a snapshot to/from
-   a stream.
+   a stream.  ZX81SaveSnapshot() writes a number of chunks, each of which
+   should be passed back to ZX81LoadChunk() when loading, positioned just
+   after the chunk header.  ZX81LoadChunk() returns FALSE if the chunk was
+   corrupt.  Once all the chunks are loaded ZX81LoadDone() must be called.
+
+   ZX81CheckChunk() reads a chunk the same way without loading it, so that
+   a snapshot can be checked before any of it is loaded.  The layout is
+   what the machine's would be after the chunks before, so starts from
+   ZX81GetLayout() and is updated from the chunk.
+
+   ZX81LoadSnapshotV1() loads the original V01_DS81 layout in one go.
+*/
+void	ZX81SaveSnapshot(ZX81Machine *zx, FILE *fp);
+int	ZX81LoadChunk(ZX81Machine *zx, FILE *fp, const char *id, long len);
+int	ZX81CheckChunk(ZX81Layout *layout, FILE *fp, const char *id, long len);
+void	ZX81LoadDone(ZX81Machine *zx);
+void	ZX81LoadSnapshotV1(ZX81Machine *zx, FILE *fp);
+
+/* The machine state other than the RAM, so that it can be saved/loaded in
+   memory.  ZX81GetRAM() returns the RAM and sets *len to its length.  If it
+   is changed ZX81SetState() must be called afterwards.
+*/
+typedef struct
+{
+    Z80State		cpu;
+    Z80Byte		matrix[8];
+    int			waitkey;
+    int			started;
+    unsigned		prev_lk1;
+    unsigned		prev_lk2;
+    Z80Val		frame_tstates;
+    int			ula_nmi;
+    int			ula_vsync;
+    int			ula_vsync_end;
+    Z80Byte		ula_lcntr;
+    int			ula_line;
+    Z80Val		ula_hsync;
+} ZX81State;
+
+void	ZX81GetState(ZX81Machine *zx, ZX81State *state);
+void	ZX81SetState(ZX81Machine *zx, const ZX81State *state);
+Z80Byte *ZX81GetRAM(ZX81Machine *zx, Z80Val *len);
+
+/* Checkpoints hold the state of a machine in memory so that it can be
+   forked, eg. to try different inputs from the same point.  The RAM is
+   held in 1K pages that are shared with other checkpoints and the machine
+   for as long as they are unchanged, so a checkpoint costs little more
+   than the pages written since the one before it.
+
+   ZX81Fork() takes a checkpoint, or returns NULL if out of memory.
+   ZX81Restore() puts a machine back to a checkpoint, which can be taken
+   from any machine with the same memory and display configuration, and
+   returns FALSE if the configuration differs.  A checkpoint can be
+   restored on several threads at once, but only freed once none are.
+*/
+typedef struct ZX81Checkpoint ZX81Checkpoint;
+
+ZX81Checkpoint	*ZX81Fork(ZX81Machine *zx);
+int		ZX81Restore(ZX81Machine *zx, const ZX81Checkpoint *cp);
+void		ZX81FreeCheckpoint(ZX81Checkpoint *cp);
+
+/* Returns TRUE if the machine can't get going again by itself, ie. the Z80
+   is running code above the top of RAM or is halted with nothing to wake
+   it.  Used to spot programs that have crashed.
 */
-void	ZX81SaveSnapshot(FILE *fp);
-void	ZX81LoadSnapshot(FILE *fp);
+int	ZX81Crashed(ZX81Machine *zx);
 
 #endif
 
@@ -0,0 +1,567 @@
+/*
+   ds81 - Nintendo DS ZX81 emulator.
+
+   Copyright (C) 2006  Ian Cowburn <ianc@noddybox.co.uk>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+   $Id$
+
+   Keeps the state of a machine once the ROM has booted, so that a reset
+   can skip the RAM test and set up.
+
+   A state is kept for each ROM and memory layout, the ROM being told
+   apart by a CRC of what the CPU sees, so the patches made for the
+   display engine and fast calculator count.  The ROM only sets up the
+   RAM below 0x8000, so that is all that is kept, and RAM above it is left
+   alone by a reset just as on the real machine.
+
+   States are kept in a list that is only ever added to, so the batch
+   runner's threads can share it without locking.  Only the thread that
+   adds a state saves it, and it is written to a temporary file that is
+   renamed into place, so a run loading it never sees it half written.
+*/
+
+#include <nds.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#ifdef __unix__
+#include <unistd.h>
+#endif
+
+#include "bootcache.h"
+#include "zx81.h"
+#include "stream.h"
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+/* ---------------------------------------- PRIVATE DATA AND TYPES
+*/
+#define MAGIC		"DS81BOOT"
+#define VERSION		2
+
+/* Changed whenever a change to the emulation changes the state the ROM
+   boots to, so that states saved by older builds aren't used
+*/
+#define CORE_VERSION	1
+#define ROM_SIZE	0x2000
+#define RAM_START	0x4000
+#define RAM_STOP	0x8000
+
+typedef struct
+{
+    unsigned long	rom_crc;
+    ZX81Layout		layout;
+} Key;
+
+typedef struct Entry
+{
+    struct Entry	*next;
+    Key			key;
+    ZX81State		state;
+    Z80Val		len;
+    Z80Byte		*ram;
+} Entry;
+
+static Entry		*cache;
+static const char	*cache_dir;
+
+
+/* ---------------------------------------- PRIVATE FUNCTIONS
+*/
+static unsigned long CRC(unsigned long crc, const unsigned char *p, long len)
+{
+    int f;
+
+    crc = ~crc;
+
+    while(len--)
+    {
+	crc ^= *p++;
+
+	for(f = 0; f < 8; f++)
+	{
+	    crc = (crc >> 1) ^ (0xedb88320UL & -(crc & 1));
+	}
+    }
+
+    return ~crc & 0xffffffffUL;
+}
+
+
+static void GetKey(ZX81Machine *zx, Key *key)
+{
+    Z80 *z80 = ZX81GetZ80(zx);
+    unsigned char rom[ROM_SIZE];
+    int f;
+
+    for(f = 0; f < ROM_SIZE; f++)
+    {
+	rom[f] = ZX81ReadMem(z80, f);
+    }
+
+    memset(key, 0, sizeof *key);
+    key->rom_crc = CRC(0, rom, ROM_SIZE);
+    ZX81GetLayout(zx, &key->layout);
+}
+
+
+static int SameKey(const Key *a, const Key *b)
+{
+    return a->rom_crc == b->rom_crc &&
+	   a->layout.ram_bot == b->layout.ram_bot &&
+	   a->layout.ram_top == b->layout.ram_top &&
+	   a->layout.ram_len == b->layout.ram_len &&
+	   a->layout.ula_display == b->layout.ula_display;
+}
+
+
+/* Gets where the RAM the ROM sets up sits in the block from ZX81GetRAM(),
+   and how long it is.
+*/
+static Z80Val RAMSpan(const Key *key, Z80Val *offset)
+{
+    Z80Val end = key->layout.ram_bot + key->layout.ram_len;
+
+    if (end > RAM_STOP)
+    {
+	end = RAM_STOP;
+    }
+
+    *offset = RAM_START - key->layout.ram_bot;
+
+    return end - RAM_START;
+}
+
+
+static Entry *First(void)
+{
+#if defined(__GNUC__) && defined(__unix__)
+    return __atomic_load_n(&cache, __ATOMIC_ACQUIRE);
+#else
+    return cache;
+#endif
+}
+
+
+static Entry *FindFrom(Entry *e, const Key *key)
+{
+    for(; e; e = e->next)
+    {
+	if (SameKey(&e->key, key))
+	{
+	    return e;
+	}
+    }
+
+    return NULL;
+}
+
+
+static Entry *Find(const Key *key)
+{
+    return FindFrom(First(), key);
+}
+
+
+/* Adds e to the list, unless another thread has added a state for the same
+   key first, in which case FALSE is returned.
+*/
+static int Publish(Entry *e)
+{
+#if defined(__GNUC__) && defined(__unix__)
+    do
+    {
+	e->next = First();
+
+	if (FindFrom(e->next, &e->key))
+	{
+	    return FALSE;
+	}
+    } while(!__sync_bool_compare_and_swap(&cache, e->next, e));
+#else
+    if (Find(&e->key))
+    {
+	return FALSE;
+    }
+
+    e->next = cache;
+    cache = e;
+#endif
+
+    return TRUE;
+}
+
+
+static Entry *NewEntry(const Key *key)
+{
+    Entry *e;
+    Z80Val offset;
+
+    if (!(e = malloc(sizeof *e)))
+    {
+	return NULL;
+    }
+
+    e->key = *key;
+    e->len = RAMSpan(key, &offset);
+
+    if (!(e->ram = malloc(e->len)))
+    {
+	free(e);
+	return NULL;
+    }
+
+    return e;
+}
+
+
+static void FreeEntry(Entry *e)
+{
+    free(e->ram);
+    free(e);
+}
+
+
+/* Files are named after a CRC of the key, so the name fits in 8.3.  The
+   temporary file a state is written to first has the extension changed
+   and, where there can be other processes saving the same state, the
+   process ID added.
+*/
+static int FileName(char *file, const Key *key, int temp)
+{
+    unsigned char buff[5 * 4];
+    unsigned long v[5];
+    int f;
+
+    if (!cache_dir || strlen(cache_dir) + 13 + 21 > FILENAME_MAX)
+    {
+	return FALSE;
+    }
+
+    v[0] = key->rom_crc;
+    v[1] = key->layout.ram_bot;
+    v[2] = key->layout.ram_top;
+    v[3] = key->layout.ram_len;
+    v[4] = key->layout.ula_display;
+
+    for(f = 0; f < 5 * 4; f++)
+    {
+	buff[f] = v[f / 4] >> (f % 4 * 8);
+    }
+
+    sprintf(file, "%s%8.8lX.%s", cache_dir, CRC(0, buff, sizeof buff),
+	    temp ? "T81" : "B81");
+
+#ifdef __unix__
+    if (temp)
+    {
+	sprintf(file + strlen(file), ".%ld", (long)getpid());
+    }
+#endif
+
+    return TRUE;
+}
+
+
+static void PutKey(FILE *fp, const Key *key)
+{
+    PUT_ULong(fp, key->rom_crc);
+    PUT_ULong(fp, key->layout.ram_bot);
+    PUT_ULong(fp, key->layout.ram_top);
+    PUT_ULong(fp, key->layout.ram_len);
+    PUT_ULong(fp, key->layout.ula_display);
+}
+
+
+/* The state is written a field at a time, as snapshots are, so that the
+   file doesn't depend on how the compiler lays out the structures
+*/
+static void PutState(FILE *fp, const ZX81State *state)
+{
+    const Z80State *cpu = &state->cpu;
+
+    PUT_ULong(fp, cpu->regs.PC);
+    PUT_ULong(fp, cpu->regs.AF.w);
+    PUT_ULong(fp, cpu->regs.BC.w);
+    PUT_ULong(fp, cpu->regs.DE.w);
+    PUT_ULong(fp, cpu->regs.HL.w);
+    PUT_ULong(fp, cpu->regs.AF_);
+    PUT_ULong(fp, cpu->regs.BC_);
+    PUT_ULong(fp, cpu->regs.DE_);
+    PUT_ULong(fp, cpu->regs.HL_);
+    PUT_ULong(fp, cpu->regs.IX.w);
+    PUT_ULong(fp, cpu->regs.IY.w);
+    PUT_ULong(fp, cpu->regs.SP);
+    PUT_Byte(fp, cpu->regs.IFF1);
+    PUT_Byte(fp, cpu->regs.IFF2);
+    PUT_Byte(fp, cpu->regs.IM);
+    PUT_Byte(fp, cpu->regs.I);
+    PUT_Byte(fp, cpu->regs.R);
+
+    PUT_ULong(fp, cpu->cycle);
+    PUT_Long(fp, cpu->halt);
+    PUT_Byte(fp, cpu->shift);
+    PUT_Long(fp, cpu->raise);
+    PUT_Byte(fp, cpu->devbyte);
+    PUT_Long(fp, cpu->nmi);
+    PUT_Long(fp, cpu->last_cb);
+
+    PUT_Block(fp, state->matrix, sizeof state->matrix);
+    PUT_Long(fp, state->waitkey);
+    PUT_Long(fp, state->started);
+    PUT_ULong(fp, state->prev_lk1);
+    PUT_ULong(fp, state->prev_lk2);
+    PUT_ULong(fp, state->frame_tstates);
+
+    PUT_Long(fp, state->ula_nmi);
+    PUT_Long(fp, state->ula_vsync);
+    PUT_Long(fp, state->ula_vsync_end);
+    PUT_Byte(fp, state->ula_lcntr);
+    PUT_Long(fp, state->ula_line);
+    PUT_ULong(fp, state->ula_hsync);
+}
+
+
+static int GetState(FILE *fp, ZX81State *state)
+{
+    Z80State *cpu = &state->cpu;
+
+    memset(state, 0, sizeof *state);
+
+    cpu->regs.PC = GET_ULong(fp);
+    cpu->regs.AF.w = GET_ULong(fp);
+    cpu->regs.BC.w = GET_ULong(fp);
+    cpu->regs.DE.w = GET_ULong(fp);
+    cpu->regs.HL.w = GET_ULong(fp);
+    cpu->regs.AF_ = GET_ULong(fp);
+    cpu->regs.BC_ = GET_ULong(fp);
+    cpu->regs.DE_ = GET_ULong(fp);
+    cpu->regs.HL_ = GET_ULong(fp);
+    cpu->regs.IX.w = GET_ULong(fp);
+    cpu->regs.IY.w = GET_ULong(fp);
+    cpu->regs.SP = GET_ULong(fp);
+    cpu->regs.IFF1 = GET_Byte(fp);
+    cpu->regs.IFF2 = GET_Byte(fp);
+    cpu->regs.IM = GET_Byte(fp);
+    cpu->regs.I = GET_Byte(fp);
+    cpu->regs.R = GET_Byte(fp);
+
+    cpu->cycle = GET_ULong(fp);
+    cpu->halt = GET_Long(fp);
+    cpu->shift = GET_Byte(fp);
+    cpu->raise = GET_Long(fp);
+    cpu->devbyte = GET_Byte(fp);
+    cpu->nmi = GET_Long(fp);
+    cpu->last_cb = GET_Long(fp);
+
+    GET_Block(fp, state->matrix, sizeof state->matrix);
+    state->waitkey = GET_Long(fp);
+    state->started = GET_Long(fp);
+    state->prev_lk1 = GET_ULong(fp);
+    state->prev_lk2 = GET_ULong(fp);
+    state->frame_tstates = GET_ULong(fp);
+
+    state->ula_nmi = GET_Long(fp);
+    state->ula_vsync = GET_Long(fp);
+    state->ula_vsync_end = GET_Long(fp);
+    state->ula_lcntr = GET_Byte(fp);
+    state->ula_line = GET_Long(fp);
+    state->ula_hsync = GET_ULong(fp);
+
+    return !feof(fp) && !ferror(fp);
+}
+
+
+static void Save(const Entry *e)
+{
+    char file[FILENAME_MAX];
+    char temp[FILENAME_MAX];
+    FILE *fp;
+    int ok;
+
+    if (!FileName(file, &e->key, FALSE) || !FileName(temp, &e->key, TRUE) ||
+	!(fp = fopen(temp, "wb")))
+    {
+	return;
+    }
+
+    PUT_Block(fp, MAGIC, 8);
+    PUT_ULong(fp, VERSION);
+    PUT_ULong(fp, CORE_VERSION);
+    PutKey(fp, &e->key);
+    PutState(fp, &e->state);
+    PUT_RLE(fp, e->ram, e->len);
+
+    ok = !ferror(fp);
+
+    if (fclose(fp) != 0 || !ok || rename(temp, file) != 0)
+    {
+	remove(temp);
+    }
+}
+
+
+/* Reads a kept state for key, if there is one
+*/
+static Entry *Load(const Key *key)
+{
+    char file[FILENAME_MAX];
+    char magic[8];
+    FILE *fp;
+    Entry *e;
+    Key file_key;
+    long start;
+    long end;
+    int ok;
+
+    if (!FileName(file, key, FALSE) || !(fp = fopen(file, "rb")))
+    {
+	return NULL;
+    }
+
+    if (!(e = NewEntry(key)))
+    {
+	fclose(fp);
+	return NULL;
+    }
+
+    memset(&file_key, 0, sizeof file_key);
+
+    ok = GET_Block(fp, magic, 8) && memcmp(magic, MAGIC, 8) == 0 &&
+	 GET_ULong(fp) == VERSION && GET_ULong(fp) == CORE_VERSION;
+
+    if (ok)
+    {
+	file_key.rom_crc = GET_ULong(fp);
+	file_key.layout.ram_bot = GET_ULong(fp);
+	file_key.layout.ram_top = GET_ULong(fp);
+	file_key.layout.ram_len = GET_ULong(fp);
+	file_key.layout.ula_display = GET_ULong(fp);
+
+	ok = SameKey(&file_key, key) && GetState(fp, &e->state);
+    }
+
+    if (ok)
+    {
+	start = ftell(fp);
+	fseek(fp, 0, SEEK_END);
+	end = ftell(fp);
+	fseek(fp, start, SEEK_SET);
+
+	ok = GET_RLE(fp, e->ram, e->len, end - start);
+    }
+
+    fclose(fp);
+
+    if (!ok)
+    {
+	FreeEntry(e);
+	return NULL;
+    }
+
+    return e;
+}
+
+
+/* Boots the machine and keeps its state, unless another thread kept one
+   for the same key while this one was booting.
+*/
+static void Boot(ZX81Machine *zx, const Key *key)
+{
+    Entry *e;
+    Z80Val offset;
+    Z80Val len;
+    int frames;
+    int f;
+
+    frames = key->layout.ula_display ? BOOT_ULA_FRAMES : BOOT_FRAMES;
+
+    for(f = 0; f < frames; f++)
+    {
+	ZX81RunFrame(zx);
+    }
+
+    if (!(e = NewEntry(key)))
+    {
+	return;
+    }
+
+    ZX81GetState(zx, &e->state);
+    RAMSpan(key, &offset);
+    memcpy(e->ram, ZX81GetRAM(zx, &len) + offset, e->len);
+
+    if (!Publish(e))
+    {
+	FreeEntry(e);
+	return;
+    }
+
+    Save(e);
+}
+
+
+/* ---------------------------------------- EXPORTED INTERFACES
+*/
+void BOOT_SetDir(const char *dir)
+{
+    cache_dir = dir;
+}
+
+
+int BOOT_Reset(ZX81Machine *zx)
+{
+    Entry *e;
+    Key key;
+    Z80Val offset;
+    Z80Val len;
+
+    ZX81Reset(zx);
+    GetKey(zx, &key);
+
+    if (!(e = Find(&key)))
+    {
+	if ((e = Load(&key)))
+	{
+	    if (!Publish(e))
+	    {
+		FreeEntry(e);
+		e = Find(&key);
+	    }
+	}
+	else
+	{
+	    Boot(zx, &key);
+	    return FALSE;
+	}
+    }
+
+    RAMSpan(&key, &offset);
+    memcpy(ZX81GetRAM(zx, &len) + offset, e->ram, e->len);
+    ZX81SetState(zx, &e->state);
+
+    return TRUE;
+}
+
+
+/* END OF FILE */
@@ -0,0 +1,1620 @@
+/*
+   ds81 - Nintendo DS ZX81 emulator.
+
+   Copyright (C) 2006  Ian Cowburn <ianc@noddybox.co.uk>
+   
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+  
+   $Id$
+
+   Does the ROM's floating point calculator (RST 28h) natively.
+
+   After a RST 28h the ROM reads a stream of literals, each of which calls
+   a routine from a table to work on the 5 byte numbers on the calculator
+   stack.  Here the literals are still read from memory and the routines
+   still looked up in the ROM's table, but the routines are done in C.
+   The arithmetic follows the ROM's code bit for bit, quirks and all, so
+   that the answers, the memory left behind and the errors reported are
+   the same as the ROM's.
+
+   Functions like SIN and LN are written in the ROM as more literals with
+   a little machine code around them, so those are done by following the
+   ROM's literals and doing the bits of machine code here.
+
+   The string literals, PEEK and USR are left to the ROM by starting it
+   where it reads the literal.  The junk the ROM leaves in BC' and below
+   the stack pointer isn't reproduced.
+*/
+#include <nds.h>
+
+#include "calc.h"
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+/* ---------------------------------------- PRIVATE DATA AND TYPES
+*/
+
+/* System variables
+*/
+#define STKEND		0x401c
+#define BREG		0x401e
+#define MEM		0x401f
+
+/* The ROM's table of literal routines and the constants for stk-const
+*/
+#define TABLE		0x1923
+#define CONSTANTS	0x1915
+
+/* Where the ROM is restarted
+*/
+#define RE_ENTRY	0x19a7	/* Reads the next literal		*/
+#define REPORT_4	0x0ed3	/* Out of memory			*/
+#define REPORT_6	0x1880	/* Arithmetic overflow			*/
+
+/* Literal routines done here
+*/
+#define END_CALC	0x002b
+#define E_TO_FP		0x155a
+#define ADDITION	0x1755
+#define SUBTRACT	0x174c
+#define MULTIPLY	0x17c6
+#define DIVISION	0x1882
+#define TRUNCATE	0x18e4
+#define DELETE		0x19e3
+#define FP_CALC_2	0x19e4
+#define DUPLICATE	0x19f6
+#define STK_DATA	0x19fc
+#define GET_MEM		0x1a45
+#define STK_CONST	0x1a51
+#define ST_MEM		0x1a63
+#define EXCHANGE	0x1a72
+#define SERIES		0x1a7f
+#define NEGATE		0x1aa0
+#define ABS		0x1aaa
+#define SGN		0x1aaf
+#define GREATER_0	0x1ace
+#define NOT		0x1ad5
+#define LESS_0		0x1adb
+#define OR		0x1aed
+#define NO_AND_NO	0x1af3
+#define STR_AND_NO	0x1af8
+#define COMPARE		0x1b03
+#define DEC_JR_NZ	0x1c17
+#define JUMP		0x1c23
+#define JUMP_TRUE	0x1c2f
+#define N_MOD_M		0x1c37
+#define INT		0x1c46
+#define EXP		0x1c5b
+#define LN		0x1ca9
+#define GET_ARGT	0x1d18
+#define COS		0x1d3e
+#define SIN		0x1d49
+#define TAN		0x1d6e
+#define ATN		0x1d76
+#define ASN		0x1dc4
+#define ACS		0x1dd4
+#define SQR		0x1ddb
+#define TO_POWER	0x1de2
+
+/* Machine code in the ROM that is done here
+*/
+#define STACK_BC	0x1520	/* PUSH BC, RST 28h, stk-zero		*/
+#define FP_TO_BC	0x15c7	/* RST 28h, end-calc			*/
+#define SERIES_LOOP	0x1a90	/* CALL stk-data, CALL GEN-ENT-2	*/
+#define EXP_SCALE	0x1c8f	/* CALL FP-TO-A and add to the exponent	*/
+#define EXP_ERROR	0x1c99
+#define EXP_RET		0x1ca3
+#define EXP_ZERO	0x1ca4
+#define LN_SCALE	0x1cb4	/* Stack the exponent with STACK-A	*/
+#define LN_INC		0x1cd0	/* INC (HL)				*/
+#define ATN_SMALL	0x1d89
+
+/* Opcodes the functions are made of
+*/
+#define OP_RST_08	0xcf
+#define OP_RST_28	0xef
+#define OP_JP		0xc3
+
+/* How a calculation is started
+*/
+typedef enum
+{
+    CALCULATE,		/* RST 28h				*/
+    GEN_ENT_1,		/* As RST 28h, but not setting HL and DE	*/
+    GEN_ENT_2		/* As GEN-ENT-1, but not setting BREG	*/
+} Entry;
+
+/* The registers the calculator keeps its state in
+*/
+typedef struct
+{
+    Z80		*z80;
+    Z80Word	hl;		/* The last number used			*/
+    Z80Word	de;		/* Usually STKEND			*/
+    Z80Byte	b;		/* Copied to BREG by a RST 28h		*/
+    Z80Word	lit;		/* HL', the next literal		*/
+    Z80Word	sp;		/* SP as the current routine was called	*/
+    Z80Word	error;		/* Where the ROM reports an error	*/
+    Z80Word	error_sp;
+    int		set_iy;		/* STACK-BC sets IY			*/
+    Z80Val	count;		/* Literals run				*/
+} Calc;
+
+
+/* ---------------------------------------- PRIVATE FUNCTIONS
+*/
+static Z80Word	Enter(Calc *c, Z80Word addr, Z80Word sp, Entry entry);
+
+#define PEEK(addr)	Z80Peek(c->z80,(addr))
+#define POKE(addr,val)	Z80Poke(c->z80,(addr),(val))
+
+static Z80Word Peekw(Calc *c, Z80Word addr)
+{
+    return PEEK(addr)|(Z80Word)PEEK(addr+1)<<8;
+}
+
+
+static void Pokew(Calc *c, Z80Word addr, Z80Word val)
+{
+    POKE(addr,val&0xff);
+    POKE(addr+1,val>>8);
+}
+
+
+static void Error(Calc *c, Z80Word addr, Z80Word sp)
+{
+    c->error=addr;
+    c->error_sp=sp;
+}
+
+
+/* TEST-5-SP, called with the stack pointer at sp.  Raises report 4 and
+   returns FALSE if there isn't room for another number.
+*/
+static int Test5(Calc *c, Z80Word sp)
+{
+    Z80Val top;
+    int carry;
+
+    sp-=6;
+    top=(Z80Val)Peekw(c,STKEND)+5;
+
+    if (top<=0xffff)
+    {
+	top+=0x24;
+	carry=top>0xffff;
+
+	if ((top&0xffff)<(Z80Val)sp+carry)
+	{
+	    return TRUE;
+	}
+    }
+
+    Error(c,REPORT_4,sp);
+    return FALSE;
+}
+
+
+/* Sets the number at addr to 1 or 0
+*/
+static void SetResult(Calc *c, Z80Word addr, int one)
+{
+    int f;
+
+    for(f=0;f<5;f++)
+    {
+	POKE(addr+f,0);
+    }
+
+    if (one)
+    {
+	POKE(addr,0x81);
+    }
+}
+
+
+static void Copy(Calc *c, Z80Word from, Z80Word to)
+{
+    int f;
+
+    for(f=0;f<5;f++)
+    {
+	POKE(to+f,PEEK(from+f));
+    }
+}
+
+
+static uint32 Mantissa(Calc *c, Z80Word addr)
+{
+    return (uint32)PEEK(addr+1)<<24|(uint32)PEEK(addr+2)<<16|
+	   (uint32)PEEK(addr+3)<<8|PEEK(addr+4);
+}
+
+
+
+
+/* ---------------------------------------- ARITHMETIC
+*/
+
+/* PREP-ADD.  Turns the number at addr into a 40 bit twos complement
+   number, the first byte holding the sign, and returns its exponent.
+*/
+static Z80Byte PrepAdd(Calc *c, Z80Word addr)
+{
+    Z80Byte e;
+    Z80Byte b;
+    unsigned carry;
+    int f;
+
+    e=PEEK(addr);
+    POKE(addr,0);
+
+    if (!e)
+    {
+	return 0;
+    }
+
+    b=PEEK(addr+1);
+    POKE(addr+1,b|0x80);
+
+    if (b&0x80)
+    {
+	carry=1;
+
+	for(f=4;f>=0;f--)
+	{
+	    carry+=(Z80Byte)~PEEK(addr+f);
+	    POKE(addr+f,carry&0xff);
+	    carry>>=8;
+	}
+    }
+
+    return e;
+}
+
+
+/* PREP-M/D.  Returns FALSE if the number at addr is zero, otherwise XORs
+   its sign into *sign and sets the top bit of its mantissa.
+*/
+static int PrepMD(Calc *c, Z80Word addr, Z80Byte *sign)
+{
+    Z80Byte b;
+
+    if (!PEEK(addr))
+    {
+	return FALSE;
+    }
+
+    b=PEEK(addr+1);
+    *sign^=b;
+    POKE(addr+1,b|0x80);
+
+    return TRUE;
+}
+
+
+/* FETCH-TWO.  Reads the first byte and mantissa of the numbers at first
+   and second, storing a in the second byte of the first as the ROM does.
+*/
+static void FetchTwo(Calc *c, Z80Word first, Z80Word second, Z80Byte a,
+		     Z80Byte *s1, uint32 *m1, Z80Byte *s2, uint32 *m2)
+{
+    *s1=PEEK(first);
+    *m1=Mantissa(c,first);
+    POKE(first+1,a);
+    *s2=PEEK(second);
+    *m2=Mantissa(c,second);
+}
+
+
+/* SHIFT-FP.  Shifts the 40 bit number in s:m right n places, rounding it
+   with ADD-BACK.
+*/
+static void ShiftFP(Z80Byte *s, uint32 *m, Z80Byte n)
+{
+    int out=0;
+
+    if (!n)
+    {
+	return;
+    }
+
+    if (n<0x21)
+    {
+	while(n--)
+	{
+	    out=*m&1;
+	    *m=*m>>1|(uint32)(*s&1)<<31;
+	    *s=*s>>1|(*s&0x80);
+	}
+
+	/* The number is zeroed if rounding carries out of the mantissa
+	*/
+	if (!out || ++*m)
+	{
+	    return;
+	}
+    }
+
+    *s=0;
+    *m=0;
+}
+
+
+/* Writes the mantissa m to the number at addr, keeping the sign that has
+   been left in its second byte.
+*/
+static void Store(Calc *c, Z80Word addr, uint32 m)
+{
+    POKE(addr+1,((m>>24)&0x7f)|(PEEK(addr+1)&0x80));
+    POKE(addr+2,(m>>16)&0xff);
+    POKE(addr+3,(m>>8)&0xff);
+    POKE(addr+4,m&0xff);
+}
+
+
+/* Adds one to the exponent of the number at addr, raising report 6 and
+   returning FALSE if it overflows.
+*/
+static int IncExponent(Calc *c, Z80Word addr)
+{
+    Z80Byte e=PEEK(addr)+1;
+
+    POKE(addr,e);
+
+    if (!e)
+    {
+	Error(c,REPORT_6,c->sp);
+	return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+/* The result is too small.  This leaves the smallest number there is if
+   the top bits of both a and the mantissa are set, otherwise zero.
+*/
+static void Underflow(Calc *c, Z80Word addr, uint32 m, Z80Byte a)
+{
+    a&=m>>24;
+    m=(uint32)a<<24;
+    a=a<<1|a>>7;
+    POKE(addr,a);
+
+    if (!(a&1))
+    {
+	POKE(addr+1,a);
+    }
+
+    Store(c,addr,m);
+}
+
+
+/* Normalises the mantissa m of the number at addr, rounding it with the
+   guard bits in a which are rotated in as it is shifted.
+*/
+static void Normalise(Calc *c, Z80Word addr, uint32 m, Z80Byte a)
+{
+    Z80Byte e;
+    int f;
+
+    for(f=0;f<32;f++)
+    {
+	if (m&0x80000000)
+	{
+	    if ((a&0x80) && !++m)
+	    {
+		m=0x80000000;
+
+		if (!IncExponent(c,addr))
+		{
+		    return;
+		}
+	    }
+
+	    Store(c,addr,m);
+	    return;
+	}
+
+	a=a<<1|a>>7;
+	m=m<<1|(a&1);
+	e=PEEK(addr)-1;
+	POKE(addr,e);
+
+	if (!e)
+	{
+	    Underflow(c,addr,m,0x80);
+	    return;
+	}
+    }
+
+    Underflow(c,addr,m,0);
+}
+
+
+/* Sets the exponent of a product or quotient and normalises it, as the
+   ROM does from $1810.  a, carry and sign are the register and flags left
+   by working out the new exponent.
+*/
+static void Scale(Calc *c, Z80Word addr, Z80Byte a, int carry, int sign,
+		  uint32 m, Z80Byte guard)
+{
+    a^=0x80;
+
+    if (sign)
+    {
+	if (!carry)
+	{
+	    Error(c,REPORT_6,c->sp);
+	    return;
+	}
+
+	carry=FALSE;
+    }
+
+    a++;
+
+    if (!a && !carry && (m&0x80000000))
+    {
+	Error(c,REPORT_6,c->sp);
+	return;
+    }
+
+    POKE(addr,a);
+
+    if (carry)
+    {
+	Underflow(c,addr,m,a ? 0 : 0x80);
+    }
+    else
+    {
+	Normalise(c,addr,m,guard);
+    }
+}
+
+
+static void Addition(Calc *c)
+{
+    Z80Word big;
+    Z80Word small;
+    Z80Byte e1;
+    Z80Byte e2;
+    Z80Byte s1;
+    Z80Byte s2;
+    Z80Byte s;
+    uint32 m1;
+    uint32 m2;
+    uint32 lo;
+    uint32 hi;
+    uint32 m;
+
+    e1=PrepAdd(c,c->hl);
+    e2=PrepAdd(c,c->de);
+
+    if (e2<e1)
+    {
+	big=c->hl;
+	small=c->de;
+    }
+    else
+    {
+	big=c->de;
+	small=c->hl;
+	s=e1;
+	e1=e2;
+	e2=s;
+    }
+
+    FetchTwo(c,big,small,e1-e2,&s1,&m1,&s2,&m2);
+    ShiftFP(&s2,&m2,e1-e2);
+
+    POKE(c->hl,e1);
+
+    lo=(m1&0xffff)+(m2&0xffff);
+    hi=(m1>>16)+(m2>>16)+(lo>>16);
+    s=s1+s2+(hi>>16);
+    m=hi<<16|(lo&0xffff);
+
+    /* The sum has overflowed into the sign byte
+    */
+    if (((s>>1)^s)&1)
+    {
+	ShiftFP(&s,&m,1);
+
+	if (!IncExponent(c,c->hl))
+	{
+	    return;
+	}
+    }
+
+    POKE(c->hl+1,s&0x80);
+
+    if (s&0x80)
+    {
+	if (m)
+	{
+	    m=-m;
+	}
+	else
+	{
+	    m=0x80000000;
+
+	    if (!IncExponent(c,c->hl))
+	    {
+		return;
+	    }
+	}
+    }
+
+    Normalise(c,c->hl,m,0);
+}
+
+
+static void Subtract(Calc *c)
+{
+    if (!PEEK(c->de))
+    {
+	return;
+    }
+
+    POKE(c->de+1,PEEK(c->de+1)^0x80);
+    Addition(c);
+}
+
+
+static void Multiply(Calc *c)
+{
+    Z80Byte sign=0;
+    Z80Byte e1;
+    Z80Byte e2;
+    uint32 m1;
+    uint32 m2;
+    uint32 p;
+    uint32 q;
+    uint32 sum;
+    int carry;
+    int out;
+    int f;
+
+    if (!PrepMD(c,c->hl,&sign))
+    {
+	return;
+    }
+
+    if (!PrepMD(c,c->de,&sign))
+    {
+	Underflow(c,c->hl,0,0);
+	return;
+    }
+
+    FetchTwo(c,c->hl,c->de,sign,&e1,&m1,&e2,&m2);
+
+    /* Shift and add, the product going into p and the bits shifted out of
+       it into q
+    */
+    p=0;
+    q=m1;
+    carry=FALSE;
+
+    for(f=0;f<33;f++)
+    {
+	if (f)
+	{
+	    if (carry)
+	    {
+		sum=p+m2;
+		carry=sum<p;
+		p=sum;
+	    }
+
+	    out=p&1;
+	    p=p>>1|(uint32)carry<<31;
+	    carry=out;
+	}
+
+	out=q&1;
+	q=q>>1|(uint32)carry<<31;
+	carry=out;
+    }
+
+    sum=e1+e2;
+    carry=sum>0xff && (sum&0xff);
+    sum=(sum-1)&0xff;
+
+    Scale(c,c->hl,sum,!carry,sum&0x80,p,q>>24);
+}
+
+
+static void Division(Calc *c)
+{
+    Z80Byte sign=0;
+    Z80Byte e1;
+    Z80Byte e2;
+    Z80Byte guard;
+    uint32 r;
+    uint32 d;
+    uint32 q=0;
+    int last[2];
+    int carry;
+    int shift;
+    int top=FALSE;
+    int b;
+
+    if (!PrepMD(c,c->de,&sign))
+    {
+	Error(c,REPORT_6,c->sp);
+	return;
+    }
+
+    if (!PrepMD(c,c->hl,&sign))
+    {
+	return;
+    }
+
+    FetchTwo(c,c->hl,c->de,sign,&e1,&r,&e2,&d);
+
+    /* Long division with 34 trial subtractions, the last two of which are
+       kept as guard bits.  The last is made without shifting, and with the
+       one before it as a borrow that isn't put back if it fails.
+    */
+    carry=FALSE;
+    shift=FALSE;
+    b=-33;
+
+    for(;;)
+    {
+	if (shift)
+	{
+	    q=q<<1|carry;
+	    top=r>>31;
+	    r<<=1;
+	    carry=FALSE;
+	}
+
+	if (shift && top)
+	{
+	    r-=d;
+	    carry=TRUE;
+	}
+	else if (carry ? r>d : r>=d)
+	{
+	    r-=d+carry;
+	    carry=TRUE;
+	}
+	else
+	{
+	    r-=carry;
+	    carry=FALSE;
+	}
+
+	if (++b<0)
+	{
+	    shift=TRUE;
+	    continue;
+	}
+
+	last[b]=carry;
+
+	if (b)
+	{
+	    break;
+	}
+
+	shift=FALSE;
+    }
+
+    guard=(q>>26)|last[1]<<6|last[0]<<7;
+
+    Scale(c,c->hl,e1-e2,e1<e2,(Z80Byte)(e1-e2)&0x80,q,guard);
+}
+
+
+static void Truncate(Calc *c)
+{
+    Z80Byte a=PEEK(c->hl);
+    Z80Word addr;
+    int f;
+
+    if (a<0x81)
+    {
+	POKE(c->hl,0);
+	a=0x20;
+    }
+    else
+    {
+	a-=0xa0;
+
+	if (!(a&0x80))
+	{
+	    return;
+	}
+
+	a=-a;
+    }
+
+    /* Clear the fraction, working back from the end of the number
+    */
+    addr=c->de-1;
+
+    for(f=a>>3;f;f--)
+    {
+	POKE(addr--,0);
+    }
+
+    if (a&7)
+    {
+	POKE(addr,PEEK(addr)&(Z80Byte)(0xff<<(a&7)));
+    }
+}
+
+
+/* ---------------------------------------- STACK AND LOGIC
+*/
+static void Exchange(Calc *c)
+{
+    Z80Byte b;
+    int f;
+
+    for(f=0;f<5;f++)
+    {
+	b=PEEK(c->hl+f);
+	POKE(c->hl+f,PEEK(c->de+f));
+	POKE(c->de+f,b);
+    }
+
+    c->hl+=5;
+    c->de+=5;
+}
+
+
+/* Copies the number at HL to DE, as the duplicate routine called with the
+   stack pointer at sp.
+*/
+static int Duplicate(Calc *c, Z80Word sp)
+{
+    if (!Test5(c,sp-2))
+    {
+	return FALSE;
+    }
+
+    Copy(c,c->hl,c->de);
+    c->hl+=5;
+    c->de+=5;
+
+    return TRUE;
+}
+
+
+/* Stacks a number from the literals to DE, as STK-DATA called at $19FE
+   with the stack pointer at sp.
+*/
+static int StkData(Calc *c, Z80Word sp)
+{
+    Z80Byte e;
+    int len;
+    int f;
+
+    if (!Test5(c,sp-2))
+    {
+	return FALSE;
+    }
+
+    e=PEEK(c->lit);
+    len=(e>>6)+1;
+    e&=0x3f;
+
+    if (!e)
+    {
+	e=PEEK(++c->lit);
+    }
+
+    POKE(c->de++,e+0x50);
+    c->lit++;
+
+    for(f=0;f<4;f++)
+    {
+	POKE(c->de++,f<len ? PEEK(c->lit++) : 0);
+    }
+
+    return TRUE;
+}
+
+
+static int StkConst(Calc *c, Z80Byte a, Z80Word sp)
+{
+    Z80Word lit=c->lit;
+    Z80Word de;
+
+    c->hl=c->de;
+    c->lit=CONSTANTS;
+
+    /* The ROM skips to the constant wanted by stacking the ones before it
+       at address zero
+    */
+    while(a--)
+    {
+	de=c->de;
+	c->de=0;
+
+	if (!StkData(c,sp-10))
+	{
+	    return FALSE;
+	}
+
+	c->de=de;
+    }
+
+    if (!StkData(c,sp-4))
+    {
+	return FALSE;
+    }
+
+    c->lit=lit;
+
+    return TRUE;
+}
+
+
+static Z80Word MemSlot(Calc *c, Z80Byte a)
+{
+    return Peekw(c,MEM)+(Z80Byte)(a*5);
+}
+
+
+static int StMem(Calc *c, Z80Byte a, Z80Word sp)
+{
+    if (!Test5(c,sp-6))
+    {
+	return FALSE;
+    }
+
+    Copy(c,c->hl,MemSlot(c,a));
+    c->de=c->hl+5;
+
+    return TRUE;
+}
+
+
+static int GetMem(Calc *c, Z80Byte a, Z80Word sp)
+{
+    if (!Test5(c,sp-6))
+    {
+	return FALSE;
+    }
+
+    Copy(c,MemSlot(c,a),c->de);
+    c->hl=c->de;
+    c->de+=5;
+
+    return TRUE;
+}
+
+
+static void Negate(Calc *c)
+{
+    if (PEEK(c->hl))
+    {
+	POKE(c->hl+1,PEEK(c->hl+1)^0x80);
+    }
+}
+
+
+static void Sgn(Calc *c)
+{
+    Z80Byte a=PEEK(c->hl+1);
+
+    if (PEEK(c->hl))
+    {
+	SetResult(c,c->hl,TRUE);
+    }
+
+    POKE(c->hl+1,PEEK(c->hl+1)>>1|(a&0x80));
+}
+
+
+static void Not(Calc *c)
+{
+    SetResult(c,c->hl,!PEEK(c->hl));
+}
+
+
+static void GreaterZero(Calc *c)
+{
+    if (PEEK(c->hl))
+    {
+	SetResult(c,c->hl,!(PEEK(c->hl+1)&0x80));
+    }
+}
+
+
+/* Works out the flags the compare routine uses from BREG, as the ROM does.
+   Bit 2 of the result is set for strings, and *swap is set if the numbers
+   are swapped first.
+*/
+static Z80Byte CompareFlags(Z80Byte b, int *swap)
+{
+    Z80Byte a=b-8;
+
+    if (!(a&4))
+    {
+	a--;
+    }
+
+    *swap=a&1;
+
+    return a>>1|a<<7;
+}
+
+
+/* Compares two numbers, leaving 1 or 0.  The strings are left to the ROM.
+*/
+static void Compare(Calc *c)
+{
+    Z80Word hl;
+    Z80Byte a;
+    int swap;
+    int carry;
+
+    a=CompareFlags(c->b,&swap);
+
+    if (swap)
+    {
+	hl=c->hl;
+	Exchange(c);
+	c->de=c->hl;
+	c->hl=hl;
+    }
+
+    carry=a&1;
+    a=a>>1|a<<7;
+
+    Subtract(c);
+
+    if (c->error)
+    {
+	return;
+    }
+
+    if (carry)
+    {
+	Not(c);
+    }
+
+    GreaterZero(c);
+
+    if (!(a&1))
+    {
+	Not(c);
+    }
+}
+
+
+static void Jump(Calc *c)
+{
+    c->lit+=(signed char)PEEK(c->lit);
+}
+
+
+/* ---------------------------------------- THE CALCULATOR
+*/
+
+/* Looks up the routine for a literal as SCAN-ENT does, returning its address
+   and the value it is passed in A.
+*/
+static Z80Word Lookup(Calc *c, Z80Byte lit, Z80Byte *a)
+{
+    if (lit&0x80)
+    {
+	*a=lit&0x1f;
+	return Peekw(c,TABLE+0x72+((lit&0x60)>>4));
+    }
+
+    *a=lit*2;
+    return Peekw(c,TABLE+lit*2);
+}
+
+
+/* Returns TRUE if the literal can be done here
+*/
+static int Supported(Calc *c, Z80Byte lit)
+{
+    Z80Byte a;
+    int swap;
+
+    switch(Lookup(c,lit,&a))
+    {
+	case COMPARE:
+	    return !(CompareFlags(PEEK(BREG),&swap)&4);
+
+	case FP_CALC_2:
+	    return Lookup(c,PEEK(BREG),&a)!=FP_CALC_2 &&
+		   Supported(c,PEEK(BREG));
+
+	case END_CALC:
+	case E_TO_FP:
+	case ADDITION:
+	case SUBTRACT:
+	case MULTIPLY:
+	case DIVISION:
+	case TRUNCATE:
+	case DELETE:
+	case DUPLICATE:
+	case STK_DATA:
+	case GET_MEM:
+	case STK_CONST:
+	case ST_MEM:
+	case EXCHANGE:
+	case SERIES:
+	case NEGATE:
+	case ABS:
+	case SGN:
+	case GREATER_0:
+	case NOT:
+	case LESS_0:
+	case OR:
+	case NO_AND_NO:
+	case STR_AND_NO:
+	case DEC_JR_NZ:
+	case JUMP:
+	case JUMP_TRUE:
+	case N_MOD_M:
+	case INT:
+	case EXP:
+	case LN:
+	case GET_ARGT:
+	case COS:
+	case SIN:
+	case TAN:
+	case ATN:
+	case ASN:
+	case ACS:
+	case SQR:
+	case TO_POWER:
+	    return TRUE;
+
+	default:
+	    return FALSE;
+    }
+}
+
+
+/* FP-TO-BC, called with the stack pointer at sp.  Takes the number off the
+   top of the stack and rounds it to a 16 bit value, returning FALSE if it
+   is too big.
+*/
+static int FpToBC(Calc *c, Z80Word sp, Z80Word *bc, int *positive)
+{
+    Z80Word addr;
+    Z80Word v=0;
+    Z80Byte rnd;
+    Z80Byte e;
+    int ok=TRUE;
+    int out;
+    int n;
+
+    addr=Peekw(c,STKEND)-5;
+    Pokew(c,STKEND,addr);
+    e=PEEK(addr);
+    *positive=TRUE;
+
+    if (e)
+    {
+	*positive=!(PEEK(addr+1)&0x80);
+	v=(PEEK(addr+1)|0x80)<<8|PEEK(addr+2);
+	rnd=PEEK(addr+3);
+
+	if (e>=0x91)
+	{
+	    ok=FALSE;
+	}
+	else
+	{
+	    n=0x90-e;
+
+	    if (n>=8)
+	    {
+		rnd=v&0xff;
+		v>>=8;
+		n-=8;
+	    }
+
+	    out=rnd>>7;
+
+	    while(n--)
+	    {
+		out=v&1;
+		v>>=1;
+	    }
+
+	    if (out && !++v)
+	    {
+		ok=FALSE;
+	    }
+	}
+    }
+
+    c->b=v>>8;
+    Enter(c,FP_TO_BC+1,sp-6,CALCULATE);
+    c->b=v>>8;
+    *bc=v;
+
+    return ok;
+}
+
+
+/* FP-TO-A, called with the stack pointer at sp
+*/
+static int FpToA(Calc *c, Z80Word sp, Z80Byte *a, int *positive)
+{
+    Z80Word bc;
+    int ok;
+
+    ok=FpToBC(c,sp-2,&bc,positive) && !(bc>>8);
+    *a=bc&0xff;
+
+    return ok;
+}
+
+
+/* STACK-BC, called with the stack pointer at sp
+*/
+static void StackBC(Calc *c, Z80Word bc, Z80Word sp)
+{
+    Z80Byte hi=bc>>8;
+    Z80Byte lo=bc&0xff;
+    Z80Word addr;
+    int carry;
+
+    c->set_iy=TRUE;
+    c->b=hi;
+    Enter(c,STACK_BC+6,sp-4,CALCULATE);
+
+    if (c->error)
+    {
+	return;
+    }
+
+    addr=c->hl;
+    POKE(addr,0x91);
+
+    if (!hi)
+    {
+	POKE(addr,0);
+
+	if (!lo)
+	{
+	    c->b=0;
+	    return;
+	}
+
+	hi=lo;
+	lo=0;
+	POKE(addr,0x89);
+    }
+
+    do
+    {
+	POKE(addr,PEEK(addr)-1);
+	carry=hi>>7;
+	hi=hi<<1|lo>>7;
+	lo<<=1;
+    } while(!carry);
+
+    lo=lo>>1|hi<<7;
+    hi>>=1;
+
+    POKE(addr+1,hi);
+    POKE(addr+2,lo);
+    c->b=hi;
+}
+
+
+/* Runs a routine written as machine code around more literals, called with
+   the stack pointer at sp.  The few bits of machine code are done here
+   by address, and the rest is just RST 28h, JP, RET or an error.
+*/
+static void Code(Calc *c, Z80Word addr, Z80Byte a, Z80Word sp)
+{
+    Z80Byte n;
+    Z80Byte e;
+    int positive;
+    int ok;
+
+    while(!c->error)
+    {
+	switch(addr)
+	{
+	    case SERIES:
+		c->b=a;
+		addr=Enter(c,SERIES+4,sp-2,GEN_ENT_1);
+		break;
+
+	    case SERIES_LOOP:
+		c->hl=c->de;
+
+		if (StkData(c,sp-2))
+		{
+		    addr=Enter(c,SERIES_LOOP+6,sp-2,GEN_ENT_2);
+		}
+		break;
+
+	    case EXP_SCALE:
+		ok=FpToA(c,sp-2,&n,&positive);
+		e=PEEK(c->hl);
+
+		if (positive)
+		{
+		    if (!ok || n+e>0xff)
+		    {
+			addr=EXP_ERROR;
+			break;
+		    }
+
+		    e+=n;
+		}
+		else
+		{
+		    if (!ok || n>=e)
+		    {
+			addr=EXP_ZERO;
+			break;
+		    }
+
+		    e-=n;
+		}
+
+		POKE(c->hl,e);
+		addr=EXP_RET;
+		break;
+
+	    case LN_SCALE:
+		n=PEEK(c->hl);
+		POKE(c->hl,0x80);
+		StackBC(c,n,sp-2);
+		addr=LN_SCALE+6;
+		break;
+
+	    case LN_INC:
+		POKE(c->hl,PEEK(c->hl)+1);
+		addr++;
+		break;
+
+	    case ATN:
+		addr=PEEK(c->hl)<0x81 ? ATN_SMALL : ATN+5;
+		break;
+
+	    default:
+		switch(PEEK(addr))
+		{
+		    case OP_RST_28:
+			addr=Enter(c,addr+1,sp-2,CALCULATE);
+			break;
+
+		    case OP_JP:
+			addr=Peekw(c,addr+1);
+			break;
+
+		    case OP_RST_08:
+			Error(c,addr,sp);
+			break;
+
+		    default:
+			return;
+		}
+		break;
+	}
+    }
+}
+
+
+/* Runs the routine at addr, called with the stack pointer at sp
+*/
+static void Routine(Calc *c, Z80Word addr, Z80Byte a, Z80Word sp)
+{
+    c->sp=sp;
+
+    switch(addr)
+    {
+	case JUMP_TRUE:
+	    if (PEEK(c->de))
+	    {
+		Jump(c);
+	    }
+	    else
+	    {
+		c->lit++;
+	    }
+	    break;
+
+	case DEC_JR_NZ:
+	    POKE(BREG,PEEK(BREG)-1);
+
+	    if (PEEK(BREG))
+	    {
+		Jump(c);
+	    }
+	    else
+	    {
+		c->lit++;
+	    }
+	    break;
+
+	case JUMP:
+	    Jump(c);
+	    break;
+
+	case DELETE:
+	    break;
+
+	case EXCHANGE:
+	    Exchange(c);
+	    break;
+
+	case DUPLICATE:
+	    Duplicate(c,sp);
+	    break;
+
+	case STK_DATA:
+	    c->hl=c->de;
+	    StkData(c,sp);
+	    break;
+
+	case STK_CONST:
+	    StkConst(c,a,sp);
+	    break;
+
+	case ST_MEM:
+	    StMem(c,a,sp);
+	    break;
+
+	case GET_MEM:
+	    GetMem(c,a,sp);
+	    break;
+
+	case ADDITION:
+	    Addition(c);
+	    break;
+
+	case SUBTRACT:
+	    Subtract(c);
+	    break;
+
+	case MULTIPLY:
+	    Multiply(c);
+	    break;
+
+	case DIVISION:
+	    Division(c);
+	    break;
+
+	case TRUNCATE:
+	    Truncate(c);
+	    break;
+
+	case COMPARE:
+	    Compare(c);
+	    break;
+
+	case NEGATE:
+	    Negate(c);
+	    break;
+
+	case ABS:
+	    POKE(c->hl+1,PEEK(c->hl+1)&0x7f);
+	    break;
+
+	case SGN:
+	    Sgn(c);
+	    break;
+
+	case NOT:
+	    Not(c);
+	    break;
+
+	case LESS_0:
+	    SetResult(c,c->hl,PEEK(c->hl+1)&0x80);
+	    break;
+
+	case GREATER_0:
+	    GreaterZero(c);
+	    break;
+
+	case OR:
+	    if (PEEK(c->de))
+	    {
+		SetResult(c,c->hl,TRUE);
+	    }
+	    break;
+
+	case NO_AND_NO:
+	    if (!PEEK(c->de))
+	    {
+		SetResult(c,c->hl,FALSE);
+	    }
+	    break;
+
+	case STR_AND_NO:
+	    if (!PEEK(c->de))
+	    {
+		POKE(c->de-1,0);
+		POKE(c->de-2,0);
+	    }
+	    break;
+
+	default:
+	    Code(c,addr,a,sp);
+	    break;
+    }
+}
+
+
+/* Runs a literal as SCAN-ENT does, the stack pointer being at sp before the
+   routine is called.  Returns FALSE at end-calc or an error.
+*/
+static int Literal(Calc *c, Z80Byte lit, Z80Word sp)
+{
+    Z80Word addr;
+    Z80Byte a;
+
+    if (!(lit&0x80) && lit<0x18)
+    {
+	c->de=c->hl;
+	c->hl-=5;
+    }
+
+    addr=Lookup(c,lit,&a);
+    c->b=PEEK(BREG);
+    c->count++;
+
+    switch(addr)
+    {
+	case END_CALC:
+	    return FALSE;
+
+	case FP_CALC_2:
+	    return Literal(c,PEEK(BREG),sp);
+
+	default:
+	    Routine(c,addr,a,sp-2);
+	    return !c->error;
+    }
+}
+
+
+/* Runs literals from RE-ENTRY until end-calc, the stack pointer being at sp
+   as the routines are looked up.  Returns FALSE on an error, or if this is
+   the top level and the next literal is left to the ROM.
+*/
+static int Calculate(Calc *c, Z80Word sp, int top)
+{
+    Z80Byte lit;
+
+    do
+    {
+	Pokew(c,STKEND,c->de);
+	lit=PEEK(c->lit);
+
+	if (top && !Supported(c,lit))
+	{
+	    return FALSE;
+	}
+
+	c->lit++;
+    } while(Literal(c,lit,sp));
+
+    return !c->error;
+}
+
+
+/* Starts a calculation running the literals at addr, as a call to one of
+   the entry points with the stack pointer at sp.  Returns the address after
+   the end-calc.
+*/
+static Z80Word Enter(Calc *c, Z80Word addr, Z80Word sp, Entry entry)
+{
+    Z80Word lit=c->lit;
+
+    if (entry==CALCULATE)
+    {
+	c->de=Peekw(c,STKEND);
+	c->hl=c->de-5;
+    }
+
+    if (entry!=GEN_ENT_2)
+    {
+	POKE(BREG,c->b);
+    }
+
+    c->lit=addr;
+    Calculate(c,sp,FALSE);
+    addr=c->lit;
+    c->lit=lit;
+    c->b=PEEK(BREG);
+
+    return addr;
+}
+
+
+/* ---------------------------------------- PUBLIC INTERFACES
+*/
+void CALC_Run(Z80 *z80)
+{
+    Calc calc={0};
+    Calc *c=&calc;
+    Z80Word sp;
+    int done;
+
+    c->z80=z80;
+    sp=z80->SP;
+
+    c->lit=Peekw(c,sp);
+    c->b=z80->BC.w>>8;
+    c->de=Peekw(c,STKEND);
+    c->hl=c->de-5;
+    POKE(BREG,c->b);
+
+    done=Calculate(c,sp,TRUE);
+
+    Z80ResetCycles(z80,Z80Cycles(z80)+c->count*CALC_COST);
+
+    if (c->error)
+    {
+	/* The ROM reports errors with the saved HL' still on the stack
+	*/
+	Pokew(c,sp,z80->HL_);
+	z80->HL_=c->lit;
+	z80->PC=c->error;
+	z80->SP=c->error_sp;
+    }
+    else if (done)
+    {
+	/* As end-calc leaves things, having popped RE-ENTRY into AF.  BC is
+	   loaded from STKEND and BREG as each routine is looked up.
+	*/
+	Pokew(c,sp,c->lit);
+	z80->SP=sp+2;
+	z80->PC=c->lit;
+	z80->AF.w=RE_ENTRY;
+	z80->BC.w=Peekw(c,STKEND+1);
+	z80->DE.w=c->de;
+	z80->HL.w=c->hl;
+	z80->DE_=END_CALC;
+    }
+    else
+    {
+	/* Let the ROM carry on from RE-ENTRY
+	*/
+	Pokew(c,sp,z80->HL_);
+	z80->HL_=c->lit;
+	z80->PC=RE_ENTRY;
+	z80->DE.w=c->de;
+	z80->HL.w=c->hl;
+    }
+
+    if (c->set_iy)
+    {
+	z80->IY.w=0x4000;
+    }
+}
+
+
+/* END OF FILE */
@@ -22,6 +22,7 @@
 
 #include <nds.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "config.h"
@@ -36,7 +37,31 @@ const char *conf_entry[DS81_NUM_CONFIG_ITEMS]=
     "average_touchscreen",
     "static_ram_at_0x2000",
     "allow_tape_save",
-    "load_default_snapshot"
+    "load_default_snapshot",
+    "ula_display",
+    "rewind",
+    "fast_calculator",
+    "ram_pack",
+    "turbo",
+    "turbo_speed"
+};
+
+static const char *ram_pack_desc[DS81_NUM_RAM_PACKS]=
+{
+    "1K RAM",
+    "2K RAM",
+    "16K RAM PACK",
+    "32K RAM PACK",
+    "48K RAM PACK",
+    "56K RAM PACK"
+};
+
+static const char *turbo_speed_desc[DS81_NUM_TURBO_SPEEDS]=
+{
+    "TURBO SPEED 2X",
+    "TURBO SPEED 4X",
+    "TURBO SPEED 8X",
+    "TURBO SPEED UNLIMITED"
 };
 
 
@@ -48,7 +73,13 @@ int	DS81_Config[DS81_NUM_CONFIG_ITEMS]=
     FALSE,
     FALSE,
     FALSE,
-    FALSE
+    FALSE,
+    FALSE,
+    TRUE,
+    FALSE,
+    DS81_RAM_16K,
+    FALSE,
+    DS81_TURBO_4X
 };
 
 
@@ -79,7 +110,12 @@ int LoadConfig(void)
 		    if (strncmp(line, conf_entry[f],
 		    		strlen(conf_entry[f])) == 0)
 		    {
-		    	DS81_Config[f] = (*(p+1) == '1');
+			int v = atoi(p+1);
+
+			if (v>=0 && v<ConfigChoices(f))
+			{
+			    DS81_Config[f] = v;
+			}
 		    }
 		}
 		
@@ -138,8 +174,42 @@ const char *ConfigDesc(DS81_ConfigItem item)
 	case DS81_ALLOW_TAPE_SAVE:
 	    return "ALLOW TAPE SAVING";
 
+	case DS81_ULA_DISPLAY:
+	    return "ACCURATE DISPLAY";
+
+	case DS81_REWIND:
+	    return "REWIND BUFFER";
+
+	case DS81_FAST_CALC:
+	    return "FAST CALCULATOR";
+
+	case DS81_RAM_PACK:
+	    return ram_pack_desc[DS81_Config[DS81_RAM_PACK]];
+
+	case DS81_TURBO:
+	    return "TURBO MODE";
+
+	case DS81_TURBO_SPEED:
+	    return turbo_speed_desc[DS81_Config[DS81_TURBO_SPEED]];
+
     	default:
 	    return "UNKNOWN";
     }
 }
 
+
+int ConfigChoices(DS81_ConfigItem item)
+{
+    switch(item)
+    {
+	case DS81_RAM_PACK:
+	    return DS81_NUM_RAM_PACKS;
+
+	case DS81_TURBO_SPEED:
+	    return DS81_NUM_TURBO_SPEEDS;
+
+    	default:
+	    return 2;
+    }
+}
+
@@ -350,6 +350,10 @@ void GUI_Alert(int fatal, const char *text)
 }
 
 
+/* Where each config item goes, spaced so they all fit above the help
+*/
+#define CONFIG_Y(n)	(6+(n)*12)
+
 void GUI_Config(void)
 {
     int sel;
@@ -364,7 +368,7 @@ void GUI_Config(void)
     FB_Clear();
 
     FB_Centre("Up/Down to select",140,COL_YELLOW,COL_TRANSPARENT);
-    FB_Centre("A to toggle",150,COL_YELLOW,COL_TRANSPARENT);
+    FB_Centre("A to toggle or change",150,COL_YELLOW,COL_TRANSPARENT);
     FB_Centre("Or use touchscreen",160,COL_YELLOW,COL_TRANSPARENT);
     FB_Centre("START to finish",170,COL_YELLOW,COL_TRANSPARENT);
 
@@ -372,31 +376,34 @@ void GUI_Config(void)
     FB_Centre("SELECT to finish and save",180,COL_YELLOW,COL_TRANSPARENT);
 #endif
 
-    for(f=0;f<DS81_NUM_CONFIG_ITEMS;f++)
-    {
-	FB_Print(ConfigDesc(f),14,20+f*14,COL_WHITE,COL_TRANSPARENT);
-    }
-
     while(!done)
     {
 	uint32 key=0;
 
+	/* Items that aren't just on or off show their setting instead
+	*/
 	for(f=0;f<DS81_NUM_CONFIG_ITEMS;f++)
 	{
-	    FB_FillBox(2,20+f*14-1,10,10,
-			DS81_Config[f] ? COL_WHITE : COL_BLACK);
+	    FB_FillBox(14,CONFIG_Y(f)-1,SCREEN_WIDTH-16,10,COL_BLACK);
+	    FB_Print(ConfigDesc(f),14,CONFIG_Y(f),COL_WHITE,COL_TRANSPARENT);
+
+	    if (ConfigChoices(f)==2)
+	    {
+		FB_FillBox(2,CONFIG_Y(f)-1,10,10,
+			    DS81_Config[f] ? COL_WHITE : COL_BLACK);
 
-	    FB_Box(2,20+f*14-1,10,10,COL_GREY);
+		FB_Box(2,CONFIG_Y(f)-1,10,10,COL_GREY);
+	    }
 	}
 
-	FB_Box(0,20+sel*14-3,SCREEN_WIDTH-1,14,COL_GUISELECT);
+	FB_Box(0,CONFIG_Y(sel)-2,SCREEN_WIDTH-1,12,COL_GUISELECT);
 
 	do
 	{
 	    swiWaitForVBlank();
 	} while(!(key=keysDownRepeat()));
 
-	FB_Box(0,20+sel*14-3,SCREEN_WIDTH-1,14,COL_BLACK);
+	FB_Box(0,CONFIG_Y(sel)-2,SCREEN_WIDTH-1,12,COL_BLACK);
 
 	if (key & KEY_START)
 	{
@@ -411,7 +418,7 @@ void GUI_Config(void)
 #endif
 	else if (key & KEY_A)
 	{
-	    DS81_Config[sel] = !DS81_Config[sel];
+	    DS81_Config[sel] = (DS81_Config[sel]+1) % ConfigChoices(sel);
 	}
 	else if ((key & KEY_UP) && sel)
 	{
@@ -428,12 +435,12 @@ void GUI_Config(void)
 
 	    touchRead(&tp);
 
-	    nsel = (tp.py-18)/14;
+	    nsel = (tp.py-CONFIG_Y(0)+2)/12;
 
 	    if (nsel>=0 && nsel<DS81_NUM_CONFIG_ITEMS)
 	    {
 	    	sel = nsel;
-		DS81_Config[sel] = !DS81_Config[sel];
+		DS81_Config[sel] = (DS81_Config[sel]+1) % ConfigChoices(sel);
 	    }
 	}
     }
@@ -720,7 +727,8 @@ int GUI_FileSelect(char pwd[], char selected_file[], const char *filter)
 }
 
 
-int GUI_InputName(const char *prompt, const char *ext, char name[], int maxlen)
+int GUI_InputName(ZX81Machine *zx, const char *prompt, const char *ext,
+		  char name[], int maxlen)
 {
     struct
     {
@@ -774,7 +782,7 @@ int GUI_InputName(const char *prompt, const char *ext, char name[], int maxlen)
     int update = TRUE;
 
     SK_DisplayKeyboard();
-    ZX81SuspendDisplay();
+    ZX81SuspendDisplay(zx);
 
     name[0] = 0;
 
@@ -789,7 +797,7 @@ int GUI_InputName(const char *prompt, const char *ext, char name[], int maxlen)
 			  "press space/break to cancel.\n",
 			  prompt, name, ext);
 
-	    ZX81DisplayString(text);
+	    ZX81DisplayString(zx,text);
 
 	    update = FALSE;
 	}
@@ -855,7 +863,7 @@ int GUI_InputName(const char *prompt, const char *ext, char name[], int maxlen)
 	swiWaitForVBlank();
     }
 
-    ZX81ResumeDisplay();
+    ZX81ResumeDisplay(zx);
 
     return accept;
 }
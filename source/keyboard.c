@@ -421,6 +421,40 @@ void SK_DefinePad(SoftKey pad, SoftKey key)
 }
 
 
+SoftKey SK_PadKey(SoftKey pad)
+{
+    switch(pad)
+    {
+	case SK_PAD_LEFT:
+	    return pad_left_key;
+	case SK_PAD_RIGHT:
+	    return pad_right_key;
+	case SK_PAD_UP:
+	    return pad_up_key;
+	case SK_PAD_DOWN:
+	    return pad_down_key;
+	case SK_PAD_A:
+	    return pad_A_key;
+	case SK_PAD_B:
+	    return pad_B_key;
+	case SK_PAD_X:
+	    return pad_X_key;
+	case SK_PAD_Y:
+	    return pad_Y_key;
+	case SK_PAD_R:
+	    return pad_R_key;
+	case SK_PAD_L:
+	    return pad_L_key;
+	case SK_PAD_START:
+	    return pad_start_key;
+	case SK_PAD_SELECT:
+	    return pad_select_key;
+	default:
+	    return NUM_SOFT_KEYS;
+    }
+}
+
+
 const char *SK_KeyName(SoftKey k)
 {
     return keynames[k];
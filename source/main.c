@@ -36,6 +36,9 @@
 #include "textmode.h"
 #include "monitor.h"
 #include "snapshot.h"
+#include "rewind.h"
+#include "bootcache.h"
+#include "pace.h"
 
 #include "splashimg_bin.h"
 #include "rom_font_bin.h"
@@ -97,9 +100,10 @@ static int	sub_text_overlay_bg;
 static void VBlankFunc(void)
 {
     scanKeys();
+    PACE_VBlank();
 }
 
-static void Splash(void)
+static void Splash(ZX81Machine *zx)
 {
     static char scroller[]=
     {
@@ -135,8 +139,8 @@ static void Splash(void)
     int res=FALSE;
     int scr_x=0;
 
-    ZX81SuspendDisplay();
-    ZX81DisplayString("10 rem " DS81_VERSION "\n"
+    ZX81SuspendDisplay(zx);
+    ZX81DisplayString(zx,"10 rem " DS81_VERSION "\n"
 		      "20 print \"%the zx81 is ace%\"\n"
 		      "30 goto 20");
 
@@ -166,8 +170,9 @@ static void Splash(void)
 
     if (res)
     {
-	ZX81EnableFileSystem(TRUE);
+	ZX81EnableFileSystem(zx,TRUE);
 	SNAP_Enable(TRUE);
+	BOOT_SetDir(DEFAULT_SNAPDIR);
 
 	FB_Centre("Found a FAT device.",y,COL_WHITE,COL_TRANSPARENT);
 	y += 8;
@@ -190,7 +195,7 @@ static void Splash(void)
     }
     else
     {
-	ZX81EnableFileSystem(FALSE);
+	ZX81EnableFileSystem(zx,FALSE);
 	SNAP_Enable(FALSE);
 
 	FB_Centre("Sorry, but you don't have a",y,COL_WHITE,COL_TRANSPARENT);
@@ -234,13 +239,13 @@ static void Splash(void)
 
     TM_Cls();
 
-    ZX81ResumeDisplay();
+    ZX81ResumeDisplay(zx);
 }
 
 
 /* ---------------------------------------- JOYPAD MAPPING
 */
-static void MapJoypad(void)
+static void MapJoypad(ZX81Machine *zx)
 {
     SoftKeyEvent ev;
     SoftKey pad = NUM_SOFT_KEYS;
@@ -249,9 +254,9 @@ static void MapJoypad(void)
 
     SK_DisplayKeyboard();
 
-    ZX81SuspendDisplay();
+    ZX81SuspendDisplay(zx);
 
-    ZX81DisplayString("press the joypad button you want\n"
+    ZX81DisplayString(zx,"press the joypad button you want\n"
 		      "to define and then the ZX81 key\n"
 		      "you want to use.\n\n"
 		      "press on the config banner to\n"
@@ -277,14 +282,14 @@ static void MapJoypad(void)
 		    /* Now, just how dumb was making % the inverse on/off...
 		    */
 		    sprintf(text,"defining\n  %%%s%%",SK_KeyName(pad));
-		    ZX81DisplayString(text);
+		    ZX81DisplayString(zx,text);
 		}
 
 		if (ev.key<=SK_SPACE && pad!=NUM_SOFT_KEYS)
 		{
 		    sprintf(text,"mapped\n  %%%s%%\nto\n  %%%s%%",
 		    			SK_KeyName(pad),SK_KeyName(ev.key));
-		    ZX81DisplayString(text);
+		    ZX81DisplayString(zx,text);
 
 		    SK_DefinePad(pad,ev.key);
 
@@ -296,7 +301,34 @@ static void MapJoypad(void)
 	swiWaitForVBlank();
     }
 
-    ZX81ResumeDisplay();
+    ZX81ResumeDisplay(zx);
+}
+
+
+/* ---------------------------------------- CONFIGURATION
+*/
+static void Configure(ZX81Machine *zx)
+{
+    ZX81Layout before;
+    ZX81Layout after;
+
+    ZX81GetLayout(zx,&before);
+
+    GUI_Config();
+    SK_SetSticky(SK_SHIFT,DS81_Config[DS81_STICKY_SHIFT]);
+    ZX81Reconfigure(zx);
+
+    ZX81GetLayout(zx,&after);
+
+    /* The program in memory can't carry on with the RAM moved or resized
+       under it, so the machine is reset as a real one would need to be
+       after changing the RAM pack
+    */
+    if (before.ram_bot!=after.ram_bot || before.ram_top!=after.ram_top ||
+	before.ram_len!=after.ram_len)
+    {
+	BOOT_Reset(zx);
+    }
 }
 
 
@@ -304,7 +336,7 @@ static void MapJoypad(void)
 */
 int main(int argc, char *argv[])
 {
-    Z80 *z80;
+    ZX81Machine *zx;
 
     powerOn(POWER_ALL_2D);
 
@@ -361,23 +393,18 @@ int main(int argc, char *argv[])
     */
     keysSetRepeat(30,15);
 
-    z80 = Z80Init(ZX81ReadMem,
-		  ZX81WriteMem,
-		  ZX81ReadPort,
-		  ZX81WritePort,
-		  ZX81ReadDisassem);
+    zx = ZX81Create((uint16*)BG_MAP_RAM(0), (uint16*)BG_BMP_RAM(2));
 
-    if (!z80)
+    if (!zx)
     {
 	GUI_Alert(TRUE,"Failed to initialise\nthe Z80 CPU emulation!");
     }
 
-    ZX81Init((uint16*)BG_MAP_RAM(0), (uint16*)BG_BMP_RAM(2), z80);
-
-    Splash();
+    Splash(zx);
 
     LoadConfig();
-    ZX81Reconfigure();
+    ZX81Reconfigure(zx);
+    BOOT_Reset(zx);
 
     SK_DisplayKeyboard();
 
@@ -385,14 +412,33 @@ int main(int argc, char *argv[])
 
     if (DS81_Config[DS81_LOAD_DEFAULT_SNAPSHOT])
     {
-    	SNAP_Load(z80, "AUTO", SNAP_TYPE_FULL);
+    	SNAP_Load(zx, "AUTO", SNAP_TYPE_FULL);
     }
 
     while(1)
     {
 	SoftKeyEvent ev;
 
-    	Z80Exec(z80);
+    	ZX81RunFrame(zx);
+	RWD_Frame(zx);
+
+#ifdef DS81_PACE_STATUS
+	{
+	    Pacer *pace = ZX81GetPacer(zx);
+
+	    /* Average run and draw times, and the frames drawn and late
+	    */
+	    if (pace->no_frames >= 50)
+	    {
+		DS81_DEBUG_STATUS("%5lu+%5luus %2lu/%2lu late %2lu",
+				  pace->run_us, pace->draw_us,
+				  pace->no_drawn, pace->no_frames,
+				  pace->no_late);
+
+		PACE_ClearStats(pace);
+	    }
+	}
+#endif
 
 	while(SK_GetEvent(&ev))
 	{
@@ -405,43 +451,40 @@ int main(int argc, char *argv[])
 			switch(GUI_Menu(main_menu))
 			{
 			    case MenuReset:
-				ZX81Reset(z80);
+				BOOT_Reset(zx);
 				break;
 
 			    case MenuSelectTape:
-			    	SelectTape();
+			    	SelectTape(zx);
 				break;
 
 			    case MenuConfigure:
-				GUI_Config();
-				SK_SetSticky(SK_SHIFT,
-					     DS81_Config[DS81_STICKY_SHIFT]);
-				ZX81Reconfigure();
+				Configure(zx);
 				break;
 
 			    case MenuMapJoypad:
-				MapJoypad();
+				MapJoypad(zx);
 			    	break;
 
 			    case MenuMonitor:
-			    	MachineCodeMonitor(z80);
+			    	MachineCodeMonitor(zx);
 				break;
 
 #ifndef DS81_DISABLE_FAT
 			    case MenuSaveSnapshot:
-			    	SNAP_Save(z80, SNAP_TYPE_FULL);
+			    	SNAP_Save(zx, SNAP_TYPE_FULL);
 			    	break;
 
 			    case MenuLoadSnapshot:
-			    	SNAP_Load(z80, NULL, SNAP_TYPE_FULL);
+			    	SNAP_Load(zx, NULL, SNAP_TYPE_FULL);
 			    	break;
 
 			    case MenuSaveMappings:
-			    	SNAP_Save(z80, SNAP_TYPE_KEYBOARD);
+			    	SNAP_Save(zx, SNAP_TYPE_KEYBOARD);
 			    	break;
 
 			    case MenuLoadMappings:
-			    	SNAP_Load(z80, NULL, SNAP_TYPE_KEYBOARD);
+			    	SNAP_Load(zx, NULL, SNAP_TYPE_KEYBOARD);
 			    	break;
 #endif
 			}
@@ -450,8 +493,18 @@ int main(int argc, char *argv[])
 		    }
 		    break;
 
+		/* R toggles turbo mode, unless it has been mapped to a key
+		*/
+	    	case SK_PAD_R:
+		    if (ev.pressed && SK_PadKey(SK_PAD_R)==NUM_SOFT_KEYS)
+		    {
+			DS81_Config[DS81_TURBO] = !DS81_Config[DS81_TURBO];
+			ZX81Reconfigure(zx);
+		    }
+		    break;
+
 	    	default:
-		    ZX81HandleKey(ev.key,ev.pressed);
+		    ZX81HandleKey(zx,ev.key,ev.pressed);
 		    break;
 	    }
 	}
@@ -28,6 +28,7 @@
 #include "textmode.h"
 #include "framebuffer.h"
 #include "zx81.h"
+#include "rewind.h"
 #include "config.h"
 
 /* ---------------------------------------- PRIVATE DATA AND TYPES
@@ -67,12 +68,12 @@ static void DisplayHelp()
 	    "",
 	    "Press START to toggle between",
 	    "single step mode and running.",
-	    "",
 	    "Press SELECT to toggle between",
 	    "CPU info and memory display.",
 	    "",
 	    "In single step mode press A",
 	    "to execute next instruction.",
+	    "Press LEFT to rewind the ZX81.",
 	    "",
 	    "Use L/R (+ Y for larger jumps)",
 	    "to alter address in mem display.",
@@ -239,8 +240,9 @@ static void DisplayMem(Z80 *cpu, MemDisplayType disp, Z80Word addr, int as_hex)
 
 /* ---------------------------------------- PUBLIC INTERFACES
 */
-void MachineCodeMonitor(Z80 *cpu)
+void MachineCodeMonitor(ZX81Machine *zx)
 {
+    Z80 *cpu = ZX81GetZ80(zx);
     static Z80Word display_address = 0x4000;
     static MemDisplayType mem_display = DISPLAY_ADDR;
     int done = FALSE;
@@ -286,7 +288,7 @@ void MachineCodeMonitor(Z80 *cpu)
 
 	    while(SK_GetBareEvent(&ev))
 	    {
-	    	ZX81HandleKey(ev.key,ev.pressed);
+	    	ZX81HandleKey(zx,ev.key,ev.pressed);
 
 		if (ev.key == SK_CONFIG && ev.pressed)
 		{
@@ -342,9 +344,15 @@ void MachineCodeMonitor(Z80 *cpu)
 	    mem_display = (mem_display+1) % DISPLAY_TYPE_COUNT;
 	}
 
+	if (key & KEY_LEFT)
+	{
+	    running = FALSE;
+	    RWD_Back(zx);
+	}
+
 	if (running || (key & KEY_A))
 	{
-	    Z80SingleStep(cpu);
+	    ZX81SingleStep(zx);
 	}
     }
 
@@ -354,7 +362,7 @@ void MachineCodeMonitor(Z80 *cpu)
     for(soft_key = SK_1; soft_key <= SK_SPACE; soft_key++)
     {
     	SK_SetSticky(soft_key,FALSE);
-	ZX81HandleKey(soft_key,FALSE);
+	ZX81HandleKey(zx,soft_key,FALSE);
     }
 
     SK_SetSticky(SK_SHIFT,DS81_Config[DS81_STICKY_SHIFT]);
@@ -0,0 +1,385 @@
+/*
+   ds81 - Nintendo DS ZX81 emulator.
+
+   Copyright (C) 2006  Ian Cowburn <ianc@noddybox.co.uk>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+   $Id$
+
+   Paces the emulation against the display, and runs it flat out for turbo
+   mode.
+*/
+
+#include <nds.h>
+
+#ifdef DS81_HOST
+#include <time.h>
+#endif
+
+#include "pace.h"
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+/* ---------------------------------------- PRIVATE DATA
+*/
+#ifdef DS81_HOST
+
+/* There's no display to keep up with on hosts, so frames are run flat out
+   unless in turbo mode
+*/
+#define PERIOD		(1000000UL / PACE_HOST_HZ)
+#define REALTIME	FALSE
+
+#else
+
+/* The DS refreshes at about 59.83Hz.  Timers 2 and 3 are cascaded to count
+   the bus clock over 64.
+*/
+#define PERIOD		16715UL
+#define REALTIME	TRUE
+#define TIMER_HZ	523656UL
+
+static volatile unsigned long	vblanks;
+
+#endif
+
+
+/* ---------------------------------------- PRIVATE FUNCTIONS
+*/
+#ifdef DS81_HOST
+
+static unsigned long long Nanoseconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static unsigned long SystemMicros(void)
+{
+    return Nanoseconds() / 1000;
+}
+
+
+static void SystemWait(void)
+{
+    unsigned long long next;
+    unsigned long long t;
+    struct timespec ts;
+
+    t = Nanoseconds();
+    next = (t * PACE_HOST_HZ / 1000000000ULL + 1) * 1000000000ULL /
+							    PACE_HOST_HZ;
+
+    ts.tv_sec = (next - t) / 1000000000ULL;
+    ts.tv_nsec = (next - t) % 1000000000ULL;
+    nanosleep(&ts, NULL);
+}
+
+#else
+
+/* The timers are read as they go, so that the microseconds wrap cleanly
+   rather than when the timers do
+*/
+static unsigned long SystemMicros(void)
+{
+    static int started;
+    static unsigned long last;
+    static unsigned long micros;
+    static unsigned long long frac;
+    unsigned long count;
+    unsigned long hi;
+
+    if (!started)
+    {
+	TIMER_DATA(2) = 0;
+	TIMER_DATA(3) = 0;
+	TIMER_CR(3) = TIMER_ENABLE | TIMER_CASCADE;
+	TIMER_CR(2) = TIMER_ENABLE | TIMER_DIV_64;
+	started = TRUE;
+    }
+
+    /* Read the top half either side of the bottom in case it ticks over
+    */
+    do
+    {
+	hi = TIMER_DATA(3);
+	count = hi << 16 | TIMER_DATA(2);
+    } while(hi != TIMER_DATA(3));
+
+    frac += (unsigned long long)(count - last) * 1000000UL;
+    last = count;
+
+    micros += frac / TIMER_HZ;
+    frac %= TIMER_HZ;
+
+    return micros;
+}
+
+
+static void SystemWait(void)
+{
+    swiWaitForVBlank();
+}
+
+#endif
+
+static const PaceClock system_clock =
+{
+    PACE_Ticks,
+    SystemMicros,
+    SystemWait,
+    PERIOD,
+    REALTIME
+};
+
+
+/* Returns TRUE if time a is before time b, allowing for the clock wrapping
+*/
+static int Before(unsigned long a, unsigned long b)
+{
+    return (long)(a - b) < 0;
+}
+
+
+/* Adds a time to a running average, which starts from the first
+*/
+static void Average(unsigned long *avg, unsigned long t)
+{
+    if (*avg)
+    {
+	*avg = *avg - *avg / 8 + t / 8;
+    }
+    else
+    {
+	*avg = t;
+    }
+}
+
+
+/* Starts the next frame at now, at the start of a tick
+*/
+static void Resync(Pacer *p, unsigned long now)
+{
+    p->mark = now;
+    p->deadline = now + p->clock->period;
+    p->tick = p->clock->ticks();
+}
+
+
+static int TurboDraw(Pacer *p)
+{
+    unsigned long now = p->clock->ticks();
+
+    /* Only the first frame of each tick is drawn, and the count of frames
+       run in the tick starts again with it
+    */
+    if (now != p->tick)
+    {
+	p->tick = now;
+	p->frames = 0;
+	return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+static void TurboWait(Pacer *p)
+{
+    if (p->cap && ++p->frames >= p->cap)
+    {
+	while(p->clock->ticks() == p->tick)
+	{
+	    p->clock->wait();
+	}
+    }
+}
+
+
+/* ---------------------------------------- EXPORTED INTERFACES
+*/
+void PACE_VBlank(void)
+{
+#ifndef DS81_HOST
+    vblanks++;
+#endif
+}
+
+
+unsigned long PACE_Ticks(void)
+{
+#ifdef DS81_HOST
+    return Nanoseconds() * PACE_HOST_HZ / 1000000000ULL;
+#else
+    return vblanks;
+#endif
+}
+
+
+void PACE_Init(Pacer *p)
+{
+    p->turbo = FALSE;
+    p->cap = 0;
+    p->draw = TRUE;
+    p->frames = 0;
+    p->tick = 0;
+    p->skipped = 0;
+    p->run_us = 0;
+    p->draw_us = 0;
+
+    PACE_SetClock(p, &system_clock);
+    PACE_ClearStats(p);
+}
+
+
+void PACE_SetClock(Pacer *p, const PaceClock *clock)
+{
+    p->clock = clock;
+
+    if (clock->realtime)
+    {
+	Resync(p, clock->micros());
+    }
+}
+
+
+void PACE_SetTurbo(Pacer *p, int turbo, int cap)
+{
+    p->turbo = turbo;
+    p->cap = cap;
+    p->frames = 0;
+
+    /* The first frame in turbo mode is always drawn
+    */
+    if (turbo)
+    {
+	p->tick = p->clock->ticks() - 1;
+    }
+    else if (p->clock->realtime)
+    {
+	Resync(p, p->clock->micros());
+    }
+}
+
+
+int PACE_Draw(Pacer *p)
+{
+    unsigned long now;
+
+    p->no_frames++;
+
+    if (p->turbo)
+    {
+	p->draw = TurboDraw(p);
+    }
+    else if (!p->clock->realtime)
+    {
+	p->draw = TRUE;
+    }
+    else
+    {
+	now = p->clock->micros();
+
+	Average(&p->run_us, now - p->mark);
+	p->mark = now;
+
+	/* Draw if the next frame could still be run by the end of its tick
+	   afterwards, so that a frame that is late from being drawn is made
+	   up by not drawing the next
+	*/
+	p->draw = p->skipped >= PACE_MAX_SKIP ||
+		  !Before(p->deadline + p->clock->period,
+			  now + p->draw_us + p->run_us);
+    }
+
+    if (p->draw)
+    {
+	p->skipped = 0;
+	p->no_drawn++;
+    }
+    else
+    {
+	p->skipped++;
+    }
+
+    return p->draw;
+}
+
+
+void PACE_Wait(Pacer *p)
+{
+    unsigned long now;
+
+    if (p->turbo)
+    {
+	TurboWait(p);
+	return;
+    }
+
+    if (!p->clock->realtime)
+    {
+	return;
+    }
+
+    now = p->clock->micros();
+
+    if (p->draw)
+    {
+	Average(&p->draw_us, now - p->mark);
+    }
+
+    /* The tick is what decides whether the frame is late, as the clock
+       and the display may not quite agree
+    */
+    if (p->clock->ticks() == p->tick)
+    {
+	p->clock->wait();
+	Resync(p, p->clock->micros());
+    }
+    else
+    {
+	p->no_late++;
+	p->deadline += p->clock->period;
+	p->tick++;
+	p->mark = now;
+
+	if (p->clock->ticks() - p->tick > PACE_MAX_DEBT)
+	{
+	    Resync(p, now);
+	}
+    }
+}
+
+
+void PACE_ClearStats(Pacer *p)
+{
+    p->no_frames = 0;
+    p->no_drawn = 0;
+    p->no_late = 0;
+}
+
+
+/* END OF FILE */
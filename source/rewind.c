@@ -0,0 +1,320 @@
+/*
+   ds81 - Nintendo DS ZX81 emulator.
+
+   Copyright (C) 2006  Ian Cowburn <ianc@noddybox.co.uk>
+   
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+  
+   $Id$
+
+   Provides an in-memory buffer of previous machine states for rewinding.
+
+   Each state holds the CPU and machine state, and the RAM as the bytes
+   that changed from the state before it, XORed with what they were.  A
+   copy of the RAM as of the newest state is kept, so the RAM can be
+   recreated by XORing the changes back in, newest first.  The changes are
+   stored as runs of unchanged bytes and runs of changed bytes, which
+   keeps them to a few hundred bytes for most games.
+*/
+
+#include <nds.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rewind.h"
+#include "zx81.h"
+#include "config.h"
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+/* ---------------------------------------- PRIVATE DATA AND TYPES
+*/
+#define BUFFER_SIZE	0x40000
+#define MAX_STATES	512
+
+typedef struct
+{
+    ZX81State	state;
+    long	len;
+} Header;
+
+/* States are stored in the buffer as a Header followed by len bytes of
+   changes.  Offsets are kept aligned so the Header can be read in place.
+*/
+#define ALIGN(n)	(((n)+sizeof(long)-1)&~(long)(sizeof(long)-1))
+
+static unsigned char	*buffer;
+static unsigned char	*ram_copy;
+static Z80Val		ram_len;
+static Z80Byte		*ram_addr;
+
+static long		offset[MAX_STATES];
+static long		size[MAX_STATES];
+static int		oldest;
+static int		count;
+static long		next;
+static long		used;
+
+static int		frame;
+
+
+/* ---------------------------------------- PRIVATE FUNCTIONS
+*/
+static void DropOldest(void)
+{
+    used -= size[oldest];
+    oldest = (oldest + 1) % MAX_STATES;
+    count--;
+}
+
+
+/* Finds room for len bytes after the newest state, dropping the oldest
+   states as needed.  Returns the offset.
+*/
+static long Allocate(long len)
+{
+    if (count == MAX_STATES)
+    {
+	DropOldest();
+    }
+
+    if (next + len > BUFFER_SIZE)
+    {
+	while(count && offset[oldest] >= next)
+	{
+	    DropOldest();
+	}
+
+	next = 0;
+    }
+
+    while(count && offset[oldest] >= next && offset[oldest] < next + len)
+    {
+	DropOldest();
+    }
+
+    return next;
+}
+
+
+/* Stores the differences between ram and ram_copy, and updates ram_copy.
+   Returns the number of bytes used, which is at most len+8.
+*/
+static long Pack(unsigned char *out, const Z80Byte *ram, Z80Byte *copy,
+		 Z80Val len)
+{
+    unsigned char *p = out;
+    Z80Val f = 0;
+
+    while(f < len)
+    {
+	Z80Val same = 0;
+	Z80Val diff = 0;
+
+	while(f + same < len && same < 0xffff && ram[f + same] == copy[f + same])
+	{
+	    same++;
+	}
+
+	f += same;
+
+	/* Short runs of unchanged bytes are taken into the changed run, as
+	   they're cheaper than starting a new one
+	*/
+	while(f + diff < len && diff < 0xfff0)
+	{
+	    Z80Val run = 0;
+
+	    while(f + diff + run < len && run < 4 &&
+	    	  ram[f + diff + run] == copy[f + diff + run])
+	    {
+		run++;
+	    }
+
+	    if (run == 4 || f + diff + run == len)
+	    {
+		break;
+	    }
+
+	    diff += run + 1;
+	}
+
+	*p++ = same;
+	*p++ = same >> 8;
+	*p++ = diff;
+	*p++ = diff >> 8;
+
+	while(diff--)
+	{
+	    *p++ = ram[f] ^ copy[f];
+	    copy[f] = ram[f];
+	    f++;
+	}
+    }
+
+    return p - out;
+}
+
+
+/* XORs the differences stored by Pack() back into copy
+*/
+static void Unpack(const unsigned char *p, Z80Byte *copy, Z80Val len)
+{
+    Z80Val f = 0;
+
+    while(f < len)
+    {
+	Z80Val diff;
+
+	f += p[0] | p[1] << 8;
+	diff = p[2] | p[3] << 8;
+	p += 4;
+
+	while(diff--)
+	{
+	    copy[f++] ^= *p++;
+	}
+    }
+}
+
+
+static void Capture(ZX81Machine *zx)
+{
+    Z80Byte *ram;
+    Z80Val len;
+    Header *h;
+    long at;
+    int slot;
+
+    ram = ZX81GetRAM(zx, &len);
+
+    if (!buffer)
+    {
+	buffer = malloc(BUFFER_SIZE);
+
+	if (!buffer)
+	{
+	    return;
+	}
+    }
+
+    /* The RAM may have been reconfigured since the last state
+    */
+    if (ram != ram_addr || len != ram_len)
+    {
+	free(ram_copy);
+
+	if (!(ram_copy = malloc(len)))
+	{
+	    ram_addr = NULL;
+	    return;
+	}
+
+	memset(ram_copy, 0, len);
+	ram_addr = ram;
+	ram_len = len;
+	RWD_Clear();
+    }
+
+    at = Allocate(ALIGN(sizeof(Header) + len + 8));
+
+    h = (Header *)(buffer + at);
+    ZX81GetState(zx, &h->state);
+    h->len = Pack(buffer + at + sizeof(Header), ram, ram_copy, len);
+
+    slot = (oldest + count++) % MAX_STATES;
+    offset[slot] = at;
+    size[slot] = ALIGN(sizeof(Header) + h->len);
+
+    next = at + size[slot];
+    used += size[slot];
+}
+
+
+/* ---------------------------------------- PUBLIC INTERFACES
+*/
+void RWD_Frame(ZX81Machine *zx)
+{
+    if (!DS81_Config[DS81_REWIND])
+    {
+	return;
+    }
+
+    if (++frame >= RWD_FRAMES)
+    {
+	frame = 0;
+	Capture(zx);
+    }
+}
+
+
+int RWD_Back(ZX81Machine *zx)
+{
+    Z80Byte *ram;
+    Z80Val len;
+    Header *h;
+    int slot;
+
+    ram = ZX81GetRAM(zx, &len);
+
+    if (!count || ram != ram_addr || len != ram_len)
+    {
+	return FALSE;
+    }
+
+    slot = (oldest + --count) % MAX_STATES;
+    h = (Header *)(buffer + offset[slot]);
+
+    memcpy(ram, ram_copy, len);
+    ZX81SetState(zx, &h->state);
+
+    Unpack(buffer + offset[slot] + sizeof(Header), ram_copy, len);
+
+    next = offset[slot];
+    used -= size[slot];
+    frame = 0;
+
+    return TRUE;
+}
+
+
+void RWD_Clear(void)
+{
+    oldest = 0;
+    count = 0;
+    next = 0;
+    used = 0;
+    frame = 0;
+}
+
+
+int RWD_Count(long *bytes)
+{
+    if (bytes)
+    {
+	*bytes = used;
+    }
+
+    return count;
+}
+
+
+/* END OF FILE */
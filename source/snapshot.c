@@ -31,6 +31,7 @@
 #include "snapshot.h"
 #include "zx81.h"
 #include "gui.h"
+#include "stream.h"
 
 #include "config.h"
 
@@ -48,7 +49,8 @@
 /* ---------------------------------------- STATICS
 */
 static int		enabled;
-static const char 	*magic = "V01_DS81";
+static const char 	*magic = "V02_DS81";
+static const char 	*magic_v1 = "V01_DS81";
 static const char	*extension[2] = {".D81", ".K81"};
 
 
@@ -66,19 +68,132 @@ static void WriteMagic(FILE *fp, SnapshotType t)
     fputc(t, fp);
 }
 
+/* Returns the version of the snapshot, or zero if it isn't one
+*/
 static int CheckMagic(FILE *fp, SnapshotType t)
 {
-    const char *p = magic;
+    char buff[9] = {0};
+    int version;
 
-    while(*p)
+    fread(buff, 1, 8, fp);
+
+    if (strcmp(buff, magic) == 0)
+    {
+	version = 2;
+    }
+    else if (strcmp(buff, magic_v1) == 0)
+    {
+	version = 1;
+    }
+    else
+    {
+	return 0;
+    }
+
+    return (fgetc(fp) == t) ? version : 0;
+}
+
+
+static void LoadV1(ZX81Machine *zx, FILE *fp, SnapshotType type)
+{
+    SK_LoadSnapshot(fp);
+
+    if (type == SNAP_TYPE_FULL)
+    {
+	Z80LoadSnapshot(ZX81GetZ80(zx), fp);
+	ZX81LoadSnapshotV1(zx, fp);
+    }
+}
+
+
+/* Reads the chunks up to the END chunk without loading them, so that a
+   damaged snapshot is found before any of it has been loaded, and then
+   goes back to the first.  Returns FALSE if the snapshot is damaged.
+*/
+static int CheckV2(ZX81Machine *zx, FILE *fp, SnapshotType type)
+{
+    ZX81Layout layout;
+    char id[5] = "";
+    long pos;
+    long end;
+    long len;
+    int ok;
+
+    ZX81GetLayout(zx, &layout);
+
+    pos = ftell(fp);
+    ok = fseek(fp, 0, SEEK_END) == 0;
+    end = ftell(fp);
+    ok = ok && fseek(fp, pos, SEEK_SET) == 0;
+
+    while(ok && GET_Chunk(fp, id, &len))
+    {
+	long start = ftell(fp);
+
+	if (strcmp(id, "END ") == 0)
+	{
+	    break;
+	}
+
+	ok = len <= end - start;
+
+	if (ok && type == SNAP_TYPE_FULL)
+	{
+	    ok = ZX81CheckChunk(&layout, fp, id, len);
+	}
+
+	ok = ok && fseek(fp, start + len, SEEK_SET) == 0;
+    }
+
+    ok = ok && strcmp(id, "END ") == 0;
+
+    return fseek(fp, pos, SEEK_SET) == 0 && ok;
+}
+
+
+/* Loads the chunks up to the END chunk, skipping any that aren't known.
+   The snapshot should have been checked with CheckV2() first, so that it
+   is only left part loaded if memory runs out.  Returns FALSE if it was.
+*/
+static int LoadV2(ZX81Machine *zx, FILE *fp, SnapshotType type)
+{
+    char id[5] = "";
+    long len;
+    int ok = TRUE;
+
+    while(ok && GET_Chunk(fp, id, &len))
     {
-	if (fgetc(fp) != *p++)
+	long start = ftell(fp);
+
+	if (strcmp(id, "END ") == 0)
+	{
+	    break;
+	}
+	else if (strcmp(id, "KEYS") == 0)
 	{
-	    return FALSE;
+	    SK_LoadSnapshot(fp);
+	}
+	else if (type == SNAP_TYPE_FULL)
+	{
+	    if (strcmp(id, "CPU ") == 0)
+	    {
+		Z80LoadSnapshot(ZX81GetZ80(zx), fp);
+	    }
+	    else
+	    {
+		ok = ZX81LoadChunk(zx, fp, id, len);
+	    }
 	}
+
+	ok = ok && fseek(fp, start + len, SEEK_SET) == 0;
+    }
+
+    if (type == SNAP_TYPE_FULL)
+    {
+	ZX81LoadDone(zx);
     }
 
-    return (fgetc(fp) == t);
+    return ok && strcmp(id, "END ") == 0;
 }
 
 
@@ -89,7 +204,7 @@ void SNAP_Enable(int enable)
     enabled = enable;
 }
 
-void SNAP_Save(Z80 *cpu, SnapshotType type)
+void SNAP_Save(ZX81Machine *zx, SnapshotType type)
 {
     char base[FILENAME_MAX] = "";
     char file[FILENAME_MAX];
@@ -100,7 +215,7 @@ void SNAP_Save(Z80 *cpu, SnapshotType type)
     	return;
     }
 
-    if(!GUI_InputName("enter snapshot filename",
+    if(!GUI_InputName(zx, "enter snapshot filename",
     			extension[type], base, 8) || !base[0])
     {
     	return;
@@ -120,17 +235,33 @@ void SNAP_Save(Z80 *cpu, SnapshotType type)
 
     if (fp)
     {
+	long start;
+	int failed;
+
 	WriteMagic(fp, type);
 
+	start = PUT_Chunk(fp, "KEYS");
 	SK_SaveSnapshot(fp);
+	PUT_EndChunk(fp, start);
 
 	if (type == SNAP_TYPE_FULL)
 	{
-	    Z80SaveSnapshot(cpu, fp);
-	    ZX81SaveSnapshot(fp);
+	    start = PUT_Chunk(fp, "CPU ");
+	    Z80SaveSnapshot(ZX81GetZ80(zx), fp);
+	    PUT_EndChunk(fp, start);
+
+	    ZX81SaveSnapshot(zx, fp);
 	}
 
-    	fclose(fp);
+	start = PUT_Chunk(fp, "END ");
+	PUT_EndChunk(fp, start);
+
+	failed = ferror(fp);
+
+	if (fclose(fp) != 0 || failed)
+	{
+	    GUI_Alert(FALSE, "Failed to save snapshot");
+	}
     }
     else
     {
@@ -138,7 +269,7 @@ void SNAP_Save(Z80 *cpu, SnapshotType type)
     }
 }
 
-void SNAP_Load(Z80 *cpu, const char *optional_name, SnapshotType type)
+void SNAP_Load(ZX81Machine *zx, const char *optional_name, SnapshotType type)
 {
     static char last_dir[FILENAME_MAX] = "/";
     char file[FILENAME_MAX];
@@ -175,19 +306,26 @@ void SNAP_Load(Z80 *cpu, const char *optional_name, SnapshotType type)
 
     if (fp)
     {
-	if (!CheckMagic(fp, type))
-	{
-	    GUI_Alert(FALSE, "Not a valid snapshot");
-	}
-	else
+	switch(CheckMagic(fp, type))
 	{
-	    SK_LoadSnapshot(fp);
-
-	    if (type == SNAP_TYPE_FULL)
-	    {
-		Z80LoadSnapshot(cpu, fp);
-		ZX81LoadSnapshot(fp);
-	    }
+	    case 1:
+		LoadV1(zx, fp, type);
+		break;
+
+	    case 2:
+		if (!CheckV2(zx, fp, type))
+		{
+		    GUI_Alert(FALSE, "Snapshot is damaged");
+		}
+		else if (!LoadV2(zx, fp, type))
+		{
+		    GUI_Alert(FALSE, "Not enough memory");
+		}
+		break;
+
+	    default:
+		GUI_Alert(FALSE, "Not a valid snapshot");
+		break;
 	}
 
     	fclose(fp);
@@ -22,10 +22,29 @@
     Provides the routines for streaming.
 
 */
+#include <stdlib.h>
+#include <string.h>
+
 #include "stream.h"
 
-/* The long functions are a tad convuluted, but I'm in a dash.
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+/* Values are always stored little-endian, and longs as 32 bits whatever
+   the size of a long on the machine doing the saving.
+*/
+
+/* Runs of RLE_MIN or more of the same byte, and any byte equal to RLE_ESC,
+   are stored as RLE_ESC, count, byte.  Anything else is stored as is.
 */
+#define RLE_ESC		0xed
+#define RLE_MIN		4
+#define RLE_MAX		255
 
 void PUT_Byte(FILE *fp, unsigned char c)
 {
@@ -34,26 +53,81 @@ void PUT_Byte(FILE *fp, unsigned char c)
 
 void PUT_Long(FILE *fp, long l)
 {
-    union {long l; unsigned char c[4];} u;
+    PUT_ULong(fp, (unsigned long)l);
+}
 
-    u.l = l;
+void PUT_ULong(FILE *fp, unsigned long l)
+{
+    unsigned char c[4];
 
-    fputc(u.c[0], fp);
-    fputc(u.c[1], fp);
-    fputc(u.c[2], fp);
-    fputc(u.c[3], fp);
+    c[0] = l;
+    c[1] = l >> 8;
+    c[2] = l >> 16;
+    c[3] = l >> 24;
+
+    fwrite(c, 1, 4, fp);
 }
 
-void PUT_ULong(FILE *fp, unsigned long l)
+void PUT_Block(FILE *fp, const void *p, long len)
+{
+    fwrite(p, 1, len, fp);
+}
+
+long PUT_Chunk(FILE *fp, const char *id)
+{
+    fwrite(id, 1, 4, fp);
+    PUT_ULong(fp, 0);
+
+    return ftell(fp);
+}
+
+void PUT_EndChunk(FILE *fp, long start)
 {
-    union {unsigned long l; unsigned char c[4];} u;
+    long end = ftell(fp);
 
-    u.l = l;
+    fseek(fp, start - 4, SEEK_SET);
+    PUT_ULong(fp, end - start);
+    fseek(fp, end, SEEK_SET);
+}
 
-    fputc(u.c[0], fp);
-    fputc(u.c[1], fp);
-    fputc(u.c[2], fp);
-    fputc(u.c[3], fp);
+void PUT_RLE(FILE *fp, const unsigned char *p, long len)
+{
+    unsigned char buff[1024];
+    int pos = 0;
+
+    while(len > 0)
+    {
+	unsigned char c = *p;
+	int run = 1;
+
+	while(run < len && run < RLE_MAX && p[run] == c)
+	{
+	    run++;
+	}
+
+	if (pos > (int)sizeof buff - RLE_MIN)
+	{
+	    fwrite(buff, 1, pos, fp);
+	    pos = 0;
+	}
+
+	if (run >= RLE_MIN || c == RLE_ESC)
+	{
+	    buff[pos++] = RLE_ESC;
+	    buff[pos++] = run;
+	    buff[pos++] = c;
+	}
+	else
+	{
+	    run = 1;
+	    buff[pos++] = c;
+	}
+
+	p += run;
+	len -= run;
+    }
+
+    fwrite(buff, 1, pos, fp);
 }
 
 unsigned char GET_Byte(FILE *fp)
@@ -63,24 +137,83 @@ unsigned char GET_Byte(FILE *fp)
 
 long GET_Long(FILE *fp)
 {
-    union {long l; unsigned char c[4];} u;
+    unsigned long l = GET_ULong(fp);
 
-    u.c[0] = (unsigned char)fgetc(fp);
-    u.c[1] = (unsigned char)fgetc(fp);
-    u.c[2] = (unsigned char)fgetc(fp);
-    u.c[3] = (unsigned char)fgetc(fp);
+    if (l & 0x80000000UL)
+    {
+	return -(long)(0xffffffffUL - l) - 1;
+    }
 
-    return u.l;
+    return (long)l;
 }
 
 unsigned long GET_ULong(FILE *fp)
 {
-    union {unsigned long l; unsigned char c[4];} u;
+    unsigned char c[4] = {0};
 
-    u.c[0] = (unsigned char)fgetc(fp);
-    u.c[1] = (unsigned char)fgetc(fp);
-    u.c[2] = (unsigned char)fgetc(fp);
-    u.c[3] = (unsigned char)fgetc(fp);
+    fread(c, 1, 4, fp);
 
-    return u.l;
+    return c[0] | (unsigned long)c[1] << 8 |
+    		(unsigned long)c[2] << 16 | (unsigned long)c[3] << 24;
+}
+
+int GET_Block(FILE *fp, void *p, long len)
+{
+    return fread(p, 1, len, fp) == (size_t)len;
+}
+
+int GET_Chunk(FILE *fp, char *id, long *len)
+{
+    if (fread(id, 1, 4, fp) != 4)
+    {
+	return FALSE;
+    }
+
+    id[4] = 0;
+    *len = GET_ULong(fp);
+
+    return !feof(fp) && *len >= 0;
+}
+
+int GET_RLE(FILE *fp, unsigned char *p, long len, long packed)
+{
+    unsigned char *buff;
+    long f;
+    int ok;
+
+    if (!(buff = malloc(packed)))
+    {
+	return FALSE;
+    }
+
+    ok = GET_Block(fp, buff, packed);
+
+    for(f = 0; ok && f < packed && len > 0;)
+    {
+	if (buff[f] == RLE_ESC)
+	{
+	    int run;
+
+	    if (f + 2 >= packed || (run = buff[f+1]) > len)
+	    {
+		ok = FALSE;
+	    }
+	    else
+	    {
+		memset(p, buff[f+2], run);
+		p += run;
+		len -= run;
+		f += 3;
+	    }
+	}
+	else
+	{
+	    *p++ = buff[f++];
+	    len--;
+	}
+    }
+
+    free(buff);
+
+    return ok && len == 0;
 }
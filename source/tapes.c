@@ -189,6 +189,8 @@ static Tape	tapes[NO_TAPES]=
 
 static int	current=0;
 
+static TapeSource	source;
+
 /* ---------------------------------------- PRIVATE INTERFACES
 */
 static void InitTapes(void)
@@ -209,7 +211,7 @@ static void InitTapes(void)
     }
 }
 
-static void DisplayTape(Tape *t)
+static void DisplayTape(ZX81Machine *zx, Tape *t)
 {
     FB_Clear();
     FB_Blit(&t->img,255-t->img.width,0,1);
@@ -222,24 +224,24 @@ static void DisplayTape(Tape *t)
     FB_Print("LOAD \"\"",0,70,COL_WHITE,COL_TRANSPARENT);
     FB_Print("ON THE ZX81!",0,80,COL_WHITE,COL_TRANSPARENT);
 
-    ZX81DisplayString(t->text);
+    ZX81DisplayString(zx,t->text);
 }
 
 /* ---------------------------------------- PUBLIC INTERFACES
 */
-void SelectTape(void)
+void SelectTape(ZX81Machine *zx)
 {
     int done=FALSE;
 
     InitTapes();
 
-    ZX81SuspendDisplay();
+    ZX81SuspendDisplay(zx);
 
     while(!done)
     {
 	uint32 key=0;
 
-    	DisplayTape(tapes+current);
+    	DisplayTape(zx,tapes+current);
 
         do
         {
@@ -262,8 +264,10 @@ void SelectTape(void)
 	    int f;
 
 	    done=TRUE;
-	    ZX81SetTape(tapes[current].tape,
-	    		tapes[current].tape_end - tapes[current].tape);
+	    TAPE_MemorySource(&source,
+			      tapes[current].tape,
+			      tapes[current].tape_end - tapes[current].tape);
+	    ZX81SetTape(zx,&source);
 
 	    for(f=0;tapes[current].keys[f]!=NUM_SOFT_KEYS;f+=2)
 	    {
@@ -277,6 +281,6 @@ void SelectTape(void)
 	}
     }
 
-    ZX81ResumeDisplay();
+    ZX81ResumeDisplay(zx);
 }
 
@@ -0,0 +1,153 @@
+/*
+    ds81 - Nintendo DS ZX81 emulator
+
+    Copyright (C) 2006  Ian Cowburn <ianc@noddybox.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+    -------------------------------------------------------------------------
+
+    Provides the sources for tape images.
+
+*/
+#include <string.h>
+#include <nds.h>
+
+#ifdef DS81_HOST
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "tapesource.h"
+
+/* ---------------------------------------- PRIVATE FUNCTIONS
+*/
+static long ReadFile(TapeSource *src, unsigned char *dest, long len)
+{
+    FILE *fp = src->handle;
+
+    if (fseek(fp, 0, SEEK_SET) != 0)
+    {
+	return -1;
+    }
+
+    return fread(dest, 1, len, fp);
+}
+
+
+#ifdef DS81_HOST
+static void CloseMapped(TapeSource *src)
+{
+    munmap((void *)src->data, src->len);
+}
+
+
+/* Maps the file into memory so that it can be copied like a built-in tape
+*/
+static int MapFile(TapeSource *src, FILE *fp)
+{
+    struct stat st;
+    void *p;
+
+    if (fstat(fileno(fp), &st) != 0 || st.st_size == 0)
+    {
+	return FALSE;
+    }
+
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+
+    if (p == MAP_FAILED)
+    {
+	return FALSE;
+    }
+
+    src->data = p;
+    src->len = st.st_size;
+    src->close = CloseMapped;
+
+    return TRUE;
+}
+#endif
+
+
+/* ---------------------------------------- PUBLIC INTERFACES
+*/
+void TAPE_MemorySource(TapeSource *src, const unsigned char *image, long len)
+{
+    src->data = image;
+    src->len = len;
+    src->read = NULL;
+    src->close = NULL;
+    src->handle = NULL;
+}
+
+
+int TAPE_FileSource(TapeSource *src, FILE *fp)
+{
+    TAPE_MemorySource(src, NULL, 0);
+
+#ifdef DS81_HOST
+    if (MapFile(src, fp))
+    {
+	return TRUE;
+    }
+#endif
+
+    if (fseek(fp, 0, SEEK_END) != 0 || (src->len = ftell(fp)) < 0)
+    {
+	return FALSE;
+    }
+
+    src->read = ReadFile;
+    src->handle = fp;
+
+    return TRUE;
+}
+
+
+long TAPE_Read(TapeSource *src, unsigned char *dest, long max)
+{
+    if (src->len > max)
+    {
+	return -1;
+    }
+
+    if (src->data)
+    {
+	memcpy(dest, src->data, src->len);
+	return src->len;
+    }
+
+    if (src->read && src->read(src, dest, src->len) == src->len)
+    {
+	return src->len;
+    }
+
+    return -1;
+}
+
+
+void TAPE_Close(TapeSource *src)
+{
+    if (src->close)
+    {
+	src->close(src);
+    }
+
+    TAPE_MemorySource(src, NULL, 0);
+}
+
+
+/* END OF FILE */
@@ -114,12 +114,79 @@ static void Z80_CheckInterrupt(Z80 *cpu)
 }
 
 
+/* Works out when the next event is due
+*/
+static void Z80_NextEvent(Z80 *cpu)
+{
+    int f;
+
+    PRIV->due=Z80_NEVER;
+
+    for(f=0;f<MAX_EVENTS;f++)
+	if (PRIV->event[f].event && PRIV->event[f].when<PRIV->due)
+	    PRIV->due=PRIV->event[f].when;
+}
+
+
+/* Calls the events that are due, earliest first
+*/
+static void Z80_RunEvents(Z80 *cpu)
+{
+    while(PRIV->cycle>=PRIV->due)
+    {
+	Z80Event event=NULL;
+	Z80Val when=PRIV->due;
+	int f;
+
+	for(f=0;f<MAX_EVENTS && !event;f++)
+	{
+	    if (PRIV->event[f].event && PRIV->event[f].when==when)
+	    {
+		event=PRIV->event[f].event;
+		PRIV->event[f].event=NULL;
+	    }
+	}
+
+	Z80_NextEvent(cpu);
+
+#ifdef ENABLE_IDLE_SKIP
+	PRIV->idle_from=0;
+#endif
+
+	FLUSH_FLAGS;
+	event(cpu,when);
+    }
+}
+
+
+/* Fetches the opcode for an M1 cycle, passing it through the fetch hook if
+   one covers the address
+*/
+static inline Z80Byte Z80_FetchOpcode(Z80 *cpu)
+{
+    Z80Word pc=cpu->PC;
+    Z80Byte opcode=FETCH_BYTE;
+
+    if (pc>=PRIV->fetch_from)
+    {
+	FLUSH_FLAGS;
+	opcode=PRIV->fetch_hook(cpu,pc,opcode);
+    }
+
+    return opcode;
+}
+
+
 /* ---------------------------------------- INTERFACES
 */
 
 #ifdef ENABLE_ARRAY_MEMORY
 Z80     *Z80Init(Z80ReadPort read_port,
                  Z80WritePort write_port)
+#elif defined(ENABLE_PAGED_MEMORY)
+Z80     *Z80Init(Z80WriteMemory write_memory,
+                 Z80ReadPort read_port,
+                 Z80WritePort write_port)
 #else
 Z80     *Z80Init(Z80ReadMemory read_memory,
                  Z80WriteMemory write_memory,
@@ -134,7 +201,7 @@ Z80     *Z80Init(Z80ReadMemory read_memory,
 
     InitTables();
 
-#ifndef ENABLE_ARRAY_MEMORY
+#if !defined(ENABLE_ARRAY_MEMORY) && !defined(ENABLE_PAGED_MEMORY)
     if (!read_memory || !write_memory)
     	return NULL;
 #endif
@@ -147,7 +214,33 @@ Z80     *Z80Init(Z80ReadMemory read_memory,
 
 	if (cpu->priv)
 	{
-#ifndef ENABLE_ARRAY_MEMORY
+#ifdef ENABLE_JIT
+	    Z80_JitInit(cpu);
+#endif
+
+#if defined(ENABLE_PAGED_MEMORY)
+	    PRIV->mwrite=write_memory;
+
+#ifdef ENABLE_DECODE_CACHE
+	    memset(PRIV->cache,0,sizeof PRIV->cache);
+	    memset(PRIV->code,0,sizeof PRIV->code);
+
+	    for(f=0;f<Z80_NO_PAGES;f++)
+	    {
+		PRIV->home[f]=f;
+		PRIV->gen[f]=1;
+	    }
+
+	    PRIV->gen_next=1;
+	    PRIV->fill=NULL;
+	    PRIV->hits=0;
+	    PRIV->misses=0;
+#endif
+
+	    memset(PRIV->idle,0xff,sizeof PRIV->idle);
+	    memset(PRIV->rpage,0,sizeof PRIV->rpage);
+	    Z80MapMemory(cpu,0,0x10000,NULL,NULL);
+#elif !defined(ENABLE_ARRAY_MEMORY)
 	    PRIV->mread=read_memory;
 	    PRIV->mwrite=write_memory;
 	    PRIV->disread=read_for_disassem;
@@ -159,6 +252,15 @@ Z80     *Z80Init(Z80ReadMemory read_memory,
 		for(r=0;r<MAX_PER_CALLBACK;r++)
 		    PRIV->callback[f][r]=NULL;
 
+	    for(f=0;f<MAX_EVENTS;f++)
+		PRIV->event[f].event=NULL;
+
+	    PRIV->due=Z80_NEVER;
+
+	    PRIV->user=NULL;
+
+	    Z80SetFetchHook(cpu,0,NULL);
+
 	    Z80Reset(cpu);
 	}
 	else
@@ -172,6 +274,107 @@ Z80     *Z80Init(Z80ReadMemory read_memory,
 }
 
 
+void Z80Free(Z80 *cpu)
+{
+#ifdef ENABLE_JIT
+    Z80_JitFree(cpu);
+#endif
+
+    free(cpu->priv);
+    free(cpu);
+}
+
+
+#ifdef ENABLE_PAGED_MEMORY
+
+#ifdef ENABLE_DECODE_CACHE
+/* Pages read from the same memory share the generation of the lowest of
+   them, their home.  Called once page has been pointed at new memory.
+*/
+static void Z80_CacheMap(Z80 *cpu, int page)
+{
+    int home=-1;
+    int next=-1;
+    int f;
+
+    /* Pages still reading the old memory move to the next lowest
+    */
+    for(f=0;f<Z80_NO_PAGES;f++)
+    {
+	if (f!=page && PRIV->home[f]==page)
+	{
+	    if (next==-1)
+		next=f;
+
+	    PRIV->home[f]=next;
+	}
+    }
+
+    for(f=0;f<Z80_NO_PAGES;f++)
+    {
+	if (PRIV->rpage[f]==PRIV->rpage[page])
+	{
+	    if (home==-1)
+		home=f;
+
+	    PRIV->home[f]=home;
+	}
+    }
+
+    Z80_InvalidatePage(cpu,home);
+}
+#endif
+
+
+void Z80MapMemory(Z80 *cpu, Z80Word addr, Z80Val len,
+		  Z80Byte *read, Z80Byte *write)
+{
+    int page;
+    int f;
+
+    page=addr>>Z80_PAGE_SHIFT;
+
+    for(f=0;f<len>>Z80_PAGE_SHIFT && page+f<Z80_NO_PAGES;f++)
+    {
+	if (read)
+	    PRIV->rpage[page+f]=read+f*Z80_PAGE_SIZE;
+	else
+	    PRIV->rpage[page+f]=PRIV->idle;
+
+	if (write)
+	    PRIV->wpage[page+f]=write+f*Z80_PAGE_SIZE;
+	else
+	    PRIV->wpage[page+f]=PRIV->discard;
+
+#ifdef ENABLE_DECODE_CACHE
+	Z80_CacheMap(cpu,page+f);
+#endif
+
+#ifdef ENABLE_JIT
+	Z80_JitMapPage(cpu,page+f);
+#endif
+    }
+}
+
+
+void Z80TrapWrites(Z80 *cpu, Z80Word addr, Z80Val len)
+{
+    int page;
+    int f;
+
+    if (!PRIV->mwrite)
+	return;
+
+    page=addr>>Z80_PAGE_SHIFT;
+
+    for(f=0;f<len>>Z80_PAGE_SHIFT && page+f<Z80_NO_PAGES;f++)
+    {
+	PRIV->wpage[page+f]=NULL;
+    }
+}
+#endif
+
+
 void Z80Reset(Z80 *cpu)
 {
     PRIV->cycle=0;
@@ -199,6 +402,10 @@ void Z80Reset(Z80 *cpu)
 
     PRIV->raise=FALSE;
     PRIV->nmi=FALSE;
+
+#ifdef ENABLE_LAZY_FLAGS
+    PRIV->lazy=Z80_LAZY_NONE;
+#endif
 }
 
 
@@ -210,7 +417,40 @@ Z80Val Z80Cycles(Z80 *cpu)
 
 void Z80ResetCycles(Z80 *cpu, Z80Val cycles)
 {
+    int f;
+
+    /* Events keep the same distance ahead
+    */
+    for(f=0;f<MAX_EVENTS;f++)
+    {
+	Z80TimedEvent *ev=PRIV->event+f;
+
+	if (!ev->event)
+	    continue;
+
+	if (cycles>=PRIV->cycle)
+	    ev->when+=cycles-PRIV->cycle;
+	else if (ev->when>PRIV->cycle-cycles)
+	    ev->when-=PRIV->cycle-cycles;
+	else
+	    ev->when=0;
+    }
+
     PRIV->cycle=cycles;
+
+    Z80_NextEvent(cpu);
+}
+
+
+Z80Byte Z80Peek(Z80 *cpu, Z80Word addr)
+{
+    return PEEK(addr);
+}
+
+
+void Z80Poke(Z80 *cpu, Z80Word addr, Z80Byte val)
+{
+    POKE(addr,val);
 }
 
 
@@ -245,6 +485,56 @@ void Z80RemoveCallback(Z80 *cpu, Z80CallbackReason reason, Z80Callback callback)
 }
 
 
+int Z80Schedule(Z80 *cpu, Z80Event event, Z80Val when)
+{
+    int slot=-1;
+    int f;
+
+    for(f=0;f<MAX_EVENTS;f++)
+    {
+	if (PRIV->event[f].event==event)
+	{
+	    slot=f;
+	    break;
+	}
+
+	if (!PRIV->event[f].event && slot==-1)
+	    slot=f;
+    }
+
+    if (slot==-1)
+	return FALSE;
+
+    PRIV->event[slot].event=event;
+    PRIV->event[slot].when=when;
+
+    Z80_NextEvent(cpu);
+
+    /* Stop the current run of instructions in time for it
+    */
+    if (when<PRIV->end)
+	PRIV->end=when;
+
+    return TRUE;
+}
+
+
+void Z80Unschedule(Z80 *cpu, Z80Event event)
+{
+    int f;
+
+    for(f=0;f<MAX_EVENTS;f++)
+    {
+	if (PRIV->event[f].event==event)
+	{
+	    PRIV->event[f].event=NULL;
+	}
+    }
+
+    Z80_NextEvent(cpu);
+}
+
+
 void Z80Interrupt(Z80 *cpu, Z80Byte devbyte)
 {
     PRIV->raise=TRUE;
@@ -266,17 +556,31 @@ int Z80SingleStep(Z80 *cpu)
 
     PRIV->last_cb=TRUE;
     PRIV->shift=0;
+    PRIV->end=PRIV->cycle;
+
+    Z80_RunEvents(cpu);
 
     Z80_CheckInterrupt(cpu);
 
     CALLBACK(eZ80_Instruction,PRIV->cycle);
 
+#ifdef ENABLE_DECODE_CACHE
+    if (cpu->PC<PRIV->fetch_from)
+    {
+	Z80_DecodeCached(cpu);
+	FLUSH_FLAGS;
+	return PRIV->last_cb;
+    }
+#endif
+
     INC_R;
 
-    opcode=FETCH_BYTE;
+    opcode=Z80_FetchOpcode(cpu);
 
     Z80_Decode(cpu,opcode);
 
+    FLUSH_FLAGS;
+
     return PRIV->last_cb;
 }
 
@@ -287,6 +591,179 @@ void Z80Exec(Z80 *cpu)
 }
 
 
+int Z80Run(Z80 *cpu, Z80Val cycles)
+{
+    Z80Val end;
+    int f;
+
+    end=PRIV->cycle+cycles;
+
+    /* If anything wants to see every instruction fall back to stepping
+    */
+    for(f=0;f<MAX_PER_CALLBACK;f++)
+    {
+	if (PRIV->callback[eZ80_Instruction][f])
+	{
+	    while(PRIV->cycle<end)
+	    {
+		if (!Z80SingleStep(cpu))
+		    break;
+	    }
+
+	    Z80_RunEvents(cpu);
+
+	    return PRIV->last_cb;
+	}
+    }
+
+    PRIV->last_cb=TRUE;
+
+#ifdef ENABLE_IDLE_SKIP
+    /* Memory may have changed since the last loop was seen
+    */
+    PRIV->idle_from=0;
+#endif
+
+    Z80_RunEvents(cpu);
+
+    while(PRIV->last_cb && PRIV->cycle<end)
+    {
+	/* Run up to the next event.  The end is brought forward if an event
+	   is scheduled for before it.
+	*/
+	PRIV->end=PRIV->due<end ? PRIV->due:end;
+
+	while(PRIV->last_cb && PRIV->cycle<PRIV->end)
+	{
+#ifdef ENABLE_JIT
+	    if (Z80_JitRun(cpu))
+		continue;
+#endif
+
+	    PRIV->shift=0;
+
+	    Z80_CheckInterrupt(cpu);
+
+#ifdef ENABLE_DECODE_CACHE
+	    if (cpu->PC<PRIV->fetch_from)
+	    {
+		Z80_DecodeCached(cpu);
+		continue;
+	    }
+#endif
+
+	    INC_R;
+
+	    Z80_Decode(cpu,Z80_FetchOpcode(cpu));
+	}
+
+	Z80_RunEvents(cpu);
+    }
+
+    FLUSH_FLAGS;
+
+    return PRIV->last_cb;
+}
+
+
+void Z80SetFetchHook(Z80 *cpu, Z80Word addr, Z80FetchHook hook)
+{
+    PRIV->fetch_hook=hook;
+
+    if (hook)
+	PRIV->fetch_from=addr;
+    else
+	PRIV->fetch_from=0x10000;
+
+    /* Translated code bypasses the hook
+    */
+    Z80FlushCache(cpu);
+}
+
+
+void Z80SetUserData(Z80 *cpu, void *data)
+{
+    PRIV->user=data;
+}
+
+
+void *Z80UserData(Z80 *cpu)
+{
+    return PRIV->user;
+}
+
+
+void Z80FlushCache(Z80 *cpu)
+{
+    Z80FlushMemory(cpu,0,0x10000);
+}
+
+
+void Z80FlushMemory(Z80 *cpu, Z80Word addr, Z80Val len)
+{
+#if defined(ENABLE_DECODE_CACHE) || defined(ENABLE_JIT)
+    Z80Val f;
+
+    if (!len)
+	return;
+
+    for(f=addr>>Z80_PAGE_SHIFT;
+	f<=((Z80Val)addr+len-1)>>Z80_PAGE_SHIFT && f<Z80_NO_PAGES;f++)
+    {
+#ifdef ENABLE_DECODE_CACHE
+	Z80_InvalidatePage(cpu,PRIV->home[f]);
+#endif
+#ifdef ENABLE_JIT
+	Z80_JitInvalidatePage(cpu,f);
+#endif
+    }
+#endif
+}
+
+
+#ifdef ENABLE_DECODE_CACHE
+void Z80CacheStats(Z80 *cpu, Z80Val *hits, Z80Val *misses)
+{
+    *hits=PRIV->hits;
+    *misses=PRIV->misses;
+}
+
+
+/* Called when a page code has been decoded from is written to.  Every
+   generation is a new one, so that a page which comes to share the home
+   of others can't pick up their entries.
+*/
+void Z80_InvalidatePage(Z80 *cpu, int page)
+{
+    PRIV->code[page]=FALSE;
+
+    /* If the count wraps start again with an empty cache
+    */
+    if (++PRIV->gen_next==0)
+    {
+	int f;
+
+	memset(PRIV->cache,0,sizeof PRIV->cache);
+
+	for(f=0;f<Z80_NO_PAGES;f++)
+	    PRIV->gen[f]=1;
+
+	PRIV->gen_next=2;
+    }
+
+    PRIV->gen[page]=PRIV->gen_next;
+}
+#endif
+
+
+void Z80UseJit(Z80 *cpu, int use)
+{
+#ifdef ENABLE_JIT
+    Z80_JitUse(cpu,use);
+#endif
+}
+
+
 void Z80SetLabels(Z80Label labels[])
 {
     z80_labels=labels;
@@ -297,7 +774,7 @@ const char *Z80Disassemble(Z80 *cpu, Z80Word *pc)
 {
 #ifdef ENABLE_DISASSEM
     Z80Byte Z80_Dis_FetchByte(Z80 *cpu, Z80Word *pc);
-    static char s[80];
+    static THREAD_LOCAL char s[80];
     Z80Word opc,npc;
     Z80Byte op;
     int f;
@@ -314,6 +791,8 @@ const char *Z80Disassemble(Z80 *cpu, Z80Word *pc)
     {
 #ifdef ENABLE_ARRAY_MEMORY
 	strcat(s,Z80_Dis_Printf(" %.2x",(int)Z80_MEMORY[opc++]));
+#elif defined(ENABLE_PAGED_MEMORY)
+	strcat(s,Z80_Dis_Printf(" %.2x",(int)Z80_PagePeek(cpu,opc++)));
 #else
 	strcat(s,Z80_Dis_Printf(" %.2x",(int)PRIV->disread(cpu,opc++)));
 #endif
@@ -333,6 +812,8 @@ const char *Z80Disassemble(Z80 *cpu, Z80Word *pc)
 
 void Z80SaveSnapshot(Z80 *cpu, FILE *fp)
 {
+    FLUSH_FLAGS;
+
     PUT_ULong(fp, cpu->PC);
     PUT_ULong(fp, cpu->AF.w);
     PUT_ULong(fp, cpu->BC.w);
@@ -389,6 +870,44 @@ void Z80LoadSnapshot(Z80 *cpu, FILE *fp)
     cpu->priv->devbyte = GET_Byte(fp);
     cpu->priv->nmi = GET_Long(fp);
     cpu->priv->last_cb = GET_Long(fp);
+
+#ifdef ENABLE_LAZY_FLAGS
+    cpu->priv->lazy = Z80_LAZY_NONE;
+#endif
+}
+
+void Z80GetState(Z80 *cpu, Z80State *state)
+{
+    FLUSH_FLAGS;
+
+    state->regs = *cpu;
+    state->cycle = cpu->priv->cycle;
+    state->halt = cpu->priv->halt;
+    state->shift = cpu->priv->shift;
+    state->raise = cpu->priv->raise;
+    state->devbyte = cpu->priv->devbyte;
+    state->nmi = cpu->priv->nmi;
+    state->last_cb = cpu->priv->last_cb;
+}
+
+void Z80SetState(Z80 *cpu, const Z80State *state)
+{
+    struct Z80Private *priv = cpu->priv;
+
+    *cpu = state->regs;
+    cpu->priv = priv;
+
+    priv->cycle = state->cycle;
+    priv->halt = state->halt;
+    priv->shift = state->shift;
+    priv->raise = state->raise;
+    priv->devbyte = state->devbyte;
+    priv->nmi = state->nmi;
+    priv->last_cb = state->last_cb;
+
+#ifdef ENABLE_LAZY_FLAGS
+    priv->lazy = Z80_LAZY_NONE;
+#endif
 }
 
 /* END OF FILE */
@@ -24,6 +24,7 @@
 
 */
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
 
 #include "z80.h"
@@ -130,8 +131,8 @@ static Z80Word FPEEKW(Z80 *cpu, Z80Word addr)
 
 static void FPOKEW(Z80 *cpu, Z80Word addr, Z80Word val)
 {
-    PRIV->mwrite(cpu,addr,val);
-    PRIV->mwrite(cpu,addr+1,val>>8);
+    POKE(addr,val);
+    POKE(addr+1,val>>8);
 }
 #endif
 
@@ -154,9 +155,9 @@ do { \
     Z80Byte VAL=ONCE; \
     unsigned w; \
     w=cpu->AF.b[HI]+(unsigned)VAL; \
-    cpu->AF.b[LO]=SZtable[w]; \
-    if ((cpu->AF.b[HI]^w^VAL)&H_Z80) cpu->AF.b[LO]|=H_Z80; \
-    if ((VAL^cpu->AF.b[HI]^0x80)&(VAL^w)&0x80) cpu->AF.b[LO]|=P_Z80; \
+    FLAGS=SZtable[w]; \
+    if ((cpu->AF.b[HI]^w^VAL)&H_Z80) FLAGS|=H_Z80; \
+    if ((VAL^cpu->AF.b[HI]^0x80)&(VAL^w)&0x80) FLAGS|=P_Z80; \
     SETHIDDEN(w); \
     cpu->AF.b[HI]=w; \
 } while(0)
@@ -167,9 +168,9 @@ do { \
     Z80Byte VAL=ONCE; \
     unsigned w; \
     w=(cpu->AF.b[HI]+(unsigned)VAL+CARRY)&0x1ff; \
-    cpu->AF.b[LO]=SZtable[w]; \
-    if ((cpu->AF.b[HI]^w^VAL)&H_Z80) cpu->AF.b[LO]|=H_Z80; \
-    if ((VAL^cpu->AF.b[HI]^0x80)&(VAL^w)&0x80) cpu->AF.b[LO]|=P_Z80; \
+    FLAGS=SZtable[w]; \
+    if ((cpu->AF.b[HI]^w^VAL)&H_Z80) FLAGS|=H_Z80; \
+    if ((VAL^cpu->AF.b[HI]^0x80)&(VAL^w)&0x80) FLAGS|=P_Z80; \
     SETHIDDEN(w); \
     cpu->AF.b[HI]=w; \
 } while(0)
@@ -180,9 +181,9 @@ do { \
     Z80Byte VAL=ONCE; \
     unsigned w; \
     w=(cpu->AF.b[HI]-(unsigned)VAL)&0x1ff; \
-    cpu->AF.b[LO]=SZtable[w]|N_Z80; \
-    if ((cpu->AF.b[HI]^w^VAL)&H_Z80) cpu->AF.b[LO]|=H_Z80; \
-    if ((VAL^cpu->AF.b[HI])&(cpu->AF.b[HI]^w)&0x80) cpu->AF.b[LO]|=P_Z80; \
+    FLAGS=SZtable[w]|N_Z80; \
+    if ((cpu->AF.b[HI]^w^VAL)&H_Z80) FLAGS|=H_Z80; \
+    if ((VAL^cpu->AF.b[HI])&(cpu->AF.b[HI]^w)&0x80) FLAGS|=P_Z80; \
     SETHIDDEN(w); \
     cpu->AF.b[HI]=w; \
 } while(0)
@@ -193,9 +194,9 @@ do { \
     Z80Byte VAL=ONCE; \
     unsigned w; \
     w=(cpu->AF.b[HI]-(unsigned)VAL)&0x1ff; \
-    cpu->AF.b[LO]=SZtable[w]|N_Z80; \
-    if ((cpu->AF.b[HI]^w^VAL)&H_Z80) cpu->AF.b[LO]|=H_Z80; \
-    if ((VAL^cpu->AF.b[HI])&(cpu->AF.b[HI]^w)&0x80) cpu->AF.b[LO]|=P_Z80; \
+    FLAGS=SZtable[w]|N_Z80; \
+    if ((cpu->AF.b[HI]^w^VAL)&H_Z80) FLAGS|=H_Z80; \
+    if ((VAL^cpu->AF.b[HI])&(cpu->AF.b[HI]^w)&0x80) FLAGS|=P_Z80; \
     SETHIDDEN(VAL); \
 } while(0)
 
@@ -205,9 +206,9 @@ do { \
     Z80Byte VAL=ONCE; \
     unsigned w; \
     w=(cpu->AF.b[HI]-(unsigned)VAL-CARRY)&0x1ff; \
-    cpu->AF.b[LO]=SZtable[w]|N_Z80; \
-    if ((cpu->AF.b[HI]^w^VAL)&H_Z80) cpu->AF.b[LO]|=H_Z80; \
-    if ((VAL^cpu->AF.b[HI])&(cpu->AF.b[HI]^w)&0x80) cpu->AF.b[LO]|=P_Z80; \
+    FLAGS=SZtable[w]|N_Z80; \
+    if ((cpu->AF.b[HI]^w^VAL)&H_Z80) FLAGS|=H_Z80; \
+    if ((VAL^cpu->AF.b[HI])&(cpu->AF.b[HI]^w)&0x80) FLAGS|=P_Z80; \
     SETHIDDEN(w); \
     cpu->AF.b[HI]=w; \
 } while(0)
@@ -218,9 +219,9 @@ do { \
     Z80Word VAL=ONCE; \
     Z80Val w; \
     w=(REG)+(Z80Val)VAL; \
-    cpu->AF.b[LO]&=(S_Z80|Z_Z80|V_Z80); \
-    if (w>0xffff) cpu->AF.b[LO]|=C_Z80; \
-    if (((REG)^w^VAL)&0x1000) cpu->AF.b[LO]|=H_Z80; \
+    FLAGS&=(S_Z80|Z_Z80|V_Z80); \
+    if (w>0xffff) FLAGS|=C_Z80; \
+    if (((REG)^w^VAL)&0x1000) FLAGS|=H_Z80; \
     SETHIDDEN(w>>8); \
     (REG)=w; \
 } while(0) 
@@ -231,12 +232,12 @@ do { \
     Z80Word VAL=ONCE; \
     Z80Val w; \
     w=(REG)+(Z80Val)VAL+CARRY; \
-    cpu->AF.b[LO]=0; \
-    if ((w&0xffff)==0) cpu->AF.b[LO]=Z_Z80; \
-    if (w&0x8000) cpu->AF.b[LO]|=S_Z80; \
-    if (w>0xffff) cpu->AF.b[LO]|=C_Z80; \
-    if ((VAL^(REG)^0x8000)&((REG)^w)&0x8000) cpu->AF.b[LO]|=P_Z80; \
-    if (((REG)^w^VAL)&0x1000) cpu->AF.b[LO]|=H_Z80; \
+    FLAGS=0; \
+    if ((w&0xffff)==0) FLAGS=Z_Z80; \
+    if (w&0x8000) FLAGS|=S_Z80; \
+    if (w>0xffff) FLAGS|=C_Z80; \
+    if ((VAL^(REG)^0x8000)&((REG)^w)&0x8000) FLAGS|=P_Z80; \
+    if (((REG)^w^VAL)&0x1000) FLAGS|=H_Z80; \
     SETHIDDEN(w>>8); \
     (REG)=w; \
 } while(0) 
@@ -247,12 +248,12 @@ do { \
     Z80Word VAL=ONCE; \
     Z80Val w; \
     w=(REG)-(Z80Val)VAL-CARRY; \
-    cpu->AF.b[LO]=N_Z80; \
-    if (w&0x8000) cpu->AF.b[LO]|=S_Z80; \
-    if ((w&0xffff)==0) cpu->AF.b[LO]|=Z_Z80; \
-    if (w>0xffff) cpu->AF.b[LO]|=C_Z80; \
-    if ((VAL^(REG))&((REG)^w)&0x8000) cpu->AF.b[LO]|=P_Z80; \
-    if (((REG)^w^VAL)&0x1000) cpu->AF.b[LO]|=H_Z80; \
+    FLAGS=N_Z80; \
+    if (w&0x8000) FLAGS|=S_Z80; \
+    if ((w&0xffff)==0) FLAGS|=Z_Z80; \
+    if (w>0xffff) FLAGS|=C_Z80; \
+    if ((VAL^(REG))&((REG)^w)&0x8000) FLAGS|=P_Z80; \
+    if (((REG)^w^VAL)&0x1000) FLAGS|=H_Z80; \
     SETHIDDEN(w>>8); \
     (REG)=w; \
 } while(0)
@@ -261,19 +262,19 @@ do { \
 #define INC8(REG) \
 do { \
     (REG)++; \
-    cpu->AF.b[LO]=CARRY|SZtable[(REG)]; \
-    if ((REG)==0x80) cpu->AF.b[LO]|=P_Z80; \
-    if (((REG)&0x0f)==0) cpu->AF.b[LO]|=H_Z80; \
+    FLAGS=CARRY|SZtable[(REG)]; \
+    if ((REG)==0x80) FLAGS|=P_Z80; \
+    if (((REG)&0x0f)==0) FLAGS|=H_Z80; \
 } while(0) 
 
 
 #define DEC8(REG) \
 do { \
     (REG)--; \
-    cpu->AF.b[LO]=N_Z80|CARRY; \
-    if ((REG)==0x7f) cpu->AF.b[LO]|=P_Z80; \
-    if (((REG)&0x0f)==0x0f) cpu->AF.b[LO]|=H_Z80; \
-    cpu->AF.b[LO]|=SZtable[(REG)]; \
+    FLAGS=N_Z80|CARRY; \
+    if ((REG)==0x7f) FLAGS|=P_Z80; \
+    if (((REG)&0x0f)==0x0f) FLAGS|=H_Z80; \
+    FLAGS|=SZtable[(REG)]; \
 } while(0)
 
 
@@ -315,7 +316,7 @@ do { \
 */
 #define RRCA \
 do { \
-    cpu->AF.b[LO]=(cpu->AF.b[LO]&(S_Z80|Z_Z80|P_Z80))|(cpu->AF.b[HI]&C_Z80); \
+    FLAGS=(FLAGS&(S_Z80|Z_Z80|P_Z80))|(cpu->AF.b[HI]&C_Z80); \
     cpu->AF.b[HI]=(cpu->AF.b[HI]>>1)|(cpu->AF.b[HI]<<7); \
     SETHIDDEN(cpu->AF.b[HI]); \
 } while(0)
@@ -325,7 +326,7 @@ do { \
 do { \
     Z80Byte c; \
     c=CARRY; \
-    cpu->AF.b[LO]=(cpu->AF.b[LO]&(S_Z80|Z_Z80|P_Z80))|(cpu->AF.b[HI]&C_Z80); \
+    FLAGS=(FLAGS&(S_Z80|Z_Z80|P_Z80))|(cpu->AF.b[HI]&C_Z80); \
     cpu->AF.b[HI]=(cpu->AF.b[HI]>>1)|(c<<7); \
     SETHIDDEN(cpu->AF.b[HI]); \
 } while(0)
@@ -336,7 +337,7 @@ do { \
     Z80Byte c; \
     c=(REG)&C_Z80; \
     (REG)=((REG)>>1)|((REG)<<7); \
-    cpu->AF.b[LO]=PSZtable[(REG)]|c; \
+    FLAGS=PSZtable[(REG)]|c; \
     SETHIDDEN(REG); \
 } while(0) 
 
@@ -346,14 +347,14 @@ do { \
     Z80Byte c; \
     c=(REG)&C_Z80; \
     (REG)=((REG)>>1)|(CARRY<<7); \
-    cpu->AF.b[LO]=PSZtable[(REG)]|c; \
+    FLAGS=PSZtable[(REG)]|c; \
     SETHIDDEN(REG); \
 } while(0)
 
 
 #define RLCA \
 do { \
-    cpu->AF.b[LO]=(cpu->AF.b[LO]&(S_Z80|Z_Z80|P_Z80))|(cpu->AF.b[HI]>>7); \
+    FLAGS=(FLAGS&(S_Z80|Z_Z80|P_Z80))|(cpu->AF.b[HI]>>7); \
     cpu->AF.b[HI]=(cpu->AF.b[HI]<<1)|(cpu->AF.b[HI]>>7); \
     SETHIDDEN(cpu->AF.b[HI]); \
 } while(0)
@@ -363,7 +364,7 @@ do { \
 do { \
     Z80Byte c; \
     c=CARRY; \
-    cpu->AF.b[LO]=(cpu->AF.b[LO]&(S_Z80|Z_Z80|P_Z80))|(cpu->AF.b[HI]>>7); \
+    FLAGS=(FLAGS&(S_Z80|Z_Z80|P_Z80))|(cpu->AF.b[HI]>>7); \
     cpu->AF.b[HI]=(cpu->AF.b[HI]<<1)|c; \
     SETHIDDEN(cpu->AF.b[HI]); \
 } while(0)
@@ -374,7 +375,7 @@ do { \
     Z80Byte c; \
     c=(REG)>>7; \
     (REG)=((REG)<<1)|c; \
-    cpu->AF.b[LO]=PSZtable[(REG)]|c; \
+    FLAGS=PSZtable[(REG)]|c; \
     SETHIDDEN(REG); \
 } while(0)
 
@@ -384,7 +385,7 @@ do { \
     Z80Byte c; \
     c=(REG)>>7; \
     (REG)=((REG)<<1)|CARRY; \
-    cpu->AF.b[LO]=PSZtable[(REG)]|c; \
+    FLAGS=PSZtable[(REG)]|c; \
     SETHIDDEN(REG); \
 } while(0)
 
@@ -394,7 +395,7 @@ do { \
     Z80Byte c; \
     c=(REG)&C_Z80; \
     (REG)>>=1; \
-    cpu->AF.b[LO]=PSZtable[(REG)]|c; \
+    FLAGS=PSZtable[(REG)]|c; \
     SETHIDDEN(REG); \
 } while(0)
 
@@ -404,7 +405,7 @@ do { \
     Z80Byte c; \
     c=(REG)&C_Z80; \
     (REG)=((REG)>>1)|((REG)&0x80); \
-    cpu->AF.b[LO]=PSZtable[(REG)]|c; \
+    FLAGS=PSZtable[(REG)]|c; \
     SETHIDDEN(REG); \
 } while(0)
 
@@ -414,7 +415,7 @@ do { \
     Z80Byte c; \
     c=(REG)>>7; \
     (REG)=((REG)<<1)|1; \
-    cpu->AF.b[LO]=PSZtable[(REG)]|c; \
+    FLAGS=PSZtable[(REG)]|c; \
     SETHIDDEN(REG); \
 } while(0)
 
@@ -424,7 +425,7 @@ do { \
     Z80Byte c; \
     c=(REG)>>7; \
     (REG)=(REG)<<1; \
-    cpu->AF.b[LO]=PSZtable[(REG)]|c; \
+    FLAGS=PSZtable[(REG)]|c; \
     SETHIDDEN(REG); \
 } while(0)
 
@@ -434,7 +435,7 @@ do { \
 #define AND(VAL) \
 do { \
     cpu->AF.b[HI]&=VAL; \
-    cpu->AF.b[LO]=PSZtable[cpu->AF.b[HI]]|H_Z80; \
+    FLAGS=PSZtable[cpu->AF.b[HI]]|H_Z80; \
     SETHIDDEN(cpu->AF.b[HI]); \
 } while(0)
 
@@ -442,7 +443,7 @@ do { \
 #define OR(VAL) \
 do { \
     cpu->AF.b[HI]|=VAL; \
-    cpu->AF.b[LO]=PSZtable[cpu->AF.b[HI]]; \
+    FLAGS=PSZtable[cpu->AF.b[HI]]; \
     SETHIDDEN(cpu->AF.b[HI]); \
 } while(0)
 
@@ -450,24 +451,24 @@ do { \
 #define XOR(VAL) \
 do { \
     cpu->AF.b[HI]^=VAL; \
-    cpu->AF.b[LO]=PSZtable[cpu->AF.b[HI]]; \
+    FLAGS=PSZtable[cpu->AF.b[HI]]; \
     SETHIDDEN(cpu->AF.b[HI]); \
 } while(0)
 
 
 #define BIT(REG,B) \
 do { \
-    cpu->AF.b[LO]=CARRY|H_Z80; \
+    FLAGS=CARRY|H_Z80; \
     if ((REG)&(1<<B)) \
     { \
-	if (B==7 && (REG&S_Z80)) cpu->AF.b[LO]|=S_Z80; \
-	if (B==5 && (REG&B5_Z80)) cpu->AF.b[LO]|=B5_Z80; \
-	if (B==3 && (REG&B3_Z80)) cpu->AF.b[LO]|=B3_Z80; \
+	if (B==7 && (REG&S_Z80)) FLAGS|=S_Z80; \
+	if (B==5 && (REG&B5_Z80)) FLAGS|=B5_Z80; \
+	if (B==3 && (REG&B3_Z80)) FLAGS|=B3_Z80; \
     } \
     else \
     { \
-	cpu->AF.b[LO]|=Z_Z80; \
-	cpu->AF.b[LO]|=P_Z80; \
+	FLAGS|=Z_Z80; \
+	FLAGS|=P_Z80; \
     } \
 } while(0)
 
@@ -475,14 +476,366 @@ do { \
 #define BIT_RES(REG,B) (REG)&=~(1<<B)
 
 
+/* ---------------------------------------- LAZY FLAGS
+*/
+#ifdef ENABLE_LAZY_FLAGS
+
+/* The 8-bit arithmetic and boolean ops just note what they did, and F is
+   worked out from that here when it's read, the same as the ops above
+   would have set it.  lazy_w holds the result, with the carry in bit 8,
+   and lazy_a and lazy_b the operands.  INC and DEC keep the carry they
+   leave alone in lazy_b.
+*/
+void Z80_FlushFlags(Z80 *cpu)
+{
+    Z80Byte a=PRIV->lazy_a;
+    Z80Byte b=PRIV->lazy_b;
+    unsigned w=PRIV->lazy_w;
+    Z80Byte f;
+
+    switch(PRIV->lazy)
+    {
+	case Z80_LAZY_ADD:
+	    f=SZtable[w]|(w&(B3_Z80|B5_Z80));
+	    if ((a^w^b)&H_Z80) f|=H_Z80;
+	    if ((b^a^0x80)&(b^w)&0x80) f|=P_Z80;
+	    break;
+
+	case Z80_LAZY_SUB:
+	case Z80_LAZY_CMP:
+	    f=SZtable[w]|N_Z80;
+	    if ((a^w^b)&H_Z80) f|=H_Z80;
+	    if ((b^a)&(a^w)&0x80) f|=P_Z80;
+	    f|=(PRIV->lazy==Z80_LAZY_CMP ? b:w)&(B3_Z80|B5_Z80);
+	    break;
+
+	case Z80_LAZY_AND:
+	    f=PSZtable[w]|H_Z80|(w&(B3_Z80|B5_Z80));
+	    break;
+
+	case Z80_LAZY_LOGIC:
+	    f=PSZtable[w]|(w&(B3_Z80|B5_Z80));
+	    break;
+
+	case Z80_LAZY_INC:
+	    f=b|SZtable[w];
+	    if (w==0x80) f|=P_Z80;
+	    if ((w&0x0f)==0) f|=H_Z80;
+	    break;
+
+	case Z80_LAZY_DEC:
+	    f=b|N_Z80|SZtable[w];
+	    if (w==0x7f) f|=P_Z80;
+	    if ((w&0x0f)==0x0f) f|=H_Z80;
+	    break;
+
+	default:
+	    return;
+    }
+
+    PRIV->lazy=Z80_LAZY_NONE;
+    cpu->AF.b[LO]=f;
+}
+
+
+#define LAZY(OP,A,B,W) \
+do { \
+    PRIV->lazy=OP; \
+    PRIV->lazy_a=A; \
+    PRIV->lazy_b=B; \
+    PRIV->lazy_w=W; \
+} while(0)
+
+#undef ADD8
+#undef ADC8
+#undef SUB8
+#undef CMP8
+#undef SBC8
+#undef INC8
+#undef DEC8
+#undef AND
+#undef OR
+#undef XOR
+
+#define ADD8(ONCE) \
+do { \
+    Z80Byte VAL=ONCE; \
+    unsigned w; \
+    w=cpu->AF.b[HI]+(unsigned)VAL; \
+    LAZY(Z80_LAZY_ADD,cpu->AF.b[HI],VAL,w); \
+    cpu->AF.b[HI]=w; \
+} while(0)
+
+
+#define ADC8(ONCE) \
+do { \
+    Z80Byte VAL=ONCE; \
+    unsigned w; \
+    w=(cpu->AF.b[HI]+(unsigned)VAL+CARRY)&0x1ff; \
+    LAZY(Z80_LAZY_ADD,cpu->AF.b[HI],VAL,w); \
+    cpu->AF.b[HI]=w; \
+} while(0)
+
+
+#define SUB8(ONCE) \
+do { \
+    Z80Byte VAL=ONCE; \
+    unsigned w; \
+    w=(cpu->AF.b[HI]-(unsigned)VAL)&0x1ff; \
+    LAZY(Z80_LAZY_SUB,cpu->AF.b[HI],VAL,w); \
+    cpu->AF.b[HI]=w; \
+} while(0)
+
+
+#define CMP8(ONCE) \
+do { \
+    Z80Byte VAL=ONCE; \
+    unsigned w; \
+    w=(cpu->AF.b[HI]-(unsigned)VAL)&0x1ff; \
+    LAZY(Z80_LAZY_CMP,cpu->AF.b[HI],VAL,w); \
+} while(0)
+
+
+#define SBC8(ONCE) \
+do { \
+    Z80Byte VAL=ONCE; \
+    unsigned w; \
+    w=(cpu->AF.b[HI]-(unsigned)VAL-CARRY)&0x1ff; \
+    LAZY(Z80_LAZY_SUB,cpu->AF.b[HI],VAL,w); \
+    cpu->AF.b[HI]=w; \
+} while(0)
+
+
+#define INC8(REG) \
+do { \
+    Z80Byte c=CARRY; \
+    (REG)++; \
+    LAZY(Z80_LAZY_INC,0,c,(REG)); \
+} while(0)
+
+
+#define DEC8(REG) \
+do { \
+    Z80Byte c=CARRY; \
+    (REG)--; \
+    LAZY(Z80_LAZY_DEC,0,c,(REG)); \
+} while(0)
+
+
+#define AND(VAL) \
+do { \
+    cpu->AF.b[HI]&=VAL; \
+    LAZY(Z80_LAZY_AND,0,0,cpu->AF.b[HI]); \
+} while(0)
+
+
+#define OR(VAL) \
+do { \
+    cpu->AF.b[HI]|=VAL; \
+    LAZY(Z80_LAZY_LOGIC,0,0,cpu->AF.b[HI]); \
+} while(0)
+
+
+#define XOR(VAL) \
+do { \
+    cpu->AF.b[HI]^=VAL; \
+    LAZY(Z80_LAZY_LOGIC,0,0,cpu->AF.b[HI]); \
+} while(0)
+
+#endif	/* ENABLE_LAZY_FLAGS */
+
+
+/* ---------------------------------------- IDLE LOOPS
+*/
+#ifdef ENABLE_IDLE_SKIP
+
+/* Longest loop looked at in bytes, including the jump back
+*/
+#define IDLE_LOOP_BYTES		16
+
+/* Longest a loop can take.  Anything other than going straight round the
+   loop adds at least one fetch to R, and R would need another 127 fetches
+   of at least 4 T-states each to come back round to the same value.  So
+   if R has moved on by just the loop's fetches in less time than that the
+   loop was gone straight round.
+*/
+#define IDLE_MAX_TSTATES	400
+
+
+/* Length of the instruction at pc if it only reads memory and registers,
+   or 0 if not.  r is set to the fetches it makes.
+*/
+static int IdleLength(Z80 *cpu, Z80Word pc, int *r)
+{
+    Z80Byte op=PEEK(pc);
+
+    *r=1;
+
+    /* LD r,r' and the ALU ops on registers or (HL), but not LD (HL),r or
+       HALT
+    */
+    if ((op>=0x40 && op<0x70) || (op>=0x78 && op<0xc0))
+	return 1;
+
+    /* INC/DEC r but not (HL), and INC/DEC BC/DE/HL
+    */
+    if (((op&0xc6)==0x04 && (op&0x38)!=0x30) || ((op&0xc7)==0x03 && op<0x30))
+	return 1;
+
+    /* LD r,n but not (HL), and the ALU ops on n
+    */
+    if (((op&0xc7)==0x06 && op!=0x36) || (op&0xc7)==0xc6)
+	return 2;
+
+    switch(op)
+    {
+	case 0x00:				/* NOP */
+	case 0x07: case 0x0f: case 0x17: case 0x1f:	/* RLCA .. RRA */
+	case 0x2f: case 0x37: case 0x3f:	/* CPL, SCF, CCF */
+	case 0x0a: case 0x1a:			/* LD A,(BC/DE) */
+	    return 1;
+
+	case 0x2a: case 0x3a:			/* LD HL/A,(nnnn) */
+	    return 3;
+
+	case 0xcb:		/* BIT on anything, the rest on registers */
+	    op=PEEK(pc+1);
+	    *r=2;
+	    return ((op&0xc0)==0x40 || (op&0x07)!=0x06) ? 2:0;
+
+	case 0xdd:
+	case 0xfd:
+	    op=PEEK(pc+1);
+	    *r=2;
+
+	    /* LD r,(IX+d) and the ALU ops on (IX+d)
+	    */
+	    if (((op&0xc7)==0x46 && op!=0x76) || (op&0xc7)==0x86)
+		return 3;
+
+	    /* BIT b,(IX+d)
+	    */
+	    if (op==0xcb && (PEEK(pc+3)&0xc0)==0x40)
+	    {
+		*r=3;
+		return 4;
+	    }
+
+	    return 0;
+
+	default:
+	    return 0;
+    }
+}
+
+
+/* If the code at head is a loop of instructions that only read memory and
+   registers, ending with a jump back to head, returns the address of the
+   jump and sets r to the fetches made going round once.  Otherwise returns
+   0.
+*/
+Z80Word Z80_IdleLoop(Z80 *cpu, Z80Word head, int *r)
+{
+    Z80Word pc=head;
+
+    *r=0;
+
+    while((Z80Word)(pc-head)<IDLE_LOOP_BYTES)
+    {
+	Z80Byte op=PEEK(pc);
+	int len,n;
+
+	if (op==0x18 || (op&0xe7)==0x20)		/* JR, JR cc */
+	{
+	    (*r)++;
+	    return (Z80Word)(pc+2+(Z80Relative)PEEK(pc+1))==head &&
+			(Z80Val)pc+2<=PRIV->fetch_from ? pc:0;
+	}
+
+	if (op==0xc3 || (op&0xc7)==0xc2)		/* JP, JP cc */
+	{
+	    (*r)++;
+	    return PEEKW(pc+1)==head &&
+			(Z80Val)pc+3<=PRIV->fetch_from ? pc:0;
+	}
+
+	if (!(len=IdleLength(cpu,pc,&n)))
+	    return 0;
+
+	*r+=n;
+	pc+=len;
+    }
+
+    return 0;
+}
+
+
+/* Called when a jump back to a short way before from has been taken.  If
+   the registers are the same as when the jump was last taken and the loop
+   has been gone straight round since, then as the loop changes nothing
+   else it will go round in the same way until Z80Run() stops or an
+   interrupt is taken.  So the cycle count and R are moved on over as many
+   times round as fit.
+*/
+void Z80_IdleJump(Z80 *cpu, Z80Word from)
+{
+    Z80Word reg[4];
+    Z80Val t;
+    int r;
+
+    FLUSH_FLAGS;
+
+    reg[0]=cpu->AF.w;
+    reg[1]=cpu->BC.w;
+    reg[2]=cpu->DE.w;
+    reg[3]=cpu->HL.w;
+
+    t=PRIV->cycle-PRIV->idle_cycle;
+
+    if (from==PRIV->idle_from && !memcmp(reg,PRIV->idle_reg,sizeof reg) &&
+	    t<=IDLE_MAX_TSTATES && PRIV->cycle<PRIV->end &&
+	    !(PRIV->raise && (PRIV->nmi || cpu->IFF1)) &&
+	    Z80_IdleLoop(cpu,cpu->PC,&r)==from &&
+	    ((cpu->R-PRIV->idle_r)&0x7f)==r)
+    {
+	Z80Val n=(PRIV->end-PRIV->cycle-1)/t;
+
+	TSTATE(n*t);
+	ADD_R((n*r)&0x7f);
+    }
+
+    PRIV->idle_from=from;
+    memcpy(PRIV->idle_reg,reg,sizeof reg);
+    PRIV->idle_cycle=PRIV->cycle;
+    PRIV->idle_r=cpu->R;
+}
+
+
+/* Checks a taken jump from from to PC for an idle loop
+*/
+#define IDLE_JUMP(FROM) \
+do { \
+    if (cpu->PC<(FROM) && (FROM)-cpu->PC<IDLE_LOOP_BYTES) \
+	Z80_IdleJump(cpu,FROM); \
+} while(0)
+
+#else
+
+#define IDLE_JUMP(FROM) (void)(FROM)
+
+#endif	/* ENABLE_IDLE_SKIP */
+
+
 /* ---------------------------------------- JUMP OPERATIONS
 */
 #define JR_COND(COND) \
 do { \
     if (COND) \
     { \
+	Z80Word from=cpu->PC-1; \
 	TSTATE(12); \
 	JR; \
+	IDLE_JUMP(from); \
     } \
     else \
     { \
@@ -497,7 +850,9 @@ do { \
     TSTATE(10); \
     if (COND) \
     { \
+	Z80Word from=cpu->PC-1; \
 	JP; \
+	IDLE_JUMP(from); \
     } \
     else \
     { \
@@ -586,7 +941,8 @@ do { \
 
 #define CPI \
 do { \
-    Z80Byte c,b; \
+    Z80Byte c; \
+    Z80Byte b; \
  \
     c=CARRY; \
     b=PEEK(cpu->HL.w); \
@@ -609,7 +965,8 @@ do { \
 
 #define CPD \
 do { \
-    Z80Byte c,b; \
+    Z80Byte c; \
+    Z80Byte b; \
  \
     c=CARRY; \
     b=PEEK(cpu->HL.w); \
@@ -641,7 +998,7 @@ do { \
     cpu->BC.b[HI]--; \
     cpu->HL.w++; \
  \
-    cpu->AF.b[LO]=SZtable[cpu->BC.b[HI]]; \
+    FLAGS=SZtable[cpu->BC.b[HI]]; \
     SETHIDDEN(cpu->BC.b[HI]); \
  \
     w=(((Z80Word)cpu->BC.b[LO])&0xff)+b; \
@@ -672,7 +1029,7 @@ do { \
     cpu->BC.b[HI]--; \
     cpu->HL.w--; \
  \
-    cpu->AF.b[LO]=SZtable[cpu->BC.b[HI]]; \
+    FLAGS=SZtable[cpu->BC.b[HI]]; \
     SETHIDDEN(cpu->BC.b[HI]); \
  \
     w=(((Z80Word)cpu->BC.b[LO])&0xff)+b; \
@@ -699,7 +1056,7 @@ do { \
     cpu->HL.w++; \
     cpu->BC.b[HI]--; \
  \
-    cpu->AF.b[LO]=SZtable[cpu->BC.b[HI]]; \
+    FLAGS=SZtable[cpu->BC.b[HI]]; \
     SETHIDDEN(cpu->BC.b[HI]); \
 } while(0)
 
@@ -710,12 +1067,201 @@ do { \
     cpu->HL.w--; \
     cpu->BC.b[HI]--; \
  \
-    cpu->AF.b[LO]=SZtable[cpu->BC.b[HI]]; \
+    FLAGS=SZtable[cpu->BC.b[HI]]; \
     SETFLAG(N_Z80); \
     SETHIDDEN(cpu->BC.b[HI]); \
 } while(0)
 
 
+/* How many more times a repeating block instruction can go round before
+   Z80Run() would have stopped, at 21 T-states a time.  None when single
+   stepping or when the fetch hook has to see the instruction fetched
+   again.
+*/
+static Z80Val BlockRepeats(Z80 *cpu)
+{
+    if (PRIV->cycle>=PRIV->end || (Z80Word)(cpu->PC-2)>=PRIV->fetch_from)
+	return 0;
+
+    return (PRIV->end-PRIV->cycle+20)/21;
+}
+
+
+/* Whether the repeats have to stop as the instruction has been written
+   over, an interrupt could be taken or a callback asked to stop
+*/
+static int BlockStopped(Z80 *cpu, Z80Byte opcode)
+{
+    return PEEK((Z80Word)(cpu->PC-2))!=0xed ||
+	    PEEK((Z80Word)(cpu->PC-1))!=opcode ||
+	    !PRIV->last_cb || (PRIV->raise && (PRIV->nmi || cpu->IFF1));
+}
+
+
+#ifdef ENABLE_PAGED_MEMORY
+
+/* Bytes left in addr's page going up (dir 1) or down (dir -1)
+*/
+#define PAGE_LEFT(addr,dir) \
+    ((dir)>0 ? Z80_PAGE_SIZE-((addr)&Z80_PAGE_MASK) : ((addr)&Z80_PAGE_MASK)+1)
+
+/* Does as many as it can of up to max repeats of LDIR (dir 1) or LDDR
+   (dir -1) straight from page to page, and returns how many.  None are
+   done if the writes have to go through Z80_PagePoke() or could land on
+   the instruction, and the last repeat is always left so that it sets the
+   flags.
+*/
+static Z80Val BlockCopy(Z80 *cpu, Z80Val max, int dir)
+{
+    Z80Word src=cpu->HL.w;
+    Z80Word dest=cpu->DE.w;
+    int page=dest>>Z80_PAGE_SHIFT;
+    Z80Byte *from;
+    Z80Byte *to;
+    Z80Val n;
+    Z80Val f;
+
+    to=PRIV->wpage[page];
+
+    if (!to || to==PRIV->rpage[(Z80Word)(cpu->PC-2)>>Z80_PAGE_SHIFT] ||
+	to==PRIV->rpage[(Z80Word)(cpu->PC-1)>>Z80_PAGE_SHIFT])
+	return 0;
+
+#ifdef ENABLE_JIT
+    if (PRIV->jit_page[page])
+	return 0;
+#endif
+
+#ifdef ENABLE_DECODE_CACHE
+    if (PRIV->code[PRIV->home[page]])
+	Z80_InvalidatePage(cpu,PRIV->home[page]);
+#endif
+
+    n=(Z80Word)(cpu->BC.w-1);
+
+    if (n>max)
+	n=max;
+
+    if (n>PAGE_LEFT(src,dir))
+	n=PAGE_LEFT(src,dir);
+
+    if (n>PAGE_LEFT(dest,dir))
+	n=PAGE_LEFT(dest,dir);
+
+    from=PRIV->rpage[src>>Z80_PAGE_SHIFT]+(src&Z80_PAGE_MASK);
+    to+=dest&Z80_PAGE_MASK;
+
+    /* A byte at a time, as overlapping copies are used to fill memory
+    */
+    for(f=0;f<n;f++)
+    {
+	*to=*from;
+	to+=dir;
+	from+=dir;
+    }
+
+    if (dir>0)
+    {
+	cpu->HL.w+=n;
+	cpu->DE.w+=n;
+    }
+    else
+    {
+	cpu->HL.w-=n;
+	cpu->DE.w-=n;
+    }
+
+    cpu->BC.w-=n;
+    ADD_R(n*2);
+    TSTATE(n*21);
+
+    return n;
+}
+
+
+/* Skips up to max repeats of CPIR (dir 1) or CPDR (dir -1) that won't
+   find A, and returns how many.  As with BlockCopy() the last repeat is
+   left to set the flags, as is the one that finds A.
+*/
+static Z80Val BlockCompare(Z80 *cpu, Z80Val max, int dir)
+{
+    Z80Word addr=cpu->HL.w;
+    const Z80Byte *p;
+    Z80Val n;
+    Z80Val f;
+
+    n=(Z80Word)(cpu->BC.w-1);
+
+    if (n>max)
+	n=max;
+
+    if (n>PAGE_LEFT(addr,dir))
+	n=PAGE_LEFT(addr,dir);
+
+    p=PRIV->rpage[addr>>Z80_PAGE_SHIFT]+(addr&Z80_PAGE_MASK);
+
+    if (dir>0)
+    {
+	const Z80Byte *found=memchr(p,cpu->AF.b[HI],n);
+
+	if (found)
+	    n=found-p;
+
+	cpu->HL.w+=n;
+    }
+    else
+    {
+	for(f=0;f<n && p[-(long)f]!=cpu->AF.b[HI];f++);
+
+	n=f;
+	cpu->HL.w-=n;
+    }
+
+    cpu->BC.w-=n;
+    ADD_R(n*2);
+    TSTATE(n*21);
+
+    return n;
+}
+
+#else
+
+#define BlockCopy(cpu,max,dir)		0
+#define BlockCompare(cpu,max,dir)	0
+
+#endif	/* ENABLE_PAGED_MEMORY */
+
+
+/* Carries on with a repeating block instruction that has just gone round
+   once, for as long as Z80Run() would have run it, leaving PC on the
+   instruction if it still has to go round again.  BULK does as many as it
+   can of the n repeats left in one go and returns how many.
+*/
+#define BLOCK_REPEAT(OP,COND,BULK) \
+do { \
+    Z80Val n; \
+ \
+    TSTATE(5); \
+ \
+    for(n=BlockRepeats(cpu);n && !BlockStopped(cpu,opcode);n--) \
+    { \
+	n-=BULK; \
+ \
+	ADD_R(2); \
+	TSTATE(16); \
+	OP; \
+ \
+	if (!(COND)) \
+	    break; \
+ \
+	TSTATE(5); \
+    } \
+ \
+    if (COND) \
+	cpu->PC-=2; \
+} while(0)
+
+
 /* ---------------------------------------- BASE OPCODE SHORT-HAND BLOCKS
 */
 
@@ -889,131 +1435,2399 @@ do { \
 	OP(cpu->AF.b[HI],BIT_NO); \
 	break;
 
-/* ---------------------------------------- SHIFTED CB OPCODE SHORT-HAND BLOCKS
-*/
+/* ---------------------------------------- SHIFTED CB OPCODE SHORT-HAND BLOCKS
+*/
+
+#define SHIFTED_CB_ALU_BLOCK(BASE,OP) \
+    case BASE:		/* OP B */ \
+	TSTATE(8); \
+	OP_ON_MEM_WITH_COPY(OP,addr,cpu->BC.b[HI]); \
+	break; \
+ \
+    case BASE+1:	/* OP C */ \
+	TSTATE(8); \
+	OP_ON_MEM_WITH_COPY(OP,addr,cpu->BC.b[LO]); \
+	break; \
+ \
+    case BASE+2:	/* OP D */ \
+	TSTATE(8); \
+	OP_ON_MEM_WITH_COPY(OP,addr,cpu->DE.b[HI]); \
+	break; \
+ \
+    case BASE+3:	/* OP E */ \
+	TSTATE(8); \
+	OP_ON_MEM_WITH_COPY(OP,addr,cpu->DE.b[LO]); \
+	break; \
+ \
+    case BASE+4:	/* OP H */ \
+	TSTATE(8); \
+	OP_ON_MEM_WITH_COPY(OP,addr,cpu->HL.b[HI]); \
+	break; \
+ \
+    case BASE+5:	/* OP L */ \
+	TSTATE(8); \
+	OP_ON_MEM_WITH_COPY(OP,addr,cpu->HL.b[LO]); \
+	break; \
+ \
+    case BASE+6:	/* OP (HL) */ \
+	TSTATE(15); \
+	OP_ON_MEM(OP,addr); \
+	break; \
+ \
+    case BASE+7:	/* OP A */ \
+	TSTATE(8); \
+	OP_ON_MEM_WITH_COPY(OP,addr,cpu->AF.b[HI]); \
+	break;
+
+#define SHIFTED_CB_BITMANIP_BLOCK(BASE,OP,BIT_NO) \
+    case BASE:		/* OP B */ \
+	TSTATE(8); \
+	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->BC.b[HI]); \
+	break; \
+ \
+    case BASE+1:	/* OP C */ \
+	TSTATE(8); \
+	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->BC.b[LO]); \
+	break; \
+ \
+    case BASE+2:	/* OP D */ \
+	TSTATE(8); \
+	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->DE.b[HI]); \
+	break; \
+ \
+    case BASE+3:	/* OP E */ \
+	TSTATE(8); \
+	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->DE.b[LO]); \
+	break; \
+ \
+    case BASE+4:	/* OP H */ \
+	TSTATE(8); \
+	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->HL.b[HI]); \
+	break; \
+ \
+    case BASE+5:	/* OP L */ \
+	TSTATE(8); \
+	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->HL.b[LO]); \
+	break; \
+ \
+    case BASE+6:	/* OP (HL) */ \
+	TSTATE(12); \
+	OP_ON_MEM_WITH_ARG(OP,addr,BIT_NO); \
+	break; \
+ \
+    case BASE+7:	/* OP A */ \
+	TSTATE(8); \
+	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->AF.b[HI]); \
+	break;
+
+/* ---------------------------------------- DAA
+*/
+
+/* This alogrithm is based on info from
+   http://www.worldofspectrum.org/faq/reference/z80reference.htm
+*/
+static void DAA (Z80 *cpu)
+{
+    Z80Byte add=0;
+    Z80Byte carry=0;
+    Z80Byte nf=FLAGS&N_Z80;
+    Z80Byte acc=cpu->AF.b[HI];
+
+    if (acc>0x99 || IS_C)
+    {
+	add|=0x60;
+	carry=C_Z80;
+    }
+
+    if ((acc&0xf)>0x9 || IS_H)
+    {
+    	add|=0x06;
+    }
+
+    if (nf)
+    {
+    	cpu->AF.b[HI]-=add;
+    }
+    else
+    {
+    	cpu->AF.b[HI]+=add;
+    }
+
+    FLAGS=PSZtable[cpu->AF.b[HI]]
+		    | carry
+		    | nf
+		    | ((acc^cpu->AF.b[HI])&H_Z80)
+		    | (cpu->AF.b[HI]&(B3_Z80|B5_Z80));
+}
+
+/* ---------------------------------------- TABLE DRIVEN DECODER
+*/
+#ifdef ENABLE_TABLE_DECODE
+
+/* Every opcode has its own handler, and every prefix its own table of
+   handlers.  DDCB and FDCB share a table as the address is worked out
+   before the final opcode is dispatched.
+
+   Under GCC the handlers are labels inside Z80_Decode() and are reached
+   with computed gotos.  Otherwise they are small functions called through
+   tables of function pointers, in the same manner as the disassembler.
+*/
+#if defined(__GNUC__) && !defined(DISABLE_COMPUTED_GOTO)
+#define COMPUTED_GOTO
+#endif
+
+#ifdef ENABLE_DECODE_CACHE
+
+/* Handlers read operands from a copy of the instruction's bytes, which is
+   the cache entry's or, when the instruction isn't being cached, a window
+   copied from memory at PC
+*/
+#undef FETCH_BYTE
+#undef FETCH_WORD
+
+#define FETCH_BYTE		(cpu->PC++,*PRIV->fetch++)
+#define FETCH_WORD		(cpu->PC+=2,PRIV->fetch+=2,		\
+				    PRIV->fetch[-2]|			\
+					((Z80Word)PRIV->fetch[-1]<<8))
+
+static void Z80_CacheWindow(Z80 *cpu)
+{
+    int f;
+
+    for(f=0;f<Z80_CACHE_BYTES;f++)
+	PRIV->window[f]=PEEK((Z80Word)(cpu->PC+f));
+
+    PRIV->fetch=PRIV->window;
+    PRIV->fill=NULL;
+}
+
+
+/* When an instruction isn't in the cache each dispatch on the way to its
+   handler is recorded in the entry.  The last one wins, but any of them is
+   a valid starting point as the prefix handlers carry on decoding.
+*/
+static inline void Z80_CacheFill(Z80 *cpu, const void *handler,
+				 Z80Byte opcode)
+{
+    Z80CacheEntry *ce=PRIV->fill;
+    int home=PRIV->home[ce->pc>>Z80_PAGE_SHIFT];
+
+    ce->handler=handler;
+    ce->gen=PRIV->gen[home];
+    ce->skip=PRIV->fetch-ce->bytes;
+    ce->r=(cpu->R-PRIV->fill_r)&0x7f;
+    ce->tstates=PRIV->cycle-PRIV->fill_cycle;
+    ce->shift=PRIV->shift;
+    ce->opcode=opcode;
+
+    PRIV->code[home]=TRUE;
+}
+
+
+/* If the instruction at PC is in the cache does what its prefixes would
+   have done and returns the entry.  Otherwise sets the entry up to be
+   filled as the instruction is decoded.
+*/
+static inline const Z80CacheEntry *Z80_CacheLookup(Z80 *cpu)
+{
+    Z80Word pc=cpu->PC;
+    Z80CacheEntry *ce=PRIV->cache+(pc&Z80_CACHE_MASK);
+
+    if (ce->pc==pc && ce->gen==PRIV->gen[PRIV->home[pc>>Z80_PAGE_SHIFT]])
+    {
+	PRIV->hits++;
+	PRIV->fill=NULL;
+	PRIV->fetch=ce->bytes+ce->skip;
+	PRIV->shift=ce->shift;
+
+	cpu->PC=pc+ce->skip;
+	ADD_R(ce->r);
+	TSTATE(ce->tstates);
+
+	return ce;
+    }
+
+    PRIV->misses++;
+
+    /* Only instructions that are sure to be inside one page are cached, so
+       that only the generation of that page has to be checked
+    */
+    if ((pc&Z80_PAGE_MASK)>Z80_PAGE_SIZE-Z80_CACHE_BYTES)
+    {
+	Z80_CacheWindow(cpu);
+	return NULL;
+    }
+
+    memcpy(ce->bytes,PRIV->rpage[pc>>Z80_PAGE_SHIFT]+(pc&Z80_PAGE_MASK),
+	   Z80_CACHE_BYTES);
+
+    /* Generation zero is never current, so the entry can't be hit until
+       it has been filled
+    */
+    ce->pc=pc;
+    ce->gen=0;
+
+    PRIV->fetch=ce->bytes;
+    PRIV->fill=ce;
+    PRIV->fill_cycle=PRIV->cycle;
+    PRIV->fill_r=cpu->R;
+
+    return NULL;
+}
+
+#define CACHE_FILL(H)		do				\
+				{				\
+				    if (PRIV->fill)		\
+					Z80_CacheFill(cpu,H,opcode);\
+				} while(0)
+
+/* A prefix following another is rare, so the rest of the instruction is
+   read through a window rather than cached
+*/
+#define CACHE_CHAIN		do				\
+				{				\
+				    if (PRIV->shift)		\
+					Z80_CacheWindow(cpu);	\
+				} while(0)
+
+#else
+
+#define CACHE_FILL(H)
+#define CACHE_CHAIN
+
+#endif
+
+#ifdef COMPUTED_GOTO
+
+#define OPCODE(name)		name:
+#define XYCB_OPCODE(name)	name:
+#define END_OPCODE		return;
+#define HANDLER(name)		&&name
+#define DISPATCH(table)		do				\
+				{				\
+				    CACHE_FILL(table[opcode]);	\
+				    goto *table[opcode];	\
+				} while(0)
+#define XYCB_DISPATCH(ADDR)	do				\
+				{				\
+				    addr=ADDR;			\
+				    goto *xycb_opcode[opcode];	\
+				} while(0)
+
+
+#else
+
+typedef void	(*Z80OpHandler)(Z80 *cpu, Z80Byte opcode);
+typedef void	(*Z80XYCBHandler)(Z80 *cpu, Z80Byte opcode, Z80Word addr);
+
+#define OPCODE(name)		static void name(Z80 *cpu, Z80Byte opcode)
+#define XYCB_OPCODE(name)	static void name(Z80 *cpu, Z80Byte opcode,	\
+						 Z80Word addr)
+#define END_OPCODE
+#define HANDLER(name)		name
+#define DISPATCH(table)		do				\
+				{				\
+				    CACHE_FILL(&table[opcode]);	\
+				    table[opcode](cpu,opcode);	\
+				} while(0)
+#define XYCB_DISPATCH(ADDR)	xycb_opcode[opcode](cpu,opcode,ADDR)
+
+
+static const Z80OpHandler	cb_opcode[0x100];
+static const Z80OpHandler	ed_opcode[0x100];
+static const Z80OpHandler	dd_opcode[0x100];
+static const Z80OpHandler	fd_opcode[0x100];
+static const Z80XYCBHandler	xycb_opcode[0x100];
+
+#endif
+
+
+/* ---------------------------------------- DISPATCH TABLES
+*/
+#define BASE_OPCODES \
+/* 0x00 */	HANDLER(Op_00), HANDLER(Op_01), HANDLER(Op_02), HANDLER(Op_03),	\
+/* 0x04 */	HANDLER(Op_04), HANDLER(Op_05), HANDLER(Op_06), HANDLER(Op_07),	\
+/* 0x08 */	HANDLER(Op_08), HANDLER(Op_09), HANDLER(Op_0a), HANDLER(Op_0b),	\
+/* 0x0c */	HANDLER(Op_0c), HANDLER(Op_0d), HANDLER(Op_0e), HANDLER(Op_0f),	\
+/* 0x10 */	HANDLER(Op_10), HANDLER(Op_11), HANDLER(Op_12), HANDLER(Op_13),	\
+/* 0x14 */	HANDLER(Op_14), HANDLER(Op_15), HANDLER(Op_16), HANDLER(Op_17),	\
+/* 0x18 */	HANDLER(Op_18), HANDLER(Op_19), HANDLER(Op_1a), HANDLER(Op_1b),	\
+/* 0x1c */	HANDLER(Op_1c), HANDLER(Op_1d), HANDLER(Op_1e), HANDLER(Op_1f),	\
+/* 0x20 */	HANDLER(Op_20), HANDLER(Op_21), HANDLER(Op_22), HANDLER(Op_23),	\
+/* 0x24 */	HANDLER(Op_24), HANDLER(Op_25), HANDLER(Op_26), HANDLER(Op_27),	\
+/* 0x28 */	HANDLER(Op_28), HANDLER(Op_29), HANDLER(Op_2a), HANDLER(Op_2b),	\
+/* 0x2c */	HANDLER(Op_2c), HANDLER(Op_2d), HANDLER(Op_2e), HANDLER(Op_2f),	\
+/* 0x30 */	HANDLER(Op_30), HANDLER(Op_31), HANDLER(Op_32), HANDLER(Op_33),	\
+/* 0x34 */	HANDLER(Op_34), HANDLER(Op_35), HANDLER(Op_36), HANDLER(Op_37),	\
+/* 0x38 */	HANDLER(Op_38), HANDLER(Op_39), HANDLER(Op_3a), HANDLER(Op_3b),	\
+/* 0x3c */	HANDLER(Op_3c), HANDLER(Op_3d), HANDLER(Op_3e), HANDLER(Op_3f),	\
+/* 0x40 */	HANDLER(Op_40), HANDLER(Op_41), HANDLER(Op_42), HANDLER(Op_43),	\
+/* 0x44 */	HANDLER(Op_44), HANDLER(Op_45), HANDLER(Op_46), HANDLER(Op_47),	\
+/* 0x48 */	HANDLER(Op_48), HANDLER(Op_49), HANDLER(Op_4a), HANDLER(Op_4b),	\
+/* 0x4c */	HANDLER(Op_4c), HANDLER(Op_4d), HANDLER(Op_4e), HANDLER(Op_4f),	\
+/* 0x50 */	HANDLER(Op_50), HANDLER(Op_51), HANDLER(Op_52), HANDLER(Op_53),	\
+/* 0x54 */	HANDLER(Op_54), HANDLER(Op_55), HANDLER(Op_56), HANDLER(Op_57),	\
+/* 0x58 */	HANDLER(Op_58), HANDLER(Op_59), HANDLER(Op_5a), HANDLER(Op_5b),	\
+/* 0x5c */	HANDLER(Op_5c), HANDLER(Op_5d), HANDLER(Op_5e), HANDLER(Op_5f),	\
+/* 0x60 */	HANDLER(Op_60), HANDLER(Op_61), HANDLER(Op_62), HANDLER(Op_63),	\
+/* 0x64 */	HANDLER(Op_64), HANDLER(Op_65), HANDLER(Op_66), HANDLER(Op_67),	\
+/* 0x68 */	HANDLER(Op_68), HANDLER(Op_69), HANDLER(Op_6a), HANDLER(Op_6b),	\
+/* 0x6c */	HANDLER(Op_6c), HANDLER(Op_6d), HANDLER(Op_6e), HANDLER(Op_6f),	\
+/* 0x70 */	HANDLER(Op_70), HANDLER(Op_71), HANDLER(Op_72), HANDLER(Op_73),	\
+/* 0x74 */	HANDLER(Op_74), HANDLER(Op_75), HANDLER(Op_76), HANDLER(Op_77),	\
+/* 0x78 */	HANDLER(Op_78), HANDLER(Op_79), HANDLER(Op_7a), HANDLER(Op_7b),	\
+/* 0x7c */	HANDLER(Op_7c), HANDLER(Op_7d), HANDLER(Op_7e), HANDLER(Op_7f),	\
+/* 0x80 */	HANDLER(Op_80), HANDLER(Op_81), HANDLER(Op_82), HANDLER(Op_83),	\
+/* 0x84 */	HANDLER(Op_84), HANDLER(Op_85), HANDLER(Op_86), HANDLER(Op_87),	\
+/* 0x88 */	HANDLER(Op_88), HANDLER(Op_89), HANDLER(Op_8a), HANDLER(Op_8b),	\
+/* 0x8c */	HANDLER(Op_8c), HANDLER(Op_8d), HANDLER(Op_8e), HANDLER(Op_8f),	\
+/* 0x90 */	HANDLER(Op_90), HANDLER(Op_91), HANDLER(Op_92), HANDLER(Op_93),	\
+/* 0x94 */	HANDLER(Op_94), HANDLER(Op_95), HANDLER(Op_96), HANDLER(Op_97),	\
+/* 0x98 */	HANDLER(Op_98), HANDLER(Op_99), HANDLER(Op_9a), HANDLER(Op_9b),	\
+/* 0x9c */	HANDLER(Op_9c), HANDLER(Op_9d), HANDLER(Op_9e), HANDLER(Op_9f),	\
+/* 0xa0 */	HANDLER(Op_a0), HANDLER(Op_a1), HANDLER(Op_a2), HANDLER(Op_a3),	\
+/* 0xa4 */	HANDLER(Op_a4), HANDLER(Op_a5), HANDLER(Op_a6), HANDLER(Op_a7),	\
+/* 0xa8 */	HANDLER(Op_a8), HANDLER(Op_a9), HANDLER(Op_aa), HANDLER(Op_ab),	\
+/* 0xac */	HANDLER(Op_ac), HANDLER(Op_ad), HANDLER(Op_ae), HANDLER(Op_af),	\
+/* 0xb0 */	HANDLER(Op_b0), HANDLER(Op_b1), HANDLER(Op_b2), HANDLER(Op_b3),	\
+/* 0xb4 */	HANDLER(Op_b4), HANDLER(Op_b5), HANDLER(Op_b6), HANDLER(Op_b7),	\
+/* 0xb8 */	HANDLER(Op_b8), HANDLER(Op_b9), HANDLER(Op_ba), HANDLER(Op_bb),	\
+/* 0xbc */	HANDLER(Op_bc), HANDLER(Op_bd), HANDLER(Op_be), HANDLER(Op_bf),	\
+/* 0xc0 */	HANDLER(Op_c0), HANDLER(Op_c1), HANDLER(Op_c2), HANDLER(Op_c3),	\
+/* 0xc4 */	HANDLER(Op_c4), HANDLER(Op_c5), HANDLER(Op_c6), HANDLER(Op_c7),	\
+/* 0xc8 */	HANDLER(Op_c8), HANDLER(Op_c9), HANDLER(Op_ca), HANDLER(Op_cb),	\
+/* 0xcc */	HANDLER(Op_cc), HANDLER(Op_cd), HANDLER(Op_ce), HANDLER(Op_cf),	\
+/* 0xd0 */	HANDLER(Op_d0), HANDLER(Op_d1), HANDLER(Op_d2), HANDLER(Op_d3),	\
+/* 0xd4 */	HANDLER(Op_d4), HANDLER(Op_d5), HANDLER(Op_d6), HANDLER(Op_d7),	\
+/* 0xd8 */	HANDLER(Op_d8), HANDLER(Op_d9), HANDLER(Op_da), HANDLER(Op_db),	\
+/* 0xdc */	HANDLER(Op_dc), HANDLER(Op_dd), HANDLER(Op_de), HANDLER(Op_df),	\
+/* 0xe0 */	HANDLER(Op_e0), HANDLER(Op_e1), HANDLER(Op_e2), HANDLER(Op_e3),	\
+/* 0xe4 */	HANDLER(Op_e4), HANDLER(Op_e5), HANDLER(Op_e6), HANDLER(Op_e7),	\
+/* 0xe8 */	HANDLER(Op_e8), HANDLER(Op_e9), HANDLER(Op_ea), HANDLER(Op_eb),	\
+/* 0xec */	HANDLER(Op_ec), HANDLER(Op_ed), HANDLER(Op_ee), HANDLER(Op_ef),	\
+/* 0xf0 */	HANDLER(Op_f0), HANDLER(Op_f1), HANDLER(Op_f2), HANDLER(Op_f3),	\
+/* 0xf4 */	HANDLER(Op_f4), HANDLER(Op_f5), HANDLER(Op_f6), HANDLER(Op_f7),	\
+/* 0xf8 */	HANDLER(Op_f8), HANDLER(Op_f9), HANDLER(Op_fa), HANDLER(Op_fb),	\
+/* 0xfc */	HANDLER(Op_fc), HANDLER(Op_fd), HANDLER(Op_fe), HANDLER(Op_ff)
+
+
+#define CB_OPCODES \
+/* 0x00 */	HANDLER(CB_00), HANDLER(CB_01), HANDLER(CB_02), HANDLER(CB_03),	\
+/* 0x04 */	HANDLER(CB_04), HANDLER(CB_05), HANDLER(CB_06), HANDLER(CB_07),	\
+/* 0x08 */	HANDLER(CB_08), HANDLER(CB_09), HANDLER(CB_0a), HANDLER(CB_0b),	\
+/* 0x0c */	HANDLER(CB_0c), HANDLER(CB_0d), HANDLER(CB_0e), HANDLER(CB_0f),	\
+/* 0x10 */	HANDLER(CB_10), HANDLER(CB_11), HANDLER(CB_12), HANDLER(CB_13),	\
+/* 0x14 */	HANDLER(CB_14), HANDLER(CB_15), HANDLER(CB_16), HANDLER(CB_17),	\
+/* 0x18 */	HANDLER(CB_18), HANDLER(CB_19), HANDLER(CB_1a), HANDLER(CB_1b),	\
+/* 0x1c */	HANDLER(CB_1c), HANDLER(CB_1d), HANDLER(CB_1e), HANDLER(CB_1f),	\
+/* 0x20 */	HANDLER(CB_20), HANDLER(CB_21), HANDLER(CB_22), HANDLER(CB_23),	\
+/* 0x24 */	HANDLER(CB_24), HANDLER(CB_25), HANDLER(CB_26), HANDLER(CB_27),	\
+/* 0x28 */	HANDLER(CB_28), HANDLER(CB_29), HANDLER(CB_2a), HANDLER(CB_2b),	\
+/* 0x2c */	HANDLER(CB_2c), HANDLER(CB_2d), HANDLER(CB_2e), HANDLER(CB_2f),	\
+/* 0x30 */	HANDLER(CB_30), HANDLER(CB_31), HANDLER(CB_32), HANDLER(CB_33),	\
+/* 0x34 */	HANDLER(CB_34), HANDLER(CB_35), HANDLER(CB_36), HANDLER(CB_37),	\
+/* 0x38 */	HANDLER(CB_38), HANDLER(CB_39), HANDLER(CB_3a), HANDLER(CB_3b),	\
+/* 0x3c */	HANDLER(CB_3c), HANDLER(CB_3d), HANDLER(CB_3e), HANDLER(CB_3f),	\
+/* 0x40 */	HANDLER(CB_40), HANDLER(CB_41), HANDLER(CB_42), HANDLER(CB_43),	\
+/* 0x44 */	HANDLER(CB_44), HANDLER(CB_45), HANDLER(CB_46), HANDLER(CB_47),	\
+/* 0x48 */	HANDLER(CB_48), HANDLER(CB_49), HANDLER(CB_4a), HANDLER(CB_4b),	\
+/* 0x4c */	HANDLER(CB_4c), HANDLER(CB_4d), HANDLER(CB_4e), HANDLER(CB_4f),	\
+/* 0x50 */	HANDLER(CB_50), HANDLER(CB_51), HANDLER(CB_52), HANDLER(CB_53),	\
+/* 0x54 */	HANDLER(CB_54), HANDLER(CB_55), HANDLER(CB_56), HANDLER(CB_57),	\
+/* 0x58 */	HANDLER(CB_58), HANDLER(CB_59), HANDLER(CB_5a), HANDLER(CB_5b),	\
+/* 0x5c */	HANDLER(CB_5c), HANDLER(CB_5d), HANDLER(CB_5e), HANDLER(CB_5f),	\
+/* 0x60 */	HANDLER(CB_60), HANDLER(CB_61), HANDLER(CB_62), HANDLER(CB_63),	\
+/* 0x64 */	HANDLER(CB_64), HANDLER(CB_65), HANDLER(CB_66), HANDLER(CB_67),	\
+/* 0x68 */	HANDLER(CB_68), HANDLER(CB_69), HANDLER(CB_6a), HANDLER(CB_6b),	\
+/* 0x6c */	HANDLER(CB_6c), HANDLER(CB_6d), HANDLER(CB_6e), HANDLER(CB_6f),	\
+/* 0x70 */	HANDLER(CB_70), HANDLER(CB_71), HANDLER(CB_72), HANDLER(CB_73),	\
+/* 0x74 */	HANDLER(CB_74), HANDLER(CB_75), HANDLER(CB_76), HANDLER(CB_77),	\
+/* 0x78 */	HANDLER(CB_78), HANDLER(CB_79), HANDLER(CB_7a), HANDLER(CB_7b),	\
+/* 0x7c */	HANDLER(CB_7c), HANDLER(CB_7d), HANDLER(CB_7e), HANDLER(CB_7f),	\
+/* 0x80 */	HANDLER(CB_80), HANDLER(CB_81), HANDLER(CB_82), HANDLER(CB_83),	\
+/* 0x84 */	HANDLER(CB_84), HANDLER(CB_85), HANDLER(CB_86), HANDLER(CB_87),	\
+/* 0x88 */	HANDLER(CB_88), HANDLER(CB_89), HANDLER(CB_8a), HANDLER(CB_8b),	\
+/* 0x8c */	HANDLER(CB_8c), HANDLER(CB_8d), HANDLER(CB_8e), HANDLER(CB_8f),	\
+/* 0x90 */	HANDLER(CB_90), HANDLER(CB_91), HANDLER(CB_92), HANDLER(CB_93),	\
+/* 0x94 */	HANDLER(CB_94), HANDLER(CB_95), HANDLER(CB_96), HANDLER(CB_97),	\
+/* 0x98 */	HANDLER(CB_98), HANDLER(CB_99), HANDLER(CB_9a), HANDLER(CB_9b),	\
+/* 0x9c */	HANDLER(CB_9c), HANDLER(CB_9d), HANDLER(CB_9e), HANDLER(CB_9f),	\
+/* 0xa0 */	HANDLER(CB_a0), HANDLER(CB_a1), HANDLER(CB_a2), HANDLER(CB_a3),	\
+/* 0xa4 */	HANDLER(CB_a4), HANDLER(CB_a5), HANDLER(CB_a6), HANDLER(CB_a7),	\
+/* 0xa8 */	HANDLER(CB_a8), HANDLER(CB_a9), HANDLER(CB_aa), HANDLER(CB_ab),	\
+/* 0xac */	HANDLER(CB_ac), HANDLER(CB_ad), HANDLER(CB_ae), HANDLER(CB_af),	\
+/* 0xb0 */	HANDLER(CB_b0), HANDLER(CB_b1), HANDLER(CB_b2), HANDLER(CB_b3),	\
+/* 0xb4 */	HANDLER(CB_b4), HANDLER(CB_b5), HANDLER(CB_b6), HANDLER(CB_b7),	\
+/* 0xb8 */	HANDLER(CB_b8), HANDLER(CB_b9), HANDLER(CB_ba), HANDLER(CB_bb),	\
+/* 0xbc */	HANDLER(CB_bc), HANDLER(CB_bd), HANDLER(CB_be), HANDLER(CB_bf),	\
+/* 0xc0 */	HANDLER(CB_c0), HANDLER(CB_c1), HANDLER(CB_c2), HANDLER(CB_c3),	\
+/* 0xc4 */	HANDLER(CB_c4), HANDLER(CB_c5), HANDLER(CB_c6), HANDLER(CB_c7),	\
+/* 0xc8 */	HANDLER(CB_c8), HANDLER(CB_c9), HANDLER(CB_ca), HANDLER(CB_cb),	\
+/* 0xcc */	HANDLER(CB_cc), HANDLER(CB_cd), HANDLER(CB_ce), HANDLER(CB_cf),	\
+/* 0xd0 */	HANDLER(CB_d0), HANDLER(CB_d1), HANDLER(CB_d2), HANDLER(CB_d3),	\
+/* 0xd4 */	HANDLER(CB_d4), HANDLER(CB_d5), HANDLER(CB_d6), HANDLER(CB_d7),	\
+/* 0xd8 */	HANDLER(CB_d8), HANDLER(CB_d9), HANDLER(CB_da), HANDLER(CB_db),	\
+/* 0xdc */	HANDLER(CB_dc), HANDLER(CB_dd), HANDLER(CB_de), HANDLER(CB_df),	\
+/* 0xe0 */	HANDLER(CB_e0), HANDLER(CB_e1), HANDLER(CB_e2), HANDLER(CB_e3),	\
+/* 0xe4 */	HANDLER(CB_e4), HANDLER(CB_e5), HANDLER(CB_e6), HANDLER(CB_e7),	\
+/* 0xe8 */	HANDLER(CB_e8), HANDLER(CB_e9), HANDLER(CB_ea), HANDLER(CB_eb),	\
+/* 0xec */	HANDLER(CB_ec), HANDLER(CB_ed), HANDLER(CB_ee), HANDLER(CB_ef),	\
+/* 0xf0 */	HANDLER(CB_f0), HANDLER(CB_f1), HANDLER(CB_f2), HANDLER(CB_f3),	\
+/* 0xf4 */	HANDLER(CB_f4), HANDLER(CB_f5), HANDLER(CB_f6), HANDLER(CB_f7),	\
+/* 0xf8 */	HANDLER(CB_f8), HANDLER(CB_f9), HANDLER(CB_fa), HANDLER(CB_fb),	\
+/* 0xfc */	HANDLER(CB_fc), HANDLER(CB_fd), HANDLER(CB_fe), HANDLER(CB_ff)
+
+
+#define ED_OPCODES \
+/* 0x00 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x04 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x08 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x0c */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x10 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x14 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x18 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x1c */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x20 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x24 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x28 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x2c */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x30 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x34 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x38 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x3c */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x40 */	HANDLER(ED_40), HANDLER(ED_41), HANDLER(ED_42), HANDLER(ED_43),	\
+/* 0x44 */	HANDLER(ED_44), HANDLER(ED_45), HANDLER(ED_46), HANDLER(ED_47),	\
+/* 0x48 */	HANDLER(ED_48), HANDLER(ED_49), HANDLER(ED_4a), HANDLER(ED_4b),	\
+/* 0x4c */	HANDLER(ED_44), HANDLER(ED_4d), HANDLER(ED_46), HANDLER(ED_4f),	\
+/* 0x50 */	HANDLER(ED_50), HANDLER(ED_51), HANDLER(ED_52), HANDLER(ED_53),	\
+/* 0x54 */	HANDLER(ED_44), HANDLER(ED_45), HANDLER(ED_56), HANDLER(ED_57),	\
+/* 0x58 */	HANDLER(ED_58), HANDLER(ED_59), HANDLER(ED_5a), HANDLER(ED_5b),	\
+/* 0x5c */	HANDLER(ED_44), HANDLER(ED_45), HANDLER(ED_5e), HANDLER(ED_5f),	\
+/* 0x60 */	HANDLER(ED_60), HANDLER(ED_61), HANDLER(ED_62), HANDLER(ED_63),	\
+/* 0x64 */	HANDLER(ED_44), HANDLER(ED_45), HANDLER(ED_46), HANDLER(ED_67),	\
+/* 0x68 */	HANDLER(ED_68), HANDLER(ED_69), HANDLER(ED_6a), HANDLER(ED_6b),	\
+/* 0x6c */	HANDLER(ED_44), HANDLER(ED_45), HANDLER(ED_46), HANDLER(ED_6f),	\
+/* 0x70 */	HANDLER(ED_70), HANDLER(ED_71), HANDLER(ED_72), HANDLER(ED_73),	\
+/* 0x74 */	HANDLER(ED_44), HANDLER(ED_45), HANDLER(ED_56), HANDLER(ED_Nop),	\
+/* 0x78 */	HANDLER(ED_78), HANDLER(ED_79), HANDLER(ED_7a), HANDLER(ED_7b),	\
+/* 0x7c */	HANDLER(ED_44), HANDLER(ED_45), HANDLER(ED_5e), HANDLER(ED_Nop),	\
+/* 0x80 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x84 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x88 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x8c */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x90 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x94 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x98 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0x9c */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xa0 */	HANDLER(ED_a0), HANDLER(ED_a1), HANDLER(ED_a2), HANDLER(ED_a3),	\
+/* 0xa4 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xa8 */	HANDLER(ED_a8), HANDLER(ED_a9), HANDLER(ED_aa), HANDLER(ED_ab),	\
+/* 0xac */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xb0 */	HANDLER(ED_b0), HANDLER(ED_b1), HANDLER(ED_b2), HANDLER(ED_b3),	\
+/* 0xb4 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xb8 */	HANDLER(ED_b8), HANDLER(ED_b9), HANDLER(ED_ba), HANDLER(ED_bb),	\
+/* 0xbc */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xc0 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xc4 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xc8 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xcc */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xd0 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xd4 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xd8 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xdc */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xe0 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xe4 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xe8 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xec */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xf0 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xf4 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xf8 */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop),	\
+/* 0xfc */	HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop), HANDLER(ED_Nop)
+
+
+#define DD_OPCODES \
+/* 0x00 */	HANDLER(Op_00), HANDLER(Op_01), HANDLER(Op_02), HANDLER(Op_03),	\
+/* 0x04 */	HANDLER(Op_04), HANDLER(Op_05), HANDLER(Op_06), HANDLER(Op_07),	\
+/* 0x08 */	HANDLER(Op_08), HANDLER(DD_09), HANDLER(Op_0a), HANDLER(Op_0b),	\
+/* 0x0c */	HANDLER(Op_0c), HANDLER(Op_0d), HANDLER(Op_0e), HANDLER(Op_0f),	\
+/* 0x10 */	HANDLER(Op_10), HANDLER(Op_11), HANDLER(Op_12), HANDLER(Op_13),	\
+/* 0x14 */	HANDLER(Op_14), HANDLER(Op_15), HANDLER(Op_16), HANDLER(Op_17),	\
+/* 0x18 */	HANDLER(Op_18), HANDLER(DD_19), HANDLER(Op_1a), HANDLER(Op_1b),	\
+/* 0x1c */	HANDLER(Op_1c), HANDLER(Op_1d), HANDLER(Op_1e), HANDLER(Op_1f),	\
+/* 0x20 */	HANDLER(Op_20), HANDLER(DD_21), HANDLER(DD_22), HANDLER(DD_23),	\
+/* 0x24 */	HANDLER(DD_24), HANDLER(DD_25), HANDLER(DD_26), HANDLER(Op_27),	\
+/* 0x28 */	HANDLER(Op_28), HANDLER(DD_29), HANDLER(DD_2a), HANDLER(DD_2b),	\
+/* 0x2c */	HANDLER(DD_2c), HANDLER(DD_2d), HANDLER(DD_2e), HANDLER(Op_2f),	\
+/* 0x30 */	HANDLER(Op_30), HANDLER(Op_31), HANDLER(Op_32), HANDLER(Op_33),	\
+/* 0x34 */	HANDLER(DD_34), HANDLER(DD_35), HANDLER(DD_36), HANDLER(Op_37),	\
+/* 0x38 */	HANDLER(Op_38), HANDLER(DD_39), HANDLER(Op_3a), HANDLER(Op_3b),	\
+/* 0x3c */	HANDLER(Op_3c), HANDLER(Op_3d), HANDLER(Op_3e), HANDLER(Op_3f),	\
+/* 0x40 */	HANDLER(Op_40), HANDLER(Op_41), HANDLER(Op_42), HANDLER(Op_43),	\
+/* 0x44 */	HANDLER(DD_44), HANDLER(DD_45), HANDLER(DD_46), HANDLER(Op_47),	\
+/* 0x48 */	HANDLER(Op_48), HANDLER(Op_49), HANDLER(Op_4a), HANDLER(Op_4b),	\
+/* 0x4c */	HANDLER(DD_4c), HANDLER(DD_4d), HANDLER(DD_4e), HANDLER(Op_4f),	\
+/* 0x50 */	HANDLER(Op_50), HANDLER(Op_51), HANDLER(Op_52), HANDLER(Op_53),	\
+/* 0x54 */	HANDLER(DD_54), HANDLER(DD_55), HANDLER(DD_56), HANDLER(Op_57),	\
+/* 0x58 */	HANDLER(Op_58), HANDLER(Op_59), HANDLER(Op_5a), HANDLER(Op_5b),	\
+/* 0x5c */	HANDLER(DD_5c), HANDLER(DD_5d), HANDLER(DD_5e), HANDLER(Op_5f),	\
+/* 0x60 */	HANDLER(DD_60), HANDLER(DD_61), HANDLER(DD_62), HANDLER(DD_63),	\
+/* 0x64 */	HANDLER(DD_64), HANDLER(DD_65), HANDLER(DD_66), HANDLER(DD_67),	\
+/* 0x68 */	HANDLER(DD_68), HANDLER(DD_69), HANDLER(DD_6a), HANDLER(DD_6b),	\
+/* 0x6c */	HANDLER(DD_6c), HANDLER(DD_6d), HANDLER(DD_6e), HANDLER(DD_6f),	\
+/* 0x70 */	HANDLER(DD_70), HANDLER(DD_71), HANDLER(DD_72), HANDLER(DD_73),	\
+/* 0x74 */	HANDLER(DD_74), HANDLER(DD_75), HANDLER(Op_76), HANDLER(DD_77),	\
+/* 0x78 */	HANDLER(Op_78), HANDLER(Op_79), HANDLER(Op_7a), HANDLER(Op_7b),	\
+/* 0x7c */	HANDLER(DD_7c), HANDLER(DD_7d), HANDLER(DD_7e), HANDLER(Op_7f),	\
+/* 0x80 */	HANDLER(Op_80), HANDLER(Op_81), HANDLER(Op_82), HANDLER(Op_83),	\
+/* 0x84 */	HANDLER(DD_84), HANDLER(DD_85), HANDLER(DD_86), HANDLER(Op_87),	\
+/* 0x88 */	HANDLER(Op_88), HANDLER(Op_89), HANDLER(Op_8a), HANDLER(Op_8b),	\
+/* 0x8c */	HANDLER(DD_8c), HANDLER(DD_8d), HANDLER(DD_8e), HANDLER(Op_8f),	\
+/* 0x90 */	HANDLER(Op_90), HANDLER(Op_91), HANDLER(Op_92), HANDLER(Op_93),	\
+/* 0x94 */	HANDLER(DD_94), HANDLER(DD_95), HANDLER(DD_96), HANDLER(Op_97),	\
+/* 0x98 */	HANDLER(Op_98), HANDLER(Op_99), HANDLER(Op_9a), HANDLER(Op_9b),	\
+/* 0x9c */	HANDLER(DD_9c), HANDLER(DD_9d), HANDLER(DD_9e), HANDLER(Op_9f),	\
+/* 0xa0 */	HANDLER(Op_a0), HANDLER(Op_a1), HANDLER(Op_a2), HANDLER(Op_a3),	\
+/* 0xa4 */	HANDLER(DD_a4), HANDLER(DD_a5), HANDLER(DD_a6), HANDLER(Op_a7),	\
+/* 0xa8 */	HANDLER(Op_a8), HANDLER(Op_a9), HANDLER(Op_aa), HANDLER(Op_ab),	\
+/* 0xac */	HANDLER(DD_ac), HANDLER(DD_ad), HANDLER(DD_ae), HANDLER(Op_af),	\
+/* 0xb0 */	HANDLER(Op_b0), HANDLER(Op_b1), HANDLER(Op_b2), HANDLER(Op_b3),	\
+/* 0xb4 */	HANDLER(DD_b4), HANDLER(DD_b5), HANDLER(DD_b6), HANDLER(Op_b7),	\
+/* 0xb8 */	HANDLER(Op_b8), HANDLER(Op_b9), HANDLER(Op_ba), HANDLER(Op_bb),	\
+/* 0xbc */	HANDLER(DD_bc), HANDLER(DD_bd), HANDLER(DD_be), HANDLER(Op_bf),	\
+/* 0xc0 */	HANDLER(Op_c0), HANDLER(Op_c1), HANDLER(Op_c2), HANDLER(Op_c3),	\
+/* 0xc4 */	HANDLER(Op_c4), HANDLER(Op_c5), HANDLER(Op_c6), HANDLER(Op_c7),	\
+/* 0xc8 */	HANDLER(Op_c8), HANDLER(Op_c9), HANDLER(Op_ca), HANDLER(DD_cb),	\
+/* 0xcc */	HANDLER(Op_cc), HANDLER(Op_cd), HANDLER(Op_ce), HANDLER(Op_cf),	\
+/* 0xd0 */	HANDLER(Op_d0), HANDLER(Op_d1), HANDLER(Op_d2), HANDLER(Op_d3),	\
+/* 0xd4 */	HANDLER(Op_d4), HANDLER(Op_d5), HANDLER(Op_d6), HANDLER(Op_d7),	\
+/* 0xd8 */	HANDLER(Op_d8), HANDLER(Op_d9), HANDLER(Op_da), HANDLER(Op_db),	\
+/* 0xdc */	HANDLER(Op_dc), HANDLER(Op_dd), HANDLER(Op_de), HANDLER(Op_df),	\
+/* 0xe0 */	HANDLER(Op_e0), HANDLER(DD_e1), HANDLER(Op_e2), HANDLER(DD_e3),	\
+/* 0xe4 */	HANDLER(Op_e4), HANDLER(DD_e5), HANDLER(Op_e6), HANDLER(Op_e7),	\
+/* 0xe8 */	HANDLER(Op_e8), HANDLER(DD_e9), HANDLER(Op_ea), HANDLER(DD_eb),	\
+/* 0xec */	HANDLER(Op_ec), HANDLER(Op_ed), HANDLER(Op_ee), HANDLER(Op_ef),	\
+/* 0xf0 */	HANDLER(Op_f0), HANDLER(Op_f1), HANDLER(Op_f2), HANDLER(Op_f3),	\
+/* 0xf4 */	HANDLER(Op_f4), HANDLER(Op_f5), HANDLER(Op_f6), HANDLER(Op_f7),	\
+/* 0xf8 */	HANDLER(Op_f8), HANDLER(DD_f9), HANDLER(Op_fa), HANDLER(Op_fb),	\
+/* 0xfc */	HANDLER(Op_fc), HANDLER(Op_fd), HANDLER(Op_fe), HANDLER(Op_ff)
+
+
+#define FD_OPCODES \
+/* 0x00 */	HANDLER(Op_00), HANDLER(Op_01), HANDLER(Op_02), HANDLER(Op_03),	\
+/* 0x04 */	HANDLER(Op_04), HANDLER(Op_05), HANDLER(Op_06), HANDLER(Op_07),	\
+/* 0x08 */	HANDLER(Op_08), HANDLER(FD_09), HANDLER(Op_0a), HANDLER(Op_0b),	\
+/* 0x0c */	HANDLER(Op_0c), HANDLER(Op_0d), HANDLER(Op_0e), HANDLER(Op_0f),	\
+/* 0x10 */	HANDLER(Op_10), HANDLER(Op_11), HANDLER(Op_12), HANDLER(Op_13),	\
+/* 0x14 */	HANDLER(Op_14), HANDLER(Op_15), HANDLER(Op_16), HANDLER(Op_17),	\
+/* 0x18 */	HANDLER(Op_18), HANDLER(FD_19), HANDLER(Op_1a), HANDLER(Op_1b),	\
+/* 0x1c */	HANDLER(Op_1c), HANDLER(Op_1d), HANDLER(Op_1e), HANDLER(Op_1f),	\
+/* 0x20 */	HANDLER(Op_20), HANDLER(FD_21), HANDLER(FD_22), HANDLER(FD_23),	\
+/* 0x24 */	HANDLER(FD_24), HANDLER(FD_25), HANDLER(FD_26), HANDLER(Op_27),	\
+/* 0x28 */	HANDLER(Op_28), HANDLER(FD_29), HANDLER(FD_2a), HANDLER(FD_2b),	\
+/* 0x2c */	HANDLER(FD_2c), HANDLER(FD_2d), HANDLER(FD_2e), HANDLER(Op_2f),	\
+/* 0x30 */	HANDLER(Op_30), HANDLER(Op_31), HANDLER(Op_32), HANDLER(Op_33),	\
+/* 0x34 */	HANDLER(FD_34), HANDLER(FD_35), HANDLER(FD_36), HANDLER(Op_37),	\
+/* 0x38 */	HANDLER(Op_38), HANDLER(FD_39), HANDLER(Op_3a), HANDLER(Op_3b),	\
+/* 0x3c */	HANDLER(Op_3c), HANDLER(Op_3d), HANDLER(Op_3e), HANDLER(Op_3f),	\
+/* 0x40 */	HANDLER(Op_40), HANDLER(Op_41), HANDLER(Op_42), HANDLER(Op_43),	\
+/* 0x44 */	HANDLER(FD_44), HANDLER(FD_45), HANDLER(FD_46), HANDLER(Op_47),	\
+/* 0x48 */	HANDLER(Op_48), HANDLER(Op_49), HANDLER(Op_4a), HANDLER(Op_4b),	\
+/* 0x4c */	HANDLER(FD_4c), HANDLER(FD_4d), HANDLER(FD_4e), HANDLER(Op_4f),	\
+/* 0x50 */	HANDLER(Op_50), HANDLER(Op_51), HANDLER(Op_52), HANDLER(Op_53),	\
+/* 0x54 */	HANDLER(FD_54), HANDLER(FD_55), HANDLER(FD_56), HANDLER(Op_57),	\
+/* 0x58 */	HANDLER(Op_58), HANDLER(Op_59), HANDLER(Op_5a), HANDLER(Op_5b),	\
+/* 0x5c */	HANDLER(FD_5c), HANDLER(FD_5d), HANDLER(FD_5e), HANDLER(Op_5f),	\
+/* 0x60 */	HANDLER(FD_60), HANDLER(FD_61), HANDLER(FD_62), HANDLER(FD_63),	\
+/* 0x64 */	HANDLER(FD_64), HANDLER(FD_65), HANDLER(FD_66), HANDLER(FD_67),	\
+/* 0x68 */	HANDLER(FD_68), HANDLER(FD_69), HANDLER(FD_6a), HANDLER(FD_6b),	\
+/* 0x6c */	HANDLER(FD_6c), HANDLER(FD_6d), HANDLER(FD_6e), HANDLER(FD_6f),	\
+/* 0x70 */	HANDLER(FD_70), HANDLER(FD_71), HANDLER(FD_72), HANDLER(FD_73),	\
+/* 0x74 */	HANDLER(FD_74), HANDLER(FD_75), HANDLER(Op_76), HANDLER(FD_77),	\
+/* 0x78 */	HANDLER(Op_78), HANDLER(Op_79), HANDLER(Op_7a), HANDLER(Op_7b),	\
+/* 0x7c */	HANDLER(FD_7c), HANDLER(FD_7d), HANDLER(FD_7e), HANDLER(Op_7f),	\
+/* 0x80 */	HANDLER(Op_80), HANDLER(Op_81), HANDLER(Op_82), HANDLER(Op_83),	\
+/* 0x84 */	HANDLER(FD_84), HANDLER(FD_85), HANDLER(FD_86), HANDLER(Op_87),	\
+/* 0x88 */	HANDLER(Op_88), HANDLER(Op_89), HANDLER(Op_8a), HANDLER(Op_8b),	\
+/* 0x8c */	HANDLER(FD_8c), HANDLER(FD_8d), HANDLER(FD_8e), HANDLER(Op_8f),	\
+/* 0x90 */	HANDLER(Op_90), HANDLER(Op_91), HANDLER(Op_92), HANDLER(Op_93),	\
+/* 0x94 */	HANDLER(FD_94), HANDLER(FD_95), HANDLER(FD_96), HANDLER(Op_97),	\
+/* 0x98 */	HANDLER(Op_98), HANDLER(Op_99), HANDLER(Op_9a), HANDLER(Op_9b),	\
+/* 0x9c */	HANDLER(FD_9c), HANDLER(FD_9d), HANDLER(FD_9e), HANDLER(Op_9f),	\
+/* 0xa0 */	HANDLER(Op_a0), HANDLER(Op_a1), HANDLER(Op_a2), HANDLER(Op_a3),	\
+/* 0xa4 */	HANDLER(FD_a4), HANDLER(FD_a5), HANDLER(FD_a6), HANDLER(Op_a7),	\
+/* 0xa8 */	HANDLER(Op_a8), HANDLER(Op_a9), HANDLER(Op_aa), HANDLER(Op_ab),	\
+/* 0xac */	HANDLER(FD_ac), HANDLER(FD_ad), HANDLER(FD_ae), HANDLER(Op_af),	\
+/* 0xb0 */	HANDLER(Op_b0), HANDLER(Op_b1), HANDLER(Op_b2), HANDLER(Op_b3),	\
+/* 0xb4 */	HANDLER(FD_b4), HANDLER(FD_b5), HANDLER(FD_b6), HANDLER(Op_b7),	\
+/* 0xb8 */	HANDLER(Op_b8), HANDLER(Op_b9), HANDLER(Op_ba), HANDLER(Op_bb),	\
+/* 0xbc */	HANDLER(FD_bc), HANDLER(FD_bd), HANDLER(FD_be), HANDLER(Op_bf),	\
+/* 0xc0 */	HANDLER(Op_c0), HANDLER(Op_c1), HANDLER(Op_c2), HANDLER(Op_c3),	\
+/* 0xc4 */	HANDLER(Op_c4), HANDLER(Op_c5), HANDLER(Op_c6), HANDLER(Op_c7),	\
+/* 0xc8 */	HANDLER(Op_c8), HANDLER(Op_c9), HANDLER(Op_ca), HANDLER(FD_cb),	\
+/* 0xcc */	HANDLER(Op_cc), HANDLER(Op_cd), HANDLER(Op_ce), HANDLER(Op_cf),	\
+/* 0xd0 */	HANDLER(Op_d0), HANDLER(Op_d1), HANDLER(Op_d2), HANDLER(Op_d3),	\
+/* 0xd4 */	HANDLER(Op_d4), HANDLER(Op_d5), HANDLER(Op_d6), HANDLER(Op_d7),	\
+/* 0xd8 */	HANDLER(Op_d8), HANDLER(Op_d9), HANDLER(Op_da), HANDLER(Op_db),	\
+/* 0xdc */	HANDLER(Op_dc), HANDLER(Op_dd), HANDLER(Op_de), HANDLER(Op_df),	\
+/* 0xe0 */	HANDLER(Op_e0), HANDLER(FD_e1), HANDLER(Op_e2), HANDLER(FD_e3),	\
+/* 0xe4 */	HANDLER(Op_e4), HANDLER(FD_e5), HANDLER(Op_e6), HANDLER(Op_e7),	\
+/* 0xe8 */	HANDLER(Op_e8), HANDLER(FD_e9), HANDLER(Op_ea), HANDLER(FD_eb),	\
+/* 0xec */	HANDLER(Op_ec), HANDLER(Op_ed), HANDLER(Op_ee), HANDLER(Op_ef),	\
+/* 0xf0 */	HANDLER(Op_f0), HANDLER(Op_f1), HANDLER(Op_f2), HANDLER(Op_f3),	\
+/* 0xf4 */	HANDLER(Op_f4), HANDLER(Op_f5), HANDLER(Op_f6), HANDLER(Op_f7),	\
+/* 0xf8 */	HANDLER(Op_f8), HANDLER(FD_f9), HANDLER(Op_fa), HANDLER(Op_fb),	\
+/* 0xfc */	HANDLER(Op_fc), HANDLER(Op_fd), HANDLER(Op_fe), HANDLER(Op_ff)
+
+
+#define XYCB_OPCODES \
+/* 0x00 */	HANDLER(XYCB_00), HANDLER(XYCB_01), HANDLER(XYCB_02), HANDLER(XYCB_03),	\
+/* 0x04 */	HANDLER(XYCB_04), HANDLER(XYCB_05), HANDLER(XYCB_06), HANDLER(XYCB_07),	\
+/* 0x08 */	HANDLER(XYCB_08), HANDLER(XYCB_09), HANDLER(XYCB_0a), HANDLER(XYCB_0b),	\
+/* 0x0c */	HANDLER(XYCB_0c), HANDLER(XYCB_0d), HANDLER(XYCB_0e), HANDLER(XYCB_0f),	\
+/* 0x10 */	HANDLER(XYCB_10), HANDLER(XYCB_11), HANDLER(XYCB_12), HANDLER(XYCB_13),	\
+/* 0x14 */	HANDLER(XYCB_14), HANDLER(XYCB_15), HANDLER(XYCB_16), HANDLER(XYCB_17),	\
+/* 0x18 */	HANDLER(XYCB_18), HANDLER(XYCB_19), HANDLER(XYCB_1a), HANDLER(XYCB_1b),	\
+/* 0x1c */	HANDLER(XYCB_1c), HANDLER(XYCB_1d), HANDLER(XYCB_1e), HANDLER(XYCB_1f),	\
+/* 0x20 */	HANDLER(XYCB_20), HANDLER(XYCB_21), HANDLER(XYCB_22), HANDLER(XYCB_23),	\
+/* 0x24 */	HANDLER(XYCB_24), HANDLER(XYCB_25), HANDLER(XYCB_26), HANDLER(XYCB_27),	\
+/* 0x28 */	HANDLER(XYCB_28), HANDLER(XYCB_29), HANDLER(XYCB_2a), HANDLER(XYCB_2b),	\
+/* 0x2c */	HANDLER(XYCB_2c), HANDLER(XYCB_2d), HANDLER(XYCB_2e), HANDLER(XYCB_2f),	\
+/* 0x30 */	HANDLER(XYCB_30), HANDLER(XYCB_31), HANDLER(XYCB_32), HANDLER(XYCB_33),	\
+/* 0x34 */	HANDLER(XYCB_34), HANDLER(XYCB_35), HANDLER(XYCB_36), HANDLER(XYCB_37),	\
+/* 0x38 */	HANDLER(XYCB_38), HANDLER(XYCB_39), HANDLER(XYCB_3a), HANDLER(XYCB_3b),	\
+/* 0x3c */	HANDLER(XYCB_3c), HANDLER(XYCB_3d), HANDLER(XYCB_3e), HANDLER(XYCB_3f),	\
+/* 0x40 */	HANDLER(XYCB_40), HANDLER(XYCB_41), HANDLER(XYCB_42), HANDLER(XYCB_43),	\
+/* 0x44 */	HANDLER(XYCB_44), HANDLER(XYCB_45), HANDLER(XYCB_46), HANDLER(XYCB_47),	\
+/* 0x48 */	HANDLER(XYCB_48), HANDLER(XYCB_49), HANDLER(XYCB_4a), HANDLER(XYCB_4b),	\
+/* 0x4c */	HANDLER(XYCB_4c), HANDLER(XYCB_4d), HANDLER(XYCB_4e), HANDLER(XYCB_4f),	\
+/* 0x50 */	HANDLER(XYCB_50), HANDLER(XYCB_51), HANDLER(XYCB_52), HANDLER(XYCB_53),	\
+/* 0x54 */	HANDLER(XYCB_54), HANDLER(XYCB_55), HANDLER(XYCB_56), HANDLER(XYCB_57),	\
+/* 0x58 */	HANDLER(XYCB_58), HANDLER(XYCB_59), HANDLER(XYCB_5a), HANDLER(XYCB_5b),	\
+/* 0x5c */	HANDLER(XYCB_5c), HANDLER(XYCB_5d), HANDLER(XYCB_5e), HANDLER(XYCB_5f),	\
+/* 0x60 */	HANDLER(XYCB_60), HANDLER(XYCB_61), HANDLER(XYCB_62), HANDLER(XYCB_63),	\
+/* 0x64 */	HANDLER(XYCB_64), HANDLER(XYCB_65), HANDLER(XYCB_66), HANDLER(XYCB_67),	\
+/* 0x68 */	HANDLER(XYCB_68), HANDLER(XYCB_69), HANDLER(XYCB_6a), HANDLER(XYCB_6b),	\
+/* 0x6c */	HANDLER(XYCB_6c), HANDLER(XYCB_6d), HANDLER(XYCB_6e), HANDLER(XYCB_6f),	\
+/* 0x70 */	HANDLER(XYCB_70), HANDLER(XYCB_71), HANDLER(XYCB_72), HANDLER(XYCB_73),	\
+/* 0x74 */	HANDLER(XYCB_74), HANDLER(XYCB_75), HANDLER(XYCB_76), HANDLER(XYCB_77),	\
+/* 0x78 */	HANDLER(XYCB_78), HANDLER(XYCB_79), HANDLER(XYCB_7a), HANDLER(XYCB_7b),	\
+/* 0x7c */	HANDLER(XYCB_7c), HANDLER(XYCB_7d), HANDLER(XYCB_7e), HANDLER(XYCB_7f),	\
+/* 0x80 */	HANDLER(XYCB_80), HANDLER(XYCB_81), HANDLER(XYCB_82), HANDLER(XYCB_83),	\
+/* 0x84 */	HANDLER(XYCB_84), HANDLER(XYCB_85), HANDLER(XYCB_86), HANDLER(XYCB_87),	\
+/* 0x88 */	HANDLER(XYCB_88), HANDLER(XYCB_89), HANDLER(XYCB_8a), HANDLER(XYCB_8b),	\
+/* 0x8c */	HANDLER(XYCB_8c), HANDLER(XYCB_8d), HANDLER(XYCB_8e), HANDLER(XYCB_8f),	\
+/* 0x90 */	HANDLER(XYCB_90), HANDLER(XYCB_91), HANDLER(XYCB_92), HANDLER(XYCB_93),	\
+/* 0x94 */	HANDLER(XYCB_94), HANDLER(XYCB_95), HANDLER(XYCB_96), HANDLER(XYCB_97),	\
+/* 0x98 */	HANDLER(XYCB_98), HANDLER(XYCB_99), HANDLER(XYCB_9a), HANDLER(XYCB_9b),	\
+/* 0x9c */	HANDLER(XYCB_9c), HANDLER(XYCB_9d), HANDLER(XYCB_9e), HANDLER(XYCB_9f),	\
+/* 0xa0 */	HANDLER(XYCB_a0), HANDLER(XYCB_a1), HANDLER(XYCB_a2), HANDLER(XYCB_a3),	\
+/* 0xa4 */	HANDLER(XYCB_a4), HANDLER(XYCB_a5), HANDLER(XYCB_a6), HANDLER(XYCB_a7),	\
+/* 0xa8 */	HANDLER(XYCB_a8), HANDLER(XYCB_a9), HANDLER(XYCB_aa), HANDLER(XYCB_ab),	\
+/* 0xac */	HANDLER(XYCB_ac), HANDLER(XYCB_ad), HANDLER(XYCB_ae), HANDLER(XYCB_af),	\
+/* 0xb0 */	HANDLER(XYCB_b0), HANDLER(XYCB_b1), HANDLER(XYCB_b2), HANDLER(XYCB_b3),	\
+/* 0xb4 */	HANDLER(XYCB_b4), HANDLER(XYCB_b5), HANDLER(XYCB_b6), HANDLER(XYCB_b7),	\
+/* 0xb8 */	HANDLER(XYCB_b8), HANDLER(XYCB_b9), HANDLER(XYCB_ba), HANDLER(XYCB_bb),	\
+/* 0xbc */	HANDLER(XYCB_bc), HANDLER(XYCB_bd), HANDLER(XYCB_be), HANDLER(XYCB_bf),	\
+/* 0xc0 */	HANDLER(XYCB_c0), HANDLER(XYCB_c1), HANDLER(XYCB_c2), HANDLER(XYCB_c3),	\
+/* 0xc4 */	HANDLER(XYCB_c4), HANDLER(XYCB_c5), HANDLER(XYCB_c6), HANDLER(XYCB_c7),	\
+/* 0xc8 */	HANDLER(XYCB_c8), HANDLER(XYCB_c9), HANDLER(XYCB_ca), HANDLER(XYCB_cb),	\
+/* 0xcc */	HANDLER(XYCB_cc), HANDLER(XYCB_cd), HANDLER(XYCB_ce), HANDLER(XYCB_cf),	\
+/* 0xd0 */	HANDLER(XYCB_d0), HANDLER(XYCB_d1), HANDLER(XYCB_d2), HANDLER(XYCB_d3),	\
+/* 0xd4 */	HANDLER(XYCB_d4), HANDLER(XYCB_d5), HANDLER(XYCB_d6), HANDLER(XYCB_d7),	\
+/* 0xd8 */	HANDLER(XYCB_d8), HANDLER(XYCB_d9), HANDLER(XYCB_da), HANDLER(XYCB_db),	\
+/* 0xdc */	HANDLER(XYCB_dc), HANDLER(XYCB_dd), HANDLER(XYCB_de), HANDLER(XYCB_df),	\
+/* 0xe0 */	HANDLER(XYCB_e0), HANDLER(XYCB_e1), HANDLER(XYCB_e2), HANDLER(XYCB_e3),	\
+/* 0xe4 */	HANDLER(XYCB_e4), HANDLER(XYCB_e5), HANDLER(XYCB_e6), HANDLER(XYCB_e7),	\
+/* 0xe8 */	HANDLER(XYCB_e8), HANDLER(XYCB_e9), HANDLER(XYCB_ea), HANDLER(XYCB_eb),	\
+/* 0xec */	HANDLER(XYCB_ec), HANDLER(XYCB_ed), HANDLER(XYCB_ee), HANDLER(XYCB_ef),	\
+/* 0xf0 */	HANDLER(XYCB_f0), HANDLER(XYCB_f1), HANDLER(XYCB_f2), HANDLER(XYCB_f3),	\
+/* 0xf4 */	HANDLER(XYCB_f4), HANDLER(XYCB_f5), HANDLER(XYCB_f6), HANDLER(XYCB_f7),	\
+/* 0xf8 */	HANDLER(XYCB_f8), HANDLER(XYCB_f9), HANDLER(XYCB_fa), HANDLER(XYCB_fb),	\
+/* 0xfc */	HANDLER(XYCB_fc), HANDLER(XYCB_fd), HANDLER(XYCB_fe), HANDLER(XYCB_ff)
+
+/* ---------------------------------------- HANDLER SHORT-HAND BLOCKS
+*/
+
+/* The opcodes that change meaning under a DD/FD prefix.  P is the prefix
+   for the handler names, R the register used for HL and EA the expression
+   giving the effective address for (HL).
+*/
+#define INDEX_16BIT_OPCODES(P,R) \
+OPCODE(P##_09)		/* ADD HL,BC */ \
+{ \
+    TSTATE(11); \
+    ADD16(cpu->R.w,cpu->BC.w); \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_19)		/* ADD HL,DE */ \
+{ \
+    TSTATE(11); \
+    ADD16(cpu->R.w,cpu->DE.w); \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_21)		/* LD HL,nnnn */ \
+{ \
+    TSTATE(10); \
+    cpu->R.w=FETCH_WORD; \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_22)		/* LD (nnnn),HL */ \
+{ \
+    TSTATE(16); \
+    POKEW(FETCH_WORD,cpu->R.w); \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_23)		/* INC HL */ \
+{ \
+    TSTATE(6); \
+    cpu->R.w++; \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_29)		/* ADD HL,HL */ \
+{ \
+    TSTATE(11); \
+    ADD16(cpu->R.w,cpu->R.w); \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_2a)		/* LD HL,(nnnn) */ \
+{ \
+    TSTATE(7); \
+    cpu->R.w=PEEKW(FETCH_WORD); \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_2b)		/* DEC HL */ \
+{ \
+    TSTATE(6); \
+    cpu->R.w--; \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_39)		/* ADD HL,SP */ \
+{ \
+    TSTATE(11); \
+    ADD16(cpu->R.w,cpu->SP); \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_e1)		/* POP HL */ \
+{ \
+    TSTATE(10); \
+    POP(cpu->R.w); \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_e3)		/* EX (SP),HL */ \
+{ \
+    Z80Word tmp; \
+    TSTATE(19); \
+    POP(tmp); \
+    PUSH(cpu->R.w); \
+    cpu->R.w=tmp; \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_e5)		/* PUSH HL */ \
+{ \
+    TSTATE(10); \
+    PUSH(cpu->R.w); \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_e9)		/* JP (HL) */ \
+{ \
+    TSTATE(4); \
+    cpu->PC=cpu->R.w; \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_eb)		/* EX DE,HL */ \
+{ \
+    TSTATE(4); \
+    SWAP(cpu->DE.w,cpu->R.w); \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_f9)		/* LD SP,HL */ \
+{ \
+    TSTATE(6); \
+    cpu->SP=cpu->R.w; \
+} \
+END_OPCODE
+
+#define INDEX_8BIT_OPCODES(P,R,EA) \
+OPCODE(P##_24)		/* INC H */ \
+{ \
+    TSTATE(4); \
+    INC8(cpu->R.b[HI]); \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_25)		/* DEC H */ \
+{ \
+    TSTATE(4); \
+    DEC8(cpu->R.b[HI]); \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_26)		/* LD H,n */ \
+{ \
+    TSTATE(7); \
+    cpu->R.b[HI]=FETCH_BYTE; \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_2c)		/* INC L */ \
+{ \
+    TSTATE(4); \
+    INC8(cpu->R.b[LO]); \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_2d)		/* DEC L */ \
+{ \
+    TSTATE(4); \
+    DEC8(cpu->R.b[LO]); \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_2e)		/* LD L,n */ \
+{ \
+    TSTATE(7); \
+    cpu->R.b[LO]=FETCH_BYTE; \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_34)		/* INC (HL) */ \
+{ \
+    Z80Word ea; \
+    TSTATE(11); \
+    ea=EA; \
+    OP_ON_MEM(INC8,ea); \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_35)		/* DEC (HL) */ \
+{ \
+    Z80Word ea; \
+    TSTATE(11); \
+    ea=EA; \
+    OP_ON_MEM(DEC8,ea); \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_36)		/* LD (HL),n */ \
+{ \
+    Z80Word ea; \
+    TSTATE(10); \
+    ea=EA; \
+    POKE(ea,FETCH_BYTE); \
+} \
+END_OPCODE
+
+/* LD DEST,H / LD DEST,L / LD DEST,(HL).  Note that DEST2 is the real
+   register, as in LD H,(IX+d).
+*/
+#define INDEX_LD_FROM_OPCODES(P,R,EA,N4,N5,N6,DEST,DEST2) \
+OPCODE(P##_##N4)	/* LD DEST,H */ \
+{ \
+    TSTATE(4); \
+    DEST=cpu->R.b[HI]; \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_##N5)	/* LD DEST,L */ \
+{ \
+    TSTATE(4); \
+    DEST=cpu->R.b[LO]; \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_##N6)	/* LD DEST,(HL) */ \
+{ \
+    Z80Word ea; \
+    TSTATE(7); \
+    ea=EA; \
+    DEST2=PEEK(ea); \
+} \
+END_OPCODE
+
+/* LD H,SRC / LD L,SRC for the registers other than H, L and (HL)
+*/
+#define INDEX_LD_TO_OPCODES(P,R,N0,N1,N2,N3,N7,DEST) \
+OPCODE(P##_##N0)	/* LD DEST,B */ \
+{ \
+    TSTATE(4); \
+    cpu->R.b[DEST]=cpu->BC.b[HI]; \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_##N1)	/* LD DEST,C */ \
+{ \
+    TSTATE(4); \
+    cpu->R.b[DEST]=cpu->BC.b[LO]; \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_##N2)	/* LD DEST,D */ \
+{ \
+    TSTATE(4); \
+    cpu->R.b[DEST]=cpu->DE.b[HI]; \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_##N3)	/* LD DEST,E */ \
+{ \
+    TSTATE(4); \
+    cpu->R.b[DEST]=cpu->DE.b[LO]; \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_##N7)	/* LD DEST,A */ \
+{ \
+    TSTATE(4); \
+    cpu->R.b[DEST]=cpu->AF.b[HI]; \
+} \
+END_OPCODE
+
+#define INDEX_LD_TO_MEM_OPCODE(P,EA,N,SRC) \
+OPCODE(P##_##N)		/* LD (HL),SRC */ \
+{ \
+    Z80Word ea; \
+    TSTATE(7); \
+    ea=EA; \
+    POKE(ea,SRC); \
+} \
+END_OPCODE
+
+#define INDEX_LD_OPCODES(P,R,EA) \
+INDEX_LD_FROM_OPCODES(P,R,EA,44,45,46,cpu->BC.b[HI],cpu->BC.b[HI]) \
+INDEX_LD_FROM_OPCODES(P,R,EA,4c,4d,4e,cpu->BC.b[LO],cpu->BC.b[LO]) \
+INDEX_LD_FROM_OPCODES(P,R,EA,54,55,56,cpu->DE.b[HI],cpu->DE.b[HI]) \
+INDEX_LD_FROM_OPCODES(P,R,EA,5c,5d,5e,cpu->DE.b[LO],cpu->DE.b[LO]) \
+INDEX_LD_FROM_OPCODES(P,R,EA,64,65,66,cpu->R.b[HI],cpu->HL.b[HI]) \
+INDEX_LD_FROM_OPCODES(P,R,EA,6c,6d,6e,cpu->R.b[LO],cpu->HL.b[LO]) \
+INDEX_LD_FROM_OPCODES(P,R,EA,7c,7d,7e,cpu->AF.b[HI],cpu->AF.b[HI]) \
+INDEX_LD_TO_OPCODES(P,R,60,61,62,63,67,HI) \
+INDEX_LD_TO_OPCODES(P,R,68,69,6a,6b,6f,LO) \
+INDEX_LD_TO_MEM_OPCODE(P,EA,70,cpu->BC.b[HI]) \
+INDEX_LD_TO_MEM_OPCODE(P,EA,71,cpu->BC.b[LO]) \
+INDEX_LD_TO_MEM_OPCODE(P,EA,72,cpu->DE.b[HI]) \
+INDEX_LD_TO_MEM_OPCODE(P,EA,73,cpu->DE.b[LO]) \
+INDEX_LD_TO_MEM_OPCODE(P,EA,74,cpu->HL.b[HI]) \
+INDEX_LD_TO_MEM_OPCODE(P,EA,75,cpu->HL.b[LO]) \
+INDEX_LD_TO_MEM_OPCODE(P,EA,77,cpu->AF.b[HI])
+
+#define INDEX_ALU_OPCODES(P,R,EA,N4,N5,N6,OP) \
+OPCODE(P##_##N4)	/* OP A,H */ \
+{ \
+    TSTATE(4); \
+    OP(cpu->R.b[HI]); \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_##N5)	/* OP A,L */ \
+{ \
+    TSTATE(4); \
+    OP(cpu->R.b[LO]); \
+} \
+END_OPCODE \
+ \
+OPCODE(P##_##N6)	/* OP A,(HL) */ \
+{ \
+    Z80Word ea; \
+    TSTATE(7); \
+    ea=EA; \
+    OP_ON_MEM(OP,ea); \
+} \
+END_OPCODE
+
+#define INDEX_OPCODES(P,R,EA) \
+INDEX_16BIT_OPCODES(P,R) \
+INDEX_8BIT_OPCODES(P,R,EA) \
+INDEX_LD_OPCODES(P,R,EA) \
+INDEX_ALU_OPCODES(P,R,EA,84,85,86,ADD8) \
+INDEX_ALU_OPCODES(P,R,EA,8c,8d,8e,ADC8) \
+INDEX_ALU_OPCODES(P,R,EA,94,95,96,SUB8) \
+INDEX_ALU_OPCODES(P,R,EA,9c,9d,9e,SBC8) \
+INDEX_ALU_OPCODES(P,R,EA,a4,a5,a6,AND) \
+INDEX_ALU_OPCODES(P,R,EA,ac,ad,ae,XOR) \
+INDEX_ALU_OPCODES(P,R,EA,b4,b5,b6,OR) \
+INDEX_ALU_OPCODES(P,R,EA,bc,bd,be,CMP8)
+
+/* The 8-bit register loads and ALU ops that never touch H, L or (HL)
+*/
+#define LD_R8_OPCODE(N,DEST,SRC) \
+OPCODE(Op_##N)		/* LD DEST,SRC */ \
+{ \
+    TSTATE(4); \
+    DEST=SRC; \
+} \
+END_OPCODE
+
+#define LD_R8_OPCODES(N0,N1,N2,N3,N7,DEST) \
+LD_R8_OPCODE(N0,DEST,cpu->BC.b[HI]) \
+LD_R8_OPCODE(N1,DEST,cpu->BC.b[LO]) \
+LD_R8_OPCODE(N2,DEST,cpu->DE.b[HI]) \
+LD_R8_OPCODE(N3,DEST,cpu->DE.b[LO]) \
+LD_R8_OPCODE(N7,DEST,cpu->AF.b[HI])
+
+#define ALU_R8_OPCODE(N,OP,SRC) \
+OPCODE(Op_##N)		/* OP A,SRC */ \
+{ \
+    TSTATE(4); \
+    OP(SRC); \
+} \
+END_OPCODE
+
+#define ALU_R8_OPCODES(N0,N1,N2,N3,N7,OP) \
+ALU_R8_OPCODE(N0,OP,cpu->BC.b[HI]) \
+ALU_R8_OPCODE(N1,OP,cpu->BC.b[LO]) \
+ALU_R8_OPCODE(N2,OP,cpu->DE.b[HI]) \
+ALU_R8_OPCODE(N3,OP,cpu->DE.b[LO]) \
+ALU_R8_OPCODE(N7,OP,cpu->AF.b[HI])
+
+/* CB opcodes
+*/
+#define CB_REG_OPCODE(N,T,OP) \
+OPCODE(CB_##N) \
+{ \
+    TSTATE(T); \
+    OP; \
+} \
+END_OPCODE
+
+#define CB_ALU_OPCODES(N0,N1,N2,N3,N4,N5,N6,N7,OP) \
+CB_REG_OPCODE(N0,8,OP(cpu->BC.b[HI])) \
+CB_REG_OPCODE(N1,8,OP(cpu->BC.b[LO])) \
+CB_REG_OPCODE(N2,8,OP(cpu->DE.b[HI])) \
+CB_REG_OPCODE(N3,8,OP(cpu->DE.b[LO])) \
+CB_REG_OPCODE(N4,8,OP(cpu->HL.b[HI])) \
+CB_REG_OPCODE(N5,8,OP(cpu->HL.b[LO])) \
+CB_REG_OPCODE(N6,15,OP_ON_MEM(OP,cpu->HL.w)) \
+CB_REG_OPCODE(N7,8,OP(cpu->AF.b[HI]))
+
+#define CB_BITMANIP_OPCODES(N0,N1,N2,N3,N4,N5,N6,N7,OP,BIT_NO) \
+CB_REG_OPCODE(N0,8,OP(cpu->BC.b[HI],BIT_NO)) \
+CB_REG_OPCODE(N1,8,OP(cpu->BC.b[LO],BIT_NO)) \
+CB_REG_OPCODE(N2,8,OP(cpu->DE.b[HI],BIT_NO)) \
+CB_REG_OPCODE(N3,8,OP(cpu->DE.b[LO],BIT_NO)) \
+CB_REG_OPCODE(N4,8,OP(cpu->HL.b[HI],BIT_NO)) \
+CB_REG_OPCODE(N5,8,OP(cpu->HL.b[LO],BIT_NO)) \
+CB_REG_OPCODE(N6,12,OP_ON_MEM_WITH_ARG(OP,cpu->HL.w,BIT_NO)) \
+CB_REG_OPCODE(N7,8,OP(cpu->AF.b[HI],BIT_NO))
+
+/* DDCB/FDCB opcodes.  The address has already been calculated.
+*/
+#define XYCB_MEM_OPCODE(N,T,OP) \
+XYCB_OPCODE(XYCB_##N) \
+{ \
+    TSTATE(T); \
+    OP; \
+} \
+END_OPCODE
+
+#define XYCB_ALU_OPCODES(N0,N1,N2,N3,N4,N5,N6,N7,OP) \
+XYCB_MEM_OPCODE(N0,8,OP_ON_MEM_WITH_COPY(OP,addr,cpu->BC.b[HI])) \
+XYCB_MEM_OPCODE(N1,8,OP_ON_MEM_WITH_COPY(OP,addr,cpu->BC.b[LO])) \
+XYCB_MEM_OPCODE(N2,8,OP_ON_MEM_WITH_COPY(OP,addr,cpu->DE.b[HI])) \
+XYCB_MEM_OPCODE(N3,8,OP_ON_MEM_WITH_COPY(OP,addr,cpu->DE.b[LO])) \
+XYCB_MEM_OPCODE(N4,8,OP_ON_MEM_WITH_COPY(OP,addr,cpu->HL.b[HI])) \
+XYCB_MEM_OPCODE(N5,8,OP_ON_MEM_WITH_COPY(OP,addr,cpu->HL.b[LO])) \
+XYCB_MEM_OPCODE(N6,15,OP_ON_MEM(OP,addr)) \
+XYCB_MEM_OPCODE(N7,8,OP_ON_MEM_WITH_COPY(OP,addr,cpu->AF.b[HI]))
+
+#define XYCB_BITMANIP_OPCODES(N0,N1,N2,N3,N4,N5,N6,N7,OP,BIT_NO) \
+XYCB_MEM_OPCODE(N0,8, \
+	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->BC.b[HI])) \
+XYCB_MEM_OPCODE(N1,8, \
+	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->BC.b[LO])) \
+XYCB_MEM_OPCODE(N2,8, \
+	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->DE.b[HI])) \
+XYCB_MEM_OPCODE(N3,8, \
+	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->DE.b[LO])) \
+XYCB_MEM_OPCODE(N4,8, \
+	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->HL.b[HI])) \
+XYCB_MEM_OPCODE(N5,8, \
+	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->HL.b[LO])) \
+XYCB_MEM_OPCODE(N6,12,OP_ON_MEM_WITH_ARG(OP,addr,BIT_NO)) \
+XYCB_MEM_OPCODE(N7,8, \
+	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->AF.b[HI]))
+
+/* ED opcodes
+*/
+#define ED_IN_OPCODE(N,REG) \
+OPCODE(ED_##N)		/* IN REG,(C) */ \
+{ \
+    TSTATE(12); \
+ \
+    if (PRIV->pread) \
+    { \
+	REG=PRIV->pread(cpu,cpu->BC.w); \
+    } \
+    else \
+    { \
+	REG=0; \
+    } \
+ \
+    FLAGS=CARRY|PSZtable[REG]; \
+    SETHIDDEN(REG); \
+} \
+END_OPCODE
+
+#define ED_OUT_OPCODE(N,REG) \
+OPCODE(ED_##N)		/* OUT (C),REG */ \
+{ \
+    TSTATE(12); \
+    if (PRIV->pwrite) PRIV->pwrite(cpu,cpu->BC.w,REG); \
+} \
+END_OPCODE
+
+#define ED_16BIT_OPCODES(N2,N3,NA,NB,REG) \
+OPCODE(ED_##N2)		/* SBC HL,REG */ \
+{ \
+    TSTATE(15); \
+    SBC16(cpu->HL.w,REG); \
+} \
+END_OPCODE \
+ \
+OPCODE(ED_##N3)		/* LD (nnnn),REG */ \
+{ \
+    TSTATE(20); \
+    POKEW(FETCH_WORD,REG); \
+} \
+END_OPCODE \
+ \
+OPCODE(ED_##NA)		/* ADC HL,REG */ \
+{ \
+    TSTATE(15); \
+    ADC16(cpu->HL.w,REG); \
+} \
+END_OPCODE \
+ \
+OPCODE(ED_##NB)		/* LD REG,(nnnn) */ \
+{ \
+    TSTATE(20); \
+    REG=PEEKW(FETCH_WORD); \
+} \
+END_OPCODE
+
+#define ED_BLOCK_OPCODES(N,NR,OP,COND,BULK) \
+OPCODE(ED_##N)		/* OP */ \
+{ \
+    TSTATE(16); \
+    OP; \
+} \
+END_OPCODE \
+ \
+OPCODE(ED_##NR)		/* OP with repeat */ \
+{ \
+    TSTATE(16); \
+    OP; \
+    if (COND) \
+	BLOCK_REPEAT(OP,COND,BULK); \
+} \
+END_OPCODE
+
+
+
+/* ---------------------------------------- OPCODE DECODER
+*/
+#ifdef COMPUTED_GOTO
+#ifdef ENABLE_DECODE_CACHE
+static void Decode(Z80 *cpu, Z80Byte opcode, int cached)
+#else
+void Z80_Decode(Z80 *cpu, Z80Byte opcode)
+#endif
+{
+    static const void * const	base_opcode[0x100]={BASE_OPCODES};
+    static const void * const	cb_opcode[0x100]={CB_OPCODES};
+    static const void * const	ed_opcode[0x100]={ED_OPCODES};
+    static const void * const	dd_opcode[0x100]={DD_OPCODES};
+    static const void * const	fd_opcode[0x100]={FD_OPCODES};
+    static const void * const	xycb_opcode[0x100]={XYCB_OPCODES};
+    Z80Word			addr=0;
+
+#ifdef ENABLE_DECODE_CACHE
+    if (cached)
+    {
+	const Z80CacheEntry *ce=Z80_CacheLookup(cpu);
+
+	if (ce)
+	{
+	    opcode=ce->opcode;
+	    goto *ce->handler;
+	}
+
+	INC_R;
+	opcode=FETCH_BYTE;
+    }
+#endif
+
+    DISPATCH(base_opcode);
+#endif
+
+
+/* ---------------------------------------- BASE OPCODE HANDLERS
+*/
+OPCODE(Op_00)		/* NOP */
+{
+    TSTATE(4);
+}
+END_OPCODE
+
+OPCODE(Op_01)		/* LD BC,nnnn */
+{
+    TSTATE(10);
+    cpu->BC.w=FETCH_WORD;
+}
+END_OPCODE
+
+OPCODE(Op_02)		/* LD (BC),A */
+{
+    TSTATE(7);
+    POKE(cpu->BC.w,cpu->AF.b[HI]);
+}
+END_OPCODE
+
+OPCODE(Op_03)		/* INC BC */
+{
+    TSTATE(6);
+    cpu->BC.w++;
+}
+END_OPCODE
+
+OPCODE(Op_04)		/* INC B */
+{
+    TSTATE(4);
+    INC8(cpu->BC.b[HI]);
+}
+END_OPCODE
+
+OPCODE(Op_05)		/* DEC B */
+{
+    TSTATE(4);
+    DEC8(cpu->BC.b[HI]);
+}
+END_OPCODE
+
+OPCODE(Op_06)		/* LD B,n */
+{
+    TSTATE(7);
+    cpu->BC.b[HI]=FETCH_BYTE;
+}
+END_OPCODE
+
+OPCODE(Op_07)		/* RLCA */
+{
+    TSTATE(4);
+    RLCA;
+}
+END_OPCODE
+
+OPCODE(Op_08)		/* EX AF,AF' */
+{
+    TSTATE(4);
+    FLUSH_FLAGS;
+    SWAP(cpu->AF.w,cpu->AF_);
+}
+END_OPCODE
+
+OPCODE(Op_0a)		/* LD A,(BC) */
+{
+    TSTATE(7);
+    cpu->AF.b[HI]=PEEK(cpu->BC.w);
+}
+END_OPCODE
+
+OPCODE(Op_0b)		/* DEC BC */
+{
+    TSTATE(6);
+    cpu->BC.w--;
+}
+END_OPCODE
+
+OPCODE(Op_0c)		/* INC C */
+{
+    TSTATE(4);
+    INC8(cpu->BC.b[LO]);
+}
+END_OPCODE
+
+OPCODE(Op_0d)		/* DEC C */
+{
+    TSTATE(4);
+    DEC8(cpu->BC.b[LO]);
+}
+END_OPCODE
+
+OPCODE(Op_0e)		/* LD C,n */
+{
+    TSTATE(7);
+    cpu->BC.b[LO]=FETCH_BYTE;
+}
+END_OPCODE
+
+OPCODE(Op_0f)		/* RRCA */
+{
+    TSTATE(4);
+    RRCA;
+}
+END_OPCODE
+
+OPCODE(Op_10)		/* DJNZ */
+{
+    if (--(cpu->BC.b[HI]))
+    {
+	TSTATE(13);
+	JR;
+    }
+    else
+    {
+	TSTATE(8);
+	NOJR;
+    }
+}
+END_OPCODE
+
+OPCODE(Op_11)		/* LD DE,nnnn */
+{
+    TSTATE(10);
+    cpu->DE.w=FETCH_WORD;
+}
+END_OPCODE
+
+OPCODE(Op_12)		/* LD (DE),A */
+{
+    TSTATE(7);
+    POKE(cpu->DE.w,cpu->AF.b[HI]);
+}
+END_OPCODE
+
+OPCODE(Op_13)		/* INC DE */
+{
+    TSTATE(6);
+    cpu->DE.w++;
+}
+END_OPCODE
+
+OPCODE(Op_14)		/* INC D */
+{
+    TSTATE(4);
+    INC8(cpu->DE.b[HI]);
+}
+END_OPCODE
+
+OPCODE(Op_15)		/* DEC D */
+{
+    TSTATE(4);
+    DEC8(cpu->DE.b[HI]);
+}
+END_OPCODE
+
+OPCODE(Op_16)		/* LD D,n */
+{
+    TSTATE(7);
+    cpu->DE.b[HI]=FETCH_BYTE;
+}
+END_OPCODE
+
+OPCODE(Op_17)		/* RLA */
+{
+    TSTATE(4);
+    RLA;
+}
+END_OPCODE
+
+OPCODE(Op_18)		/* JR d */
+{
+    Z80Word from=cpu->PC-1;
+
+    TSTATE(12);
+    JR;
+    IDLE_JUMP(from);
+}
+END_OPCODE
+
+OPCODE(Op_1a)		/* LD A,(DE) */
+{
+    TSTATE(7);
+    cpu->AF.b[HI]=PEEK(cpu->DE.w);
+}
+END_OPCODE
+
+OPCODE(Op_1b)		/* DEC DE */
+{
+    TSTATE(6);
+    cpu->DE.w--;
+}
+END_OPCODE
+
+OPCODE(Op_1c)		/* INC E */
+{
+    TSTATE(4);
+    INC8(cpu->DE.b[LO]);
+}
+END_OPCODE
+
+OPCODE(Op_1d)		/* DEC E */
+{
+    TSTATE(4);
+    DEC8(cpu->DE.b[LO]);
+}
+END_OPCODE
+
+OPCODE(Op_1e)		/* LD E,n */
+{
+    TSTATE(7);
+    cpu->DE.b[LO]=FETCH_BYTE;
+}
+END_OPCODE
+
+OPCODE(Op_1f)		/* RRA */
+{
+    TSTATE(4);
+    RRA;
+}
+END_OPCODE
+
+OPCODE(Op_20)		/* JR NZ,e */
+{
+    JR_COND(!IS_Z);
+}
+END_OPCODE
+
+OPCODE(Op_27)		/* DAA */
+{
+    TSTATE(4);
+    DAA(cpu);
+}
+END_OPCODE
+
+OPCODE(Op_28)		/* JR Z,d */
+{
+    JR_COND(IS_Z);
+}
+END_OPCODE
+
+OPCODE(Op_2f)		/* CPL */
+{
+    TSTATE(4);
+    cpu->AF.b[HI]^=0xff;
+    SETFLAG(H_Z80);
+    SETFLAG(N_Z80);
+    SETHIDDEN(cpu->AF.b[HI]);
+}
+END_OPCODE
+
+OPCODE(Op_30)		/* JR NC,d */
+{
+    JR_COND(!IS_C);
+}
+END_OPCODE
+
+OPCODE(Op_31)		/* LD SP,nnnn */
+{
+    TSTATE(10);
+    cpu->SP=FETCH_WORD;
+}
+END_OPCODE
+
+OPCODE(Op_32)		/* LD (nnnn),A */
+{
+    TSTATE(13);
+    POKE(FETCH_WORD,cpu->AF.b[HI]);
+}
+END_OPCODE
+
+OPCODE(Op_33)		/* INC SP */
+{
+    TSTATE(6);
+    cpu->SP++;
+}
+END_OPCODE
+
+OPCODE(Op_37)		/* SCF */
+{
+    TSTATE(4);
+    FLAGS=(FLAGS&(S_Z80|Z_Z80|P_Z80))
+		  | C_Z80
+		  | (cpu->AF.b[HI]&(B3_Z80|B5_Z80));
+}
+END_OPCODE
+
+OPCODE(Op_38)		/* JR C,d */
+{
+    JR_COND(IS_C);
+}
+END_OPCODE
+
+OPCODE(Op_3a)		/* LD A,(nnnn) */
+{
+    TSTATE(13);
+    cpu->AF.b[HI]=PEEK(FETCH_WORD);
+}
+END_OPCODE
+
+OPCODE(Op_3b)		/* DEC SP */
+{
+    TSTATE(6);
+    cpu->SP--;
+}
+END_OPCODE
+
+OPCODE(Op_3c)		/* INC A */
+{
+    TSTATE(4);
+    INC8(cpu->AF.b[HI]);
+}
+END_OPCODE
+
+OPCODE(Op_3d)		/* DEC A */
+{
+    TSTATE(4);
+    DEC8(cpu->AF.b[HI]);
+}
+END_OPCODE
+
+OPCODE(Op_3e)		/* LD A,n */
+{
+    TSTATE(7);
+    cpu->AF.b[HI]=FETCH_BYTE;
+}
+END_OPCODE
+
+OPCODE(Op_3f)		/* CCF */
+{
+    TSTATE(4);
+
+    if (CARRY)
+	SETFLAG(H_Z80);
+    else
+	CLRFLAG(H_Z80);
+
+    FLAGS^=C_Z80;
+    SETHIDDEN(cpu->AF.b[HI]);
+}
+END_OPCODE
+
+LD_R8_OPCODES(40,41,42,43,47,cpu->BC.b[HI])
+LD_R8_OPCODES(48,49,4a,4b,4f,cpu->BC.b[LO])
+LD_R8_OPCODES(50,51,52,53,57,cpu->DE.b[HI])
+LD_R8_OPCODES(58,59,5a,5b,5f,cpu->DE.b[LO])
+LD_R8_OPCODES(78,79,7a,7b,7f,cpu->AF.b[HI])
+
+OPCODE(Op_76)		/* HALT */
+{
+    TSTATE(4);
+    cpu->PC--;
+
+    if (!PRIV->halt)
+	CALLBACK(eZ80_Halt,1);
+
+    PRIV->halt=TRUE;
+}
+END_OPCODE
+
+ALU_R8_OPCODES(80,81,82,83,87,ADD8)
+ALU_R8_OPCODES(88,89,8a,8b,8f,ADC8)
+ALU_R8_OPCODES(90,91,92,93,97,SUB8)
+ALU_R8_OPCODES(98,99,9a,9b,9f,SBC8)
+ALU_R8_OPCODES(a0,a1,a2,a3,a7,AND)
+ALU_R8_OPCODES(a8,a9,aa,ab,af,XOR)
+ALU_R8_OPCODES(b0,b1,b2,b3,b7,OR)
+ALU_R8_OPCODES(b8,b9,ba,bb,bf,CMP8)
+
+INDEX_OPCODES(Op,HL,cpu->HL.w)
+
+OPCODE(Op_c0)		/* RET NZ */
+{
+    RET_COND(!IS_Z);
+}
+END_OPCODE
+
+OPCODE(Op_c1)		/* POP BC */
+{
+    TSTATE(10);
+    POP(cpu->BC.w);
+}
+END_OPCODE
+
+OPCODE(Op_c2)		/* JP NZ,nnnn */
+{
+    JP_COND(!IS_Z);
+}
+END_OPCODE
+
+OPCODE(Op_c3)		/* JP nnnn */
+{
+    JP_COND(1);
+}
+END_OPCODE
+
+OPCODE(Op_c4)		/* CALL NZ,nnnn */
+{
+    CALL_COND(!IS_Z);
+}
+END_OPCODE
+
+OPCODE(Op_c5)		/* PUSH BC */
+{
+    TSTATE(10);
+    PUSH(cpu->BC.w);
+}
+END_OPCODE
+
+OPCODE(Op_c6)		/* ADD A,n */
+{
+    TSTATE(7);
+    ADD8(FETCH_BYTE);
+}
+END_OPCODE
+
+OPCODE(Op_c7)		/* RST 0 */
+{
+    RST(0);
+}
+END_OPCODE
+
+OPCODE(Op_c8)		/* RET Z */
+{
+    RET_COND(IS_Z);
+}
+END_OPCODE
+
+OPCODE(Op_c9)		/* RET */
+{
+    TSTATE(10);
+    POP(cpu->PC);
+}
+END_OPCODE
+
+OPCODE(Op_ca)		/* JP Z,nnnn */
+{
+    JP_COND(IS_Z);
+}
+END_OPCODE
+
+OPCODE(Op_cb)		/* CB PREFIX */
+{
+    INC_R;
+    opcode=FETCH_BYTE;
+    DISPATCH(cb_opcode);
+}
+END_OPCODE
+
+OPCODE(Op_cc)		/* CALL Z,nnnn */
+{
+    CALL_COND(IS_Z);
+}
+END_OPCODE
+
+OPCODE(Op_cd)		/* CALL nnnn */
+{
+    CALL_COND(1);
+}
+END_OPCODE
+
+OPCODE(Op_ce)		/* ADC A,n */
+{
+    ADC8(FETCH_BYTE);
+}
+END_OPCODE
+
+OPCODE(Op_cf)		/* RST 8 */
+{
+    RST(8);
+}
+END_OPCODE
+
+OPCODE(Op_d0)		/* RET NC */
+{
+    RET_COND(!IS_C);
+}
+END_OPCODE
+
+OPCODE(Op_d1)		/* POP DE */
+{
+    TSTATE(10);
+    POP(cpu->DE.w);
+}
+END_OPCODE
+
+OPCODE(Op_d2)		/* JP NC,nnnn */
+{
+    JP_COND(!IS_C);
+}
+END_OPCODE
+
+OPCODE(Op_d3)		/* OUT (n),A */
+{
+    TSTATE(11);
+    if (PRIV->pwrite)
+    {
+	Z80Word port;
+
+	port=FETCH_BYTE;
+	port|=(Z80Word)cpu->AF.b[HI]<<8;
+	PRIV->pwrite(cpu,port,cpu->AF.b[HI]);
+    }
+    else
+	cpu->PC++;
+}
+END_OPCODE
+
+OPCODE(Op_d4)		/* CALL NC,nnnn */
+{
+    CALL_COND(!IS_C);
+}
+END_OPCODE
+
+OPCODE(Op_d5)		/* PUSH DE */
+{
+    TSTATE(11);
+    PUSH(cpu->DE.w);
+}
+END_OPCODE
+
+OPCODE(Op_d6)		/* SUB A,n */
+{
+    TSTATE(7);
+    SUB8(FETCH_BYTE);
+}
+END_OPCODE
+
+OPCODE(Op_d7)		/* RST 10 */
+{
+    RST(0x10);
+}
+END_OPCODE
+
+OPCODE(Op_d8)		/* RET C */
+{
+    RET_COND(IS_C);
+}
+END_OPCODE
+
+OPCODE(Op_d9)		/* EXX */
+{
+    TSTATE(4);
+    SWAP(cpu->BC.w,cpu->BC_);
+    SWAP(cpu->DE.w,cpu->DE_);
+    SWAP(cpu->HL.w,cpu->HL_);
+}
+END_OPCODE
+
+OPCODE(Op_da)		/* JP C,nnnn */
+{
+    JP_COND(IS_C);
+}
+END_OPCODE
+
+OPCODE(Op_db)		/* IN A,(n) */
+{
+    TSTATE(11);
+    if (PRIV->pread)
+    {
+	Z80Word port;
+
+	port=FETCH_BYTE;
+	port|=(Z80Word)cpu->AF.b[HI]<<8;
+	cpu->AF.b[HI]=PRIV->pread(cpu,port);
+    }
+    else
+	cpu->PC++;
+}
+END_OPCODE
+
+OPCODE(Op_dc)		/* CALL C,nnnn */
+{
+    CALL_COND(IS_C);
+}
+END_OPCODE
+
+OPCODE(Op_dd)		/* DD PREFIX */
+{
+    CACHE_CHAIN;
+    TSTATE(4);
+    INC_R;
+
+    PRIV->shift=opcode;
+    opcode=FETCH_BYTE;
+    DISPATCH(dd_opcode);
+}
+END_OPCODE
+
+OPCODE(Op_de)		/* SBC A,n */
+{
+    TSTATE(7);
+    SBC8(FETCH_BYTE);
+}
+END_OPCODE
+
+OPCODE(Op_df)		/* RST 18 */
+{
+    RST(0x18);
+}
+END_OPCODE
+
+OPCODE(Op_e0)		/* RET PO */
+{
+    RET_COND(!IS_P);
+}
+END_OPCODE
+
+OPCODE(Op_e2)		/* JP PO,nnnn */
+{
+    JP_COND(!IS_P);
+}
+END_OPCODE
+
+OPCODE(Op_e4)		/* CALL PO,nnnn */
+{
+    CALL_COND(!IS_P);
+}
+END_OPCODE
+
+OPCODE(Op_e6)		/* AND A,n */
+{
+    TSTATE(7);
+    AND(FETCH_BYTE);
+}
+END_OPCODE
+
+OPCODE(Op_e7)		/* RST 20 */
+{
+    RST(0x20);
+}
+END_OPCODE
+
+OPCODE(Op_e8)		/* RET PE */
+{
+    RET_COND(IS_P);
+}
+END_OPCODE
+
+OPCODE(Op_ea)		/* JP PE,nnnn */
+{
+    JP_COND(IS_P);
+}
+END_OPCODE
+
+OPCODE(Op_ec)		/* CALL PE,nnnn */
+{
+    CALL_COND(IS_P);
+}
+END_OPCODE
+
+OPCODE(Op_ed)		/* ED PREFIX */
+{
+    INC_R;
+    opcode=FETCH_BYTE;
+    DISPATCH(ed_opcode);
+}
+END_OPCODE
+
+OPCODE(Op_ee)		/* XOR A,n */
+{
+    TSTATE(7);
+    XOR(FETCH_BYTE);
+}
+END_OPCODE
+
+OPCODE(Op_ef)		/* RST 28 */
+{
+    RST(0x28);
+}
+END_OPCODE
+
+OPCODE(Op_f0)		/* RET P */
+{
+    RET_COND(!IS_S);
+}
+END_OPCODE
+
+OPCODE(Op_f1)		/* POP AF */
+{
+    TSTATE(10);
+    FLUSH_FLAGS;
+    POP(cpu->AF.w);
+}
+END_OPCODE
+
+OPCODE(Op_f2)		/* JP P,nnnn */
+{
+    JP_COND(!IS_S);
+}
+END_OPCODE
+
+OPCODE(Op_f3)		/* DI */
+{
+    TSTATE(4);
+    cpu->IFF1=0;
+    cpu->IFF2=0;
+}
+END_OPCODE
+
+OPCODE(Op_f4)		/* CALL P,nnnn */
+{
+    CALL_COND(!IS_S);
+}
+END_OPCODE
+
+OPCODE(Op_f5)		/* PUSH AF */
+{
+    TSTATE(10);
+    FLUSH_FLAGS;
+    PUSH(cpu->AF.w);
+}
+END_OPCODE
+
+OPCODE(Op_f6)		/* OR A,n */
+{
+    TSTATE(7);
+    OR(FETCH_BYTE);
+}
+END_OPCODE
+
+OPCODE(Op_f7)		/* RST 30 */
+{
+    RST(0x30);
+}
+END_OPCODE
+
+OPCODE(Op_f8)		/* RET M */
+{
+    RET_COND(IS_S);
+}
+END_OPCODE
 
-#define SHIFTED_CB_ALU_BLOCK(BASE,OP) \
-    case BASE:		/* OP B */ \
-	TSTATE(8); \
-	OP_ON_MEM_WITH_COPY(OP,addr,cpu->BC.b[HI]); \
-	break; \
- \
-    case BASE+1:	/* OP C */ \
-	TSTATE(8); \
-	OP_ON_MEM_WITH_COPY(OP,addr,cpu->BC.b[LO]); \
-	break; \
- \
-    case BASE+2:	/* OP D */ \
-	TSTATE(8); \
-	OP_ON_MEM_WITH_COPY(OP,addr,cpu->DE.b[HI]); \
-	break; \
- \
-    case BASE+3:	/* OP E */ \
-	TSTATE(8); \
-	OP_ON_MEM_WITH_COPY(OP,addr,cpu->DE.b[LO]); \
-	break; \
- \
-    case BASE+4:	/* OP H */ \
-	TSTATE(8); \
-	OP_ON_MEM_WITH_COPY(OP,addr,cpu->HL.b[HI]); \
-	break; \
- \
-    case BASE+5:	/* OP L */ \
-	TSTATE(8); \
-	OP_ON_MEM_WITH_COPY(OP,addr,cpu->HL.b[LO]); \
-	break; \
- \
-    case BASE+6:	/* OP (HL) */ \
-	TSTATE(15); \
-	OP_ON_MEM(OP,addr); \
-	break; \
- \
-    case BASE+7:	/* OP A */ \
-	TSTATE(8); \
-	OP_ON_MEM_WITH_COPY(OP,addr,cpu->AF.b[HI]); \
-	break;
+OPCODE(Op_fa)		/* JP M,nnnn */
+{
+    JP_COND(IS_S);
+}
+END_OPCODE
 
-#define SHIFTED_CB_BITMANIP_BLOCK(BASE,OP,BIT_NO) \
-    case BASE:		/* OP B */ \
-	TSTATE(8); \
-	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->BC.b[HI]); \
-	break; \
- \
-    case BASE+1:	/* OP C */ \
-	TSTATE(8); \
-	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->BC.b[LO]); \
-	break; \
- \
-    case BASE+2:	/* OP D */ \
-	TSTATE(8); \
-	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->DE.b[HI]); \
-	break; \
- \
-    case BASE+3:	/* OP E */ \
-	TSTATE(8); \
-	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->DE.b[LO]); \
-	break; \
- \
-    case BASE+4:	/* OP H */ \
-	TSTATE(8); \
-	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->HL.b[HI]); \
-	break; \
- \
-    case BASE+5:	/* OP L */ \
-	TSTATE(8); \
-	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->HL.b[LO]); \
-	break; \
- \
-    case BASE+6:	/* OP (HL) */ \
-	TSTATE(12); \
-	OP_ON_MEM_WITH_ARG(OP,addr,BIT_NO); \
-	break; \
- \
-    case BASE+7:	/* OP A */ \
-	TSTATE(8); \
-	OP_ON_MEM_WITH_ARG_AND_COPY(OP,addr,BIT_NO,cpu->AF.b[HI]); \
-	break;
+OPCODE(Op_fb)		/* EI */
+{
+    TSTATE(4);
+    cpu->IFF1=1;
+    cpu->IFF2=1;
+}
+END_OPCODE
 
-/* ---------------------------------------- DAA
+OPCODE(Op_fc)		/* CALL M,nnnn */
+{
+    CALL_COND(IS_S);
+}
+END_OPCODE
+
+OPCODE(Op_fd)		/* FD PREFIX */
+{
+    CACHE_CHAIN;
+    TSTATE(4);
+    INC_R;
+
+    PRIV->shift=opcode;
+    opcode=FETCH_BYTE;
+    DISPATCH(fd_opcode);
+}
+END_OPCODE
+
+OPCODE(Op_fe)		/* CP A,n */
+{
+    TSTATE(7);
+    CMP8(FETCH_BYTE);
+}
+END_OPCODE
+
+OPCODE(Op_ff)		/* RST 38 */
+{
+    RST(0x38);
+}
+END_OPCODE
+
+
+/* ---------------------------------------- DD/FD OPCODE HANDLERS
 */
+INDEX_OPCODES(DD,IX,cpu->IX.w+(Z80Relative)FETCH_BYTE)
+INDEX_OPCODES(FD,IY,cpu->IY.w+(Z80Relative)FETCH_BYTE)
 
-/* This alogrithm is based on info from
-   http://www.worldofspectrum.org/faq/reference/z80reference.htm
+OPCODE(DD_cb)		/* DD CB PREFIX */
+{
+    Z80Relative cb_offset;
+
+    INC_R;
+    TSTATE(4);	/* Wild stab in the dark! */
+    cb_offset=FETCH_BYTE;
+    opcode=FETCH_BYTE;
+    XYCB_DISPATCH(cpu->IX.w+cb_offset);
+}
+END_OPCODE
+
+OPCODE(FD_cb)		/* FD CB PREFIX */
+{
+    Z80Relative cb_offset;
+
+    INC_R;
+    TSTATE(4);	/* Wild stab in the dark! */
+    cb_offset=FETCH_BYTE;
+    opcode=FETCH_BYTE;
+    XYCB_DISPATCH(cpu->IY.w+cb_offset);
+}
+END_OPCODE
+
+
+/* ---------------------------------------- CB OPCODE HANDLERS
 */
-static void DAA (Z80 *cpu)
+CB_ALU_OPCODES(00,01,02,03,04,05,06,07,RLC)
+CB_ALU_OPCODES(08,09,0a,0b,0c,0d,0e,0f,RRC)
+CB_ALU_OPCODES(10,11,12,13,14,15,16,17,RL)
+CB_ALU_OPCODES(18,19,1a,1b,1c,1d,1e,1f,RR)
+CB_ALU_OPCODES(20,21,22,23,24,25,26,27,SLA)
+CB_ALU_OPCODES(28,29,2a,2b,2c,2d,2e,2f,SRA)
+CB_ALU_OPCODES(30,31,32,33,34,35,36,37,SLL)
+CB_ALU_OPCODES(38,39,3a,3b,3c,3d,3e,3f,SRL)
+
+CB_BITMANIP_OPCODES(40,41,42,43,44,45,46,47,BIT,0)
+CB_BITMANIP_OPCODES(48,49,4a,4b,4c,4d,4e,4f,BIT,1)
+CB_BITMANIP_OPCODES(50,51,52,53,54,55,56,57,BIT,2)
+CB_BITMANIP_OPCODES(58,59,5a,5b,5c,5d,5e,5f,BIT,3)
+CB_BITMANIP_OPCODES(60,61,62,63,64,65,66,67,BIT,4)
+CB_BITMANIP_OPCODES(68,69,6a,6b,6c,6d,6e,6f,BIT,5)
+CB_BITMANIP_OPCODES(70,71,72,73,74,75,76,77,BIT,6)
+CB_BITMANIP_OPCODES(78,79,7a,7b,7c,7d,7e,7f,BIT,7)
+
+CB_BITMANIP_OPCODES(80,81,82,83,84,85,86,87,BIT_RES,0)
+CB_BITMANIP_OPCODES(88,89,8a,8b,8c,8d,8e,8f,BIT_RES,1)
+CB_BITMANIP_OPCODES(90,91,92,93,94,95,96,97,BIT_RES,2)
+CB_BITMANIP_OPCODES(98,99,9a,9b,9c,9d,9e,9f,BIT_RES,3)
+CB_BITMANIP_OPCODES(a0,a1,a2,a3,a4,a5,a6,a7,BIT_RES,4)
+CB_BITMANIP_OPCODES(a8,a9,aa,ab,ac,ad,ae,af,BIT_RES,5)
+CB_BITMANIP_OPCODES(b0,b1,b2,b3,b4,b5,b6,b7,BIT_RES,6)
+CB_BITMANIP_OPCODES(b8,b9,ba,bb,bc,bd,be,bf,BIT_RES,7)
+
+CB_BITMANIP_OPCODES(c0,c1,c2,c3,c4,c5,c6,c7,BIT_SET,0)
+CB_BITMANIP_OPCODES(c8,c9,ca,cb,cc,cd,ce,cf,BIT_SET,1)
+CB_BITMANIP_OPCODES(d0,d1,d2,d3,d4,d5,d6,d7,BIT_SET,2)
+CB_BITMANIP_OPCODES(d8,d9,da,db,dc,dd,de,df,BIT_SET,3)
+CB_BITMANIP_OPCODES(e0,e1,e2,e3,e4,e5,e6,e7,BIT_SET,4)
+CB_BITMANIP_OPCODES(e8,e9,ea,eb,ec,ed,ee,ef,BIT_SET,5)
+CB_BITMANIP_OPCODES(f0,f1,f2,f3,f4,f5,f6,f7,BIT_SET,6)
+CB_BITMANIP_OPCODES(f8,f9,fa,fb,fc,fd,fe,ff,BIT_SET,7)
+
+
+/* ---------------------------------------- DDCB/FDCB OPCODE HANDLERS
+*/
+XYCB_ALU_OPCODES(00,01,02,03,04,05,06,07,RLC)
+XYCB_ALU_OPCODES(08,09,0a,0b,0c,0d,0e,0f,RRC)
+XYCB_ALU_OPCODES(10,11,12,13,14,15,16,17,RL)
+XYCB_ALU_OPCODES(18,19,1a,1b,1c,1d,1e,1f,RR)
+XYCB_ALU_OPCODES(20,21,22,23,24,25,26,27,SLA)
+XYCB_ALU_OPCODES(28,29,2a,2b,2c,2d,2e,2f,SRA)
+XYCB_ALU_OPCODES(30,31,32,33,34,35,36,37,SLL)
+XYCB_ALU_OPCODES(38,39,3a,3b,3c,3d,3e,3f,SRL)
+
+XYCB_BITMANIP_OPCODES(40,41,42,43,44,45,46,47,BIT,0)
+XYCB_BITMANIP_OPCODES(48,49,4a,4b,4c,4d,4e,4f,BIT,1)
+XYCB_BITMANIP_OPCODES(50,51,52,53,54,55,56,57,BIT,2)
+XYCB_BITMANIP_OPCODES(58,59,5a,5b,5c,5d,5e,5f,BIT,3)
+XYCB_BITMANIP_OPCODES(60,61,62,63,64,65,66,67,BIT,4)
+XYCB_BITMANIP_OPCODES(68,69,6a,6b,6c,6d,6e,6f,BIT,5)
+XYCB_BITMANIP_OPCODES(70,71,72,73,74,75,76,77,BIT,6)
+XYCB_BITMANIP_OPCODES(78,79,7a,7b,7c,7d,7e,7f,BIT,7)
+
+XYCB_BITMANIP_OPCODES(80,81,82,83,84,85,86,87,BIT_RES,0)
+XYCB_BITMANIP_OPCODES(88,89,8a,8b,8c,8d,8e,8f,BIT_RES,1)
+XYCB_BITMANIP_OPCODES(90,91,92,93,94,95,96,97,BIT_RES,2)
+XYCB_BITMANIP_OPCODES(98,99,9a,9b,9c,9d,9e,9f,BIT_RES,3)
+XYCB_BITMANIP_OPCODES(a0,a1,a2,a3,a4,a5,a6,a7,BIT_RES,4)
+XYCB_BITMANIP_OPCODES(a8,a9,aa,ab,ac,ad,ae,af,BIT_RES,5)
+XYCB_BITMANIP_OPCODES(b0,b1,b2,b3,b4,b5,b6,b7,BIT_RES,6)
+XYCB_BITMANIP_OPCODES(b8,b9,ba,bb,bc,bd,be,bf,BIT_RES,7)
+
+XYCB_BITMANIP_OPCODES(c0,c1,c2,c3,c4,c5,c6,c7,BIT_SET,0)
+XYCB_BITMANIP_OPCODES(c8,c9,ca,cb,cc,cd,ce,cf,BIT_SET,1)
+XYCB_BITMANIP_OPCODES(d0,d1,d2,d3,d4,d5,d6,d7,BIT_SET,2)
+XYCB_BITMANIP_OPCODES(d8,d9,da,db,dc,dd,de,df,BIT_SET,3)
+XYCB_BITMANIP_OPCODES(e0,e1,e2,e3,e4,e5,e6,e7,BIT_SET,4)
+XYCB_BITMANIP_OPCODES(e8,e9,ea,eb,ec,ed,ee,ef,BIT_SET,5)
+XYCB_BITMANIP_OPCODES(f0,f1,f2,f3,f4,f5,f6,f7,BIT_SET,6)
+XYCB_BITMANIP_OPCODES(f8,f9,fa,fb,fc,fd,fe,ff,BIT_SET,7)
+
+
+/* ---------------------------------------- ED OPCODE HANDLERS
+*/
+ED_IN_OPCODE(40,cpu->BC.b[HI])
+ED_OUT_OPCODE(41,cpu->BC.b[HI])
+ED_16BIT_OPCODES(42,43,4a,4b,cpu->BC.w)
+
+OPCODE(ED_44)		/* NEG */
 {
-    Z80Byte add=0;
-    Z80Byte carry=0;
-    Z80Byte nf=cpu->AF.b[LO]&N_Z80;
-    Z80Byte acc=cpu->AF.b[HI];
+    Z80Byte b;
 
-    if (acc>0x99 || IS_C)
+    TSTATE(8);
+
+    b=cpu->AF.b[HI];
+    cpu->AF.b[HI]=0;
+    SUB8(b);
+}
+END_OPCODE
+
+OPCODE(ED_45)		/* RETN */
+{
+    TSTATE(14);
+    cpu->IFF1=cpu->IFF2;
+    POP(cpu->PC);
+}
+END_OPCODE
+
+OPCODE(ED_46)		/* IM 0 */
+{
+    TSTATE(8);
+    cpu->IM=0;
+}
+END_OPCODE
+
+OPCODE(ED_47)		/* LD I,A */
+{
+    TSTATE(9);
+    cpu->I=cpu->AF.b[HI];
+}
+END_OPCODE
+
+ED_IN_OPCODE(48,cpu->BC.b[LO])
+ED_OUT_OPCODE(49,cpu->BC.b[LO])
+
+OPCODE(ED_4d)		/* RETI */
+{
+    TSTATE(14);
+    CALLBACK(eZ80_RETI,0);
+    cpu->IFF1=cpu->IFF2;
+    POP(cpu->PC);
+}
+END_OPCODE
+
+OPCODE(ED_4f)		/* LD R,A */
+{
+    TSTATE(9);
+    cpu->R=cpu->AF.b[HI];
+}
+END_OPCODE
+
+OPCODE(ED_50)		/* IN D,(C) */
+{
+    TSTATE(12);
+
+    if (PRIV->pread)
     {
-	add|=0x60;
-	carry=C_Z80;
+	cpu->DE.b[HI]=PRIV->pread(cpu,cpu->BC.w);
+    }
+    else
+    {
+	cpu->DE.b[HI]=0;
     }
 
-    if ((acc&0xf)>0x9 || IS_H)
+    FLAGS=CARRY|PSZtable[cpu->DE.b[HI]];
+    SETHIDDEN(cpu->BC.b[HI]);
+}
+END_OPCODE
+
+ED_OUT_OPCODE(51,cpu->DE.b[HI])
+ED_16BIT_OPCODES(52,53,5a,5b,cpu->DE.w)
+
+OPCODE(ED_56)		/* IM 1 */
+{
+    TSTATE(8);
+    cpu->IM=1;
+}
+END_OPCODE
+
+OPCODE(ED_57)		/* LD A,I */
+{
+    TSTATE(9);
+    cpu->AF.b[HI]=cpu->I;
+}
+END_OPCODE
+
+OPCODE(ED_58)		/* IN E,(C) */
+{
+    TSTATE(12);
+
+    if (PRIV->pread)
     {
-    	add|=0x06;
+	cpu->DE.b[LO]=PRIV->pread(cpu,cpu->BC.w);
+    }
+    else
+    {
+	cpu->BC.b[LO]=0;
     }
 
-    if (nf)
+    FLAGS=CARRY|PSZtable[cpu->DE.b[LO]];
+    SETHIDDEN(cpu->DE.b[LO]);
+}
+END_OPCODE
+
+ED_OUT_OPCODE(59,cpu->DE.b[LO])
+
+OPCODE(ED_5e)		/* IM 2 */
+{
+    TSTATE(8);
+    cpu->IM=2;
+}
+END_OPCODE
+
+OPCODE(ED_5f)		/* LD A,R */
+{
+    TSTATE(9);
+    cpu->AF.b[HI]=cpu->R;
+}
+END_OPCODE
+
+ED_IN_OPCODE(60,cpu->HL.b[HI])
+ED_OUT_OPCODE(61,cpu->HL.b[HI])
+ED_16BIT_OPCODES(62,63,6a,6b,cpu->HL.w)
+
+OPCODE(ED_67)		/* RRD */
+{
+    Z80Byte b;
+
+    TSTATE(18);
+
+    b=PEEK(cpu->HL.w);
+
+    POKE(cpu->HL.w,(b>>4)|(cpu->AF.b[HI]<<4));
+    cpu->AF.b[HI]=(cpu->AF.b[HI]&0xf0)|(b&0x0f);
+
+    FLAGS=CARRY|PSZtable[cpu->AF.b[HI]];
+    SETHIDDEN(cpu->AF.b[HI]);
+}
+END_OPCODE
+
+ED_IN_OPCODE(68,cpu->HL.b[LO])
+ED_OUT_OPCODE(69,cpu->HL.b[LO])
+
+OPCODE(ED_6f)		/* RLD */
+{
+    Z80Byte b;
+
+    TSTATE(18);
+
+    b=PEEK(cpu->HL.w);
+
+    POKE(cpu->HL.w,(b<<4)|(cpu->AF.b[HI]&0x0f));
+    cpu->AF.b[HI]=(cpu->AF.b[HI]&0xf0)|(b>>4);
+
+    FLAGS=CARRY|PSZtable[cpu->AF.b[HI]];
+    SETHIDDEN(cpu->AF.b[HI]);
+}
+END_OPCODE
+
+OPCODE(ED_70)		/* IN (C) */
+{
+    Z80Byte b;
+
+    TSTATE(12);
+
+    if (PRIV->pread)
     {
-    	cpu->AF.b[HI]-=add;
+	b=PRIV->pread(cpu,cpu->BC.w);
     }
     else
     {
-    	cpu->AF.b[HI]+=add;
+	b=0;
     }
 
-    cpu->AF.b[LO]=PSZtable[cpu->AF.b[HI]]
-		    | carry
-		    | nf
-		    | ((acc^cpu->AF.b[HI])&H_Z80)
-		    | (cpu->AF.b[HI]&(B3_Z80|B5_Z80));
+    FLAGS=CARRY|PSZtable[b];
+    SETHIDDEN(b);
+}
+END_OPCODE
+
+ED_OUT_OPCODE(71,0)
+ED_16BIT_OPCODES(72,73,7a,7b,cpu->SP)
+
+ED_IN_OPCODE(78,cpu->AF.b[HI])
+ED_OUT_OPCODE(79,cpu->AF.b[HI])
+
+ED_BLOCK_OPCODES(a0,b0,LDI,cpu->BC.w,BlockCopy(cpu,n-1,1))
+ED_BLOCK_OPCODES(a1,b1,CPI,cpu->BC.w && !IS_Z,BlockCompare(cpu,n-1,1))
+ED_BLOCK_OPCODES(a2,b2,INI,cpu->BC.w,0)
+ED_BLOCK_OPCODES(a3,b3,OUTI,cpu->BC.w,0)
+ED_BLOCK_OPCODES(a8,b8,LDD,cpu->BC.w,BlockCopy(cpu,n-1,-1))
+ED_BLOCK_OPCODES(a9,b9,CPD,cpu->BC.w && !IS_Z,BlockCompare(cpu,n-1,-1))
+ED_BLOCK_OPCODES(aa,ba,IND,cpu->BC.w,0)
+ED_BLOCK_OPCODES(ab,bb,OUTD,cpu->BC.w,0)
+
+/* All the rest are NOP/invalid
+*/
+OPCODE(ED_Nop)
+{
+    TSTATE(8);
+    CALLBACK(eZ80_EDHook,opcode);
+}
+END_OPCODE
+
+
+#ifdef COMPUTED_GOTO
+}
+
+#ifdef ENABLE_DECODE_CACHE
+void Z80_Decode(Z80 *cpu, Z80Byte opcode)
+{
+    Z80_CacheWindow(cpu);
+    Decode(cpu,opcode,FALSE);
+}
+
+
+void Z80_DecodeCached(Z80 *cpu)
+{
+    Decode(cpu,0,TRUE);
+}
+#endif
+
+#else
+static const Z80OpHandler	base_opcode[0x100]={BASE_OPCODES};
+static const Z80OpHandler	cb_opcode[0x100]={CB_OPCODES};
+static const Z80OpHandler	ed_opcode[0x100]={ED_OPCODES};
+static const Z80OpHandler	dd_opcode[0x100]={DD_OPCODES};
+static const Z80OpHandler	fd_opcode[0x100]={FD_OPCODES};
+static const Z80XYCBHandler	xycb_opcode[0x100]={XYCB_OPCODES};
+
+void Z80_Decode(Z80 *cpu, Z80Byte opcode)
+{
+#ifdef ENABLE_DECODE_CACHE
+    Z80_CacheWindow(cpu);
+#endif
+    DISPATCH(base_opcode);
 }
 
+#ifdef ENABLE_DECODE_CACHE
+void Z80_DecodeCached(Z80 *cpu)
+{
+    const Z80CacheEntry *ce=Z80_CacheLookup(cpu);
+    Z80Byte opcode;
+
+    if (ce)
+    {
+	(*(const Z80OpHandler *)ce->handler)(cpu,ce->opcode);
+	return;
+    }
+
+    INC_R;
+    opcode=FETCH_BYTE;
+    DISPATCH(base_opcode);
+}
+#endif
+#endif
+
+#else	/* ENABLE_TABLE_DECODE */
+
 /* ---------------------------------------- HANDLERS FOR ED OPCODES
 */
 static void DecodeED(Z80 *cpu, Z80Byte opcode)
@@ -1032,7 +3846,7 @@ static void DecodeED(Z80 *cpu, Z80Byte opcode)
 	    	cpu->BC.b[HI]=0;
 	    }
 
-	    cpu->AF.b[LO]=CARRY|PSZtable[cpu->BC.b[HI]];
+	    FLAGS=CARRY|PSZtable[cpu->BC.b[HI]];
 	    SETHIDDEN(cpu->BC.b[HI]);
 	    break;
 
@@ -1091,7 +3905,7 @@ static void DecodeED(Z80 *cpu, Z80Byte opcode)
 	    	cpu->BC.b[LO]=0;
 	    }
 
-	    cpu->AF.b[LO]=CARRY|PSZtable[cpu->BC.b[LO]];
+	    FLAGS=CARRY|PSZtable[cpu->BC.b[LO]];
 	    SETHIDDEN(cpu->BC.b[LO]);
 	    break;
 
@@ -1151,7 +3965,7 @@ static void DecodeED(Z80 *cpu, Z80Byte opcode)
 	    	cpu->DE.b[HI]=0;
 	    }
 
-	    cpu->AF.b[LO]=CARRY|PSZtable[cpu->DE.b[HI]];
+	    FLAGS=CARRY|PSZtable[cpu->DE.b[HI]];
 	    SETHIDDEN(cpu->BC.b[HI]);
 	    break;
 
@@ -1210,7 +4024,7 @@ static void DecodeED(Z80 *cpu, Z80Byte opcode)
 	    	cpu->BC.b[LO]=0;
 	    }
 
-	    cpu->AF.b[LO]=CARRY|PSZtable[cpu->DE.b[LO]];
+	    FLAGS=CARRY|PSZtable[cpu->DE.b[LO]];
 	    SETHIDDEN(cpu->DE.b[LO]);
 	    break;
 
@@ -1269,7 +4083,7 @@ static void DecodeED(Z80 *cpu, Z80Byte opcode)
 	    	cpu->HL.b[HI]=0;
 	    }
 
-	    cpu->AF.b[LO]=CARRY|PSZtable[cpu->HL.b[HI]];
+	    FLAGS=CARRY|PSZtable[cpu->HL.b[HI]];
 	    SETHIDDEN(cpu->HL.b[HI]);
 	    break;
 
@@ -1322,7 +4136,7 @@ static void DecodeED(Z80 *cpu, Z80Byte opcode)
 	    POKE(cpu->HL.w,(b>>4)|(cpu->AF.b[HI]<<4));
 	    cpu->AF.b[HI]=(cpu->AF.b[HI]&0xf0)|(b&0x0f);
 
-	    cpu->AF.b[LO]=CARRY|PSZtable[cpu->AF.b[HI]];
+	    FLAGS=CARRY|PSZtable[cpu->AF.b[HI]];
 	    SETHIDDEN(cpu->AF.b[HI]);
 	    break;
 	    }
@@ -1339,7 +4153,7 @@ static void DecodeED(Z80 *cpu, Z80Byte opcode)
 	    	cpu->HL.b[LO]=0;
 	    }
 
-	    cpu->AF.b[LO]=CARRY|PSZtable[cpu->HL.b[LO]];
+	    FLAGS=CARRY|PSZtable[cpu->HL.b[LO]];
 	    SETHIDDEN(cpu->HL.b[LO]);
 	    break;
 
@@ -1392,7 +4206,7 @@ static void DecodeED(Z80 *cpu, Z80Byte opcode)
 	    POKE(cpu->HL.w,(b<<4)|(cpu->AF.b[HI]&0x0f));
 	    cpu->AF.b[HI]=(cpu->AF.b[HI]&0xf0)|(b>>4);
 
-	    cpu->AF.b[LO]=CARRY|PSZtable[cpu->AF.b[HI]];
+	    FLAGS=CARRY|PSZtable[cpu->AF.b[HI]];
 	    SETHIDDEN(cpu->AF.b[HI]);
 	    break;
 	    }
@@ -1412,7 +4226,7 @@ static void DecodeED(Z80 *cpu, Z80Byte opcode)
 	    	b=0;
 	    }
 
-	    cpu->AF.b[LO]=CARRY|PSZtable[b];
+	    FLAGS=CARRY|PSZtable[b];
 	    SETHIDDEN(b);
 	    break;
 	    }
@@ -1472,7 +4286,7 @@ static void DecodeED(Z80 *cpu, Z80Byte opcode)
 	    	cpu->AF.b[HI]=0;
 	    }
 
-	    cpu->AF.b[LO]=CARRY|PSZtable[cpu->AF.b[HI]];
+	    FLAGS=CARRY|PSZtable[cpu->AF.b[HI]];
 	    SETHIDDEN(cpu->AF.b[HI]);
 	    break;
 
@@ -1563,80 +4377,56 @@ static void DecodeED(Z80 *cpu, Z80Byte opcode)
 	    TSTATE(16);
 	    LDI;
 	    if (cpu->BC.w)
-	    {
-	    	TSTATE(5);
-		cpu->PC-=2;
-	    }
+		BLOCK_REPEAT(LDI,cpu->BC.w,BlockCopy(cpu,n-1,1));
 	    break;
 
 	case 0xb1:	/* CPIR */
 	    TSTATE(16);
 	    CPI;
 	    if (cpu->BC.w && !IS_Z)
-	    {
-	    	TSTATE(5);
-		cpu->PC-=2;
-	    }
+		BLOCK_REPEAT(CPI,cpu->BC.w && !IS_Z,BlockCompare(cpu,n-1,1));
 	    break;
 
 	case 0xb2:	/* INIR */
 	    TSTATE(16);
 	    INI;
 	    if (cpu->BC.w)
-	    {
-	    	TSTATE(5);
-		cpu->PC-=2;
-	    }
+		BLOCK_REPEAT(INI,cpu->BC.w,0);
 	    break;
 
 	case 0xb3:	/* OTIR */
 	    TSTATE(16);
 	    OUTI;
 	    if (cpu->BC.w)
-	    {
-	    	TSTATE(5);
-		cpu->PC-=2;
-	    }
+		BLOCK_REPEAT(OUTI,cpu->BC.w,0);
 	    break;
 
 	case 0xb8:	/* LDDR */
 	    TSTATE(16);
 	    LDD;
 	    if (cpu->BC.w)
-	    {
-	    	TSTATE(5);
-		cpu->PC-=2;
-	    }
+		BLOCK_REPEAT(LDD,cpu->BC.w,BlockCopy(cpu,n-1,-1));
 	    break;
 
 	case 0xb9:	/* CPDR */
 	    TSTATE(16);
 	    CPD;
 	    if (cpu->BC.w && !IS_Z)
-	    {
-	    	TSTATE(5);
-		cpu->PC-=2;
-	    }
+		BLOCK_REPEAT(CPD,cpu->BC.w && !IS_Z,BlockCompare(cpu,n-1,-1));
 	    break;
 
 	case 0xba:	/* INDR */
 	    TSTATE(16);
 	    IND;
 	    if (cpu->BC.w)
-	    {
-	    	TSTATE(5);
-		cpu->PC-=2;
-	    }
+		BLOCK_REPEAT(IND,cpu->BC.w,0);
 	    break;
 
 	case 0xbb:	/* OTDR */
 	    TSTATE(16);
 	    OUTD;
 	    if (cpu->BC.w)
-	    {
-	    	TSTATE(5);
-		cpu->PC-=2;
-	    }
+		BLOCK_REPEAT(OUTD,cpu->BC.w,0);
 	    break;
 
 	/* All the rest are NOP/invalid
@@ -1827,6 +4617,7 @@ void Z80_Decode(Z80 *cpu, Z80Byte opcode)
 
 	case 0x08:	/* EX AF,AF' */
 	    TSTATE(4);
+	    FLUSH_FLAGS;
 	    SWAP(cpu->AF.w,cpu->AF_);
 	    break;
 
@@ -1914,8 +4705,13 @@ void Z80_Decode(Z80 *cpu, Z80Byte opcode)
 	    break;
 
 	case 0x18:	/* JR d */
-	    TSTATE(12);
-	    JR;
+	    {
+		Z80Word from=cpu->PC-1;
+
+		TSTATE(12);
+		JR;
+		IDLE_JUMP(from);
+	    }
 	    break;
 
 	case 0x19:	/* ADD HL,DE */
@@ -2073,7 +4869,7 @@ void Z80_Decode(Z80 *cpu, Z80Byte opcode)
 
 	case 0x37:	/* SCF */
 	    TSTATE(4);
-	    cpu->AF.b[LO]=(cpu->AF.b[LO]&(S_Z80|Z_Z80|P_Z80))
+	    FLAGS=(FLAGS&(S_Z80|Z_Z80|P_Z80))
 			  | C_Z80
 			  | (cpu->AF.b[HI]&(B3_Z80|B5_Z80));
 	    break;
@@ -2120,7 +4916,7 @@ void Z80_Decode(Z80 *cpu, Z80Byte opcode)
 	    else
 	    	CLRFLAG(H_Z80);
 
-	    cpu->AF.b[LO]^=C_Z80;
+	    FLAGS^=C_Z80;
 	    SETHIDDEN(cpu->AF.b[HI]);
 	    break;
 
@@ -2455,6 +5251,7 @@ void Z80_Decode(Z80 *cpu, Z80Byte opcode)
 
 	case 0xf1:	/* POP AF */
 	    TSTATE(10);
+	    FLUSH_FLAGS;
 	    POP(cpu->AF.w);
 	    break;
 
@@ -2474,6 +5271,7 @@ void Z80_Decode(Z80 *cpu, Z80Byte opcode)
 
 	case 0xf5:	/* PUSH AF */
 	    TSTATE(10);
+	    FLUSH_FLAGS;
 	    PUSH(cpu->AF.w);
 	    break;
 
@@ -2529,5 +5327,7 @@ void Z80_Decode(Z80 *cpu, Z80Byte opcode)
     }
 }
 
+#endif	/* ENABLE_TABLE_DECODE */
+
 
 /* END OF FILE */
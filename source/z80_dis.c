@@ -36,7 +36,7 @@ static const char ident[]="$Id$";
 #include "z80.h"
 #include "z80_private.h"
 
-static Z80Relative	cb_off;
+static THREAD_LOCAL Z80Relative	cb_off;
 
 /* ---------------------------------------- SHARED ROUTINES
 */
@@ -44,13 +44,13 @@ static const char *z80_dis_reg8[]={"b","c","d","e","h","l","(hl)","a"};
 static const char *z80_dis_reg16[]={"bc","de","hl","sp"};
 static const char *z80_dis_condition[]={"nz","z","nc","c","po","pe","p","m"};
 
-static const char *dis_op;
-static const char *dis_arg;
+static THREAD_LOCAL const char *dis_op;
+static THREAD_LOCAL const char *dis_arg;
 
 const char *Z80_Dis_Printf(const char *format, ...)
 {
-    static int p=0;
-    static char s[16][80];
+    static THREAD_LOCAL int p=0;
+    static THREAD_LOCAL char s[16][80];
     va_list arg;
 
     va_start(arg,format);
@@ -66,6 +66,8 @@ Z80Byte Z80_Dis_FetchByte(Z80 *cpu, Z80Word *pc)
 {
 #ifdef ENABLE_ARRAY_MEMORY
     return Z80_MEMORY[(*pc)++];
+#elif defined(ENABLE_PAGED_MEMORY)
+    return Z80_PagePeek(cpu,(*pc)++);
 #else
     return cpu->priv->disread(cpu,(*pc)++);
 #endif
@@ -223,7 +225,7 @@ static void DIS_SET_R8 (Z80 *z80, Z80Byte op, Z80Word *pc)
 
 static const char *IX_RelStr(Z80 *z80, Z80Byte op, Z80Word *pc)
 {
-    static char s[80];
+    static THREAD_LOCAL char s[80];
     Z80Relative r;
 
     r=(Z80Relative)Z80_Dis_FetchByte(z80,pc);
@@ -239,7 +241,7 @@ static const char *IX_RelStr(Z80 *z80, Z80Byte op, Z80Word *pc)
 
 static const char *IX_RelStrCB(Z80 *z80, Z80Byte op, Z80Word *pc)
 {
-    static char s[80];
+    static THREAD_LOCAL char s[80];
     Z80Relative r;
 
     r=(Z80Relative)cb_off;
@@ -911,7 +913,7 @@ static void DIS_OTDR(Z80 *z80, Z80Byte op, Z80Word *pc)
 
 static const char *IY_RelStr(Z80 *z80, Z80Byte op, Z80Word *pc)
 {
-    static char s[80];
+    static THREAD_LOCAL char s[80];
     Z80Relative r;
 
     r=(Z80Relative)Z80_Dis_FetchByte(z80,pc);
@@ -927,7 +929,7 @@ static const char *IY_RelStr(Z80 *z80, Z80Byte op, Z80Word *pc)
 
 static const char *IY_RelStrCB(Z80 *z80, Z80Byte op, Z80Word *pc)
 {
-    static char s[80];
+    static THREAD_LOCAL char s[80];
     Z80Relative r;
 
     r=(Z80Relative)cb_off;
@@ -1462,6 +1464,8 @@ static void DIS_DJNZ (Z80 *z80, Z80Byte op, Z80Word *pc)
 
 #ifdef ENABLE_ARRAY_MEMORY
     new=*pc+(Z80Relative)Z80_MEMORY[*pc]+1;
+#elif defined(ENABLE_PAGED_MEMORY)
+    new=*pc+(Z80Relative)Z80_PagePeek(z80,*pc)+1;
 #else
     new=*pc+(Z80Relative)z80->priv->disread(z80,*pc)+1;
 #endif
@@ -1481,6 +1485,8 @@ static void DIS_JR (Z80 *z80, Z80Byte op, Z80Word *pc)
 
 #ifdef ENABLE_ARRAY_MEMORY
     new=*pc+(Z80Relative)Z80_MEMORY[*pc]+1;
+#elif defined(ENABLE_PAGED_MEMORY)
+    new=*pc+(Z80Relative)Z80_PagePeek(z80,*pc)+1;
 #else
     new=*pc+(Z80Relative)z80->priv->disread(z80,*pc)+1;
 #endif
@@ -1506,6 +1512,8 @@ static void DIS_JR_CO (Z80 *z80, Z80Byte op, Z80Word *pc)
     con=z80_dis_condition[(op-0x20)/8];
 #ifdef ENABLE_ARRAY_MEMORY
     new=*pc+(Z80Relative)Z80_MEMORY[*pc]+1;
+#elif defined(ENABLE_PAGED_MEMORY)
+    new=*pc+(Z80Relative)Z80_PagePeek(z80,*pc)+1;
 #else
     new=*pc+(Z80Relative)z80->priv->disread(z80,*pc)+1;
 #endif
@@ -0,0 +1,2247 @@
+/*
+
+    z80 - Z80 Emulator
+
+    Copyright (C) 2006  Ian Cowburn <ianc@noddybox.co.uk>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+    -------------------------------------------------------------------------
+
+    $Id$
+
+    Translation of Z80 code into native x86-64 code
+
+*/
+
+/* For memfd_create()
+*/
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "z80.h"
+#include "z80_private.h"
+
+static const char ident[]="$Id$";
+
+#ifdef ENABLE_JIT
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <cpuid.h>
+
+/* ---------------------------------------- CONFIGURATION
+*/
+
+/* Size of the buffer translated code is placed in.  When it fills up all
+   the blocks are thrown away and translation starts again.  The buffer is
+   never writable and executable at once.  It is mapped twice, once to
+   write code to and once to run it from, or where that can't be done the
+   part a block is translated into is made writable while it is.
+*/
+#define BUFFER_SIZE		(4*1024*1024)
+
+/* Space that must be left in the buffer to translate a block
+*/
+#define BLOCK_SPACE		(32*1024)
+
+/* Number of times code must be entered at an address before it is
+   translated
+*/
+#define HOT_COUNT		16
+
+/* Most instructions in one block
+*/
+#define MAX_INSTR		64
+
+/* Most T-states an instruction left to the interpreter can take
+*/
+#define MAX_TSTATES		23
+
+
+/* ---------------------------------------- TYPES
+*/
+typedef struct
+{
+    Z80		*cpu;
+    Z80Byte	*p;
+    Z80Val	tstates;	/* Not yet added to the cycle count */
+    int		r;		/* Not yet added to R */
+    Z80Val	max;		/* Most T-states the block can take */
+    int		chain;		/* Exits go on to the next block */
+} Jit;
+
+
+/* ---------------------------------------- TABLES
+*/
+
+/* The T-states the interpreter charges for each unprefixed opcode, which
+   translated code must match.  Conditional instructions have the longest
+   time.
+*/
+static const Z80Byte tstates[0x100]=
+{
+/* 0x00 */	 4, 10,  7,  6,  4,  4,  7,  4,  4, 11,  7,  6,  4,  4,  7,  4,
+/* 0x10 */	13, 10,  7,  6,  4,  4,  7,  4, 12, 11,  7,  6,  4,  4,  7,  4,
+/* 0x20 */	12, 10, 16,  6,  4,  4,  7,  4, 12, 11,  7,  6,  4,  4,  7,  4,
+/* 0x30 */	12, 10, 13,  6, 11, 11, 10,  4, 12, 11, 13,  6,  4,  4,  7,  4,
+/* 0x40 */	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+/* 0x50 */	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+/* 0x60 */	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+/* 0x70 */	 7,  7,  7,  7,  7,  7,  4,  7,  4,  4,  4,  4,  4,  4,  7,  4,
+/* 0x80 */	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+/* 0x90 */	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+/* 0xa0 */	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+/* 0xb0 */	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+/* 0xc0 */	11, 10, 10, 10, 17, 10,  7, 11, 11, 10, 10,  0, 17, 17,  0, 11,
+/* 0xd0 */	11, 10, 10, 11, 17, 11,  7, 11, 11,  4, 10, 11, 17,  0,  7, 11,
+/* 0xe0 */	11, 10, 10, 19, 17, 10,  7, 11, 11,  4, 10,  4, 17,  0,  7, 11,
+/* 0xf0 */	11, 10, 10,  4, 17, 10,  7, 11, 11,  6, 10,  4, 17,  0,  7, 11
+};
+
+
+/* x86 registers.  Translated code keeps BC, DE and HL in R12 to R14 and A
+   in R15, each zero extended, and the rest of the Z80 in memory.
+*/
+#define EAX	0
+#define ECX	1
+#define EDX	2
+#define ESI	6
+#define R_BC	12
+#define R_DE	13
+#define R_HL	14
+#define R_A	15
+
+/* x86 condition codes
+*/
+#define CC_Z	0x04
+#define CC_NZ	0x05
+
+/* x86 ALU ops and shifts on an immediate
+*/
+#define X_ADD	0
+#define X_OR	1
+#define X_AND	4
+#define X_SUB	5
+#define X_XOR	6
+#define X_CMP	7
+#define X_SHL	4
+#define X_SHR	5
+
+/* Offsets of the Z80 registers, private data and tables.  In translated
+   code RBX holds the Z80 and RBP its private data.
+*/
+#define ZOFF(f)		((int)offsetof(Z80,f))
+#define POFF(f)		((int)offsetof(struct Z80Private,f))
+#define TOFF(f)		((int)offsetof(Z80JitTables,f))
+
+#define OFF_A		(ZOFF(AF)+Z80_HI_WORD)
+#define OFF_F		(ZOFF(AF)+Z80_LO_WORD)
+
+
+/* ---------------------------------------- CODE EMISSION
+*/
+static void B(Jit *j, int b)
+{
+    *j->p++=b;
+}
+
+
+static void D(Jit *j, uint32_t d)
+{
+    B(j,d);
+    B(j,d>>8);
+    B(j,d>>16);
+    B(j,d>>24);
+}
+
+
+static void Q(Jit *j, uint64_t q)
+{
+    D(j,q);
+    D(j,q>>32);
+}
+
+
+/* Emits a REX prefix if reg or rm needs one.  Byte ops need one for SIL
+   and DIL, so AH can't be used with them.
+*/
+static void Rex(Jit *j, int reg, int rm, int byte)
+{
+    int rex=(reg&8)>>1|(rm&8)>>3;
+
+    if (rex || (byte && ((reg>=4 && reg<8) || (rm>=4 && rm<8))))
+	B(j,0x40|rex);
+}
+
+
+/* op rm,reg on 32-bit registers
+*/
+static void RegOp(Jit *j, int op, int reg, int rm)
+{
+    Rex(j,reg,rm,FALSE);
+    B(j,op);
+    B(j,0xc0|(reg&7)<<3|(rm&7));
+}
+
+
+/* op rm,reg on byte registers
+*/
+static void RegOpB(Jit *j, int op, int reg, int rm)
+{
+    Rex(j,reg,rm,TRUE);
+    B(j,op);
+    B(j,0xc0|(reg&7)<<3|(rm&7));
+}
+
+
+static void Mov(Jit *j, int dst, int src)
+{
+    RegOp(j,0x89,src,dst);
+}
+
+
+/* op reg,imm where op is one of the X_ ALU ops
+*/
+static void ImmOp(Jit *j, int op, int reg, uint32_t imm)
+{
+    Rex(j,0,reg,FALSE);
+    B(j,0x81);
+    B(j,0xc0|op<<3|(reg&7));
+    D(j,imm);
+}
+
+
+/* op reg,n where op is X_SHL or X_SHR
+*/
+static void Shift(Jit *j, int op, int reg, int n)
+{
+    Rex(j,0,reg,FALSE);
+    B(j,0xc1);
+    B(j,0xc0|op<<3|(reg&7));
+    B(j,n);
+}
+
+
+/* ModRM for [RBX+off]
+*/
+static void ModZ80(Jit *j, int reg, int off)
+{
+    B(j,0x43|(reg&7)<<3);
+    B(j,off);
+}
+
+
+/* ModRM for [RBP+off]
+*/
+static void ModPriv(Jit *j, int reg, int off)
+{
+    B(j,0x85|reg<<3);
+    D(j,off);
+}
+
+
+/* movzx reg,byte [RBX+off]
+*/
+static void LoadB(Jit *j, int reg, int off)
+{
+    Rex(j,reg,0,FALSE);
+    B(j,0x0f);
+    B(j,0xb6);
+    ModZ80(j,reg,off);
+}
+
+
+/* movzx reg,word [RBX+off]
+*/
+static void LoadW(Jit *j, int reg, int off)
+{
+    Rex(j,reg,0,FALSE);
+    B(j,0x0f);
+    B(j,0xb7);
+    ModZ80(j,reg,off);
+}
+
+
+/* mov byte [RBX+off],reg
+*/
+static void StoreB(Jit *j, int reg, int off)
+{
+    Rex(j,reg,0,TRUE);
+    B(j,0x88);
+    ModZ80(j,reg,off);
+}
+
+
+/* mov word [RBX+off],reg
+*/
+static void StoreW(Jit *j, int reg, int off)
+{
+    B(j,0x66);
+    Rex(j,reg,0,FALSE);
+    B(j,0x89);
+    ModZ80(j,reg,off);
+}
+
+
+static void StoreWImm(Jit *j, int off, Z80Word val)
+{
+    B(j,0x66);
+    B(j,0xc7);
+    ModZ80(j,0,off);
+    B(j,val);
+    B(j,val>>8);
+}
+
+
+static void MovImm(Jit *j, int reg, uint32_t val)
+{
+    Rex(j,0,reg,FALSE);
+    B(j,0xb8+(reg&7));
+    D(j,val);
+}
+
+
+/* Keeps reg to 16 bits
+*/
+static void Mask16(Jit *j, int reg)
+{
+    ImmOp(j,X_AND,reg,0xffff);
+}
+
+
+/* Calls fn(cpu,ESI,EDX)
+*/
+static void Call(Jit *j, const void *fn)
+{
+    B(j,0x48);			/* mov rdi,rbx */
+    B(j,0x89);
+    B(j,0xdf);
+    B(j,0x48);			/* mov rax,fn */
+    B(j,0xb8);
+    Q(j,(uintptr_t)fn);
+    B(j,0xff);			/* call rax */
+    B(j,0xd0);
+}
+
+
+/* Emits a jump with condition cc, returning where to patch the target
+*/
+static Z80Byte *Jump(Jit *j, int cc)
+{
+    B(j,0x0f);
+    B(j,0x80|cc);
+    D(j,0);
+
+    return j->p;
+}
+
+
+/* Makes the jump that ends at patch go to the current position
+*/
+static void Land(Jit *j, Z80Byte *patch)
+{
+    uint32_t rel=j->p-patch;
+
+    memcpy(patch-4,&rel,4);
+}
+
+
+/* Copies the Z80 registers kept in x86 registers back to the Z80
+*/
+static void SaveRegs(Jit *j)
+{
+    StoreW(j,R_BC,ZOFF(BC));
+    StoreW(j,R_DE,ZOFF(DE));
+    StoreW(j,R_HL,ZOFF(HL));
+    StoreB(j,R_A,OFF_A);
+}
+
+
+static void LoadRegs(Jit *j)
+{
+    LoadW(j,R_BC,ZOFF(BC));
+    LoadW(j,R_DE,ZOFF(DE));
+    LoadW(j,R_HL,ZOFF(HL));
+    LoadB(j,R_A,OFF_A);
+}
+
+
+static void Prologue(Jit *j)
+{
+    B(j,0x53);			/* push rbx */
+    B(j,0x55);			/* push rbp */
+    B(j,0x41);			/* push r12 */
+    B(j,0x54);
+    B(j,0x41);			/* push r13 */
+    B(j,0x55);
+    B(j,0x41);			/* push r14 */
+    B(j,0x56);
+    B(j,0x41);			/* push r15 */
+    B(j,0x57);
+    B(j,0x48);			/* sub rsp,8 */
+    B(j,0x83);
+    B(j,0xec);
+    B(j,0x08);
+    B(j,0x48);			/* mov rbx,rdi */
+    B(j,0x89);
+    B(j,0xfb);
+    B(j,0x48);			/* mov rbp,[rdi+priv] */
+    B(j,0x8b);
+    B(j,0x6f);
+    B(j,ZOFF(priv));
+    LoadRegs(j);
+}
+
+
+/* Returns from the block.  The registers must already have been saved.
+*/
+static void Epilogue(Jit *j)
+{
+    B(j,0x48);			/* add rsp,8 */
+    B(j,0x83);
+    B(j,0xc4);
+    B(j,0x08);
+    B(j,0x41);			/* pop r15 */
+    B(j,0x5f);
+    B(j,0x41);			/* pop r14 */
+    B(j,0x5e);
+    B(j,0x41);			/* pop r13 */
+    B(j,0x5d);
+    B(j,0x41);			/* pop r12 */
+    B(j,0x5c);
+    B(j,0x5d);			/* pop rbp */
+    B(j,0x5b);			/* pop rbx */
+    B(j,0xc3);			/* ret */
+}
+
+
+/* Adds t to the cycle count and r to R
+*/
+static void Count(Jit *j, Z80Val t, int r)
+{
+    if (t)
+    {
+	B(j,0x48);		/* add qword [rbp+cycle],t */
+	B(j,0x81);
+	ModPriv(j,0,POFF(cycle));
+	D(j,t);
+    }
+
+    if (r)
+    {
+	LoadB(j,EAX,ZOFF(R));
+	B(j,0x89);		/* mov ecx,eax */
+	B(j,0xc1);
+	B(j,0x83);		/* add eax,r */
+	B(j,0xc0);
+	B(j,r);
+	B(j,0x83);		/* and eax,0x7f */
+	B(j,0xe0);
+	B(j,0x7f);
+	B(j,0x81);		/* and ecx,0x80 */
+	B(j,0xe1);
+	D(j,0x80);
+	B(j,0x09);		/* or eax,ecx */
+	B(j,0xc8);
+	StoreB(j,EAX,ZOFF(R));
+    }
+}
+
+
+/* Brings the cycle count and R up to date
+*/
+static void Flush(Jit *j)
+{
+    Count(j,j->tstates,j->r);
+    j->tstates=0;
+    j->r=0;
+}
+
+
+/* Jumps on to the block for the PC in ECX if it is valid and can run, as
+   Z80_JitRun() would.  Only the checks that can fail while in translated
+   code are made.  The interpreter is the only thing that can halt, stop
+   Z80Run() or enable interrupts, and JitStep() leaves the block if it
+   does, and changing the fetch hook throws away all the blocks.  Any
+   interrupt raised leaves it, even one that can't yet be taken.  Uses
+   RSI for the tables.
+*/
+static void Dispatch(Jit *j)
+{
+    Z80Byte *fail[5];
+    int f=0;
+
+    B(j,0x48);			/* mov rsi,[rbp+jit] */
+    B(j,0x8b);
+    ModPriv(j,ESI,POFF(jit));
+    B(j,0x48);			/* mov rax,[rsi+rcx*8+block] */
+    B(j,0x8b);
+    B(j,0x84);
+    B(j,0xce);
+    D(j,TOFF(block));
+    B(j,0x48);			/* test rax,rax */
+    B(j,0x85);
+    B(j,0xc0);
+    B(j,0x74);			/* jz fail */
+    B(j,0);
+    fail[f++]=j->p;
+    B(j,0x89);			/* mov edx,ecx */
+    B(j,0xca);
+    B(j,0xc1);			/* shr edx,Z80_PAGE_SHIFT */
+    B(j,0xea);
+    B(j,Z80_PAGE_SHIFT);
+    B(j,0x8b);			/* mov edx,[rsi+rdx*4+gen] */
+    B(j,0x94);
+    B(j,0x96);
+    D(j,TOFF(gen));
+    B(j,0x3b);			/* cmp edx,[rax+gen] */
+    B(j,0x50);
+    B(j,offsetof(Z80JitBlock,gen));
+    B(j,0x75);			/* jne fail */
+    B(j,0);
+    fail[f++]=j->p;
+    B(j,0x0f);			/* movzx edx,word [rax+tstates] */
+    B(j,0xb7);
+    B(j,0x50);
+    B(j,offsetof(Z80JitBlock,tstates));
+    B(j,0x48);			/* add rdx,[rbp+cycle] */
+    B(j,0x03);
+    ModPriv(j,EDX,POFF(cycle));
+    B(j,0x48);			/* cmp rdx,[rbp+end] */
+    B(j,0x3b);
+    ModPriv(j,EDX,POFF(end));
+    B(j,0x77);			/* ja fail */
+    B(j,0);
+    fail[f++]=j->p;
+    B(j,0x83);			/* cmp dword [rbp+raise],0 */
+    ModPriv(j,7,POFF(raise));
+    B(j,0);
+    B(j,0x75);			/* jne fail */
+    B(j,0);
+    fail[f++]=j->p;
+
+#ifdef ENABLE_IDLE_SKIP
+    /* Z80_JitRun() has to see idle loops go round
+    */
+    B(j,0x66);			/* cmp word [rax+idle],0 */
+    B(j,0x83);
+    B(j,0x78);
+    B(j,offsetof(Z80JitBlock,idle));
+    B(j,0);
+    B(j,0x75);			/* jne fail */
+    B(j,0);
+    fail[f++]=j->p;
+#endif
+
+    B(j,0x66);			/* mov [rbp+jit_last],cx */
+    B(j,0x89);
+    ModPriv(j,ECX,POFF(jit_last));
+    B(j,0xc6);			/* mov byte [rbp+jit_dirty],0 */
+    ModPriv(j,0,POFF(jit_dirty));
+    B(j,0);
+    B(j,0xff);			/* jmp [rax+entry] */
+    B(j,0x60);
+    B(j,offsetof(Z80JitBlock,entry));
+
+    while(f--)
+	fail[f][-1]=j->p-fail[f];
+}
+
+
+/* Leaves the block with PC set to pc (or left alone if negative) after t
+   more T-states
+*/
+static void Exit(Jit *j, int pc, Z80Val t)
+{
+    if (pc>=0)
+	StoreWImm(j,ZOFF(PC),pc);
+
+    Count(j,j->tstates+t,j->r);
+
+    /* BC, DE, HL and A are still loaded if there is a block to go on to
+    */
+    if (j->chain)
+    {
+	if (pc>=0)
+	    MovImm(j,ECX,pc);
+	else
+	    LoadW(j,ECX,ZOFF(PC));
+
+	Dispatch(j);
+    }
+
+    SaveRegs(j);
+    Epilogue(j);
+}
+
+
+/* Reads the byte at the Z80 address in ECX into EAX.  Uses ECX and EDX.
+*/
+static void Read(Jit *j)
+{
+    B(j,0x89);			/* mov edx,ecx */
+    B(j,0xca);
+    B(j,0xc1);			/* shr edx,Z80_PAGE_SHIFT */
+    B(j,0xea);
+    B(j,Z80_PAGE_SHIFT);
+    B(j,0x48);			/* mov rdx,[rbp+rdx*8+rpage] */
+    B(j,0x8b);
+    B(j,0x94);
+    B(j,0xd5);
+    D(j,POFF(rpage));
+    B(j,0x81);			/* and ecx,Z80_PAGE_MASK */
+    B(j,0xe1);
+    D(j,Z80_PAGE_MASK);
+    B(j,0x0f);			/* movzx eax,byte [rdx+rcx] */
+    B(j,0xb6);
+    B(j,0x04);
+    B(j,0x0a);
+}
+
+
+/* Writes EDX to the Z80 address in ESI.  Pages that are trapped or have
+   code translated or decoded from them are left to Z80_PagePoke(), which
+   is given the registers up to date in case the write is passed on.
+*/
+static void JitPoke(Z80 *cpu, Z80Word addr, Z80Byte val)
+{
+    Z80_PagePoke(cpu,addr,val);
+}
+
+static void Write(Jit *j)
+{
+    Z80Byte *slow1;
+    Z80Byte *slow2;
+#ifdef ENABLE_DECODE_CACHE
+    Z80Byte *slow3;
+#endif
+    Z80Byte *done;
+
+    B(j,0x89);			/* mov eax,esi */
+    B(j,0xf0);
+    B(j,0xc1);			/* shr eax,Z80_PAGE_SHIFT */
+    B(j,0xe8);
+    B(j,Z80_PAGE_SHIFT);
+    B(j,0x80);			/* cmp byte [rbp+rax+jit_page],0 */
+    B(j,0xbc);
+    B(j,0x05);
+    D(j,POFF(jit_page));
+    B(j,0x00);
+    B(j,0x75);			/* jne slow */
+    B(j,0);
+    slow1=j->p;
+#ifdef ENABLE_DECODE_CACHE
+    B(j,0x0f);			/* movzx ecx,word [rbp+rax*2+home] */
+    B(j,0xb7);
+    B(j,0x8c);
+    B(j,0x45);
+    D(j,POFF(home));
+    B(j,0x80);			/* cmp byte [rbp+rcx+code],0 */
+    B(j,0xbc);
+    B(j,0x0d);
+    D(j,POFF(code));
+    B(j,0x00);
+    B(j,0x75);			/* jne slow */
+    B(j,0);
+    slow3=j->p;
+#endif
+    B(j,0x48);			/* mov rax,[rbp+rax*8+wpage] */
+    B(j,0x8b);
+    B(j,0x84);
+    B(j,0xc5);
+    D(j,POFF(wpage));
+    B(j,0x48);			/* test rax,rax */
+    B(j,0x85);
+    B(j,0xc0);
+    B(j,0x74);			/* jz slow */
+    B(j,0);
+    slow2=j->p;
+    B(j,0x89);			/* mov ecx,esi */
+    B(j,0xf1);
+    B(j,0x81);			/* and ecx,Z80_PAGE_MASK */
+    B(j,0xe1);
+    D(j,Z80_PAGE_MASK);
+    B(j,0x88);			/* mov [rax+rcx],dl */
+    B(j,0x14);
+    B(j,0x08);
+    B(j,0xeb);			/* jmp done */
+    B(j,0);
+    done=j->p;
+    slow1[-1]=j->p-slow1;
+    slow2[-1]=j->p-slow2;
+#ifdef ENABLE_DECODE_CACHE
+    slow3[-1]=j->p-slow3;
+#endif
+    SaveRegs(j);
+    Call(j,JitPoke);
+    done[-1]=j->p-done;
+}
+
+
+/* Leaves the block if a write has hit translated code
+*/
+static void CheckDirty(Jit *j, Z80Word next, Z80Val t)
+{
+    Z80Byte *patch;
+
+    B(j,0x80);			/* cmp byte [rbp+jit_dirty],0 */
+    ModPriv(j,7,POFF(jit_dirty));
+    B(j,0x00);
+    patch=Jump(j,CC_Z);
+    Exit(j,next,t);
+    Land(j,patch);
+}
+
+
+/* Loads 8-bit register r (B,C,D,E,H,L,-,A) into reg
+*/
+static void Get8(Jit *j, int reg, int r)
+{
+    int pair=R_BC+(r>>1);
+
+    if (r==7)
+    {
+	Mov(j,reg,R_A);
+    }
+    else if (r&1)
+    {
+	Rex(j,reg,pair,TRUE);	/* movzx reg,pair low byte */
+	B(j,0x0f);
+	B(j,0xb6);
+	B(j,0xc0|(reg&7)<<3|(pair&7));
+    }
+    else
+    {
+	Mov(j,reg,pair);
+	Shift(j,X_SHR,reg,8);
+    }
+}
+
+
+/* Sets 8-bit register r from the byte in reg, which is lost
+*/
+static void Set8(Jit *j, int r, int reg)
+{
+    int pair=R_BC+(r>>1);
+
+    if (r==7)
+    {
+	Mov(j,R_A,reg);
+    }
+    else if (r&1)
+    {
+	RegOpB(j,0x88,reg,pair);	/* mov pair low byte,reg */
+    }
+    else
+    {
+	ImmOp(j,X_AND,pair,0xff);
+	Shift(j,X_SHL,reg,8);
+	RegOp(j,0x09,reg,pair);		/* or pair,reg */
+    }
+}
+
+
+static void Set8Imm(Jit *j, int r, Z80Byte val)
+{
+    int pair=R_BC+(r>>1);
+
+    if (r==7)
+    {
+	MovImm(j,R_A,val);
+    }
+    else if (r&1)
+    {
+	Rex(j,0,pair,TRUE);	/* mov pair low byte,val */
+	B(j,0xb0+(pair&7));
+	B(j,val);
+    }
+    else
+    {
+	ImmOp(j,X_AND,pair,0xff);
+	ImmOp(j,X_OR,pair,val<<8);
+    }
+}
+
+
+/* Pushes register pair rr (BC,DE,HL,AF), or val if rr is negative
+*/
+static void Push(Jit *j, int rr, Z80Word val)
+{
+    LoadW(j,ESI,ZOFF(SP));
+    B(j,0x83);			/* sub esi,2 */
+    B(j,0xee);
+    B(j,0x02);
+    Mask16(j,ESI);
+    StoreW(j,ESI,ZOFF(SP));
+
+    if (rr<0)
+	MovImm(j,EDX,val&0xff);
+    else if (rr==3)
+	LoadB(j,EDX,OFF_F);
+    else
+	Get8(j,EDX,rr*2+1);
+
+    Write(j);
+
+    LoadW(j,ESI,ZOFF(SP));
+    B(j,0xff);			/* inc esi */
+    B(j,0xc6);
+    Mask16(j,ESI);
+
+    if (rr<0)
+	MovImm(j,EDX,val>>8);
+    else
+	Get8(j,EDX,rr==3 ? 7:rr*2);
+
+    Write(j);
+}
+
+
+/* Pops a word into EAX
+*/
+static void Pop(Jit *j)
+{
+    LoadW(j,ECX,ZOFF(SP));
+    Read(j);
+    Mov(j,ESI,EAX);
+
+    LoadW(j,ECX,ZOFF(SP));
+    B(j,0xff);			/* inc ecx */
+    B(j,0xc1);
+    Mask16(j,ECX);
+    Read(j);
+    Shift(j,X_SHL,EAX,8);
+    RegOp(j,0x09,ESI,EAX);	/* or eax,esi */
+
+    B(j,0x66);			/* add word [rbx+SP],2 */
+    B(j,0x83);
+    ModZ80(j,0,ZOFF(SP));
+    B(j,0x02);
+}
+
+
+/* Writes register pair rr (BC,DE,HL,SP) to nn
+*/
+static void WritePair(Jit *j, int rr, Z80Word nn)
+{
+    MovImm(j,ESI,nn);
+
+    if (rr==3)
+	LoadB(j,EDX,ZOFF(SP));
+    else
+	Get8(j,EDX,rr*2+1);
+
+    Write(j);
+    MovImm(j,ESI,(Z80Word)(nn+1));
+
+    if (rr==3)
+	LoadB(j,EDX,ZOFF(SP)+1);
+    else
+	Get8(j,EDX,rr*2);
+
+    Write(j);
+}
+
+
+/* Reads register pair rr (BC,DE,HL,SP) from nn
+*/
+static void ReadPair(Jit *j, int rr, Z80Word nn)
+{
+    int pair=R_BC+rr;
+
+    MovImm(j,ECX,nn);
+    Read(j);
+
+    if (rr==3)
+	StoreB(j,EAX,ZOFF(SP));
+    else
+	Mov(j,pair,EAX);
+
+    MovImm(j,ECX,(Z80Word)(nn+1));
+    Read(j);
+
+    if (rr==3)
+    {
+	StoreB(j,EAX,ZOFF(SP)+1);
+    }
+    else
+    {
+	Shift(j,X_SHL,EAX,8);
+	RegOp(j,0x09,EAX,pair);	/* or pair,eax */
+    }
+}
+
+
+/* Puts the address of (HL) into reg, or of (IX+d) or (IY+d) if off is the
+   offset of IX or IY
+*/
+static void MemAddr(Jit *j, int reg, int off, Z80Relative d)
+{
+    if (off<0)
+    {
+	Mov(j,reg,R_HL);
+    }
+    else
+    {
+	LoadW(j,reg,off);
+	ImmOp(j,X_ADD,reg,(uint32_t)d);
+	Mask16(j,reg);
+    }
+}
+
+
+/* Swaps the words at [RBX+a] and [RBX+b]
+*/
+static void Swap(Jit *j, int a, int b)
+{
+    LoadW(j,EAX,a);
+    LoadW(j,ECX,b);
+    StoreW(j,EAX,b);
+    StoreW(j,ECX,a);
+}
+
+
+/* Swaps register pair reg with the word at [RBX+off]
+*/
+static void SwapPair(Jit *j, int reg, int off)
+{
+    LoadW(j,EAX,off);
+    StoreW(j,reg,off);
+    Mov(j,reg,EAX);
+}
+
+
+/* Tests Z80 condition cc (NZ,Z,NC,C,PO,PE,P,M) and returns a jump taken
+   when the condition fails
+*/
+static Z80Byte *TestCond(Jit *j, int cc)
+{
+    static const Z80Byte mask[4]={Z_Z80,C_Z80,P_Z80,S_Z80};
+
+    B(j,0xf6);			/* test byte [rbx+F],mask */
+    ModZ80(j,0,OFF_F);
+    B(j,mask[cc>>1]);
+
+    return Jump(j,(cc&1) ? CC_Z:CC_NZ);
+}
+
+
+/* ---------------------------------------- FLAGS
+*/
+
+/* The x86 flags LAHF puts in AH are in the same places as the Z80's S, Z,
+   H, P and C, and the half carry and overflow come out the same as the
+   interpreter's.  Only the hidden bits and N need adding.
+*/
+
+/* Sets the x86 carry from the Z80's.  Uses EAX.
+*/
+static void CarryIn(Jit *j)
+{
+    LoadB(j,EAX,OFF_F);
+    B(j,0xd0);			/* shr al,1 */
+    B(j,0xe8);
+}
+
+
+/* Sets F to EDX with the hidden bits taken from A
+*/
+static void FlagsFromA(Jit *j)
+{
+    Mov(j,EAX,R_A);
+    ImmOp(j,X_AND,EAX,B3_Z80|B5_Z80);
+    RegOp(j,0x09,EAX,EDX);	/* or edx,eax */
+    StoreB(j,EDX,OFF_F);
+}
+
+
+/* ALU op (ADD,ADC,SUB,SBC,AND,XOR,OR,CP) on A and ESI
+*/
+static void Alu(Jit *j, int op)
+{
+    static const Z80Byte code[8]={0x00,0x10,0x28,0x18,0x20,0x30,0x08,0x38};
+
+    if (op==1 || op==3)
+	CarryIn(j);
+
+    RegOpB(j,code[op],ESI,R_A);
+    B(j,0x9f);			/* lahf */
+
+    if (op<4 || op==7)
+    {
+	B(j,0x0f);		/* seto cl */
+	B(j,0x90);
+	B(j,0xc1);
+	B(j,0xc0);		/* shl cl,2 */
+	B(j,0xe1);
+	B(j,2);
+	B(j,0x80);		/* and ah,S|Z|H|C */
+	B(j,0xe4);
+	B(j,S_Z80|Z_Z80|H_Z80|C_Z80);
+	B(j,0x08);		/* or ah,cl */
+	B(j,0xcc);
+
+	if (op>=2)
+	{
+	    B(j,0x80);		/* or ah,N */
+	    B(j,0xcc);
+	    B(j,N_Z80);
+	}
+    }
+    else
+    {
+	B(j,0x80);		/* and ah,S|Z|P */
+	B(j,0xe4);
+	B(j,S_Z80|Z_Z80|P_Z80);
+
+	if (op==4)
+	{
+	    B(j,0x80);		/* or ah,H */
+	    B(j,0xcc);
+	    B(j,H_Z80);
+	}
+    }
+
+    /* CP takes the hidden bits from the operand
+    */
+    Mov(j,EDX,op==7 ? ESI:R_A);
+    B(j,0x83);			/* and edx,B3|B5 */
+    B(j,0xe2);
+    B(j,B3_Z80|B5_Z80);
+    B(j,0x08);			/* or ah,dl */
+    B(j,0xd4);
+    B(j,0x88);			/* mov [rbx+F],ah */
+    ModZ80(j,4,OFF_F);
+}
+
+
+/* INC or DEC on CL, which leave the carry alone and clear the hidden bits
+*/
+static void IncDec(Jit *j, int dec)
+{
+    B(j,0xfe);			/* inc cl or dec cl */
+    B(j,dec ? 0xc9:0xc1);
+    B(j,0x9f);			/* lahf */
+    B(j,0x0f);			/* seto dl */
+    B(j,0x90);
+    B(j,0xc2);
+    B(j,0xc0);			/* shl dl,2 */
+    B(j,0xe2);
+    B(j,2);
+    B(j,0x80);			/* and ah,S|Z|H */
+    B(j,0xe4);
+    B(j,S_Z80|Z_Z80|H_Z80);
+    B(j,0x08);			/* or ah,dl */
+    B(j,0xd4);
+
+    if (dec)
+    {
+	B(j,0x80);		/* or ah,N */
+	B(j,0xcc);
+	B(j,N_Z80);
+    }
+
+    B(j,0x80);			/* and byte [rbx+F],C */
+    ModZ80(j,4,OFF_F);
+    B(j,C_Z80);
+    B(j,0x08);			/* or [rbx+F],ah */
+    ModZ80(j,4,OFF_F);
+}
+
+
+/* ADD HL,EDX, which keeps S, Z and P/V
+*/
+static void AddHL(Jit *j)
+{
+    B(j,0x31);			/* xor ecx,ecx */
+    B(j,0xc9);
+    Mov(j,EAX,R_HL);
+    B(j,0x31);			/* xor eax,edx */
+    B(j,0xd0);
+    B(j,0x66);			/* add hl,dx */
+    RegOp(j,0x01,EDX,R_HL);
+    B(j,0x0f);			/* setc cl */
+    B(j,0x92);
+    B(j,0xc1);
+
+    /* The half carry is out of bit 11
+    */
+    RegOp(j,0x31,R_HL,EAX);	/* xor eax,hl */
+    Shift(j,X_SHR,EAX,8);
+    ImmOp(j,X_AND,EAX,H_Z80);
+    B(j,0x09);			/* or eax,ecx */
+    B(j,0xc8);
+    Mov(j,EDX,R_HL);
+    Shift(j,X_SHR,EDX,8);
+    ImmOp(j,X_AND,EDX,B3_Z80|B5_Z80);
+    B(j,0x09);			/* or eax,edx */
+    B(j,0xd0);
+    LoadB(j,EDX,OFF_F);
+    ImmOp(j,X_AND,EDX,S_Z80|Z_Z80|P_Z80);
+    B(j,0x09);			/* or eax,edx */
+    B(j,0xd0);
+    StoreB(j,EAX,OFF_F);
+}
+
+
+/* ADC HL,EDX or SBC HL,EDX.  The half carry is worked out as for ADD.
+*/
+static void AdcSbcHL(Jit *j, int sbc)
+{
+    Mov(j,ECX,R_HL);
+    RegOp(j,0x31,EDX,ECX);	/* xor ecx,edx */
+    CarryIn(j);
+    B(j,0x66);			/* adc hl,dx or sbb hl,dx */
+    RegOp(j,sbc ? 0x19:0x11,EDX,R_HL);
+    B(j,0x9f);			/* lahf */
+    B(j,0x0f);			/* seto al */
+    B(j,0x90);
+    B(j,0xc0);
+    B(j,0xc0);			/* shl al,2 */
+    B(j,0xe0);
+    B(j,2);
+    B(j,0x80);			/* and ah,S|Z|C */
+    B(j,0xe4);
+    B(j,S_Z80|Z_Z80|C_Z80);
+    B(j,0x08);			/* or ah,al */
+    B(j,0xc4);
+    RegOp(j,0x31,R_HL,ECX);	/* xor ecx,hl */
+    Shift(j,X_SHR,ECX,8);
+    ImmOp(j,X_AND,ECX,H_Z80);
+    B(j,0x08);			/* or ah,cl */
+    B(j,0xcc);
+    Mov(j,EDX,R_HL);
+    Shift(j,X_SHR,EDX,8);
+    ImmOp(j,X_AND,EDX,B3_Z80|B5_Z80);
+    B(j,0x08);			/* or ah,dl */
+    B(j,0xd4);
+
+    if (sbc)
+    {
+	B(j,0x80);		/* or ah,N */
+	B(j,0xcc);
+	B(j,N_Z80);
+    }
+
+    B(j,0x88);			/* mov [rbx+F],ah */
+    ModZ80(j,4,OFF_F);
+}
+
+
+/* RLCA, RRCA, RLA or RRA, which are the x86 rotates ROL, ROR, RCL and RCR
+   by one.  S, Z and P/V are left alone.
+*/
+static void RotA(Jit *j, int op)
+{
+    B(j,0x31);			/* xor ecx,ecx */
+    B(j,0xc9);
+
+    if (op>=2)
+	CarryIn(j);
+
+    Rex(j,0,R_A,TRUE);		/* rotate a by one */
+    B(j,0xd0);
+    B(j,0xc0|op<<3|(R_A&7));
+    B(j,0x0f);			/* setc cl */
+    B(j,0x92);
+    B(j,0xc1);
+    LoadB(j,EDX,OFF_F);
+    ImmOp(j,X_AND,EDX,S_Z80|Z_Z80|P_Z80);
+    RegOp(j,0x09,ECX,EDX);	/* or edx,ecx */
+    FlagsFromA(j);
+}
+
+
+/* The CB op on the byte in ECX, leaving the result there
+*/
+static void BitOp(Jit *j, int op)
+{
+    /* The x86 shifts for RLC, RRC, RL, RR, SLA, SRA, SLL and SRL.  SLL is
+       RCL with the carry set.
+    */
+    static const Z80Byte shift[8]={0,1,2,3,4,7,2,5};
+    int b=(op>>3)&7;
+    int hidden=(1<<b)&(S_Z80|B5_Z80|B3_Z80);
+
+    switch(op>>6)
+    {
+	case 0:
+	    if (b==2 || b==3)
+		CarryIn(j);
+	    else if (b==6)
+		B(j,0xf9);	/* stc */
+
+	    B(j,0xd0);		/* shift cl by one */
+	    B(j,0xc1|shift[b]<<3);
+	    B(j,0x0f);		/* setc dl */
+	    B(j,0x92);
+	    B(j,0xc2);
+	    B(j,0x84);		/* test cl,cl */
+	    B(j,0xc9);
+	    B(j,0x9f);		/* lahf */
+	    B(j,0x80);		/* and ah,S|Z|P */
+	    B(j,0xe4);
+	    B(j,S_Z80|Z_Z80|P_Z80);
+	    B(j,0x08);		/* or ah,dl */
+	    B(j,0xd4);
+	    Mov(j,EDX,ECX);
+	    ImmOp(j,X_AND,EDX,B3_Z80|B5_Z80);
+	    B(j,0x08);		/* or ah,dl */
+	    B(j,0xd4);
+	    B(j,0x88);		/* mov [rbx+F],ah */
+	    ModZ80(j,4,OFF_F);
+	    break;
+
+	/* BIT keeps the carry and sets H, then Z and P/V if the bit is
+	   clear, or S, B5 or B3 if it is one of those and set
+	*/
+	case 1:
+	    LoadB(j,EAX,OFF_F);
+	    ImmOp(j,X_AND,EAX,C_Z80);
+	    ImmOp(j,X_OR,EAX,H_Z80);
+	    Mov(j,EDX,ECX);
+	    ImmOp(j,X_AND,EDX,1<<b);
+	    ImmOp(j,X_CMP,EDX,1);
+	    RegOp(j,0x19,ESI,ESI);	/* sbb esi,esi */
+	    ImmOp(j,X_AND,ESI,Z_Z80|P_Z80);
+	    RegOp(j,0x09,ESI,EAX);	/* or eax,esi */
+
+	    if (hidden)
+		RegOp(j,0x09,EDX,EAX);	/* or eax,edx */
+
+	    StoreB(j,EAX,OFF_F);
+	    break;
+
+	case 2:
+	    ImmOp(j,X_AND,ECX,~(1u<<b));
+	    break;
+
+	case 3:
+	    ImmOp(j,X_OR,ECX,1<<b);
+	    break;
+    }
+}
+
+
+/* The CB op on (HL), or on (IX+d) or (IY+d) if off is the offset of IX or
+   IY.  The byte is written back even by BIT, as the interpreter does.
+*/
+static void MemBitOp(Jit *j, int op, int off, Z80Relative d,
+		     Z80Word next, Z80Val t)
+{
+    MemAddr(j,ECX,off,d);
+    Read(j);
+    Mov(j,ECX,EAX);
+    BitOp(j,op);
+    MemAddr(j,ESI,off,d);
+    Mov(j,EDX,ECX);
+    Write(j);
+    CheckDirty(j,next,t);
+}
+
+
+/* ---------------------------------------- DECODING
+*/
+
+static int BaseLength(Z80Byte op)
+{
+    switch(op)
+    {
+	case 0x01: case 0x11: case 0x21: case 0x31:
+	case 0x22: case 0x2a: case 0x32: case 0x3a:
+	case 0xc2: case 0xca: case 0xd2: case 0xda:
+	case 0xe2: case 0xea: case 0xf2: case 0xfa:
+	case 0xc4: case 0xcc: case 0xd4: case 0xdc:
+	case 0xe4: case 0xec: case 0xf4: case 0xfc:
+	case 0xc3: case 0xcd:
+	    return 3;
+
+	case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+	case 0xd3: case 0xdb:
+	    return 2;
+
+	default:
+	    /* LD r,n and the ALU ops on n
+	    */
+	    if ((op&0xc7)==0x06 || (op&0xc7)==0xc6)
+		return 2;
+
+	    return 1;
+    }
+}
+
+
+/* Length of the instruction at pc, or 0 for a run of prefixes which the
+   interpreter decodes as a single instruction.
+*/
+static int Length(Z80 *cpu, Z80Word pc)
+{
+    Z80Byte op=PEEK(pc);
+
+    switch(op)
+    {
+	case 0xcb:
+	    return 2;
+
+	case 0xed:
+	    return (PEEK(pc+1)&0xc7)==0x43 ? 4:2;
+
+	case 0xdd:
+	case 0xfd:
+	    op=PEEK(pc+1);
+
+	    if (op==0xdd || op==0xfd || op==0xed)
+		return 0;
+
+	    if (op==0xcb)
+		return 4;
+
+	    /* (HL) becomes (IX+d) and gains an offset
+	    */
+	    if (op==0x34 || op==0x35 || op==0x36 ||
+		(op>=0x40 && op<0xc0 && op!=0x76 &&
+		    ((op&0x07)==0x06 || (op&0xf8)==0x70)))
+		return BaseLength(op)+2;
+
+	    return BaseLength(op)+1;
+
+	default:
+	    return BaseLength(op);
+    }
+}
+
+
+/* ---------------------------------------- TRANSLATION
+*/
+
+/* Runs the instruction at PC in the interpreter from translated code.
+   Returns TRUE if the block must be left, which includes when a repeating
+   block instruction has gone round more than the block allowed for.
+*/
+static int JitStep(Z80 *cpu, Z80Word next)
+{
+    Z80Val start=PRIV->cycle;
+
+    PRIV->shift=0;
+    INC_R;
+    Z80_Decode(cpu,FETCH_BYTE);
+    FLUSH_FLAGS;
+
+    return cpu->PC!=next || !PRIV->last_cb || PRIV->halt ||
+	    PRIV->jit_dirty || (PRIV->raise && (PRIV->nmi || cpu->IFF1)) ||
+	    PRIV->cycle-start>MAX_TSTATES;
+}
+
+
+static void Interpret(Jit *j, Z80Word pc, Z80Word next)
+{
+    Z80Byte *patch;
+
+    Flush(j);
+    SaveRegs(j);
+    StoreWImm(j,ZOFF(PC),pc);
+    MovImm(j,ESI,next);
+    Call(j,JitStep);
+    B(j,0x85);			/* test eax,eax */
+    B(j,0xc0);
+    B(j,0x74);			/* jz over the epilogue */
+    B(j,0);
+    patch=j->p;
+    Epilogue(j);
+    patch[-1]=j->p-patch;
+    LoadRegs(j);
+
+    j->max+=MAX_TSTATES;
+}
+
+
+/* Translates the instruction at pc.  Returns TRUE if it ends the block.
+*/
+static int Translate(Jit *j, Z80Word pc, int len)
+{
+    Z80 *cpu=j->cpu;
+    Z80Word next=pc+len;
+    Z80Byte op=PEEK(pc);
+    Z80Byte n=PEEK(pc+1);
+    Z80Word nn=PEEK(pc+1)|(Z80Word)PEEK(pc+2)<<8;
+    Z80Word rel=next+(Z80Relative)n;
+    Z80Val t=tstates[op];
+    Z80Byte *patch;
+    int dst=(op>>3)&7;
+    int src=op&7;
+    int rr=(op>>4)&3;
+    int pair=R_BC+rr;
+    int interpret=FALSE;
+
+    j->r++;
+    j->max+=tstates[op];
+
+    switch(op)
+    {
+	case 0x00:		/* NOP */
+	    break;
+
+	case 0x01: case 0x11: case 0x21:		/* LD rr,nnnn */
+	    MovImm(j,pair,nn);
+	    break;
+
+	case 0x31:		/* LD SP,nnnn */
+	    StoreWImm(j,ZOFF(SP),nn);
+	    break;
+
+	case 0x02: case 0x12:	/* LD (BC/DE),A */
+	    Mov(j,ESI,pair);
+	    Mov(j,EDX,R_A);
+	    Write(j);
+	    CheckDirty(j,next,t);
+	    break;
+
+	case 0x03: case 0x13: case 0x23:		/* INC rr */
+	case 0x0b: case 0x1b: case 0x2b:		/* DEC rr */
+	    B(j,0x66);
+	    Rex(j,0,pair,FALSE);
+	    B(j,0xff);
+	    B(j,(op&8 ? 0xc8:0xc0)|(pair&7));
+	    break;
+
+	case 0x33: case 0x3b:	/* INC SP, DEC SP */
+	    B(j,0x66);
+	    B(j,0xff);
+	    ModZ80(j,(op>>3)&1,ZOFF(SP));
+	    break;
+
+	case 0x04: case 0x0c: case 0x14: case 0x1c:	/* INC r */
+	case 0x24: case 0x2c: case 0x3c:
+	case 0x05: case 0x0d: case 0x15: case 0x1d:	/* DEC r */
+	case 0x25: case 0x2d: case 0x3d:
+	    Get8(j,ECX,dst);
+	    IncDec(j,op&1);
+	    Set8(j,dst,ECX);
+	    break;
+
+	case 0x34: case 0x35:	/* INC (HL), DEC (HL) */
+	    Mov(j,ECX,R_HL);
+	    Read(j);
+	    Mov(j,ECX,EAX);
+	    IncDec(j,op&1);
+	    Mov(j,ESI,R_HL);
+	    Mov(j,EDX,ECX);
+	    Write(j);
+	    CheckDirty(j,next,t);
+	    break;
+
+	case 0x06: case 0x0e: case 0x16: case 0x1e:	/* LD r,n */
+	case 0x26: case 0x2e: case 0x3e:
+	    Set8Imm(j,dst,n);
+	    break;
+
+	case 0x07: case 0x0f: case 0x17: case 0x1f:	/* RLCA .. RRA */
+	    RotA(j,dst);
+	    break;
+
+	case 0x2f:		/* CPL */
+	    ImmOp(j,X_XOR,R_A,0xff);
+	    LoadB(j,EDX,OFF_F);
+	    ImmOp(j,X_AND,EDX,~(B3_Z80|B5_Z80)&0xff);
+	    ImmOp(j,X_OR,EDX,H_Z80|N_Z80);
+	    FlagsFromA(j);
+	    break;
+
+	case 0x37:		/* SCF */
+	    LoadB(j,EDX,OFF_F);
+	    ImmOp(j,X_AND,EDX,S_Z80|Z_Z80|P_Z80);
+	    ImmOp(j,X_OR,EDX,C_Z80);
+	    FlagsFromA(j);
+	    break;
+
+	case 0x3f:		/* CCF, which moves the carry into H */
+	    LoadB(j,EDX,OFF_F);
+	    Mov(j,ECX,EDX);
+	    ImmOp(j,X_AND,ECX,C_Z80);
+	    Shift(j,X_SHL,ECX,4);
+	    ImmOp(j,X_AND,EDX,~(H_Z80|B3_Z80|B5_Z80)&0xff);
+	    RegOp(j,0x09,ECX,EDX);	/* or edx,ecx */
+	    ImmOp(j,X_XOR,EDX,C_Z80);
+	    FlagsFromA(j);
+	    break;
+
+	case 0x36:		/* LD (HL),n */
+	    Mov(j,ESI,R_HL);
+	    MovImm(j,EDX,n);
+	    Write(j);
+	    CheckDirty(j,next,t);
+	    break;
+
+	case 0x08:		/* EX AF,AF' */
+	    StoreB(j,R_A,OFF_A);
+	    Swap(j,ZOFF(AF),ZOFF(AF_));
+	    LoadB(j,R_A,OFF_A);
+	    break;
+
+	case 0x09: case 0x19: case 0x29:		/* ADD HL,rr */
+	    Mov(j,EDX,pair);
+	    AddHL(j);
+	    break;
+
+	case 0x39:		/* ADD HL,SP */
+	    LoadW(j,EDX,ZOFF(SP));
+	    AddHL(j);
+	    break;
+
+	case 0x0a: case 0x1a:	/* LD A,(BC/DE) */
+	    Mov(j,ECX,pair);
+	    Read(j);
+	    Mov(j,R_A,EAX);
+	    break;
+
+	case 0x10:		/* DJNZ */
+	    B(j,0x66);		/* sub bc,0x100 */
+	    Rex(j,0,R_BC,FALSE);
+	    B(j,0x81);
+	    B(j,0xe8|(R_BC&7));
+	    B(j,0x00);
+	    B(j,0x01);
+	    Rex(j,0,R_BC,FALSE);	/* test bc,0xff00 */
+	    B(j,0xf7);
+	    B(j,0xc0|(R_BC&7));
+	    D(j,0xff00);
+	    patch=Jump(j,CC_Z);
+	    Exit(j,rel,13);
+	    Land(j,patch);
+	    t=8;
+	    break;
+
+	case 0x18:		/* JR */
+	    Exit(j,rel,t);
+	    return TRUE;
+
+	case 0x20: case 0x28: case 0x30: case 0x38:	/* JR cc */
+	    patch=TestCond(j,(op>>3)&3);
+	    Exit(j,rel,12);
+	    Land(j,patch);
+	    t=7;
+	    break;
+
+	case 0x22:		/* LD (nnnn),HL */
+	    WritePair(j,2,nn);
+	    CheckDirty(j,next,t);
+	    break;
+
+	case 0x2a:		/* LD HL,(nnnn) */
+	    ReadPair(j,2,nn);
+	    break;
+
+	case 0x32:		/* LD (nnnn),A */
+	    MovImm(j,ESI,nn);
+	    Mov(j,EDX,R_A);
+	    Write(j);
+	    CheckDirty(j,next,t);
+	    break;
+
+	case 0x3a:		/* LD A,(nnnn) */
+	    MovImm(j,ECX,nn);
+	    Read(j);
+	    Mov(j,R_A,EAX);
+	    break;
+
+	case 0xc0: case 0xc8: case 0xd0: case 0xd8:	/* RET cc */
+	case 0xe0: case 0xe8: case 0xf0: case 0xf8:
+	    patch=TestCond(j,(op>>3)&7);
+	    Pop(j);
+	    StoreW(j,EAX,ZOFF(PC));
+	    Exit(j,-1,11);
+	    Land(j,patch);
+	    t=5;
+	    break;
+
+	case 0xc1: case 0xd1: case 0xe1:		/* POP rr */
+	    Pop(j);
+	    Mov(j,pair,EAX);
+	    break;
+
+	case 0xf1:		/* POP AF */
+	    Pop(j);
+	    StoreB(j,EAX,OFF_F);
+	    Shift(j,X_SHR,EAX,8);
+	    Mov(j,R_A,EAX);
+	    break;
+
+	case 0xc2: case 0xca: case 0xd2: case 0xda:	/* JP cc,nnnn */
+	case 0xe2: case 0xea: case 0xf2: case 0xfa:
+	    patch=TestCond(j,(op>>3)&7);
+	    Exit(j,nn,t);
+	    Land(j,patch);
+	    break;
+
+	case 0xc3:		/* JP nnnn */
+	    Exit(j,nn,t);
+	    return TRUE;
+
+	case 0xc4: case 0xcc: case 0xd4: case 0xdc:	/* CALL cc,nnnn */
+	case 0xe4: case 0xec: case 0xf4: case 0xfc:
+	    patch=TestCond(j,(op>>3)&7);
+	    Push(j,-1,next);
+	    Exit(j,nn,17);
+	    Land(j,patch);
+	    t=10;
+	    break;
+
+	case 0xc5: case 0xd5: case 0xe5: case 0xf5:	/* PUSH rr */
+	    Push(j,rr,0);
+	    CheckDirty(j,next,t);
+	    break;
+
+	case 0xc7: case 0xcf: case 0xd7: case 0xdf:	/* RST n */
+	case 0xe7: case 0xef: case 0xf7: case 0xff:
+	    Push(j,-1,next);
+	    Exit(j,op&0x38,t);
+	    return TRUE;
+
+	case 0xc9:		/* RET */
+	    Pop(j);
+	    StoreW(j,EAX,ZOFF(PC));
+	    Exit(j,-1,t);
+	    return TRUE;
+
+	case 0xcd:		/* CALL nnnn */
+	    Push(j,-1,next);
+	    Exit(j,nn,t);
+	    return TRUE;
+
+	case 0xd9:		/* EXX */
+	    SwapPair(j,R_BC,ZOFF(BC_));
+	    SwapPair(j,R_DE,ZOFF(DE_));
+	    SwapPair(j,R_HL,ZOFF(HL_));
+	    break;
+
+	/* The word popped is kept in the slot the prologue leaves to align
+	   the stack while HL is pushed
+	*/
+	case 0xe3:		/* EX (SP),HL */
+	    Pop(j);
+	    B(j,0x89);		/* mov [rsp],eax */
+	    B(j,0x04);
+	    B(j,0x24);
+	    Push(j,2,0);
+	    Rex(j,R_HL,0,FALSE);	/* mov hl,[rsp] */
+	    B(j,0x8b);
+	    B(j,0x04|(R_HL&7)<<3);
+	    B(j,0x24);
+	    CheckDirty(j,next,t);
+	    break;
+
+	case 0xe9:		/* JP (HL) */
+	    StoreW(j,R_HL,ZOFF(PC));
+	    Exit(j,-1,t);
+	    return TRUE;
+
+	case 0xeb:		/* EX DE,HL */
+	    RegOp(j,0x87,R_DE,R_HL);	/* xchg de,hl */
+	    break;
+
+	case 0xf9:		/* LD SP,HL */
+	    StoreW(j,R_HL,ZOFF(SP));
+	    break;
+
+	case 0xc6: case 0xce: case 0xd6: case 0xde:	/* ALU A,n */
+	case 0xe6: case 0xee: case 0xf6: case 0xfe:
+	    MovImm(j,ESI,n);
+	    Alu(j,dst);
+	    break;
+
+	/* The prefixes count towards R, and their T-states are in the
+	   instruction's.  The interpreter takes the same time for SET and
+	   RES on memory as for BIT.
+	*/
+	case 0xcb:		/* CB ops */
+	    j->r++;
+	    t=(n&7)!=6 ? 8 : n<0x40 ? 15:12;
+	    j->max+=t;
+
+	    if ((n&7)==6)
+	    {
+		MemBitOp(j,n,-1,0,next,t);
+	    }
+	    else
+	    {
+		Get8(j,ECX,n&7);
+		BitOp(j,n);
+
+		if ((n&0xc0)!=0x40)
+		    Set8(j,n&7,ECX);
+	    }
+	    break;
+
+	case 0xed:		/* ADC/SBC HL,rr and LD to and from (nnnn) */
+	    if ((n&0xc6)!=0x42)
+	    {
+		interpret=TRUE;
+		break;
+	    }
+
+	    j->r++;
+	    t=(n&1) ? 20:15;
+	    j->max+=t;
+	    rr=(n>>4)&3;
+	    nn=PEEK(pc+2)|(Z80Word)PEEK(pc+3)<<8;
+
+	    if (!(n&1))
+	    {
+		if (rr==3)
+		    LoadW(j,EDX,ZOFF(SP));
+		else
+		    Mov(j,EDX,R_BC+rr);
+
+		AdcSbcHL(j,!(n&8));
+	    }
+	    else if (n&8)
+	    {
+		ReadPair(j,rr,nn);
+	    }
+	    else
+	    {
+		WritePair(j,rr,nn);
+		CheckDirty(j,next,t);
+	    }
+	    break;
+
+	case 0xdd: case 0xfd:	/* CB ops on (IX+d) and (IY+d) */
+	    if (n!=0xcb || (PEEK(pc+3)&7)!=6)
+	    {
+		interpret=TRUE;
+		break;
+	    }
+
+	    j->r+=2;
+	    t=PEEK(pc+3)<0x40 ? 23:20;
+	    j->max+=t;
+	    MemBitOp(j,PEEK(pc+3),op==0xdd ? ZOFF(IX):ZOFF(IY),
+		     (Z80Relative)PEEK(pc+2),next,t);
+	    break;
+
+	default:
+	    if (op>=0x40 && op<0x80 && op!=0x76)	/* LD r,r */
+	    {
+		if (src==6)
+		{
+		    Mov(j,ECX,R_HL);
+		    Read(j);
+		    Set8(j,dst,EAX);
+		}
+		else if (dst==6)
+		{
+		    Mov(j,ESI,R_HL);
+		    Get8(j,EDX,src);
+		    Write(j);
+		    CheckDirty(j,next,t);
+		}
+		else if (src!=dst)
+		{
+		    Get8(j,ECX,src);
+		    Set8(j,dst,ECX);
+		}
+	    }
+	    else if (op>=0x80 && op<0xc0)		/* ALU A,r */
+	    {
+		if (src==6)
+		{
+		    Mov(j,ECX,R_HL);
+		    Read(j);
+		    Mov(j,ESI,EAX);
+		}
+		else
+		{
+		    Get8(j,ESI,src);
+		}
+
+		Alu(j,dst);
+	    }
+	    else
+	    {
+		interpret=TRUE;
+	    }
+	    break;
+    }
+
+    if (interpret)
+    {
+	j->r--;
+	j->max-=tstates[op];
+	Interpret(j,pc,next);
+	return FALSE;
+    }
+
+    j->tstates+=t;
+
+    return FALSE;
+}
+
+
+/* Pages reading the same memory are kept in a ring.  Writing through any
+   of them has to drop code translated through the others, so all of them
+   are flagged while any has code translated from it.
+*/
+static void FlagMirrors(Z80 *cpu, int page)
+{
+    int code=FALSE;
+    int f=page;
+    int n;
+
+    do
+    {
+	for(n=0;PRIV->jit && n<Z80_PAGE_SIZE/8 && !code;n++)
+	    code=PRIV->jit->code[(f<<Z80_PAGE_SHIFT)/8+n];
+
+	f=PRIV->jit_mirror[f];
+    } while(f!=page);
+
+    do
+    {
+	PRIV->jit_page[f]=code!=0;
+	f=PRIV->jit_mirror[f];
+    } while(f!=page);
+}
+
+
+/* Throws away all translated code
+*/
+static void Reset(Z80 *cpu)
+{
+    free(PRIV->jit);
+    PRIV->jit=NULL;
+
+    memset(PRIV->jit_page,0,sizeof PRIV->jit_page);
+
+    PRIV->jit_used=0;
+}
+
+
+/* Maps the buffer once to run code from and again to write it to,
+   returning FALSE if it can't be
+*/
+static int MapTwice(Z80 *cpu)
+{
+#ifdef MFD_CLOEXEC
+    int fd=memfd_create("z80jit",MFD_CLOEXEC);
+    void *run=MAP_FAILED;
+    void *write=MAP_FAILED;
+
+    if (fd==-1)
+	return FALSE;
+
+    if (ftruncate(fd,BUFFER_SIZE)==0)
+    {
+	run=mmap(NULL,BUFFER_SIZE,PROT_READ|PROT_EXEC,MAP_SHARED,fd,0);
+	write=mmap(NULL,BUFFER_SIZE,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+    }
+
+    close(fd);
+
+    if (run!=MAP_FAILED && write!=MAP_FAILED)
+    {
+	PRIV->jit_buffer=run;
+	PRIV->jit_write=write;
+	return TRUE;
+    }
+
+    if (run!=MAP_FAILED)
+	munmap(run,BUFFER_SIZE);
+
+    if (write!=MAP_FAILED)
+	munmap(write,BUFFER_SIZE);
+#endif
+
+    return FALSE;
+}
+
+
+/* Allocates the tables and buffer if they aren't already.  Translation is
+   turned off if they can't be.
+*/
+static int Allocate(Z80 *cpu)
+{
+    int f;
+
+    if (!PRIV->jit_buffer && !MapTwice(cpu))
+    {
+	PRIV->jit_buffer=mmap(NULL,BUFFER_SIZE,PROT_READ|PROT_WRITE,
+			      MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+
+	if (PRIV->jit_buffer==MAP_FAILED)
+	    PRIV->jit_buffer=NULL;
+
+	PRIV->jit_write=PRIV->jit_buffer;
+    }
+
+    if (PRIV->jit_buffer && !PRIV->jit)
+    {
+	PRIV->jit=calloc(1,sizeof *PRIV->jit);
+
+	if (PRIV->jit)
+	    for(f=0;f<Z80_NO_PAGES;f++)
+		PRIV->jit->gen[f]=1;
+    }
+
+    if (!PRIV->jit)
+	PRIV->jit_use=FALSE;
+
+    return PRIV->jit!=NULL;
+}
+
+
+/* Sets the protection of the BLOCK_SPACE bytes of the buffer from offset
+   from, where it is only mapped once
+*/
+static int Protect(Z80 *cpu, Z80Val from, int prot)
+{
+    Z80Val size=sysconf(_SC_PAGESIZE);
+    Z80Val to=from+BLOCK_SPACE;
+
+    from&=~(size-1);
+
+    return mprotect(PRIV->jit_buffer+from,to-from,prot)==0;
+}
+
+
+/* Returns where code written to the buffer at p is run from
+*/
+static void *RunAt(Z80 *cpu, Z80Byte *p)
+{
+    return PRIV->jit_buffer+(p-PRIV->jit_write);
+}
+
+
+/* Translates the code at pc into the buffer, which must be writable
+*/
+static Z80JitBlock *Build(Z80 *cpu, Z80Word pc)
+{
+    Jit j;
+    Z80JitBlock *blk;
+    Z80Byte *start;
+    int page=pc>>Z80_PAGE_SHIFT;
+    int done=FALSE;
+    int n;
+
+    blk=(Z80JitBlock *)(PRIV->jit_write+PRIV->jit_used);
+    blk->pc=pc;
+    start=(Z80Byte *)(blk+1);
+
+    j.cpu=cpu;
+    j.p=start;
+    j.tstates=0;
+    j.r=0;
+    j.max=0;
+    j.chain=TRUE;
+
+    Prologue(&j);
+    blk->entry=RunAt(cpu,j.p);
+
+#ifdef ENABLE_IDLE_SKIP
+    /* An idle loop's block ends after the jump back, so that the jump has
+       been taken if the block leaves PC at its start
+    */
+    blk->idle=Z80_IdleLoop(cpu,pc,&n);
+    j.chain=!blk->idle;
+#endif
+
+    for(n=0;n<MAX_INSTR && !done;n++)
+    {
+	int len=Length(cpu,pc);
+
+	/* Blocks stay inside one page and out of reach of the fetch hook.
+	   The page is checked as well as the length, as running on past
+	   the end of the page, or from 0xffff round to 0, goes into the
+	   next.
+	*/
+	if (!len || pc>>Z80_PAGE_SHIFT!=page ||
+		(pc&Z80_PAGE_MASK)+len>Z80_PAGE_SIZE ||
+		pc>=PRIV->fetch_from)
+	    break;
+
+	done=Translate(&j,pc,len);
+	pc+=len;
+
+#ifdef ENABLE_IDLE_SKIP
+	if (blk->idle && pc>blk->idle)
+	    break;
+#endif
+    }
+
+    if (n==0)
+	return NULL;
+
+    if (!done)
+	Exit(&j,pc,0);
+
+    /* Note the bytes translated so writing to them drops the block
+    */
+    for(n=blk->pc;n!=pc;n=(Z80Word)(n+1))
+	PRIV->jit->code[n>>3]|=1<<(n&7);
+
+    FlagMirrors(cpu,page);
+
+    blk->code=(Z80JitCode)RunAt(cpu,start);
+    blk->gen=PRIV->jit->gen[page];
+    blk->tstates=j.max;
+
+    PRIV->jit_used=(j.p-PRIV->jit_write+15)&~15;
+
+    return RunAt(cpu,(Z80Byte *)blk);
+}
+
+
+/* Translates the code at pc, returning NULL if none of it can be
+*/
+static Z80JitBlock *Compile(Z80 *cpu, Z80Word pc)
+{
+    Z80JitBlock *blk;
+    Z80Val from;
+
+    if (PRIV->jit_used+BLOCK_SPACE>BUFFER_SIZE)
+	Reset(cpu);
+
+    if (!Allocate(cpu))
+	return NULL;
+
+    if (PRIV->jit_write!=PRIV->jit_buffer)
+	return Build(cpu,pc);
+
+    from=PRIV->jit_used;
+
+    if (!Protect(cpu,from,PROT_READ|PROT_WRITE))
+    {
+	PRIV->jit_use=FALSE;
+	return NULL;
+    }
+
+    blk=Build(cpu,pc);
+
+    if (!Protect(cpu,from,PROT_READ|PROT_EXEC))
+    {
+	PRIV->jit_use=FALSE;
+	return NULL;
+    }
+
+    return blk;
+}
+
+
+/* Finds the block for PC, translating it if it has become hot.  Only
+   addresses that code is entered at count towards that, ie. ones jumped
+   to or left at by a block rather than reached by running the instruction
+   before, so that a block isn't started in the middle of another.
+*/
+static Z80JitBlock *Lookup(Z80 *cpu)
+{
+    Z80Word pc=cpu->PC;
+    Z80Word last=PRIV->jit_last;
+    Z80Byte *count=PRIV->jit_count+(pc&(Z80_JIT_COUNTS-1));
+    Z80JitBlock *blk=PRIV->jit ? PRIV->jit->block[pc] : NULL;
+
+    PRIV->jit_last=pc;
+
+    if (blk)
+    {
+	if (blk->gen==PRIV->jit->gen[pc>>Z80_PAGE_SHIFT])
+	    return blk;
+
+	PRIV->jit->block[pc]=NULL;
+    }
+
+    /* The interpreter ran the instruction at last, which is at most 4
+       bytes long
+    */
+    if ((Z80Word)(pc-last-1)<4 || ++*count<HOT_COUNT)
+	return NULL;
+
+    *count=0;
+    blk=Compile(cpu,pc);
+
+    if (blk)
+	PRIV->jit->block[pc]=blk;
+
+    return blk;
+}
+
+
+/* Translated code works out the flags with LAHF, which some of the first
+   x86-64 processors don't have
+*/
+static int HasLahf(void)
+{
+    unsigned a,b,c,d;
+
+    return __get_cpuid(0x80000001,&a,&b,&c,&d) && (c&1);
+}
+
+
+/* ---------------------------------------- INTERFACES
+*/
+void Z80_JitInit(Z80 *cpu)
+{
+    int f;
+
+    PRIV->jit=NULL;
+    PRIV->jit_buffer=NULL;
+    PRIV->jit_write=NULL;
+
+    memset(PRIV->jit_count,0,sizeof PRIV->jit_count);
+    memset(PRIV->jit_page,0,sizeof PRIV->jit_page);
+
+    for(f=0;f<Z80_NO_PAGES;f++)
+	PRIV->jit_mirror[f]=f;
+
+    PRIV->jit_used=0;
+    PRIV->jit_last=0;
+    PRIV->jit_dirty=FALSE;
+    PRIV->jit_use=HasLahf();
+}
+
+
+void Z80_JitFree(Z80 *cpu)
+{
+    free(PRIV->jit);
+
+    if (PRIV->jit_write!=PRIV->jit_buffer)
+	munmap(PRIV->jit_write,BUFFER_SIZE);
+
+    if (PRIV->jit_buffer)
+	munmap(PRIV->jit_buffer,BUFFER_SIZE);
+}
+
+
+void Z80_JitUse(Z80 *cpu, int use)
+{
+    PRIV->jit_use=use && HasLahf();
+}
+
+
+int Z80_JitRun(Z80 *cpu)
+{
+    int ran=FALSE;
+
+    if (!PRIV->jit_use)
+	return FALSE;
+
+    /* Translated code doesn't check for interrupts, so is only run when
+       none can be taken
+    */
+    while(PRIV->last_cb && PRIV->cycle<PRIV->end && !PRIV->halt &&
+	  !(PRIV->raise && (PRIV->nmi || cpu->IFF1)) &&
+	  cpu->PC<PRIV->fetch_from)
+    {
+	Z80JitBlock *blk=Lookup(cpu);
+
+	if (!blk || PRIV->cycle+blk->tstates>PRIV->end)
+	    break;
+
+	/* Translated code reads F directly
+	*/
+	FLUSH_FLAGS;
+
+	PRIV->jit_dirty=FALSE;
+	blk->code(cpu);
+	ran=TRUE;
+
+	/* Where the block was left counts as somewhere code is entered
+	*/
+	PRIV->jit_last=cpu->PC;
+
+#ifdef ENABLE_IDLE_SKIP
+	if (blk->idle && cpu->PC==blk->pc)
+	    Z80_IdleJump(cpu,blk->idle);
+#endif
+    }
+
+    return ran;
+}
+
+
+void Z80_JitWrite(Z80 *cpu, Z80Word addr)
+{
+    int page=addr>>Z80_PAGE_SHIFT;
+    int f=page;
+
+    do
+    {
+	Z80Word a=(f<<Z80_PAGE_SHIFT)|(addr&Z80_PAGE_MASK);
+
+	if (PRIV->jit->code[a>>3]&(1<<(a&7)))
+	    Z80_JitInvalidatePage(cpu,f);
+
+	f=PRIV->jit_mirror[f];
+    } while(f!=page);
+}
+
+
+void Z80_JitMapPage(Z80 *cpu, int page)
+{
+    int f;
+
+    Z80_JitInvalidatePage(cpu,page);
+
+    /* Out of the ring of the old memory and into that of the new
+    */
+    for(f=page;PRIV->jit_mirror[f]!=page;f=PRIV->jit_mirror[f])
+	;
+
+    PRIV->jit_mirror[f]=PRIV->jit_mirror[page];
+    PRIV->jit_mirror[page]=page;
+
+    for(f=0;f<Z80_NO_PAGES;f++)
+    {
+	if (f!=page && PRIV->rpage[f]==PRIV->rpage[page])
+	{
+	    PRIV->jit_mirror[page]=PRIV->jit_mirror[f];
+	    PRIV->jit_mirror[f]=page;
+	    break;
+	}
+    }
+
+    FlagMirrors(cpu,page);
+}
+
+
+void Z80_JitInvalidatePage(Z80 *cpu, int page)
+{
+    PRIV->jit_page[page]=FALSE;
+    PRIV->jit_dirty=TRUE;
+
+    if (!PRIV->jit)
+	return;
+
+    memset(PRIV->jit->code+(page<<Z80_PAGE_SHIFT)/8,0,Z80_PAGE_SIZE/8);
+
+    /* If the generation wraps old blocks could become valid again
+    */
+    if (++PRIV->jit->gen[page]==0)
+    {
+	memset(PRIV->jit->block+(page<<Z80_PAGE_SHIFT),0,
+	       Z80_PAGE_SIZE*sizeof PRIV->jit->block[0]);
+
+	PRIV->jit->gen[page]=1;
+    }
+
+    FlagMirrors(cpu,page);
+}
+
+#endif	/* ENABLE_JIT */
+
+/* END OF FILE */
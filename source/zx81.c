@@ -28,12 +28,18 @@
 #include <ctype.h>
 #include <nds.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "zx81.h"
 #include "gui.h"
 
 #include "stream.h"
 
 #include "config.h"
+#include "calc.h"
+#include "pace.h"
 
 #include "zx81_bin.h"
 
@@ -58,6 +64,7 @@
 #define ED_WAITKEY	0xf2
 #define ED_ENDWAITKEY	0xf3
 #define ED_PAUSE	0xf4
+#define ED_CALC		0xf5
 
 #define SLOW_TSTATES	16000
 #define FAST_TSTATES	64000
@@ -69,57 +76,216 @@
 #define FRAMES		16436
 #define CDFLAG		16443
 
-static Z80Val		FRAME_TSTATES=FAST_TSTATES;
-
-/* The ZX81 screen and memory
+/* The ULA display engine.  A scanline is 207 T-states, or 414 pixels, and a
+   frame at 50Hz is 65000 T-states.  ULA_LEFT and ULA_TOP are the pixel and
+   scanline after HSYNC and VSYNC that the normal 256x192 display starts at.
 */
-static void		(*DrawScreen)(Z80 *z80);
-
-static int		waitkey=FALSE;
-static int		started=FALSE;
-
-static int		hires=FALSE;
-static int		hires_dfile;
-static int		last_I;
-
-static unsigned		prev_lk1;
-static unsigned		prev_lk2;
+#define ULA_LINE_TSTATES	207
+#define ULA_FRAME_TSTATES	65000
+#define ULA_LINE_PIXELS		(ULA_LINE_TSTATES*2+8)
+#define ULA_LEFT		128
+#define ULA_TOP			56
 
 #define	SCR_W		256
 #define	SCR_H		192
 #define	TXT_W		32
 #define	TXT_H		24
 
-static Z80Byte		mem[0x10000];
+#define DFILE		0x400c
 
-static Z80Byte		scr_mirror[7000];
+/* Tape
+*/
+#define TAPE_START	0x4009
+#define TAPE_MAX	(RAM_END-TAPE_START)
 
-static Z80Word		RAMBOT=0;
-static Z80Word		RAMTOP=0;
+/* The memory map is kept in 1K pages.  Only the RAM belongs to a machine;
+   the ROM and the empty memory above the RAM are shared by all of them.
+   The RAM always starts and ends on a page boundary.
+*/
+#define PAGE_SHIFT	10
+#define PAGE_SIZE	(1<<PAGE_SHIFT)
+#define PAGE_MASK	(PAGE_SIZE-1)
+#define NO_PAGES	(0x10000>>PAGE_SHIFT)
 
-#define DFILE		0x400c
+#if defined(ENABLE_PAGED_MEMORY) && Z80_PAGE_SHIFT > PAGE_SHIFT
+#error "Z80_PAGE_SHIFT must not be more than the ZX81's PAGE_SHIFT"
+#endif
 
-#define WORD(a)		(mem[a] | (Z80Word)mem[a+1]<<8)
+/* Checkpoints.  The RAM is held in pages, each of which is shared by any
+   checkpoints and machines that hold the same bytes in that part of RAM.
+   Once made a page is never changed.
+*/
+typedef struct
+{
+    int			refs;
+    Z80Byte		data[PAGE_SIZE];
+} SharedPage;
 
-/* Tape
+struct ZX81Checkpoint
+{
+    ZX81State		state;
+    Z80Word		ram_bot;
+    Z80Word		ram_top;
+    Z80Val		ram_len;
+    int			ula_display;
+    SharedPage		*page[NO_PAGES];
+};
+
+/* Pages can be shared between machines run on different threads
+*/
+#if defined(__GNUC__) && defined(__unix__)
+#define PAGE_REF(p)	__sync_add_and_fetch(&(p)->refs,1)
+#define PAGE_UNREF(p)	__sync_sub_and_fetch(&(p)->refs,1)
+#else
+#define PAGE_REF(p)	(++(p)->refs)
+#define PAGE_UNREF(p)	(--(p)->refs)
+#endif
+
+/* A ZX81.  Everything that changes as a machine runs is held in here, so
+   any number of them can be run side by side.
+*/
+struct ZX81Machine
+{
+    Z80			*z80;
+
+    /* The ZX81 memory.  page[] and write_page[] point at where each page
+       of the address space is read from and written to.  ram holds the
+       ram_len bytes from ram_bot, which are mirrored up to ram_top if
+       that's further.  Writes outside the RAM go to discard.
+    */
+    Z80Byte		*page[NO_PAGES];
+    Z80Byte		*write_page[NO_PAGES];
+    Z80Byte		*ram;
+    Z80Byte		*rom;
+    Z80Word		ram_bot;
+    Z80Word		ram_top;
+    Z80Val		ram_len;
+    Z80Byte		discard[PAGE_SIZE];
+
+    Z80Val		frame_tstates;
+
+    /* The ULA display engine
+    */
+    int			ula_display;
+    int			ula_nmi;
+    int			ula_vsync;
+    int			ula_vsync_end;
+    Z80Byte		ula_lcntr;
+    int			ula_line;
+    Z80Val		ula_hsync;
+
+    uint16		ula_scanline[ULA_LINE_PIXELS];
+    int			ula_dirty_lo;
+    int			ula_dirty_hi;
+
+    /* The ZX81 screen
+    */
+    void		(*DrawScreen)(ZX81Machine *zx);
+
+    int			waitkey;
+    int			started;
+
+    int			hires;
+    int			hires_dfile;
+    int			last_I;
+
+    Z80Byte		scr_mirror[7000];
+
+    /* The text display is only redrawn where the display file has been
+       written to.  text_row[] holds the address of the NEWLINE before each
+       row as last drawn, with text_row[TXT_H] the one ending the last row.
+    */
+    Z80Word		text_row[TXT_H+1];
+    int			text_dirty[TXT_H];
+    int			text_dirty_any;
+    int			text_all_dirty;
+
+    uint16		*txt_screen;
+    uint16		*bmp_screen;
+
+    /* Decides which frames are drawn, and waits between them
+    */
+    Pacer		pace;
+
+    /* The keyboard
+    */
+    Z80Byte		matrix[8];
+    unsigned		prev_lk1;
+    unsigned		prev_lk2;
+
+    /* Tape
+    */
+    int			enable_filesystem;
+    int			allow_save;
+    TapeSource		*tape_source;
+
+    char		last_dir[FILENAME_MAX];
+
+    /* The checkpoint page each page of RAM was last copied to or from
+    */
+    SharedPage		*shared[NO_PAGES];
+};
+
+/* Reads address a.  POKE() must only be used for addresses in RAM, and
+   RAM() points at them for copying blocks.
 */
-static int		enable_filesystem;
-static int		allow_save;
-static const Z80Byte	*tape_image;
-static int		tape_len;
+#define PEEK(a)		(zx->page[(Z80Word)(a)>>PAGE_SHIFT][(a)&PAGE_MASK])
+#define POKE(a,v)	(PEEK(a)=(v))
+#define RAM(a)		(zx->ram+((a)-zx->ram_bot))
+#define RAM_END		((Z80Val)zx->ram_bot+zx->ram_len)
 
-static char		last_dir[FILENAME_MAX] = "/";
+#define WORD(a)		(PEEK(a) | (Z80Word)PEEK((a)+1)<<8)
 
-/* GFX vars
+/* The ROM patched for each display engine and calculator, and a page of
+   zeroes read from outside the ROM and RAM.  Shared by all machines.
+*/
+enum
+{
+    ROM_TEXT,
+    ROM_TEXT_CALC,
+    ROM_ULA,
+    NO_ROMS
+};
+
+static Z80Byte		rom_image[NO_ROMS][ROMLEN];
+static const Z80Byte	empty_page[PAGE_SIZE];
+
+/* The RAM for each DS81_RAM_PACK setting.  The 1K and 2K of a bare machine
+   appear over and over up to 0x7fff as not all the address lines are
+   decoded.  The 56K pack fills 0x2000 to 0x3fff as well.
 */
-static uint16		*txt_screen;
-static uint16		*bmp_screen;
+static const struct
+{
+    Z80Word	top;
+    Z80Val	len;
+    int		at_0x2000;
+} ram_pack[DS81_NUM_RAM_PACKS]=
+    {
+    	{0x7fff, 0x0400, FALSE},	/* 1K	*/
+    	{0x7fff, 0x0800, FALSE},	/* 2K	*/
+    	{0x7fff, 0x4000, FALSE},	/* 16K	*/
+    	{0xbfff, 0x8000, FALSE},	/* 32K	*/
+    	{0xffff, 0xc000, FALSE},	/* 48K	*/
+    	{0xffff, 0xc000, TRUE}		/* 56K	*/
+    };
 
-/* The keyboard
+/* The most frames run for each VBlank for each DS81_TURBO_SPEED setting, or
+   0 for as many as will run
+*/
+static const int turbo_cap[DS81_NUM_TURBO_SPEEDS]={2, 4, 8, 0};
+
+/* The eight pixels for each byte of a character pattern, as pairs of pixels
+   so that they can be written 32 bits at a time.  The first pixel of each
+   pair is in the low half as both the DS and x86 are little-endian.  Shared
+   by all machines.
 */
-static Z80Byte		matrix[8];
+typedef uint32 __attribute__((__may_alias__)) PixelPair;
+
+static uint32		pixel_table[256][4];
 
-static struct
+/* The keyboard
+*/
+static const struct
 {
     int row;
     int bit;
@@ -138,17 +304,198 @@ static struct
 
 /* ---------------------------------------- PRIVATE FUNCTIONS
 */
-#define PEEKW(addr)		(mem[addr] | (Z80Word)mem[addr+1]<<8)
+#define PEEKW(addr)		(PEEK(addr) | (Z80Word)PEEK((addr)+1)<<8)
 
 #define POKEW(addr,val)         do					\
                                 {					\
                                     Z80Word wa=addr;			\
                                     Z80Word wv=val;			\
-                                    mem[wa]=wv;				\
-                                    mem[wa+1]=wv>>8;			\
+				    POKE(wa,wv);			\
+				    POKE(wa+1,wv>>8);			\
                                 } while(0)
 
-static void RomPatch(void)
+/* Points each page of the address space at the ROM, the RAM or the empty
+   page.  The ROM is mirrored at 0x2000 unless there is RAM there.  With the
+   ULA display engine the upper 32K mirrors the lower 32K as on the real
+   thing, where there's no RAM.
+*/
+static void BuildPageTable(ZX81Machine *zx)
+{
+    Z80Val mirror;
+    int p;
+
+    /* Anything from ram_bot+ram_len to ram_top repeats the RAM at 0x4000
+    */
+    mirror=(RAM_END-0x4000)>>PAGE_SHIFT;
+
+    for(p=0;p<NO_PAGES;p++)
+    {
+	Z80Val addr=(Z80Val)p<<PAGE_SHIFT;
+
+	if (addr>=zx->ram_bot && addr<=zx->ram_top)
+	{
+	    if (addr<RAM_END)
+	    {
+		zx->page[p]=RAM(addr);
+	    }
+	    else
+	    {
+		zx->page[p]=zx->page[p-mirror];
+	    }
+
+	    zx->write_page[p]=zx->page[p];
+	}
+	else if (zx->ula_display && addr>=0x8000)
+	{
+	    zx->page[p]=zx->page[p-(0x8000>>PAGE_SHIFT)];
+	    zx->write_page[p]=zx->write_page[p-(0x8000>>PAGE_SHIFT)];
+	}
+	else if (addr<0x4000)
+	{
+	    zx->page[p]=zx->rom+(addr&(ROMLEN-1));
+	    zx->write_page[p]=zx->discard;
+	}
+	else
+	{
+	    zx->page[p]=(Z80Byte *)empty_page;
+	    zx->write_page[p]=zx->discard;
+	}
+    }
+}
+
+
+/* Makes the RAM run from bot to top, with len bytes of it that are then
+   mirrored up to top.  What was in RAM at each address is kept, and the
+   rest cleared.  Returns FALSE if there isn't the memory, leaving the RAM
+   as it was.
+*/
+static int SizeRAM(ZX81Machine *zx, Z80Word bot, Z80Word top, Z80Val len)
+{
+    Z80Byte *ram;
+    Z80Val f;
+
+    if (zx->ram && bot==zx->ram_bot && top==zx->ram_top && len==zx->ram_len)
+    {
+	return TRUE;
+    }
+
+    if (!(ram=malloc(len)))
+    {
+	return FALSE;
+    }
+
+    /* Addresses that weren't RAM before, such as the ROM when the RAM is
+       moved down to 0x2000, start cleared
+    */
+    for(f=0;f<len;f++)
+    {
+	Z80Val addr=bot+f;
+
+	if (zx->ram && addr>=zx->ram_bot && addr<=zx->ram_top)
+	{
+	    ram[f]=PEEK(addr);
+	}
+	else
+	{
+	    ram[f]=0;
+	}
+    }
+
+    free(zx->ram);
+    zx->ram=ram;
+    zx->ram_bot=bot;
+    zx->ram_top=top;
+    zx->ram_len=len;
+
+    BuildPageTable(zx);
+
+    return TRUE;
+}
+
+
+/* Fits the RAM pack set in the config
+*/
+static int FitRAMPack(ZX81Machine *zx)
+{
+    int pack=DS81_Config[DS81_RAM_PACK];
+    Z80Word bot=0x4000;
+    Z80Val len;
+
+    if (pack<0 || pack>=DS81_NUM_RAM_PACKS)
+    {
+	pack=DS81_RAM_16K;
+    }
+
+    len=ram_pack[pack].len;
+
+    if (DS81_Config[DS81_STATIC_RAM_AT_0x2000] || ram_pack[pack].at_0x2000)
+    {
+	bot=0x2000;
+	len+=0x2000;
+    }
+
+    return SizeRAM(zx,bot,ram_pack[pack].top,len);
+}
+
+
+/* Older snapshots have ram_top a byte into the upper 32K.  That byte is
+   dropped to leave the RAM in whole pages.
+*/
+#define SNAP_TOP(t)	((((t)+1)&~(Z80Val)PAGE_MASK)-1)
+
+/* Checks a RAM layout read from a snapshot.  The RAM must be whole pages
+   between the ROM and ram_top covering 0x4000, and if mirrored must fit a
+   whole number of times between 0x4000 and ram_top.
+*/
+static int ValidRAM(Z80Val bot, Z80Val top, Z80Val len)
+{
+    Z80Val end=bot+len;
+
+    if (bot<ROMLEN || bot>0x4000 || (bot&PAGE_MASK) || top>0xffff ||
+	((top+1)&PAGE_MASK) || (len&PAGE_MASK) || end<=0x4000 || end>top+1)
+    {
+	return FALSE;
+    }
+
+    return (top+1-0x4000)%(end-0x4000)==0;
+}
+
+
+/* Points the Z80's page table at the memory.  As the RAM is in whole pages
+   writes only need trapping to track the text display.
+*/
+static void MapMemory(ZX81Machine *zx)
+{
+#ifdef ENABLE_PAGED_MEMORY
+    Z80Val bot;
+    Z80Val top;
+    int p;
+
+    for(p=0;p<NO_PAGES;p++)
+    {
+	Z80Byte *write=zx->write_page[p];
+
+	Z80MapMemory(zx->z80,p<<PAGE_SHIFT,PAGE_SIZE,zx->page[p],
+		     write==zx->discard ? NULL : write);
+    }
+
+    /* Writes to the text display file go through ZX81WriteMem() so that
+       changed rows can be tracked
+    */
+    if (!zx->ula_display && zx->text_row[TXT_H]>zx->text_row[0])
+    {
+	bot=zx->text_row[0]&~(Z80Val)Z80_PAGE_MASK;
+	top=((Z80Val)zx->text_row[TXT_H]|Z80_PAGE_MASK)+1;
+
+	Z80TrapWrites(zx->z80,bot,top-bot);
+    }
+#endif
+}
+
+
+/* Patches a copy of the ROM for the display engine and calculator
+*/
+static void PatchROM(Z80Byte *rom, int ula_display, int fast_calc)
 {
     static const Z80Byte save[]=
     {
@@ -192,38 +539,95 @@ static void RomPatch(void)
 
     for(f=0;save[f]!=0xff;f++)
     {
-	mem[ROM_SAVE+f]=save[f];
+	rom[ROM_SAVE+f]=save[f];
     }
 
     for(f=0;load[f]!=0xff;f++)
     {
-	mem[ROM_LOAD+f]=load[f];
+	rom[ROM_LOAD+f]=load[f];
+    }
+
+    /* The ULA display engine runs the ROM's own display and keyboard code
+    */
+    if (ula_display)
+    {
+	return;
     }
 
     for(f=0;fast_hack[f]!=0xff;f++)
     {
-	mem[0x4ca+f]=fast_hack[f];
+	rom[0x4ca+f]=fast_hack[f];
     }
 
     for(f=0;kbd_hack[f]!=0xff;f++)
     {
-	mem[0x2bb+f]=kbd_hack[f];
+	rom[0x2bb+f]=kbd_hack[f];
     }
 
     for(f=0;pause_hack[f]!=0xff;f++)
     {
-	mem[0xf3a+f]=pause_hack[f];
+	rom[0xf3a+f]=pause_hack[f];
     }
 
     /* Trust me, we have a ZX81... Honestly.
     */
-    mem[0x21c]=0x00;
-    mem[0x21d]=0x00;
+    rom[0x21c]=0x00;
+    rom[0x21d]=0x00;
 
     /* Remove HALTs as we don't do interrupts
     */
-    mem[0x0079]=0;
-    mem[0x02ec]=0;
+    rom[0x0079]=0;
+    rom[0x02ec]=0;
+
+    /* Do the calculator natively by trapping RST 28h
+    */
+    if (fast_calc)
+    {
+	rom[0x0028]=0xed;
+	rom[0x0029]=ED_CALC;
+    }
+}
+
+
+/* Patches the shared copies of the ROM
+*/
+static void InitROM(void)
+{
+    static int init=FALSE;
+    int f;
+
+    if (init)
+    {
+	return;
+    }
+
+    for(f=0;f<NO_ROMS;f++)
+    {
+	memcpy(rom_image[f],zx81_bin,ROMLEN);
+	PatchROM(rom_image[f],f==ROM_ULA,f==ROM_TEXT_CALC);
+    }
+
+    init=TRUE;
+}
+
+
+/* Picks the ROM patched for the machine's configuration.  The page table
+   must be rebuilt afterwards.
+*/
+static void LoadROM(ZX81Machine *zx)
+{
+    if (zx->ula_display)
+    {
+	zx->rom=rom_image[ROM_ULA];
+    }
+    else if (DS81_Config[DS81_FAST_CALC])
+    {
+	zx->rom=rom_image[ROM_TEXT_CALC];
+    }
+    else
+    {
+	zx->rom=rom_image[ROM_TEXT];
+    }
 }
 
 static Z80Byte FromASCII(char c)
@@ -256,7 +660,8 @@ static Z80Byte FromASCII(char c)
 
 /* Open a tape file the passed address
 */
-static FILE *OpenTapeFile(Z80Word addr, int *cancelled, const char *mode)
+static FILE *OpenTapeFile(ZX81Machine *zx, Z80Word addr, int *cancelled,
+			  const char *mode)
 {
     static const char zx_chars[] = "\"#$:?()><=+-*/;,."
 				   "0123456789"
@@ -276,7 +681,8 @@ static FILE *OpenTapeFile(Z80Word addr, int *cancelled, const char *mode)
     {
     	int ch;
 
-	ch = mem[addr++];
+	ch = PEEK(addr);
+	addr++;
 
 	if (ch&0x80)
 	{
@@ -292,7 +698,7 @@ static FILE *OpenTapeFile(Z80Word addr, int *cancelled, const char *mode)
 
     if (fn[0] == '*')
     {
-    	if (GUI_FileSelect(last_dir,fn,".P"))
+    	if (GUI_FileSelect(zx->last_dir,fn,".P"))
 	{
 	    fp = fopen(fn, mode);
 	}
@@ -321,48 +727,44 @@ static FILE *OpenTapeFile(Z80Word addr, int *cancelled, const char *mode)
 }
 
 
-static void LoadInternalTape(Z80 *z80)
-{
-    memcpy(mem+0x4009,tape_image,tape_len);
-}
-
-
-static void LoadExternalTape(FILE *tape, Z80 *z80)
+static void LoadTape(ZX81Machine *zx, TapeSource *src)
 {
-    int c;
-    Z80Byte *a;
-
-    a=mem+0x4009;
-
-    while((c=getc(tape))!=EOF)
+    if (src->len > TAPE_MAX)
     {
-    	*a++=c;
+	GUI_Alert(FALSE,"Tape too big for memory");
+	SK_DisplayKeyboard();
+    }
+    else if (TAPE_Read(src,RAM(TAPE_START),TAPE_MAX) < 0)
+    {
+	GUI_Alert(FALSE,"Couldn't read tape");
+	SK_DisplayKeyboard();
     }
+
+    Z80FlushCache(zx->z80);
+    zx->text_all_dirty=TRUE;
 }
 
 
-static void SaveExternalTape(FILE *tape, Z80 *z80)
+static void SaveExternalTape(ZX81Machine *zx, FILE *tape)
 {
-    int f;
     int end;
 
-    f = 0x4009;
     end = WORD(E_LINE);
 
-    while(f <= end)
+    if (end >= TAPE_START && end < TAPE_START+TAPE_MAX)
     {
-    	fputc(mem[f++], tape);
+	fwrite(RAM(TAPE_START), 1, end-TAPE_START+1, tape);
     }
 }
 
 
-static void ClearBitmap(void)
+static void ClearBitmap(ZX81Machine *zx)
 {
     uint16 *s;
     uint16 p;
     int f;
 
-    s = bmp_screen;
+    s = zx->bmp_screen;
     p = 0x8000|RGB15(31,31,31);
 
     for(f=0;f<SCREEN_WIDTH*SCREEN_HEIGHT;f++)
@@ -372,35 +774,121 @@ static void ClearBitmap(void)
 }
 
 
-static void ClearText(void)
+static void InitPixelTable(void)
+{
+    static int init=FALSE;
+    int v;
+    int f;
+
+    if (init)
+    {
+	return;
+    }
+
+    init=TRUE;
+
+    for(v=0;v<256;v++)
+    {
+	for(f=0;f<4;f++)
+	{
+	    uint32 p0=(v & (0x80>>(f*2))) ? 0x8000 : 0xffff;
+	    uint32 p1=(v & (0x40>>(f*2))) ? 0x8000 : 0xffff;
+
+	    pixel_table[v][f]=p0|(p1<<16);
+	}
+    }
+}
+
+
+/* Writes the eight pixels for pattern v to dst, which must be 32-bit
+   aligned
+*/
+static inline void ExpandPixels(uint16 *dst, int v)
+{
+#ifdef __SSE2__
+    _mm_storeu_si128((__m128i *)dst,
+		     _mm_loadu_si128((const __m128i *)pixel_table[v]));
+#else
+    PixelPair *d=(PixelPair *)dst;
+    const uint32 *p=pixel_table[v];
+
+    d[0]=p[0];
+    d[1]=p[1];
+    d[2]=p[2];
+    d[3]=p[3];
+#endif
+}
+
+
+static void ClearText(ZX81Machine *zx)
 {
     uint16 *s;
     int f;
 
-    s = txt_screen;
+    s = zx->txt_screen;
 
     for(f=0;f<TXT_W*TXT_H;f++)
     {
     	*s++=0;
     }
+
+    zx->text_all_dirty=TRUE;
+}
+
+
+/* Called before val is written to addr in the text display file
+*/
+static void TextWrite(ZX81Machine *zx, Z80Word addr, Z80Byte val)
+{
+    int lo;
+    int hi;
+
+    /* Adding or removing a NEWLINE moves the rows around
+    */
+    if ((PEEK(addr)==118) != (val==118))
+    {
+	zx->text_all_dirty=TRUE;
+	return;
+    }
+
+    /* Find the row with text_row[lo] < addr <= text_row[lo+1]
+    */
+    lo=0;
+    hi=TXT_H;
+
+    while(hi-lo>1)
+    {
+	int mid=(lo+hi)/2;
+
+	if (addr>zx->text_row[mid])
+	{
+	    lo=mid;
+	}
+	else
+	{
+	    hi=mid;
+	}
+    }
+
+    zx->text_dirty[lo]=TRUE;
+    zx->text_dirty_any=TRUE;
 }
 
 
-static void DrawScreen_HIRES_Dirty(Z80 *z80)
+static void DrawScreen_HIRES_Dirty(ZX81Machine *zx)
 {
     uint16 *bmp;
-    Z80Byte *scr;
+    Z80Word scr;
     Z80Byte *mirror;
     int x,y;
     int table;
     int c;
     int v;
-    int b;
 
-    scr = mem + hires_dfile;
-    mirror = scr_mirror;
-    bmp = bmp_screen;
-    table = z80->I << 8;
+    scr = zx->hires_dfile;
+    mirror = zx->scr_mirror;
+    bmp = zx->bmp_screen;
+    table = zx->z80->I << 8;
 
     /* scr is increment in both loops so that it can skip the end-of-line
        character
@@ -409,39 +897,27 @@ static void DrawScreen_HIRES_Dirty(Z80 *z80)
     {
     	for(x=0; x<32; x++)
 	{
-	    c = *scr;
+	    c = PEEK(scr);
 
 	    if (c != *mirror)
 	    {
 	    	*mirror++ = c;
 
-		v = mem[table + (c&0x3f)*8];
+		v = PEEK(table + (c&0x3f)*8);
 
 		if (c & 0x80)
 		{
 		    v ^= 0xff;
 		}
 
-		for(b=0;b<8;b++)
-		{
-		    if (v & 0x80)
-		    {
-			*bmp++ = 0x8000;
-		    }
-		    else
-		    {
-			*bmp++ = 0xffff;
-		    }
-
-		    v=v<<1;
-		}
+		ExpandPixels(bmp,v);
 	    }
 	    else
 	    {
 	    	mirror++;
-		bmp+=8;
 	    }
 
+	    bmp+=8;
 	    scr++;
 	}
 
@@ -450,18 +926,18 @@ static void DrawScreen_HIRES_Dirty(Z80 *z80)
 }
 
 
-static void DrawScreen_HIRES_Full(Z80 *z80)
+static void DrawScreen_HIRES_Full(ZX81Machine *zx)
 {
     uint16 *bmp;
-    Z80Byte *scr;
+    Z80Word scr;
     Z80Byte *mirror;
     int x,y;
     int table;
 
-    scr = mem + hires_dfile;
-    mirror = scr_mirror;
-    bmp = bmp_screen;
-    table = z80->I << 8;
+    scr = zx->hires_dfile;
+    mirror = zx->scr_mirror;
+    bmp = zx->bmp_screen;
+    table = zx->z80->I << 8;
 
     /* scr is increment in both loops so that it can skip the end-of-line
        character
@@ -472,96 +948,138 @@ static void DrawScreen_HIRES_Full(Z80 *z80)
 	{
 	    int c;
 	    int v;
-	    int b;
 
-	    c = *mirror++ = *scr;
+	    c = *mirror++ = PEEK(scr);
 
-	    v = mem[table + (c&0x3f)*8];
+	    v = PEEK(table + (c&0x3f)*8);
 
 	    if (c & 0x80)
 	    {
 	    	v ^= 0xff;
 	    }
 
-	    for(b=0;b<8;b++)
-	    {
-	    	if (v & 0x80)
-		{
-		    *bmp++ = 0x8000;
-		}
-		else
-		{
-		    *bmp++ = 0xffff;
-		}
-
-		v=v<<1;
-	    }
+	    ExpandPixels(bmp,v);
 
+	    bmp+=8;
 	    scr++;
 	}
 
 	scr++;
     }
 
-    DrawScreen = DrawScreen_HIRES_Dirty;
+    zx->DrawScreen = DrawScreen_HIRES_Dirty;
 }
 
 
-static void DrawScreen_TEXT(Z80 *z80)
+/* Draws row y from the display file row following the NEWLINE at scr,
+   returning where the row ends.
+*/
+static Z80Word DrawTextRow(ZX81Machine *zx, Z80Word scr, int y)
 {
-    Z80Byte *scr=mem+WORD(DFILE);
-    int x,y;
+    int x;
 
+    scr++;
     x=0;
-    y=0;
 
-    while(y<TXT_H)
+    while((PEEK(scr)!=118)&&(x<TXT_W))
     {
+	Z80Byte ch = PEEK(scr);
+
 	scr++;
-	x=0;
 
-	while((*scr!=118)&&(x<TXT_W))
+	if (ch&0x80)
 	{
-	    Z80Byte ch = *scr++;
+	    zx->txt_screen[x+y*32]=(ch&0x3f)|0x40;
+	}
+	else
+	{
+	    zx->txt_screen[x+y*32]=(ch&0x3f);
+	}
 
-	    if (ch&0x80)
-	    {
-	    	txt_screen[x+y*32]=(ch&0x3f)|0x40;
-	    }
-	    else
-	    {
-	    	txt_screen[x+y*32]=(ch&0x3f);
-	    }
+	x++;
+    }
+
+    while (x<TXT_W)
+    {
+	zx->txt_screen[x+y*32]=0;
+	x++;
+    }
+
+    return scr;
+}
+
+
+static void DrawScreen_TEXT(ZX81Machine *zx)
+{
+    Z80Word dfile;
+    int y;
+
+    dfile=WORD(DFILE);
+
+    if (zx->text_all_dirty || dfile!=zx->text_row[0])
+    {
+	Z80Word scr=dfile;
+	Z80Word end=zx->text_row[TXT_H];
 
-	    x++;
+	for(y=0;y<TXT_H;y++)
+	{
+	    zx->text_row[y]=scr;
+	    scr=DrawTextRow(zx,scr,y);
+	    zx->text_dirty[y]=FALSE;
 	}
 
-	while (x<TXT_W)
+	zx->text_row[TXT_H]=scr;
+
+	zx->text_all_dirty=FALSE;
+	zx->text_dirty_any=FALSE;
+
+	/* Move the write tracking if the display file has
+	*/
+	if (zx->text_row[0]!=dfile || zx->text_row[TXT_H]!=end)
 	{
-	    txt_screen[x+y*32]=0;
-	    x++;
+	    MapMemory(zx);
 	}
 
-	y++;
+	return;
     }
+
+    /* Nothing to do for a static screen
+    */
+    if (!zx->text_dirty_any)
+    {
+	return;
+    }
+
+    for(y=0;y<TXT_H;y++)
+    {
+	if (zx->text_dirty[y])
+	{
+	    DrawTextRow(zx,zx->text_row[y],y);
+	    zx->text_dirty[y]=FALSE;
+	}
+    }
+
+    zx->text_dirty_any=FALSE;
 }
 
 
-static void DrawSnow(Z80 *z80)
+static void DrawSnow(ZX81Machine *zx)
 {
     uint16 *s;
     int f;
 
-    s = txt_screen;
+    s = zx->txt_screen;
 
     for(f=0;f<TXT_W*TXT_H;f++)
     {
     	*s++=8;
     }
+
+    zx->text_all_dirty=TRUE;
 }
 
 
-static void FindHiresDFILE(void)
+static void FindHiresDFILE(ZX81Machine *zx)
 {
     /* Somewhat based on the code from xz81, an X-based ZX81 emulator,
        (C) 1994 Ian Collier.  Search the ZX81's RAM until we find what looks
@@ -576,7 +1094,7 @@ static void FindHiresDFILE(void)
     {
 	int v;
 
-	v = mem[f+32];
+	v = PEEK(f+32);
 
 	if (v&0x40)
 	{
@@ -585,12 +1103,12 @@ static void FindHiresDFILE(void)
 
 	    for(n=0;n<192 && ok;n++)
 	    {
-	    	if (mem[f+33*n]&0x40)
+	    	if (PEEK(f+33*n)&0x40)
 		{
 		    ok = FALSE;
 		}
 
-		if (mem[f+32+33*n] != v)
+		if (PEEK(f+32+33*n) != v)
 		{
 		    ok = FALSE;
 		}
@@ -598,7 +1116,7 @@ static void FindHiresDFILE(void)
 
 	    if (ok)
 	    {
-	    	hires_dfile = f;
+	    	zx->hires_dfile = f;
 		return;
 	    }
 	}
@@ -607,13 +1125,13 @@ static void FindHiresDFILE(void)
     /* All else fails, put the hires dfile at 0x4000 -- at least it should be
        obvious that the hires won't work for whatever is being run.
     */
-    hires_dfile = 0x4000;
+    zx->hires_dfile = 0x4000;
 }
 
 
 /* Perform ZX81 housekeeping functions like updating FRAMES and updating LASTK
 */
-static void ZX81HouseKeeping(Z80 *z80)
+static void ZX81HouseKeeping(ZX81Machine *zx)
 {
     unsigned row;
     unsigned lastk1;
@@ -621,11 +1139,11 @@ static void ZX81HouseKeeping(Z80 *z80)
 
     /* British ZX81
     */
-    mem[MARGIN]=55;
+    POKE(MARGIN,55);
 
     /* Update FRAMES
     */
-    if (FRAME_TSTATES==SLOW_TSTATES)
+    if (zx->frame_tstates==SLOW_TSTATES)
     {
     	Z80Word frame=PEEKW(FRAMES)&0x7fff;
 
@@ -637,10 +1155,10 @@ static void ZX81HouseKeeping(Z80 *z80)
 	POKEW(FRAMES,frame|0x8000);
     }
 
-    if (!started)
+    if (!zx->started)
     {
-    	prev_lk1=0;
-    	prev_lk2=0;
+    	zx->prev_lk1=0;
+    	zx->prev_lk2=0;
 	return;
     }
 
@@ -653,7 +1171,7 @@ static void ZX81HouseKeeping(Z80 *z80)
     {
     	unsigned b;
 
-	b=(~matrix[row]&0x1f)<<1;
+	b=(~zx->matrix[row]&0x1f)<<1;
 
 	if (row==0)
 	{
@@ -675,100 +1193,290 @@ static void ZX81HouseKeeping(Z80 *z80)
 	}
     }
 
-    if (lastk1 && (lastk1!=prev_lk1 || lastk2!=prev_lk2))
+    if (lastk1 && (lastk1!=zx->prev_lk1 || lastk2!=zx->prev_lk2))
     {
-    	mem[CDFLAG]|=1;
+    	POKE(CDFLAG,PEEK(CDFLAG)|1);
     }
     else
     {
-    	mem[CDFLAG]&=~1;
+    	POKE(CDFLAG,PEEK(CDFLAG)&~1);
     }
 
-    mem[LASTK1]=lastk1^0xff;
-    mem[LASTK2]=lastk2^0xff;
+    POKE(LASTK1,lastk1^0xff);
+    POKE(LASTK2,lastk2^0xff);
 
-    prev_lk1=lastk1;
-    prev_lk2=lastk2;
+    zx->prev_lk1=lastk1;
+    zx->prev_lk2=lastk2;
 }
 
 
-static int CheckTimers(Z80 *z80, Z80Val val)
+/* Called once val T-states have been run and the frame is complete
+*/
+static void EndFrame(ZX81Machine *zx, Z80Val val)
 {
-    if (val>=FRAME_TSTATES)
+    Z80 *z80=zx->z80;
+
+    /* Check for hi-res modes
+    */
+    if (z80->I && z80->I != zx->last_I)
     {
-    	/* Check for hi-res modes
-	*/
-	if (z80->I && z80->I != last_I)
+	zx->last_I = z80->I;
+
+	if (z80->I == 0x1e)
 	{
-	    last_I = z80->I;
+	    zx->hires = FALSE;
+	    zx->DrawScreen = DrawScreen_TEXT;
+	    ClearBitmap(zx);
+	}
+	else
+	{
+	    zx->hires = TRUE;
+	    zx->DrawScreen = DrawScreen_HIRES_Full;
+	    ClearBitmap(zx);
+	    ClearText(zx);
+	    FindHiresDFILE(zx);
+	}
+    }
 
-	    if (z80->I == 0x1e)
-	    {
-	    	hires = FALSE;
-		DrawScreen = DrawScreen_TEXT;
-		ClearBitmap();
-	    }
-	    else
-	    {
-	    	hires = TRUE;
-		DrawScreen = DrawScreen_HIRES_Full;
-		ClearBitmap();
-		ClearText();
-		FindHiresDFILE();
-	    }
+    Z80ResetCycles(z80,val-zx->frame_tstates);
+
+    /* Kludge warning - We assume that a hires display will not be in
+       FAST mode! 
+    */
+    if (zx->started && ((PEEK(CDFLAG) & 0x80) || zx->waitkey || zx->hires))
+    {
+	if (PACE_Draw(&zx->pace))
+	{
+	    zx->DrawScreen(zx);
+	}
+
+	zx->frame_tstates=SLOW_TSTATES;
+    }
+    else
+    {
+	if (PACE_Draw(&zx->pace))
+	{
+	    DrawSnow(zx);
 	}
 
-	Z80ResetCycles(z80,val-FRAME_TSTATES);
+	zx->frame_tstates=FAST_TSTATES;
+    }
 
-	/* Kludge warning - We assume that a hires display will not be in
-	   FAST mode! 
-	*/
-	if (started && ((mem[CDFLAG] & 0x80) || waitkey || hires))
+    /* Update FRAMES (if in SLOW) and scan the keyboard.  This only happens
+       once we've got to a decent point in the boot cycle (detected with
+       a valid stack pointer).
+    */
+    if (z80->SP<0x8000)
+    {
+	ZX81HouseKeeping(zx);
+    }
+
+    PACE_Wait(&zx->pace);
+}
+
+
+/* The ULA display engine.  Rather than working out the display from the
+   D_FILE once a frame this follows the ULA as the Z80 runs, so that the
+   tricks played by pseudo-hires titles come out as on the real machine.
+
+   Opcodes fetched above 0x8000 with bit 6 clear are the display: the Z80
+   is given a NOP and the ULA shifts out the character pattern at I*256 for
+   the current line of the character.  Each completed scanline is copied
+   from ula_scanline into the bitmap, so the cost per scanline is fixed.
+*/
+static void ULAClearScanline(ZX81Machine *zx)
+{
+    int f;
+
+    for(f=zx->ula_dirty_lo;f<zx->ula_dirty_hi;f++)
+    {
+	zx->ula_scanline[f]=0xffff;
+    }
+
+    zx->ula_dirty_lo=ULA_LINE_PIXELS;
+    zx->ula_dirty_hi=0;
+}
+
+
+/* Called for HSYNC, which starts a new scanline at T-state when.  This is
+   scheduled as a Z80 event for the end of the line, and called early by
+   ULAFetch() when an interrupt is acknowledged.
+*/
+static void ULAHSync(Z80 *z80, Z80Val when)
+{
+    ZX81Machine *zx=Z80UserData(z80);
+    int y;
+
+    y=zx->ula_line-ULA_TOP;
+
+    if (y>=0 && y<SCR_H && zx->pace.draw)
+    {
+	uint16 *bmp;
+	uint16 *src;
+	int x;
+
+	bmp=zx->bmp_screen+y*SCR_W;
+	src=zx->ula_scanline+ULA_LEFT;
+
+	for(x=0;x<SCR_W;x++)
 	{
-	    DrawScreen(z80);
-	    FRAME_TSTATES=SLOW_TSTATES;
+	    *bmp++=*src++;
 	}
-	else
+    }
+
+    if (zx->ula_dirty_hi)
+    {
+	ULAClearScanline(zx);
+    }
+
+    zx->ula_line++;
+
+    /* LCNTR is held at zero during VSYNC, which only finishes on the HSYNC
+       after the OUT that ends it.
+    */
+    if (zx->ula_vsync)
+    {
+	zx->ula_lcntr=0;
+
+	if (zx->ula_vsync_end)
 	{
-	    DrawSnow(z80);
-	    FRAME_TSTATES=FAST_TSTATES;
+	    zx->ula_vsync=FALSE;
+	    zx->ula_line=0;
 	}
+    }
+    else
+    {
+	zx->ula_lcntr=(zx->ula_lcntr+1)&7;
+    }
 
-	/* Update FRAMES (if in SLOW) and scan the keyboard.  This only happens
-	   once we've got to a decent point in the boot cycle (detected with
-	   a valid stack pointer).
-	*/
-	if (z80->SP<0x8000)
+    if (zx->ula_nmi)
+    {
+	Z80NMI(z80);
+    }
+
+    zx->ula_hsync=when+ULA_LINE_TSTATES;
+    Z80Schedule(z80,ULAHSync,zx->ula_hsync);
+}
+
+
+static Z80Byte ULAFetch(Z80 *z80, Z80Word addr, Z80Byte opcode)
+{
+    ZX81Machine *zx=Z80UserData(z80);
+    Z80Val now;
+
+    now=Z80Cycles(z80);
+
+    if (!(opcode&0x40))
+    {
+	Z80Val x;
+	int v;
+
+	v=PEEK(((z80->I<<8)|((opcode&0x3f)<<3)|zx->ula_lcntr)&0x7fff);
+
+	if (opcode&0x80)
 	{
-	    ZX81HouseKeeping(z80);
+	    v^=0xff;
 	}
 
-	swiWaitForVBlank();
+	x=(now+ULA_LINE_TSTATES-zx->ula_hsync)*2;
 
-	return FALSE;
+	if (x<=ULA_LINE_PIXELS-8)
+	{
+	    ExpandPixels(zx->ula_scanline+x,v);
+
+	    if ((int)x<zx->ula_dirty_lo)
+	    {
+		zx->ula_dirty_lo=x;
+	    }
+
+	    if ((int)x+8>zx->ula_dirty_hi)
+	    {
+		zx->ula_dirty_hi=x+8;
+	    }
+	}
+
+	opcode=0;
+    }
+
+    /* A6 of the refresh address (the R register before this fetch
+       incremented it) is wired to /INT.  The ULA generates HSYNC when the
+       interrupt is acknowledged, which keeps the display lines in step.
+    */
+    if (!((z80->R-1)&0x40) && z80->IFF1)
+    {
+	Z80Interrupt(z80,0xff);
+	ULAHSync(z80,now);
+    }
+
+    return opcode;
+}
+
+
+static void ULAReset(ZX81Machine *zx)
+{
+    Z80 *z80=zx->z80;
+
+    zx->ula_nmi=FALSE;
+    zx->ula_vsync=FALSE;
+    zx->ula_vsync_end=FALSE;
+    zx->ula_lcntr=0;
+    zx->ula_line=0;
+    zx->ula_hsync=Z80Cycles(z80)+ULA_LINE_TSTATES;
+
+    if (zx->ula_display)
+    {
+	Z80Schedule(z80,ULAHSync,zx->ula_hsync);
     }
     else
     {
-	return TRUE;
+	Z80Unschedule(z80,ULAHSync);
+    }
+
+    zx->ula_dirty_lo=0;
+    zx->ula_dirty_hi=ULA_LINE_PIXELS;
+    ULAClearScanline(zx);
+}
+
+
+/* HSYNC is a Z80 event, so the frame is just run through.  The scanlines
+   are copied to the display as they finish, so whether to draw is decided
+   at the start.
+*/
+static void ULARunFrame(ZX81Machine *zx)
+{
+    Z80 *z80=zx->z80;
+
+    PACE_Draw(&zx->pace);
+
+    while(Z80Cycles(z80)<ULA_FRAME_TSTATES)
+    {
+	Z80Run(z80,ULA_FRAME_TSTATES-Z80Cycles(z80));
     }
+
+    Z80ResetCycles(z80,Z80Cycles(z80)-ULA_FRAME_TSTATES);
+    zx->ula_hsync-=ULA_FRAME_TSTATES;
+
+    PACE_Wait(&zx->pace);
 }
 
 
 static int EDCallback(Z80 *z80, Z80Val data)
 {
+    ZX81Machine *zx=Z80UserData(z80);
     Z80Word pause;
+    int ret=TRUE;
 
     switch((Z80Byte)data)
     {
     	case ED_SAVE:
-	    if (allow_save && z80->DE.w<0x8000)
+	    if (zx->allow_save && z80->DE.w<0x8000)
 	    {
 		FILE *fp;
 		int cancel;
 
-		if ((fp=OpenTapeFile(z80->HL.w, &cancel, "wb")))
+		if ((fp=OpenTapeFile(zx,z80->HL.w, &cancel, "wb")))
 		{
-		    SaveExternalTape(fp,z80);
+		    SaveExternalTape(zx,fp);
 		    fclose(fp);
 		}
 	    }
@@ -780,14 +1488,26 @@ static int EDCallback(Z80 *z80, Z80Val data)
 	       never intended for the emulator to be doing any GUI related
 	       nonsense (like the alerts) but simply emulating.
 	    */
-	    if (enable_filesystem && z80->DE.w<0x8000)
+	    if (zx->enable_filesystem && z80->DE.w<0x8000)
 	    {
 		FILE *fp;
 		int cancel;
 
-		if ((fp=OpenTapeFile(z80->DE.w, &cancel, "rb")))
+		if ((fp=OpenTapeFile(zx,z80->DE.w, &cancel, "rb")))
 		{
-		    LoadExternalTape(fp,z80);
+		    TapeSource src;
+
+		    if (TAPE_FileSource(&src,fp))
+		    {
+			LoadTape(zx,&src);
+			TAPE_Close(&src);
+		    }
+		    else
+		    {
+			GUI_Alert(FALSE,"Couldn't read tape");
+			SK_DisplayKeyboard();
+		    }
+
 		    fclose(fp);
 		}
 		else
@@ -801,9 +1521,9 @@ static int EDCallback(Z80 *z80, Z80Val data)
 	    }
 	    else
 	    {
-		if (tape_image)
+		if (zx->tape_source)
 		{
-		    LoadInternalTape(z80);
+		    LoadTape(zx,zx->tape_source);
 		}
 		else
 		{
@@ -812,116 +1532,275 @@ static int EDCallback(Z80 *z80, Z80Val data)
 		}
 	    }
 
-	    mem[CDFLAG]=0xc0;
+	    /* With the ULA display engine clear the flag saying the display
+	       is running, so that the ROM's SLOW/FAST routine the patch jumps
+	       to restarts it if the loaded program wants SLOW mode.
+	    */
+	    if (zx->ula_display)
+	    {
+		POKE(CDFLAG,PEEK(CDFLAG)&~0x80);
+	    }
+	    else
+	    {
+		POKE(CDFLAG,0xc0);
+	    }
 	    break;
 
 	case ED_WAITKEY:
-	    waitkey=TRUE;
-	    started=TRUE;
+	    zx->waitkey=TRUE;
+	    zx->started=TRUE;
 	    break;
 
 	case ED_ENDWAITKEY:
-	    waitkey=FALSE;
+	    zx->waitkey=FALSE;
 	    break;
 
 	case ED_PAUSE:
-	    waitkey=TRUE;
+	    zx->waitkey=TRUE;
 
 	    pause=z80->BC.w;
 
-	    while(pause-- && !(mem[CDFLAG]&1))
+	    /* The keys only change on VBlank, so in turbo mode they're only
+	       read for the frames that are drawn
+	    */
+	    while(pause-- && !(PEEK(CDFLAG)&1))
 	    {
 		SoftKeyEvent ev;
 
-		while (SK_GetEvent(&ev))
+		while ((zx->pace.draw || !zx->pace.turbo) && SK_GetEvent(&ev))
 		{
-		    ZX81HandleKey(ev.key,ev.pressed);
+		    ZX81HandleKey(zx,ev.key,ev.pressed);
 		}
 
-	    	CheckTimers(z80,FRAME_TSTATES);
+	    	EndFrame(zx,zx->frame_tstates);
 	    }
 
-	    waitkey=FALSE;
+	    /* The frame has been restarted, so stop Z80Run() and let
+	       ZX81RunFrame() start a new one.
+	    */
+	    zx->waitkey=FALSE;
+	    ret=FALSE;
+	    break;
+
+	case ED_CALC:
+	    CALC_Run(z80);
 	    break;
 
 	default:
 	    break;
     }
 
-    return TRUE;
+    return ret;
+}
+
+
+/* Sets the machine state other than the RAM.  The caller deals with any
+   code the Z80 has cached from memory that has changed.
+*/
+static void SetState(ZX81Machine *zx, const ZX81State *state)
+{
+    Z80SetState(zx->z80, &state->cpu);
+
+    memcpy(zx->matrix, state->matrix, sizeof zx->matrix);
+
+    zx->waitkey = state->waitkey;
+    zx->started = state->started;
+    zx->prev_lk1 = state->prev_lk1;
+    zx->prev_lk2 = state->prev_lk2;
+    zx->frame_tstates = state->frame_tstates;
+
+    zx->ula_nmi = state->ula_nmi;
+    zx->ula_vsync = state->ula_vsync;
+    zx->ula_vsync_end = state->ula_vsync_end;
+    zx->ula_lcntr = state->ula_lcntr;
+    zx->ula_line = state->ula_line;
+    zx->ula_hsync = state->ula_hsync;
+
+    if (zx->ula_display)
+    {
+	Z80Schedule(zx->z80, ULAHSync, zx->ula_hsync);
+    }
+
+    ULAClearScanline(zx);
+
+    /* Force hi/lo res detection and a full redraw
+    */
+    zx->last_I = 0;
+    zx->text_all_dirty = TRUE;
+}
+
+
+/* Returns TRUE if page p is part of the RAM rather than a mirror of it
+*/
+static int RAMPage(ZX81Machine *zx, int p)
+{
+    Z80Val addr = (Z80Val)p << PAGE_SHIFT;
+
+    return addr >= zx->ram_bot && addr < RAM_END;
+}
+
+
+/* Drops anything the Z80 has cached from the RAM page at addr, wherever it
+   appears in the memory map
+*/
+static void FlushRAMPage(ZX81Machine *zx, Z80Val addr)
+{
+    Z80Val mirror = RAM_END - 0x4000;
+
+    do
+    {
+	Z80FlushMemory(zx->z80, addr, PAGE_SIZE);
+
+	if (zx->ula_display && addr < 0x8000)
+	{
+	    Z80FlushMemory(zx->z80, addr + 0x8000, PAGE_SIZE);
+	}
+
+	addr += mirror;
+    } while(addr >= RAM_END && addr <= zx->ram_top);
+}
+
+
+static void ReleasePage(SharedPage *page)
+{
+    if (page && PAGE_UNREF(page) == 0)
+    {
+	free(page);
+    }
+}
+
+
+/* Makes page the one the machine's RAM at p was last copied to or from
+*/
+static void BindPage(ZX81Machine *zx, int p, SharedPage *page)
+{
+    if (zx->shared[p] != page)
+    {
+	PAGE_REF(page);
+	ReleasePage(zx->shared[p]);
+	zx->shared[p] = page;
+    }
 }
 
 
 /* ---------------------------------------- EXPORTED INTERFACES
 */
-void ZX81Init(uint16 *text_vram, uint16* bitmap_vram, Z80 *z80)
+ZX81Machine *ZX81Create(uint16 *text_vram, uint16 *bitmap_vram)
 {
+    ZX81Machine *zx;
+    Z80 *z80;
     Z80Word f;
 
-    txt_screen = text_vram;
-    bmp_screen = bitmap_vram;
+    zx = calloc(1, sizeof *zx);
 
-    hires = FALSE;
-    hires_dfile = 0;
-    last_I = 0x1e;
-    DrawScreen = DrawScreen_TEXT;
+    if (!zx)
+    {
+	return NULL;
+    }
 
-    ClearBitmap();
+#ifdef ENABLE_PAGED_MEMORY
+    z80 = Z80Init(ZX81WriteMem,
+		  ZX81ReadPort,
+		  ZX81WritePort);
+#else
+    z80 = Z80Init(ZX81ReadMem,
+		  ZX81WriteMem,
+		  ZX81ReadPort,
+		  ZX81WritePort,
+		  ZX81ReadDisassem);
+#endif
 
-    /* Load the ROM
-    */
-    memcpy(mem,zx81_bin,ROMLEN);
+    if (!z80)
+    {
+	free(zx);
+	return NULL;
+    }
 
-    /* Patch the ROM
-    */
-    RomPatch();
-    Z80LodgeCallback(z80,eZ80_EDHook,EDCallback);
-    Z80LodgeCallback(z80,eZ80_Instruction,CheckTimers);
+    Z80SetUserData(z80,zx);
 
-    /* Mirror the ROM
-    */
-    memcpy(mem+ROMLEN,mem,ROMLEN);
+    zx->txt_screen = text_vram;
+    zx->bmp_screen = bitmap_vram;
+    zx->z80 = z80;
+
+    zx->frame_tstates = FAST_TSTATES;
+    zx->text_all_dirty = TRUE;
+    strcpy(zx->last_dir, "/");
+
+    zx->hires = FALSE;
+    zx->hires_dfile = 0;
+    zx->last_I = 0x1e;
+    zx->DrawScreen = DrawScreen_TEXT;
+    PACE_Init(&zx->pace);
 
-    /* Memory size (16K)
+    InitPixelTable();
+    InitROM();
+    ClearBitmap(zx);
+
+    /* The RAM pack from the config, with the ROM patched for the display
+       engine
     */
-    RAMBOT=0x4000;
-    RAMTOP=RAMBOT+0x4000;
+    Z80LodgeCallback(z80,eZ80_EDHook,EDCallback);
 
-    for(f = RAMBOT; f <= RAMTOP; f++)
+    LoadROM(zx);
+
+    if (!FitRAMPack(zx))
     {
-    	mem[f] = 0;
+	ZX81Destroy(zx);
+	return NULL;
     }
 
     for(f = 0; f < 8; f++)
     {
-    	matrix[f] = 0x1f;
+    	zx->matrix[f] = 0x1f;
     }
 
-    /* Fill the upper 32K with RET opcodes -- hopefully by simply returning
-       RET for ULA reads we save a lot of ROM patching shenanigans.
-       
-       Note that this check used to be in ZX81ReadMem, but obviously this 
-       should cut down on a *lot* of pointless expression evaluation!
-    */
-    for(f = 0x8000; f <= RAMTOP; f++)
+    MapMemory(zx);
+
+    return zx;
+}
+
+
+void ZX81Destroy(ZX81Machine *zx)
+{
+    int p;
+
+    if (zx)
     {
-    	mem[f] = 0xc9;
+	for(p = 0; p < NO_PAGES; p++)
+	{
+	    ReleasePage(zx->shared[p]);
+	}
+
+	Z80Free(zx->z80);
+	free(zx->ram);
+	free(zx);
     }
+}
+
+
+Z80 *ZX81GetZ80(ZX81Machine *zx)
+{
+    return zx->z80;
+}
+
 
+Pacer *ZX81GetPacer(ZX81Machine *zx)
+{
+    return &zx->pace;
 }
 
 
-void ZX81HandleKey(SoftKey key, int is_pressed)
+void ZX81HandleKey(ZX81Machine *zx, SoftKey key, int is_pressed)
 {
     if (key<SK_CONFIG)
     {
 	if (is_pressed)
 	{
-	    matrix[key_matrix[key].row]&=~key_matrix[key].bit;
+	    zx->matrix[key_matrix[key].row]&=~key_matrix[key].bit;
 	}
 	else
 	{
-	    matrix[key_matrix[key].row]|=key_matrix[key].bit;
+	    zx->matrix[key_matrix[key].row]|=key_matrix[key].bit;
 	}
     }
     else
@@ -931,23 +1810,33 @@ void ZX81HandleKey(SoftKey key, int is_pressed)
 }
 
 
+/* The page tables take care of the mirrors and of where the RAM is, so
+   neither of these need to check the address
+*/
 Z80Byte ZX81ReadMem(Z80 *z80, Z80Word addr)
 {
-    return mem[addr];
+    ZX81Machine *zx=Z80UserData(z80);
+
+    return PEEK(addr);
 }
 
 
 void ZX81WriteMem(Z80 *z80, Z80Word addr, Z80Byte val)
 {
-    if (addr>=RAMBOT && addr<=RAMTOP)
+    ZX81Machine *zx=Z80UserData(z80);
+
+    if (addr>zx->text_row[0] && addr<=zx->text_row[TXT_H])
     {
-	mem[addr]=val;
+	TextWrite(zx,addr,val);
     }
+
+    zx->write_page[addr>>PAGE_SHIFT][addr&PAGE_MASK]=val;
 }
 
 
 Z80Byte ZX81ReadPort(Z80 *z80, Z80Word port)
 {
+    ZX81Machine *zx=Z80UserData(z80);
     Z80Byte b=0;
 
     switch(port&0xff)
@@ -958,28 +1847,28 @@ Z80Byte ZX81ReadPort(Z80 *z80, Z80Word port)
 	    switch(port&0xff00)
 	    {
 	    	case 0xfe00:
-		    b=matrix[0];
+		    b=zx->matrix[0];
 		    break;
 	    	case 0xfd00:
-		    b=matrix[1];
+		    b=zx->matrix[1];
 		    break;
 	    	case 0xfb00:
-		    b=matrix[2];
+		    b=zx->matrix[2];
 		    break;
 	    	case 0xf700:
-		    b=matrix[3];
+		    b=zx->matrix[3];
 		    break;
 	    	case 0xef00:
-		    b=matrix[4];
+		    b=zx->matrix[4];
 		    break;
 	    	case 0xdf00:
-		    b=matrix[5];
+		    b=zx->matrix[5];
 		    break;
 	    	case 0xbf00:
-		    b=matrix[6];
+		    b=zx->matrix[6];
 		    break;
 	    	case 0x7f00:
-		    b=matrix[7];
+		    b=zx->matrix[7];
 		    break;
 	    }
 
@@ -989,6 +1878,15 @@ Z80Byte ZX81ReadPort(Z80 *z80, Z80Word port)
 	    */
 	    b |= 0x60;
 
+	    /* With the NMI generator off this also starts VSYNC
+	    */
+	    if (!zx->ula_nmi)
+	    {
+		zx->ula_vsync=TRUE;
+		zx->ula_vsync_end=FALSE;
+		zx->ula_lcntr=0;
+	    }
+
 	    break;
 
 	default:
@@ -1002,77 +1900,146 @@ Z80Byte ZX81ReadPort(Z80 *z80, Z80Word port)
 
 void ZX81WritePort(Z80 *z80, Z80Word port, Z80Byte val)
 {
+    ZX81Machine *zx=Z80UserData(z80);
+
+    /* Any write ends VSYNC
+    */
+    if (zx->ula_vsync)
+    {
+	zx->ula_vsync_end=TRUE;
+    }
+
     switch(port&0xff)
     {
-    	case 0xfd:
+    	case 0xfd:	/* NMI generator off */
+	    zx->ula_nmi=FALSE;
 	    break;
 
-	case 0xfe:
+	case 0xfe:	/* NMI generator on */
+	    zx->ula_nmi=TRUE;
 	    break;
     }
 }
 
 
-void ZX81Reset(Z80 *z80)
+void ZX81Reset(ZX81Machine *zx)
 {
+    Z80 *z80=zx->z80;
     int f;
 
     for(f=0;f<8;f++)
-    	matrix[f]=0x1f;
+    	zx->matrix[f]=0x1f;
 
     Z80Reset(z80);
     Z80ResetCycles(z80,0);
 
-    started=FALSE;
+    zx->started=FALSE;
+
+    ULAReset(zx);
+
+    zx->text_all_dirty = TRUE;
 
-    hires = FALSE;
-    hires_dfile = 0;
-    last_I = 0x1e;
-    DrawScreen = DrawScreen_TEXT;
+    zx->hires = FALSE;
+    zx->hires_dfile = 0;
+    zx->last_I = 0x1e;
+    zx->DrawScreen = DrawScreen_TEXT;
 
-    ClearBitmap();
+    ClearBitmap(zx);
 }
 
 
-void ZX81EnableFileSystem(int enable)
+Z80Val ZX81FrameTStates(ZX81Machine *zx)
 {
-    enable_filesystem=enable;
+    if (zx->ula_display)
+    {
+	return ULA_FRAME_TSTATES;
+    }
+
+    return zx->frame_tstates;
 }
 
 
-void ZX81SetTape(const Z80Byte *image, int len)
+void ZX81RunFrame(ZX81Machine *zx)
 {
-    tape_image=image;
-    tape_len=len;
+    Z80 *z80=zx->z80;
+
+    if (zx->ula_display)
+    {
+	ULARunFrame(zx);
+	return;
+    }
+
+    while(Z80Cycles(z80)<zx->frame_tstates)
+    {
+	Z80Run(z80,zx->frame_tstates-Z80Cycles(z80));
+    }
+
+    EndFrame(zx,Z80Cycles(z80));
 }
 
 
-void ZX81SuspendDisplay(void)
+int ZX81SingleStep(ZX81Machine *zx)
 {
-    ClearBitmap();
-    ClearText();
+    Z80 *z80=zx->z80;
+
+    if (zx->ula_display)
+    {
+	if (Z80Cycles(z80)>=ULA_FRAME_TSTATES)
+	{
+	    Z80ResetCycles(z80,Z80Cycles(z80)-ULA_FRAME_TSTATES);
+	    zx->ula_hsync-=ULA_FRAME_TSTATES;
+	}
+
+	return Z80SingleStep(z80);
+    }
+
+    if (Z80Cycles(z80)>=zx->frame_tstates)
+    {
+	EndFrame(zx,Z80Cycles(z80));
+    }
+
+    return Z80SingleStep(z80);
+}
+
+
+void ZX81EnableFileSystem(ZX81Machine *zx, int enable)
+{
+    zx->enable_filesystem=enable;
+}
+
+
+void ZX81SetTape(ZX81Machine *zx, TapeSource *src)
+{
+    zx->tape_source=src;
 }
 
 
-void ZX81ResumeDisplay(void)
+void ZX81SuspendDisplay(ZX81Machine *zx)
 {
-    ClearText();
+    ClearBitmap(zx);
+    ClearText(zx);
+}
+
+
+void ZX81ResumeDisplay(ZX81Machine *zx)
+{
+    ClearText(zx);
 
     /* Reset last_I to force hi/lo res detection
     */
-    last_I = 0;
+    zx->last_I = 0;
 }
 
 
-void ZX81DisplayString(const char *p)
+void ZX81DisplayString(ZX81Machine *zx, const char *p)
 {
     uint16 *s;
     uint16 inv=0;
     int f;
 
-    ClearText();
+    ClearText(zx);
 
-    s = txt_screen;
+    s = zx->txt_screen;
     f = 0;
 
     while(*p)
@@ -1098,73 +2065,495 @@ void ZX81DisplayString(const char *p)
 }
 
 
-void ZX81Reconfigure(void)
+void ZX81Reconfigure(ZX81Machine *zx)
 {
-    if (DS81_Config[DS81_STATIC_RAM_AT_0x2000])
+    if (!FitRAMPack(zx))
     {
-    	RAMBOT = 0x2000;
+	GUI_Alert(FALSE,"Not enough memory");
     }
-    else
+
+    /* Switching display engine changes the ROM patches and memory map
+    */
+    if (zx->ula_display != DS81_Config[DS81_ULA_DISPLAY])
     {
-    	RAMBOT = 0x4000;
-	memcpy(mem+ROMLEN,mem,ROMLEN);
+	zx->ula_display = DS81_Config[DS81_ULA_DISPLAY];
+
+	if (zx->ula_display)
+	{
+	    Z80SetFetchHook(zx->z80,0x8000,ULAFetch);
+	    ULAReset(zx);
+	    ClearText(zx);
+	}
+	else
+	{
+	    Z80SetFetchHook(zx->z80,0,NULL);
+	    Z80Unschedule(zx->z80,ULAHSync);
+	    Z80ResetCycles(zx->z80,0);
+	    zx->last_I = 0;
+	}
+
+	ClearBitmap(zx);
+	zx->text_all_dirty = TRUE;
     }
 
-    allow_save = enable_filesystem && DS81_Config[DS81_ALLOW_TAPE_SAVE];
+    LoadROM(zx);
+    BuildPageTable(zx);
+    MapMemory(zx);
+
+    PACE_SetTurbo(&zx->pace,DS81_Config[DS81_TURBO],
+		  turbo_cap[DS81_Config[DS81_TURBO_SPEED]]);
+
+    zx->allow_save = zx->enable_filesystem &&
+		     DS81_Config[DS81_ALLOW_TAPE_SAVE];
 }
 
 
-void ZX81SaveSnapshot(FILE *fp)
+void ZX81SaveSnapshot(ZX81Machine *zx, FILE *fp)
 {
-    int f;
+    long start;
+
+    start = PUT_Chunk(fp, "ZX81");
 
-    for(f=0; f<sizeof mem; f++)
+    PUT_Block(fp, zx->matrix, sizeof zx->matrix);
+
+    PUT_Long(fp, zx->waitkey);
+    PUT_Long(fp, zx->started);
+
+    PUT_ULong(fp, zx->ram_bot);
+    PUT_ULong(fp, zx->ram_top);
+
+    PUT_ULong(fp, zx->prev_lk1);
+    PUT_ULong(fp, zx->prev_lk2);
+
+    PUT_ULong(fp, zx->frame_tstates);
+
+    PUT_EndChunk(fp, start);
+
+    /* Only the RAM is stored -- the rest is rebuilt from the ROM on loading
+    */
+    start = PUT_Chunk(fp, "RAM ");
+
+    PUT_ULong(fp, zx->ram_bot);
+    PUT_ULong(fp, zx->ram_len);
+    PUT_RLE(fp, zx->ram, zx->ram_len);
+
+    PUT_EndChunk(fp, start);
+
+    if (zx->ula_display)
     {
-	PUT_Byte(fp, mem[f]);
+	start = PUT_Chunk(fp, "ULA ");
+
+	PUT_Long(fp, zx->ula_nmi);
+	PUT_Long(fp, zx->ula_vsync);
+	PUT_Long(fp, zx->ula_vsync_end);
+	PUT_Byte(fp, zx->ula_lcntr);
+	PUT_Long(fp, zx->ula_line);
+	PUT_ULong(fp, zx->ula_hsync);
+
+	PUT_EndChunk(fp, start);
     }
+}
+
 
-    for(f=0; f<sizeof matrix; f++)
+int ZX81LoadChunk(ZX81Machine *zx, FILE *fp, const char *id, long len)
+{
+    if (strcmp(id, "ZX81") == 0)
     {
-	PUT_Byte(fp, matrix[f]);
+	Z80Val bot;
+	Z80Val top;
+
+	GET_Block(fp, zx->matrix, sizeof zx->matrix);
+
+	zx->waitkey = GET_Long(fp);
+	zx->started = GET_Long(fp);
+
+	bot = GET_ULong(fp);
+	top = SNAP_TOP(GET_ULong(fp));
+
+	/* The RAM chunk says if the RAM is mirrored
+	*/
+	if (!ValidRAM(bot, top, top + 1 - bot) ||
+	    !SizeRAM(zx, bot, top, top + 1 - bot))
+	{
+	    return FALSE;
+	}
+
+	zx->prev_lk1 = GET_ULong(fp);
+	zx->prev_lk2 = GET_ULong(fp);
+
+	zx->frame_tstates = GET_ULong(fp);
+
+	/* The snapshot may have been taken with the other display engine,
+	   in which case there is no ULA chunk
+	*/
+	ULAReset(zx);
     }
+    else if (strcmp(id, "RAM ") == 0)
+    {
+	Z80Val addr;
+	Z80Val size;
+
+	addr = GET_ULong(fp);
+	size = GET_ULong(fp);
 
-    PUT_Long(fp, waitkey);
-    PUT_Long(fp, started);
+	if (addr != zx->ram_bot || size > 0x10000 - addr)
+	{
+	    return FALSE;
+	}
 
-    PUT_ULong(fp, RAMBOT);
-    PUT_ULong(fp, RAMTOP);
+	if (size < zx->ram_len &&
+	    (!ValidRAM(addr, zx->ram_top, size) ||
+	     !SizeRAM(zx, addr, zx->ram_top, size)))
+	{
+	    return FALSE;
+	}
 
-    PUT_ULong(fp, prev_lk1);
-    PUT_ULong(fp, prev_lk2);
+	/* Older snapshots have the byte SNAP_TOP() drops
+	*/
+	if (size > zx->ram_len)
+	{
+	    Z80Byte *ram;
+	    int ok;
+
+	    if (!(ram = malloc(size)))
+	    {
+		return FALSE;
+	    }
+
+	    ok = GET_RLE(fp, ram, size, len - 8);
+	    memcpy(zx->ram, ram, zx->ram_len);
+	    free(ram);
+
+	    return ok;
+	}
+
+	return GET_RLE(fp, zx->ram, size, len - 8);
+    }
+    else if (strcmp(id, "ULA ") == 0)
+    {
+	if (zx->ula_display)
+	{
+	    zx->ula_nmi = GET_Long(fp);
+	    zx->ula_vsync = GET_Long(fp);
+	    zx->ula_vsync_end = GET_Long(fp);
+	    zx->ula_lcntr = GET_Byte(fp);
+	    zx->ula_line = GET_Long(fp);
+	    zx->ula_hsync = GET_ULong(fp);
+
+	    Z80Schedule(zx->z80, ULAHSync, zx->ula_hsync);
+	}
+    }
+
+    return TRUE;
 }
 
 
-void ZX81LoadSnapshot(FILE *fp)
+int ZX81CheckChunk(ZX81Layout *layout, FILE *fp, const char *id, long len)
 {
-    int f;
+    if (strcmp(id, "ZX81") == 0)
+    {
+	Z80Byte matrix[8];
+	Z80Val bot;
+	Z80Val top;
+
+	if (!GET_Block(fp, matrix, sizeof matrix))
+	{
+	    return FALSE;
+	}
+
+	GET_Long(fp);
+	GET_Long(fp);
 
-    for(f=0; f<sizeof mem; f++)
+	bot = GET_ULong(fp);
+	top = SNAP_TOP(GET_ULong(fp));
+
+	if (!ValidRAM(bot, top, top + 1 - bot))
+	{
+	    return FALSE;
+	}
+
+	layout->ram_bot = bot;
+	layout->ram_top = top;
+	layout->ram_len = top + 1 - bot;
+    }
+    else if (strcmp(id, "RAM ") == 0)
     {
-	mem[f] = GET_Byte(fp);
+	Z80Byte *ram;
+	Z80Val addr;
+	Z80Val size;
+	int ok;
+
+	addr = GET_ULong(fp);
+	size = GET_ULong(fp);
+
+	if (addr != layout->ram_bot || size > 0x10000 - addr ||
+	    (size < layout->ram_len &&
+	     !ValidRAM(addr, layout->ram_top, size)))
+	{
+	    return FALSE;
+	}
+
+	if (size < layout->ram_len)
+	{
+	    layout->ram_len = size;
+	}
+
+	/* The RAM is unpacked to see that it is all there
+	*/
+	if (!(ram = malloc(size)))
+	{
+	    return FALSE;
+	}
+
+	ok = GET_RLE(fp, ram, size, len - 8);
+	free(ram);
+
+	return ok;
     }
 
-    for(f=0; f<sizeof matrix; f++)
+    return TRUE;
+}
+
+
+void ZX81LoadDone(ZX81Machine *zx)
+{
+    LoadROM(zx);
+    BuildPageTable(zx);
+    MapMemory(zx);
+
+    /* Reset last_I to force hi/lo res detection
+    */
+    zx->last_I = 0;
+    zx->text_all_dirty = TRUE;
+}
+
+
+void ZX81GetState(ZX81Machine *zx, ZX81State *state)
+{
+    Z80GetState(zx->z80, &state->cpu);
+
+    memcpy(state->matrix, zx->matrix, sizeof zx->matrix);
+
+    state->waitkey = zx->waitkey;
+    state->started = zx->started;
+    state->prev_lk1 = zx->prev_lk1;
+    state->prev_lk2 = zx->prev_lk2;
+    state->frame_tstates = zx->frame_tstates;
+
+    state->ula_nmi = zx->ula_nmi;
+    state->ula_vsync = zx->ula_vsync;
+    state->ula_vsync_end = zx->ula_vsync_end;
+    state->ula_lcntr = zx->ula_lcntr;
+    state->ula_line = zx->ula_line;
+    state->ula_hsync = zx->ula_hsync;
+}
+
+
+void ZX81SetState(ZX81Machine *zx, const ZX81State *state)
+{
+    SetState(zx, state);
+
+    /* Memory has been changed behind the Z80's back
+    */
+    Z80FlushCache(zx->z80);
+}
+
+
+Z80Byte *ZX81GetRAM(ZX81Machine *zx, Z80Val *len)
+{
+    *len = zx->ram_len;
+
+    return zx->ram;
+}
+
+
+void ZX81GetLayout(ZX81Machine *zx, ZX81Layout *layout)
+{
+    memset(layout, 0, sizeof *layout);
+
+    layout->ram_bot = zx->ram_bot;
+    layout->ram_top = zx->ram_top;
+    layout->ram_len = zx->ram_len;
+    layout->ula_display = zx->ula_display;
+}
+
+
+ZX81Checkpoint *ZX81Fork(ZX81Machine *zx)
+{
+    ZX81Checkpoint *cp;
+    int p;
+
+    if (!(cp = malloc(sizeof *cp)))
     {
-	matrix[f] = GET_Byte(fp);
+	return NULL;
     }
 
-    waitkey = GET_Long(fp);
-    started = GET_Long(fp);
+    ZX81GetState(zx, &cp->state);
+    cp->ram_bot = zx->ram_bot;
+    cp->ram_top = zx->ram_top;
+    cp->ram_len = zx->ram_len;
+    cp->ula_display = zx->ula_display;
+
+    /* Only pages written to since they were last shared are copied
+    */
+    for(p = 0; p < NO_PAGES; p++)
+    {
+	SharedPage *page = zx->shared[p];
+	Z80Val addr = (Z80Val)p << PAGE_SHIFT;
 
-    RAMBOT = GET_ULong(fp);
-    RAMTOP = GET_ULong(fp);
+	cp->page[p] = NULL;
 
-    prev_lk1 = GET_ULong(fp);
-    prev_lk2 = GET_ULong(fp);
+	if (!RAMPage(zx, p))
+	{
+	    continue;
+	}
 
-    /* Reset last_I to force hi/lo res detection
+	if (!page || memcmp(page->data, RAM(addr), PAGE_SIZE) != 0)
+	{
+	    if (!(page = malloc(sizeof *page)))
+	    {
+		ZX81FreeCheckpoint(cp);
+		return NULL;
+	    }
+
+	    page->refs = 0;
+	    memcpy(page->data, RAM(addr), PAGE_SIZE);
+	    BindPage(zx, p, page);
+	}
+
+	PAGE_REF(page);
+	cp->page[p] = page;
+    }
+
+    return cp;
+}
+
+
+int ZX81Restore(ZX81Machine *zx, const ZX81Checkpoint *cp)
+{
+    int p;
+
+    if (cp->ram_bot != zx->ram_bot || cp->ram_top != zx->ram_top ||
+	cp->ram_len != zx->ram_len || cp->ula_display != zx->ula_display)
+    {
+	return FALSE;
+    }
+
+    /* Only pages that differ are copied back, and only the code the Z80
+       has cached from them is dropped
+    */
+    for(p = 0; p < NO_PAGES; p++)
+    {
+	SharedPage *page = cp->page[p];
+	Z80Val addr = (Z80Val)p << PAGE_SHIFT;
+
+	if (!page || !RAMPage(zx, p))
+	{
+	    continue;
+	}
+
+	if (memcmp(RAM(addr), page->data, PAGE_SIZE) != 0)
+	{
+	    memcpy(RAM(addr), page->data, PAGE_SIZE);
+	    FlushRAMPage(zx, addr);
+	}
+
+	BindPage(zx, p, page);
+    }
+
+    SetState(zx, &cp->state);
+
+    return TRUE;
+}
+
+
+void ZX81FreeCheckpoint(ZX81Checkpoint *cp)
+{
+    int p;
+
+    if (cp)
+    {
+	for(p = 0; p < NO_PAGES; p++)
+	{
+	    ReleasePage(cp->page[p]);
+	}
+
+	free(cp);
+    }
+}
+
+
+int ZX81Crashed(ZX81Machine *zx)
+{
+    Z80State state;
+    Z80Word pc;
+
+    Z80GetState(zx->z80, &state);
+
+    /* The ULA display runs the display file in the upper mirror of RAM
     */
-    last_I = 0;
+    pc = state.regs.PC;
+
+    if (zx->ula_display)
+    {
+	pc &= 0x7fff;
+    }
+
+    if (pc > zx->ram_top)
+    {
+	return TRUE;
+    }
+
+    if (!state.halt)
+    {
+	return FALSE;
+    }
+
+    /* Without the ULA display there are no interrupts.  With it a halted
+       Z80 is woken by the NMI generator or, when halted in the display
+       file, by the interrupt ULAFetch() raises.
+    */
+    return !zx->ula_display ||
+	   (!zx->ula_nmi && !(state.regs.IFF1 && (state.regs.PC & 0x8000)));
+}
+
+
+void ZX81LoadSnapshotV1(ZX81Machine *zx, FILE *fp)
+{
+    Z80Byte *mem;
+    Z80Val bot;
+    Z80Val top;
+
+    /* The whole 64K was stored, but only the RAM is kept
+    */
+    if (!(mem = malloc(0x10000)))
+    {
+	GUI_Alert(FALSE,"Not enough memory");
+	return;
+    }
+
+    GET_Block(fp, mem, 0x10000);
+    GET_Block(fp, zx->matrix, sizeof zx->matrix);
+
+    zx->waitkey = GET_Long(fp);
+    zx->started = GET_Long(fp);
+
+    bot = GET_ULong(fp);
+    top = SNAP_TOP(GET_ULong(fp));
+
+    zx->prev_lk1 = GET_ULong(fp);
+    zx->prev_lk2 = GET_ULong(fp);
+
+    if (ValidRAM(bot, top, top + 1 - bot) &&
+	SizeRAM(zx, bot, top, top + 1 - bot))
+    {
+	memcpy(zx->ram, mem + bot, zx->ram_len);
+    }
+
+    free(mem);
+
+    ULAReset(zx);
+    ZX81LoadDone(zx);
 }
 
 